@@ -0,0 +1,396 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/tuxnet.h>
+
+// Compares HTTP/2 multiplexing with HTTP/1.1 keep-alive connections.
+//
+// Usage: http2_bench [options]
+//
+//   --concurrency N,N,...  Requests in flight to measure at (1,8,32,96).
+//   --requests N           Requests per run (200000).
+//   --size BYTES           Response body size (64).
+//   --port PORT            Loopback port the server listens on (18084).
+//
+// An http_server answering every request with the same body runs in the
+// same process. For every concurrency level, HTTP/1.1 keeps that many
+// requests in flight over as many keep-alive connections, one request at a
+// time each, while HTTP/2 keeps them in flight as streams of a single
+// prior-knowledge connection. The benchmark reports requests per second,
+// the connections (and so server threads) each run needed, and HTTP/2's
+// throughput relative to HTTP/1.1.
+
+namespace
+{
+
+    typedef std::chrono::steady_clock bench_clock;
+
+    /// Request every HTTP/1.1 client sends.
+    const char http1_request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    /// :method GET, :scheme http, :path / and :authority, all unindexed.
+    const char http2_request_block[] = "\x82\x86\x84\x01\x09localhost";
+
+    /// Command line options.
+    struct options
+    {
+        std::vector<int> concurrency = { 1, 8, 32, 96 };
+        long requests = 200000;
+        int size = 64;
+        int port = 18084;
+    };
+
+    /// Answers every request with the same body.
+    class bench_server : public tuxnet::http_server
+    {
+
+        std::string m_body;
+
+        public:
+
+            /// Constructor.
+            bench_server(const tuxnet::http_options& options, int size) :
+                tuxnet::http_server(options), m_body(size, 'x')
+            {
+            }
+
+        protected:
+
+            void on_request(tuxnet::peer* remote_peer,
+                const tuxnet::http_request& request) override
+            {
+                respond(remote_peer, 200, m_body);
+            }
+
+    };
+
+    // Returns seconds elapsed since a given time.
+    double seconds_since(bench_clock::time_point since)
+    {
+        return std::chrono::duration<double>(bench_clock::now() - since)
+            .count();
+    }
+
+    // Opens a loopback connection, returns its file descriptor or -1.
+    int open_connection(int port)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        sockaddr_in remote = {};
+        remote.sin_family = AF_INET;
+        remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        remote.sin_port = htons(port);
+        if (
+            connect(fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote))
+            == -1
+        )
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Sends a whole buffer.
+    bool send_all(int fd, const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t count = ::send(fd, data, length, MSG_NOSIGNAL);
+            if (count <= 0) return false;
+            data += count;
+            length -= count;
+        }
+        return true;
+    }
+
+    // Runs one HTTP/1.1 connection until the shared budget is used up.
+    void run_http1(int port, std::atomic<long>& budget,
+        std::atomic<long>& completed, std::atomic<bool>& failed)
+    {
+        int fd = open_connection(port);
+        if (fd == -1)
+        {
+            failed = true;
+            return;
+        }
+        std::string input;
+        char buffer[65536];
+        while (budget-- > 0)
+        {
+            if (
+                send_all(fd, http1_request, sizeof(http1_request) - 1)
+                != true
+            )
+            {
+                failed = true;
+                break;
+            }
+            // Read until the head and its Content-Length worth of body.
+            size_t total = 0;
+            while ((total == 0) or (input.size() < total))
+            {
+                ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (count <= 0)
+                {
+                    failed = true;
+                    ::close(fd);
+                    return;
+                }
+                input.append(buffer, count);
+                size_t end = input.find("\r\n\r\n");
+                if ((total != 0) or (end == std::string::npos)) continue;
+                const char* length = strcasestr(input.c_str(),
+                    "\r\ncontent-length:");
+                if ((length == nullptr) or (length > input.data() + end))
+                {
+                    failed = true;
+                    ::close(fd);
+                    return;
+                }
+                total = end + 4 + atol(length + 17);
+            }
+            input.erase(0, total);
+            completed++;
+        }
+        ::close(fd);
+    }
+
+    // Runs HTTP/1.1 with a connection per request in flight.
+    double bench_http1(const options& opt, int concurrency)
+    {
+        std::atomic<long> budget(opt.requests);
+        std::atomic<long> completed(0);
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> threads;
+        auto start = bench_clock::now();
+        for (int n = 0; n < concurrency; ++n)
+        {
+            threads.emplace_back(run_http1, opt.port, std::ref(budget),
+                std::ref(completed), std::ref(failed));
+        }
+        for (std::thread& thread : threads) thread.join();
+        double seconds = seconds_since(start);
+        if ((failed == true) or (completed != opt.requests)) return -1;
+        return seconds;
+    }
+
+    // Queues a request on a new stream.
+    void queue_http2_request(std::string& out, uint32_t stream)
+    {
+        tuxnet::http2_write_frame_header(out, sizeof(http2_request_block) - 1,
+            tuxnet::HTTP2_HEADERS,
+            tuxnet::HTTP2_FLAG_END_HEADERS | tuxnet::HTTP2_FLAG_END_STREAM,
+            stream);
+        out.append(http2_request_block, sizeof(http2_request_block) - 1);
+    }
+
+    // Queues a SETTINGS parameter.
+    void queue_setting(std::string& out, uint16_t id, uint32_t value)
+    {
+        char bytes[6] = { char(id >> 8), char(id), char(value >> 24),
+            char(value >> 16), char(value >> 8), char(value) };
+        out.append(bytes, sizeof(bytes));
+    }
+
+    // Queues a WINDOW_UPDATE of the connection.
+    void queue_window_update(std::string& out, uint32_t increment)
+    {
+        tuxnet::http2_write_frame_header(out, 4, tuxnet::HTTP2_WINDOW_UPDATE,
+            0, 0);
+        char bytes[4] = { char(increment >> 24), char(increment >> 16),
+            char(increment >> 8), char(increment) };
+        out.append(bytes, sizeof(bytes));
+    }
+
+    // Runs HTTP/2 with a stream per request in flight, on one connection.
+    double bench_http2(const options& opt, int concurrency)
+    {
+        // Large windows, so flow control never holds responses back.
+        const uint32_t window = 1 << 30;
+        int fd = open_connection(opt.port);
+        if (fd == -1) return -1;
+        auto start = bench_clock::now();
+        std::string out(tuxnet::http2_preface);
+        tuxnet::http2_write_frame_header(out, 6, tuxnet::HTTP2_SETTINGS, 0,
+            0);
+        queue_setting(out, tuxnet::HTTP2_SETTINGS_INITIAL_WINDOW_SIZE,
+            window);
+        queue_window_update(out, window - 65535);
+        uint32_t next_stream = 1;
+        long sent = 0;
+        long completed = 0;
+        uint64_t received = 0;
+        for (; (sent < concurrency) and (sent < opt.requests); ++sent)
+        {
+            queue_http2_request(out, next_stream);
+            next_stream += 2;
+        }
+        std::string input;
+        char buffer[65536];
+        bool failed = false;
+        while ((failed != true) and (completed < opt.requests))
+        {
+            if (send_all(fd, out.data(), out.size()) != true) break;
+            out.clear();
+            ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (count <= 0) break;
+            input.append(buffer, count);
+            size_t offset = 0;
+            while (input.size() - offset >= tuxnet::http2_frame_header_length)
+            {
+                tuxnet::http2_frame_header header;
+                tuxnet::http2_read_frame_header(input.data() + offset,
+                    header);
+                size_t length = tuxnet::http2_frame_header_length
+                    + header.length;
+                if (input.size() - offset < length) break;
+                offset += length;
+                if (header.type == tuxnet::HTTP2_SETTINGS)
+                {
+                    if ((header.flags & tuxnet::HTTP2_FLAG_ACK) != 0) continue;
+                    tuxnet::http2_write_frame_header(out, 0,
+                        tuxnet::HTTP2_SETTINGS, tuxnet::HTTP2_FLAG_ACK, 0);
+                    continue;
+                }
+                if (
+                    (header.type == tuxnet::HTTP2_RST_STREAM)
+                    or (header.type == tuxnet::HTTP2_GOAWAY)
+                )
+                {
+                    failed = true;
+                    break;
+                }
+                if (header.type == tuxnet::HTTP2_DATA)
+                {
+                    received += header.length;
+                }
+                else if (header.type != tuxnet::HTTP2_HEADERS) continue;
+                if ((header.flags & tuxnet::HTTP2_FLAG_END_STREAM) == 0)
+                {
+                    continue;
+                }
+                completed++;
+                if (sent < opt.requests)
+                {
+                    queue_http2_request(out, next_stream);
+                    next_stream += 2;
+                    sent++;
+                }
+            }
+            input.erase(0, offset);
+            if (received >= window / 2)
+            {
+                queue_window_update(out, received);
+                received = 0;
+            }
+        }
+        double seconds = seconds_since(start);
+        ::close(fd);
+        if (completed != opt.requests) return -1;
+        return seconds;
+    }
+
+    // Prints usage.
+    void usage(const char* name)
+    {
+        std::cerr << "Usage: " << name << " [--concurrency N,N,...]"
+            " [--requests N] [--size BYTES] [--port PORT]" << std::endl;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        bool has_value = (n + 1 < argc);
+        if ((arg == "--concurrency") and has_value)
+        {
+            opt.concurrency.clear();
+            for (const std::string& level : tuxnet::str_split(argv[++n], ","))
+            {
+                opt.concurrency.push_back(atoi(level.c_str()));
+            }
+        }
+        else if ((arg == "--requests") and has_value)
+        {
+            opt.requests = atol(argv[++n]);
+        }
+        else if ((arg == "--size") and has_value) opt.size = atoi(argv[++n]);
+        else if ((arg == "--port") and has_value) opt.port = atoi(argv[++n]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((opt.requests < 1) or (opt.size < 1))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    tuxnet::http_options http;
+    for (int level : opt.concurrency)
+    {
+        if (level < 1)
+        {
+            std::cerr << "Concurrency levels must be positive." << std::endl;
+            return 1;
+        }
+        if (uint32_t(level) > http.http2.max_concurrent_streams)
+        {
+            http.http2.max_concurrent_streams = level;
+        }
+    }
+    tuxnet::ip4_socket_address saddr(tuxnet::ip4_address("127.0.0.1"),
+        opt.port);
+    bench_server server(http, opt.size);
+    tuxnet::socket_addresses saddrs = { &saddr };
+    if (server.listen(saddrs, tuxnet::L4_PROTO_TCP) != true)
+    {
+        std::cerr << "Could not listen on port " << opt.port << "."
+            << std::endl;
+        return 1;
+    }
+    std::thread poller([&server](){ while (server.poll() == true); });
+    poller.detach();
+    usleep(100000);
+    printf("%ld requests, %d byte responses\n\n", opt.requests, opt.size);
+    printf("%11s %10s %12s %14s %10s\n", "concurrency", "protocol",
+        "connections", "requests/s", "speedup");
+    for (int level : opt.concurrency)
+    {
+        double http1 = bench_http1(opt, level);
+        double http2 = bench_http2(opt, level);
+        if ((http1 < 0) or (http2 < 0))
+        {
+            fprintf(stderr, "Concurrency %d failed.\n", level);
+            fflush(stderr);
+            _exit(1);
+        }
+        printf("%11d %10s %12d %14.0f %10s\n", level, "HTTP/1.1", level,
+            opt.requests / http1, "");
+        printf("%11s %10s %12d %14.0f %9.2fx\n", "", "HTTP/2", 1,
+            opt.requests / http2, http1 / http2);
+        fflush(stdout);
+    }
+    // The server's threads don't stop, leave without tearing them down.
+    _exit(0);
+}
@@ -0,0 +1,101 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
+#include <tuxnet/log.h>
+
+// Compares the cost of logging through the text sink against the binary sink.
+//
+// Usage: log_bench [records] [directory]
+//
+// Both sinks write to files in the given directory (/tmp by default) so the
+// comparison isn't skewed by terminal output.
+
+namespace
+{
+
+    typedef std::chrono::steady_clock bench_clock;
+
+    // Logs records with the given format and returns nanoseconds per record.
+    double run(uint32_t format_id, long records)
+    {
+        auto start = bench_clock::now();
+        for (long n = 0; n < records; ++n)
+        {
+            tuxnet::log::get().info(format_id, n, 8080, "127.0.0.1", 0.5);
+        }
+        auto end = bench_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count()
+            / records;
+    }
+
+    // Logs preformatted strings and returns nanoseconds per record.
+    double run_preformatted(long records)
+    {
+        auto start = bench_clock::now();
+        for (long n = 0; n < records; ++n)
+        {
+            tuxnet::log::get().info("Accepted connection " + std::to_string(n)
+                + " on port " + std::to_string(8080) + " from 127.0.0.1 "
+                + std::to_string(0.5));
+        }
+        auto end = bench_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count()
+            / records;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    long records = 1000000;
+    std::string directory = "/tmp";
+    if (argc > 1) records = atol(argv[1]);
+    if (argc > 2) directory = argv[2];
+    if (records <= 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [records] [directory]"
+            << std::endl;
+        return 1;
+    }
+    uint32_t format_id = tuxnet::log::get().register_format(
+        "Accepted connection {} on port {} from {} {}");
+    std::string text_path = directory + "/log_bench.txt";
+    std::string binary_path = directory + "/log_bench.bin";
+    double text_ns = 0;
+    double text_preformatted_ns = 0;
+    double binary_ns = 0;
+    double binary_preformatted_ns = 0;
+    {
+        std::ofstream out(text_path);
+        tuxnet::log::get().set_sink(new tuxnet::text_log_sink(out, out));
+        text_preformatted_ns = run_preformatted(records);
+        text_ns = run(format_id, records);
+        tuxnet::log::get().set_sink(new tuxnet::text_log_sink());
+    }
+    {
+        tuxnet::binary_log_sink* sink = new tuxnet::binary_log_sink(
+            binary_path, 256*1024*1024, 1);
+        if (sink->is_open() != true) return 1;
+        tuxnet::log::get().set_sink(sink);
+        binary_preformatted_ns = run_preformatted(records);
+        binary_ns = run(format_id, records);
+        tuxnet::log::get().set_sink(new tuxnet::text_log_sink());
+    }
+    std::cout << "records: " << records << std::endl;
+    std::cout << "text sink,   preformatted : " << text_preformatted_ns
+        << " ns/record" << std::endl;
+    std::cout << "text sink,   format id    : " << text_ns
+        << " ns/record" << std::endl;
+    std::cout << "binary sink, preformatted : " << binary_preformatted_ns
+        << " ns/record" << std::endl;
+    std::cout << "binary sink, format id    : " << binary_ns
+        << " ns/record" << std::endl;
+    unlink(text_path.c_str());
+    unlink(binary_path.c_str());
+    std::string rotated = binary_path + ".1";
+    unlink(rotated.c_str());
+    return 0;
+}
@@ -0,0 +1,704 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/tuxnet.h>
+#include <tuxnet/lockable.h>
+#include <tuxnet/peer.h>
+#include <tuxnet/protocol.h>
+#include <tuxnet/socket.h>
+
+// Microbenchmarks for the library's hot paths.
+//
+// Usage: micro_bench [options]
+//
+//   --filter TEXT        Only run benchmarks whose name contains TEXT.
+//   --min-time MS        Minimum duration of every measurement (200).
+//   --repetitions N      Measurements per benchmark, the median is
+//                        reported (5).
+//   --json PATH          Write the results to PATH as JSON.
+//   --baseline PATH      Compare against results saved earlier with --json.
+//   --threshold PERCENT  Slowdown reported as a regression (10).
+//   --port PORT          Loopback port used by the accept benchmark (18081).
+//
+// Peer benchmarks run over a socketpair with realistic HTTP payloads, the
+// accept benchmark connects to a listening tuxnet::socket over loopback.
+// Refilling and draining the socketpair is left out of the measurement.
+//
+// With --baseline, every benchmark is compared by its median time per
+// operation and the exit status is 2 when any of them got slower than the
+// threshold, so the comparison can gate a release.
+
+namespace
+{
+
+    typedef std::chrono::steady_clock bench_clock;
+
+    /// Command line options.
+    struct options
+    {
+        std::string filter;
+        double min_time_ms = 200;
+        int repetitions = 5;
+        std::string json;
+        std::string baseline;
+        double threshold = 10;
+        int port = 18081;
+    };
+
+    /// Options, the accept benchmark needs the port.
+    options g_options;
+
+    /// Accumulates the time spent in measured sections.
+    class timer
+    {
+        bench_clock::time_point m_since;
+
+        public:
+
+            /// Nanoseconds measured so far.
+            uint64_t elapsed = 0;
+
+            /// Starts measuring.
+            void start()
+            {
+                m_since = bench_clock::now();
+            }
+
+            /// Stops measuring.
+            void stop()
+            {
+                elapsed += std::chrono::duration_cast<
+                    std::chrono::nanoseconds>(bench_clock::now() - m_since)
+                    .count();
+            }
+    };
+
+    /// Runs a given number of operations, measuring them with the timer.
+    typedef void (*bench_function)(uint64_t iterations, timer& t);
+
+    /// A named benchmark.
+    struct benchmark
+    {
+        const char* name;
+        bench_function run;
+    };
+
+    /// Result of a benchmark.
+    struct result
+    {
+        std::string name;
+        uint64_t iterations;
+        double ns_per_op;
+        double min_ns_per_op;
+    };
+
+    /// Keeps the compiler from optimizing a value away.
+    template <class T>
+    inline void keep(const T& value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    /// Typical request head of a browser.
+    const std::string request_head =
+        "GET /static/css/main.css?v=20190412 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:66.0) "
+            "Gecko/20100101 Firefox/66.0\r\n"
+        "Accept: text/css,*/*;q=0.1\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Referer: https://www.example.com/\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "\r\n";
+
+    /// Typical small response.
+    const std::string response =
+        "HTTP/1.1 200 OK\r\n"
+        "Server: tuxnet\r\n"
+        "Date: Fri, 12 Apr 2019 10:00:00 GMT\r\n"
+        "Content-Type: text/html; charset=utf-8\r\n"
+        "Content-Length: 256\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n" + std::string(256, 'x');
+
+    /// Operations between refills of the socketpair.
+    const uint64_t batch_size = 64;
+
+    /// Socket owning the benchmark peers, ignores their events.
+    class bench_socket : public tuxnet::socket
+    {
+        public:
+
+            /// Number of peers that disconnected.
+            std::atomic<uint64_t> disconnects;
+
+            /// Constructor.
+            bench_socket() : tuxnet::socket(tuxnet::L4_PROTO_TCP),
+                disconnects(0)
+            {
+            }
+
+        protected:
+
+            virtual void on_receive(tuxnet::peer* client)
+            {
+            }
+
+            virtual void on_connect(tuxnet::peer* client)
+            {
+            }
+
+            virtual void on_disconnect(tuxnet::peer* client)
+            {
+                disconnects++;
+            }
+    };
+
+    /// A peer reading from and writing to one end of a socketpair.
+    class peer_pair
+    {
+
+        public:
+
+            /// Peer on one end.
+            tuxnet::peer* peer;
+            /// File descriptor of the other end.
+            int remote;
+
+            /// Constructor.
+            peer_pair() : peer(nullptr), remote(-1)
+            {
+                int fds[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+                {
+                    perror("socketpair");
+                    exit(1);
+                }
+                sockaddr_in in_addr = {};
+                in_addr.sin_family = AF_INET;
+                in_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                in_addr.sin_port = htons(50000);
+                // Only used if the peer disconnects.
+                static bench_socket owner;
+                peer = new tuxnet::peer(fds[0], in_addr, &owner);
+                remote = fds[1];
+                if (peer->initialize() != true)
+                {
+                    std::cerr << "Could not initialize peer." << std::endl;
+                    exit(1);
+                }
+            }
+
+            /// Destructor.
+            ~peer_pair()
+            {
+                delete peer;
+                ::close(remote);
+            }
+
+            /// Sends data to the peer.
+            void fill(const std::string& data)
+            {
+                const char* pos = data.data();
+                size_t length = data.length();
+                while (length > 0)
+                {
+                    ssize_t count = ::send(remote, pos, length, 0);
+                    if (count == -1)
+                    {
+                        if (errno == EINTR) continue;
+                        perror("send");
+                        exit(1);
+                    }
+                    pos += count;
+                    length -= count;
+                }
+            }
+
+            /// Receives a given number of bytes the peer sent.
+            void drain(size_t length)
+            {
+                char buffer[16384];
+                while (length > 0)
+                {
+                    ssize_t count = recv(remote, buffer,
+                        std::min(length, sizeof(buffer)), 0);
+                    if (count <= 0)
+                    {
+                        if ((count == -1) and (errno == EINTR)) continue;
+                        perror("recv");
+                        exit(1);
+                    }
+                    length -= count;
+                }
+            }
+    };
+
+    // Benchmarks. ------------------------------------------------------------
+
+
+    // Reads request header lines.
+    void bench_read_line(uint64_t iterations, timer& t)
+    {
+        peer_pair pair;
+        tuxnet::str_vector lines = tuxnet::str_split(request_head, "\r\n");
+        // Leave out the empty lines at the end of the head.
+        lines.resize(lines.size() - 2);
+        std::string batch;
+        std::vector<size_t> ends;
+        for (uint64_t n = 0; n < batch_size; ++n)
+        {
+            batch += lines[n % lines.size()] + "\r\n";
+            ends.push_back(batch.length());
+        }
+        while (iterations > 0)
+        {
+            uint64_t count = std::min(iterations, batch_size);
+            pair.fill(batch.substr(0, ends[count - 1]));
+            t.start();
+            for (uint64_t n = 0; n < count; ++n)
+            {
+                std::string line = pair.peer->read_line();
+                keep(line);
+            }
+            t.stop();
+            iterations -= count;
+        }
+    }
+
+    // Reads request heads up to the empty line.
+    void bench_read_string_until(uint64_t iterations, timer& t)
+    {
+        peer_pair pair;
+        std::string batch;
+        for (uint64_t n = 0; n < batch_size; ++n) batch += request_head;
+        while (iterations > 0)
+        {
+            uint64_t count = std::min(iterations, batch_size);
+            /* read_string_until() only notices the token after receiving
+             * the byte behind it, so a batch needs one more byte. */
+            pair.fill(batch.substr(0, count * request_head.length()) + "G");
+            t.start();
+            for (uint64_t n = 0; n < count; ++n)
+            {
+                std::string head = pair.peer->read_string_until("\r\n\r\n");
+                keep(head);
+            }
+            t.stop();
+            iterations -= count;
+        }
+    }
+
+    // Reads whole requests.
+    void bench_read_all(uint64_t iterations, timer& t)
+    {
+        peer_pair pair;
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            pair.fill(request_head);
+            t.start();
+            std::string request = pair.peer->read_all();
+            keep(request);
+            t.stop();
+        }
+    }
+
+    // Writes responses.
+    void bench_write_string(uint64_t iterations, timer& t)
+    {
+        peer_pair pair;
+        while (iterations > 0)
+        {
+            uint64_t count = std::min(iterations, batch_size);
+            t.start();
+            for (uint64_t n = 0; n < count; ++n)
+            {
+                pair.peer->write_string(response);
+            }
+            t.stop();
+            pair.drain(count * response.length());
+            iterations -= count;
+        }
+    }
+
+    // Parses dotted quad addresses.
+    void bench_ip4_set(uint64_t iterations, timer& t)
+    {
+        const std::string addresses[] = {
+            "127.0.0.1", "10.20.30.40", "192.168.100.200", "203.0.113.7"
+        };
+        tuxnet::ip4_address address;
+        t.start();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            address.set(addresses[n & 3]);
+            keep(address);
+        }
+        t.stop();
+    }
+
+    // Formats addresses as dotted quads.
+    void bench_ip4_as_string(uint64_t iterations, timer& t)
+    {
+        tuxnet::ip4_address address("192.168.100.200");
+        t.start();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            std::string text = address.as_string();
+            keep(text);
+        }
+        t.stop();
+    }
+
+    // Splits a request head into lines.
+    void bench_str_split_lines(uint64_t iterations, timer& t)
+    {
+        t.start();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            tuxnet::str_vector lines = tuxnet::str_split(request_head, "\r\n");
+            keep(lines);
+        }
+        t.stop();
+    }
+
+    // Splits a header into name and value.
+    void bench_str_split_header(uint64_t iterations, timer& t)
+    {
+        const std::string header = "Accept-Encoding: gzip, deflate, br";
+        t.start();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            tuxnet::str_vector parts = tuxnet::str_split(header, ": ", 2);
+            keep(parts);
+        }
+        t.stop();
+    }
+
+    // Looks up protocol numbers.
+    void bench_layer4_to_proto(uint64_t iterations, timer& t)
+    {
+        t.start();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            int proto = tuxnet::layer4_to_proto((n & 1) ?
+                tuxnet::L4_PROTO_UDP : tuxnet::L4_PROTO_TCP);
+            keep(proto);
+        }
+        t.stop();
+    }
+
+    // Updates a lockable nobody else uses.
+    void bench_lockable_atomic(uint64_t iterations, timer& t)
+    {
+        tuxnet::lockable<uint64_t> value(0);
+        t.start();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            value.atomic([](uint64_t& v){ v++; });
+        }
+        t.stop();
+        keep(value.get());
+    }
+
+    // Updates a lockable another thread keeps updating too.
+    void bench_lockable_atomic_contended(uint64_t iterations, timer& t)
+    {
+        tuxnet::lockable<uint64_t> value(0);
+        std::atomic<bool> stopping(false);
+        std::thread other([&value, &stopping](){
+            while (stopping != true) value.atomic([](uint64_t& v){ v++; });
+        });
+        t.start();
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            value.atomic([](uint64_t& v){ v++; });
+        }
+        t.stop();
+        stopping = true;
+        other.join();
+        keep(value.get());
+    }
+
+    // Connects to a listening socket and accepts the connection.
+    void bench_accept(uint64_t iterations, timer& t)
+    {
+        /* Peers are deleted by their own threads, keep the socket and the
+         * address it refers to around. */
+        static bench_socket* listener = nullptr;
+        static tuxnet::ip4_socket_address saddr(
+            tuxnet::ip4_address("127.0.0.1"), g_options.port);
+        static uint64_t accepted = 0;
+        if (listener == nullptr)
+        {
+            listener = new bench_socket();
+            if (listener->listen(&saddr) != true) exit(1);
+        }
+        sockaddr_in in_addr = {};
+        in_addr.sin_family = AF_INET;
+        in_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        in_addr.sin_port = htons(g_options.port);
+        // Reset on close so the client ports don't pile up in TIME_WAIT.
+        linger reset = { 1, 0 };
+        for (uint64_t n = 0; n < iterations; ++n)
+        {
+            t.start();
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+            if (connect(fd, reinterpret_cast<sockaddr*>(&in_addr),
+                sizeof(in_addr)) == -1)
+            {
+                perror("connect");
+                exit(1);
+            }
+            listener->poll();
+            t.stop();
+            ::close(fd);
+            accepted++;
+        }
+        // Let the peer threads wind down before the next measurement.
+        for (int n = 0; (n < 1000) and (listener->disconnects < accepted); ++n)
+        {
+            usleep(1000);
+        }
+    }
+
+    /// All benchmarks, in the order they run.
+    const benchmark benchmarks[] = {
+        { "peer_read_line", bench_read_line },
+        { "peer_read_string_until", bench_read_string_until },
+        { "peer_read_all", bench_read_all },
+        { "peer_write_string", bench_write_string },
+        { "ip4_address_set", bench_ip4_set },
+        { "ip4_address_as_string", bench_ip4_as_string },
+        { "str_split_lines", bench_str_split_lines },
+        { "str_split_header", bench_str_split_header },
+        { "layer4_to_proto", bench_layer4_to_proto },
+        { "lockable_atomic", bench_lockable_atomic },
+        { "lockable_atomic_contended", bench_lockable_atomic_contended },
+        { "socket_accept", bench_accept }
+    };
+
+    // Harness. ---------------------------------------------------------------
+
+    // Runs a benchmark once and returns the nanoseconds it measured.
+    uint64_t measure(const benchmark& bench, uint64_t iterations)
+    {
+        timer t;
+        bench.run(iterations, t);
+        return t.elapsed;
+    }
+
+    // Runs a benchmark long enough for a stable result.
+    result run(const benchmark& bench)
+    {
+        double min_time = g_options.min_time_ms * 1e6;
+        // Find an iteration count which runs for at least min_time.
+        uint64_t iterations = 1;
+        while (true)
+        {
+            uint64_t elapsed = measure(bench, iterations);
+            if (elapsed >= min_time) break;
+            if (elapsed < min_time / 100)
+            {
+                iterations *= 10;
+                continue;
+            }
+            iterations = std::max(iterations + 1, uint64_t(iterations
+                * min_time * 1.2 / std::max(elapsed, uint64_t(1))));
+        }
+        std::vector<double> samples;
+        for (int n = 0; n < g_options.repetitions; ++n)
+        {
+            samples.push_back(double(measure(bench, iterations)) / iterations);
+        }
+        std::sort(samples.begin(), samples.end());
+        result r;
+        r.name = bench.name;
+        r.iterations = iterations;
+        r.ns_per_op = samples[samples.size() / 2];
+        r.min_ns_per_op = samples[0];
+        return r;
+    }
+
+    // Writes results as JSON.
+    bool write_json(const std::string& path, const std::vector<result>& results)
+    {
+        std::ofstream out(path);
+        if (out.good() != true) return false;
+        char line[512];
+        out << "{\n  \"benchmarks\": [\n";
+        for (size_t n = 0; n < results.size(); ++n)
+        {
+            snprintf(line, sizeof(line), "    { \"name\": \"%s\", "
+                "\"iterations\": %llu, \"ns_per_op\": %.3f, "
+                "\"min_ns_per_op\": %.3f }%s\n", results[n].name.c_str(),
+                static_cast<unsigned long long>(results[n].iterations),
+                results[n].ns_per_op, results[n].min_ns_per_op,
+                (n + 1 < results.size()) ? "," : "");
+            out << line;
+        }
+        out << "  ]\n}\n";
+        return out.good();
+    }
+
+    // Reads results written by write_json().
+    bool read_json(const std::string& path, std::vector<result>& results)
+    {
+        std::ifstream in(path);
+        if (in.good() != true) return false;
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        std::string text = buffer.str();
+        const std::string name_key = "\"name\": \"";
+        const std::string ns_key = "\"ns_per_op\": ";
+        size_t pos = 0;
+        while ((pos = text.find(name_key, pos)) != std::string::npos)
+        {
+            pos += name_key.length();
+            size_t end = text.find('"', pos);
+            size_t ns = text.find(ns_key, pos);
+            if ((end == std::string::npos) or (ns == std::string::npos))
+            {
+                return false;
+            }
+            result r = {};
+            r.name = text.substr(pos, end - pos);
+            r.ns_per_op = strtod(text.c_str() + ns + ns_key.length(),
+                nullptr);
+            results.push_back(r);
+            pos = ns;
+        }
+        return true;
+    }
+
+    // Compares results against a baseline, returns the number of regressions.
+    int compare(const std::vector<result>& results,
+        const std::vector<result>& baseline)
+    {
+        int regressions = 0;
+        printf("\n%-28s %12s %12s %9s\n", "benchmark", "baseline ns",
+            "current ns", "change");
+        for (const result& r : results)
+        {
+            auto it = std::find_if(baseline.begin(), baseline.end(),
+                [&r](const result& b){ return b.name == r.name; });
+            if ((it == baseline.end()) or (it->ns_per_op <= 0))
+            {
+                printf("%-28s %12s %12.1f %9s\n", r.name.c_str(), "-",
+                    r.ns_per_op, "new");
+                continue;
+            }
+            double change = (r.ns_per_op - it->ns_per_op) / it->ns_per_op
+                * 100;
+            const char* verdict = "";
+            if (change > g_options.threshold)
+            {
+                verdict = "  REGRESSION";
+                regressions++;
+            }
+            else if (change < -g_options.threshold)
+            {
+                verdict = "  improved";
+            }
+            printf("%-28s %12.1f %12.1f %+8.1f%%%s\n", r.name.c_str(),
+                it->ns_per_op, r.ns_per_op, change, verdict);
+        }
+        return regressions;
+    }
+
+    // Prints usage.
+    void usage(const char* name)
+    {
+        std::cerr << "Usage: " << name << " [--filter TEXT] [--min-time MS]"
+            " [--repetitions N] [--json PATH] [--baseline PATH]"
+            " [--threshold PERCENT] [--port PORT]" << std::endl;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    options& opt = g_options;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        bool has_value = (n + 1 < argc);
+        if ((arg == "--filter") and has_value) opt.filter = argv[++n];
+        else if ((arg == "--min-time") and has_value)
+        {
+            opt.min_time_ms = atof(argv[++n]);
+        }
+        else if ((arg == "--repetitions") and has_value)
+        {
+            opt.repetitions = atoi(argv[++n]);
+        }
+        else if ((arg == "--json") and has_value) opt.json = argv[++n];
+        else if ((arg == "--baseline") and has_value) opt.baseline = argv[++n];
+        else if ((arg == "--threshold") and has_value)
+        {
+            opt.threshold = atof(argv[++n]);
+        }
+        else if ((arg == "--port") and has_value) opt.port = atoi(argv[++n]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((opt.min_time_ms <= 0) or (opt.repetitions < 1) or (opt.port <= 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<result> baseline;
+    if (
+        (opt.baseline.empty() != true)
+        and (read_json(opt.baseline, baseline) != true)
+    )
+    {
+        std::cerr << "Could not read baseline " << opt.baseline << "."
+            << std::endl;
+        return 1;
+    }
+    std::vector<result> results;
+    printf("%-28s %12s %12s %14s\n", "benchmark", "ns/op", "min ns/op",
+        "iterations");
+    for (const benchmark& bench : benchmarks)
+    {
+        if (std::string(bench.name).find(opt.filter) == std::string::npos)
+        {
+            continue;
+        }
+        result r = run(bench);
+        printf("%-28s %12.1f %12.1f %14llu\n", r.name.c_str(), r.ns_per_op,
+            r.min_ns_per_op, static_cast<unsigned long long>(r.iterations));
+        fflush(stdout);
+        results.push_back(r);
+    }
+    if ((opt.json.empty() != true) and (write_json(opt.json, results) != true))
+    {
+        std::cerr << "Could not write " << opt.json << "." << std::endl;
+        return 1;
+    }
+    if (opt.baseline.empty() != true)
+    {
+        if (compare(results, baseline) > 0) return 2;
+    }
+    return 0;
+}
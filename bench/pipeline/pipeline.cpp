@@ -0,0 +1,235 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <tuxnet/tuxnet.h>
+
+// Measures what pipelining buys a request/response client.
+//
+// Usage: pipeline_bench [options]
+//
+//   --depths N,N,...  Pipeline windows to measure (1,2,4,8,16,32,64,128).
+//   --requests N      Requests per window (100000).
+//   --size BYTES      Request payload size (32).
+//   --codec NAME      line, length or tagged (line).
+//   --port PORT       Loopback port the echo server listens on (18083).
+//
+// An echo server runs in the same process, so every request comes back as
+// its own response. For every window a fresh connection sends all requests
+// as fast as the window allows, and the benchmark reports requests per
+// second, the mean latency from send() to completion, and the speedup over
+// the first window. A window of 1 is the classic wait-for-each-response
+// client paying a full round trip per request.
+
+namespace
+{
+
+    typedef std::chrono::steady_clock bench_clock;
+
+    /// Command line options.
+    struct options
+    {
+        std::vector<int> depths = { 1, 2, 4, 8, 16, 32, 64, 128 };
+        long requests = 100000;
+        int size = 32;
+        std::string codec = "line";
+        int port = 18083;
+    };
+
+    /// Sends every byte it receives straight back.
+    class echo_server : public tuxnet::server
+    {
+
+        protected:
+
+            void on_receive(tuxnet::peer* remote_peer) override
+            {
+                char buffer[65536];
+                int count = remote_peer->read_bytes(buffer, sizeof(buffer));
+                if (count > 0) remote_peer->write_bytes(buffer, count);
+            }
+
+    };
+
+    /// Pipelined client remembering its connection.
+    class bench_client : public tuxnet::pipelined_client
+    {
+
+        public:
+
+            std::atomic<tuxnet::peer*> connection;
+
+            bench_client(const tuxnet::framing_codec* codec, int window) :
+                pipelined_client(codec, window), connection(nullptr)
+            {
+            }
+
+            ~bench_client()
+            {
+                close_all();
+            }
+
+        protected:
+
+            void on_ready(tuxnet::peer* remote_peer) override
+            {
+                connection = remote_peer;
+            }
+
+    };
+
+    /// Outcome of a single window.
+    struct result
+    {
+        bool ok;
+        double seconds;
+        double mean_latency_us;
+    };
+
+    // Gets the seconds elapsed since a given time.
+    double seconds_since(bench_clock::time_point start)
+    {
+        return std::chrono::duration<double>(bench_clock::now() - start)
+            .count();
+    }
+
+    // Sends all requests through a connection with a given window.
+    result run(const options& opt, const tuxnet::framing_codec* codec,
+        const tuxnet::socket_address* saddr, int depth)
+    {
+        result r = { false, 0, 0 };
+        bench_client client(codec, depth);
+        if (client.connect(saddr) != true) return r;
+        auto start = bench_clock::now();
+        while ((client.connection == nullptr) and (seconds_since(start) < 5))
+        {
+            usleep(1000);
+        }
+        tuxnet::peer* connection = client.connection;
+        if (connection == nullptr) return r;
+        std::string payload(opt.size, 'x');
+        std::atomic<long> completed(0);
+        std::atomic<long> failed(0);
+        std::atomic<uint64_t> latency_ns(0);
+        start = bench_clock::now();
+        for (long n = 0; n < opt.requests; ++n)
+        {
+            uint64_t sent = tuxnet::stats_clock();
+            bool ok = client.send(connection, payload.data(), payload.size(),
+                [&completed, &failed, &latency_ns, sent](const char* data,
+                    size_t length, int error){
+                    if (error != 0) failed++;
+                    latency_ns += tuxnet::stats_clock() - sent;
+                    completed++;
+                });
+            if (ok != true) return r;
+        }
+        while ((completed < opt.requests) and (seconds_since(start) < 60))
+        {
+            usleep(100);
+        }
+        r.seconds = seconds_since(start);
+        r.ok = (completed == opt.requests) and (failed == 0);
+        r.mean_latency_us = double(latency_ns) / opt.requests / 1000;
+        return r;
+    }
+
+    // Prints usage.
+    void usage(const char* name)
+    {
+        std::cerr << "Usage: " << name << " [--depths N,N,...]"
+            " [--requests N] [--size BYTES] [--codec line|length|tagged]"
+            " [--port PORT]" << std::endl;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        bool has_value = (n + 1 < argc);
+        if ((arg == "--depths") and has_value)
+        {
+            opt.depths.clear();
+            for (const std::string& depth : tuxnet::str_split(argv[++n], ","))
+            {
+                opt.depths.push_back(atoi(depth.c_str()));
+            }
+        }
+        else if ((arg == "--requests") and has_value)
+        {
+            opt.requests = atol(argv[++n]);
+        }
+        else if ((arg == "--size") and has_value) opt.size = atoi(argv[++n]);
+        else if ((arg == "--codec") and has_value) opt.codec = argv[++n];
+        else if ((arg == "--port") and has_value) opt.port = atoi(argv[++n]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    tuxnet::line_codec line;
+    tuxnet::length_prefixed_codec length(false);
+    tuxnet::length_prefixed_codec tagged(true);
+    const tuxnet::framing_codec* codec = nullptr;
+    if (opt.codec == "line") codec = &line;
+    else if (opt.codec == "length") codec = &length;
+    else if (opt.codec == "tagged") codec = &tagged;
+    if ((codec == nullptr) or (opt.requests < 1) or (opt.size < 1))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    for (int depth : opt.depths)
+    {
+        if (depth < 1)
+        {
+            std::cerr << "Depths must be positive." << std::endl;
+            return 1;
+        }
+    }
+    tuxnet::ip4_socket_address saddr(tuxnet::ip4_address("127.0.0.1"),
+        opt.port);
+    echo_server server;
+    tuxnet::socket_addresses saddrs = { &saddr };
+    if (server.listen(saddrs, tuxnet::L4_PROTO_TCP) != true)
+    {
+        std::cerr << "Could not listen on port " << opt.port << "."
+            << std::endl;
+        return 1;
+    }
+    std::thread poller([&server](){ while (server.poll() == true); });
+    poller.detach();
+    usleep(100000);
+    printf("%ld requests of %d bytes, %s codec\n\n", opt.requests, opt.size,
+        opt.codec.c_str());
+    printf("%8s %14s %16s %10s\n", "window", "requests/s", "mean latency us",
+        "speedup");
+    double baseline = 0;
+    for (int depth : opt.depths)
+    {
+        result r = run(opt, codec, &saddr, depth);
+        if (r.ok != true)
+        {
+            fprintf(stderr, "Window %d failed.\n", depth);
+            fflush(stderr);
+            _exit(1);
+        }
+        double rate = opt.requests / r.seconds;
+        if (baseline == 0) baseline = rate;
+        printf("%8d %14.0f %16.1f %9.2fx\n", depth, rate, r.mean_latency_us,
+            rate / baseline);
+        fflush(stdout);
+    }
+    // The server's threads don't stop, leave without tearing them down.
+    _exit(0);
+}
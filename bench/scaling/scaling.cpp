@@ -0,0 +1,346 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <tuxnet/tuxnet.h>
+
+// Measures what idle connections cost a tuxnet server.
+//
+// Usage: scaling_bench [options]
+//
+//   --steps N,N,...  Connection counts to measure at (1000,10000,100000).
+//   --port PORT      Loopback port the server listens on (18082).
+//   --timeout SECONDS
+//                    How long to wait for the server to accept a step (30).
+//
+// The server runs in a child process so its footprint can be read from
+// /proc without the client side mixed in. The parent opens idle
+// connections step by step, spreading them over several 127.0.0.x source
+// addresses so the ephemeral port range isn't the limit, and after every
+// step reports the server's resident memory, threads and file descriptors,
+// the memory per connection relative to an idle server, and how fast the
+// connections were established and accepted.
+//
+// 100000 connections need at least 200000 file descriptors on the client
+// side, and many more threads and descriptors than default limits allow on
+// the server side. The soft descriptor limit is raised to the hard limit;
+// when something runs out the benchmark reports how far it got.
+
+namespace
+{
+
+    typedef std::chrono::steady_clock bench_clock;
+
+    /// Connections per client source address.
+    const int connections_per_source = 25000;
+
+    /// Command line options.
+    struct options
+    {
+        std::vector<long> steps = { 1000, 10000, 100000 };
+        int port = 18082;
+        double timeout = 30;
+    };
+
+    /// Counters shared with the server process.
+    struct shared_counters
+    {
+        std::atomic<long> accepted;
+        std::atomic<bool> listening;
+    };
+
+    /// Server counting accepted connections, ignores whatever they send.
+    class counting_server : public tuxnet::server
+    {
+        shared_counters* m_counters;
+
+        public:
+
+            /// Constructor.
+            counting_server(shared_counters* counters) :
+                tuxnet::server(), m_counters(counters)
+            {
+            }
+
+        protected:
+
+            virtual void on_connect(tuxnet::peer* remote_peer)
+            {
+                m_counters->accepted++;
+            }
+
+            virtual void on_receive(tuxnet::peer* remote_peer)
+            {
+                remote_peer->read_all();
+            }
+
+    };
+
+    /// Footprint of a process.
+    struct footprint
+    {
+        long rss_kb = 0;
+        long threads = 0;
+        long fds = 0;
+    };
+
+    // Runs the server, never returns.
+    void run_server(int port, shared_counters* counters)
+    {
+        counting_server server(counters);
+        tuxnet::ip4_socket_address saddr(tuxnet::ip4_address("127.0.0.1"),
+            port);
+        tuxnet::socket_addresses saddrs = { &saddr };
+        if (server.listen(saddrs, tuxnet::L4_PROTO_TCP) != true) _exit(1);
+        counters->listening = true;
+        while (server.poll() == true)
+        {
+        }
+        _exit(0);
+    }
+
+    // Reads the footprint of a process from /proc.
+    footprint read_footprint(pid_t pid)
+    {
+        footprint result;
+        std::string path = "/proc/" + std::to_string(pid);
+        FILE* status = fopen((path + "/status").c_str(), "r");
+        if (status != nullptr)
+        {
+            char line[256];
+            while (fgets(line, sizeof(line), status) != nullptr)
+            {
+                sscanf(line, "VmRSS: %ld", &result.rss_kb);
+                sscanf(line, "Threads: %ld", &result.threads);
+            }
+            fclose(status);
+        }
+        DIR* dir = opendir((path + "/fd").c_str());
+        if (dir != nullptr)
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                if (entry->d_name[0] != '.') result.fds++;
+            }
+            closedir(dir);
+        }
+        return result;
+    }
+
+    // Opens an idle connection, returns its file descriptor or -1.
+    int open_connection(int port, long index)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+        // Reset on close, there's no point in lingering in TIME_WAIT.
+        linger reset = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        // Pick the source port at connect() time, per 4-tuple.
+        int enable = 1;
+        setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enable,
+            sizeof(enable));
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1
+            + index / connections_per_source);
+        sockaddr_in remote = {};
+        remote.sin_family = AF_INET;
+        remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        remote.sin_port = htons(port);
+        if (
+            (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local))
+                == -1)
+            or (connect(fd, reinterpret_cast<sockaddr*>(&remote),
+                sizeof(remote)) == -1)
+        )
+        {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            return -1;
+        }
+        return fd;
+    }
+
+    // Checks whether the server process is still running.
+    bool server_running(pid_t pid)
+    {
+        int status = 0;
+        return waitpid(pid, &status, WNOHANG) == 0;
+    }
+
+    // Returns seconds elapsed since a given time.
+    double seconds_since(bench_clock::time_point since)
+    {
+        return std::chrono::duration<double>(bench_clock::now() - since)
+            .count();
+    }
+
+    // Raises the soft file descriptor limit as far as allowed.
+    long raise_fd_limit()
+    {
+        rlimit limit = {};
+        getrlimit(RLIMIT_NOFILE, &limit);
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        return limit.rlim_cur;
+    }
+
+    // Prints usage.
+    void usage(const char* name)
+    {
+        std::cerr << "Usage: " << name << " [--steps N,N,...] [--port PORT]"
+            " [--timeout SECONDS]" << std::endl;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        bool has_value = (n + 1 < argc);
+        if ((arg == "--steps") and has_value)
+        {
+            opt.steps.clear();
+            for (const std::string& step : tuxnet::str_split(argv[++n], ","))
+            {
+                opt.steps.push_back(atol(step.c_str()));
+            }
+        }
+        else if ((arg == "--port") and has_value) opt.port = atoi(argv[++n]);
+        else if ((arg == "--timeout") and has_value)
+        {
+            opt.timeout = atof(argv[++n]);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    for (size_t n = 0; n < opt.steps.size(); ++n)
+    {
+        if (
+            (opt.steps[n] < 1)
+            or ((n > 0) and (opt.steps[n] <= opt.steps[n - 1]))
+        )
+        {
+            std::cerr << "Steps must be positive and increasing." << std::endl;
+            return 1;
+        }
+    }
+    long fd_limit = raise_fd_limit();
+    shared_counters* counters = static_cast<shared_counters*>(mmap(nullptr,
+        sizeof(shared_counters), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (counters == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    new (counters) shared_counters();
+    pid_t server_pid = fork();
+    if (server_pid == -1)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (server_pid == 0) run_server(opt.port, counters);
+    // Wait for the server to listen and settle.
+    auto start = bench_clock::now();
+    while ((counters->listening != true) and (seconds_since(start) < 5))
+    {
+        if (server_running(server_pid) != true) break;
+        usleep(10000);
+    }
+    if (counters->listening != true)
+    {
+        std::cerr << "Server didn't start listening." << std::endl;
+        kill(server_pid, SIGKILL);
+        return 1;
+    }
+    usleep(200000);
+    footprint idle = read_footprint(server_pid);
+    printf("descriptor limit %ld, idle server: %ld kB RSS, %ld threads, "
+        "%ld fds\n\n", fd_limit, idle.rss_kb, idle.threads, idle.fds);
+    printf("%12s %12s %10s %10s %14s %12s %12s\n", "connections", "RSS kB",
+        "threads", "fds", "bytes/conn", "connect s", "accepts/s");
+    std::vector<int> fds;
+    bool failed = false;
+    for (long step : opt.steps)
+    {
+        long before = fds.size();
+        auto step_start = bench_clock::now();
+        while ((long(fds.size()) < step) and (failed != true))
+        {
+            int fd = open_connection(opt.port, fds.size());
+            if (fd == -1)
+            {
+                fprintf(stderr, "Connection %zu failed: %s\n", fds.size() + 1,
+                    strerror(errno));
+                failed = true;
+                break;
+            }
+            fds.push_back(fd);
+        }
+        double connect_seconds = seconds_since(step_start);
+        // Wait for the server to accept everything.
+        while (
+            (counters->accepted < long(fds.size()))
+            and (seconds_since(step_start) < opt.timeout)
+            and (server_running(server_pid) == true)
+        )
+        {
+            usleep(1000);
+        }
+        double accept_seconds = seconds_since(step_start);
+        long accepted = counters->accepted;
+        if (server_running(server_pid) != true)
+        {
+            fprintf(stderr, "Server exited after accepting %ld "
+                "connections.\n", accepted);
+            failed = true;
+            break;
+        }
+        if (accepted < long(fds.size()))
+        {
+            fprintf(stderr, "Server accepted only %ld of %zu connections "
+                "within %g s.\n", accepted, fds.size(), opt.timeout);
+            failed = true;
+        }
+        footprint now = read_footprint(server_pid);
+        double per_connection = 0;
+        if (accepted > 0)
+        {
+            per_connection = double(now.rss_kb - idle.rss_kb) * 1024
+                / accepted;
+        }
+        printf("%12ld %12ld %10ld %10ld %14.0f %12.3f %12.0f\n", accepted,
+            now.rss_kb, now.threads, now.fds, per_connection,
+            connect_seconds, (accepted - before) / accept_seconds);
+        fflush(stdout);
+        if (failed == true) break;
+    }
+    kill(server_pid, SIGKILL);
+    waitpid(server_pid, nullptr, 0);
+    for (int fd : fds) ::close(fd);
+    return (failed == true) ? 2 : 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * Admin listener serving engine metrics.
+ **/
+
+#ifndef TUXNET_ADMIN_H_INCLUDE
+#define TUXNET_ADMIN_H_INCLUDE
+
+#include <atomic>
+#include <thread>
+#include "tuxnet/socket_address.h"
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    /**
+     * Serves the counters and latency histograms of a stats_registry in the
+     * Prometheus text exposition format (version 0.0.4).
+     *
+     * The listener runs on its own thread with the SCHED_IDLE policy (or the
+     * lowest nice value when that isn't permitted), so the kernel only gives
+     * it CPU time when the event loops don't need it. Connections are handled
+     * one at a time with blocking I/O and short timeouts, and every scrape
+     * renders into buffers allocated up front, so scraping doesn't touch the
+     * heap.
+     *
+     * Any path is answered with the metrics page, which is what
+     * Prometheus expects at /metrics.
+     */
+    class admin_listener
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Size of the response body buffer.
+        static const int m_body_capacity = 64 * 1024;
+        /// Size of the request buffer.
+        static const int m_request_capacity = 4096;
+
+        /// Response body buffer.
+        char* m_body;
+        /// Number of bytes used in m_body.
+        int m_body_length;
+        /// Listening socket file descriptor.
+        int m_fd;
+        /// Merged histograms, indexed by latency_metric.
+        histogram_snapshot m_histograms[LATENCY_METRIC_COUNT];
+        /// Request buffer.
+        char* m_request;
+        /// Set to stop the listener thread.
+        std::atomic<bool> m_stopping;
+        /// Registry to export.
+        stats_registry* const m_stats;
+        /// Listener thread.
+        std::thread m_thread;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Appends formatted text to the response body.
+         *
+         * Output that doesn't fit is dropped, the page stays valid up to the
+         * last complete line.
+         */
+        void m_append(const char* format, ...)
+            __attribute__((format(printf, 2, 3)));
+
+        /// Appends a counter with its HELP and TYPE lines.
+        void m_counter(const char* name, const char* help, uint64_t value);
+
+        /// Handles a single scrape.
+        void m_handle(int fd);
+
+        /// Lowers the priority of the calling thread.
+        static void m_lower_priority();
+
+        /// Renders all metrics into the response body.
+        void m_render();
+
+        /// Accepts and handles connections until stopped.
+        void m_run();
+
+        /// Sends a whole buffer, giving up on errors.
+        static bool m_send(int fd, const char* data, int length);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param stats : Registry to export, must outlive the listener.
+             */
+            admin_listener(stats_registry* stats);
+
+            /// Destructor, stops the listener thread.
+            ~admin_listener();
+
+            admin_listener(const admin_listener&) = delete;
+            admin_listener& operator=(const admin_listener&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Starts listening and serving scrapes.
+             * @param saddr : Address/port pair to listen on (IPv4).
+             * @return Returns true on success, false on error.
+             */
+            bool listen(const socket_address* const saddr);
+
+            /// Stops serving and closes the listening socket.
+            void stop();
+
+    };
+
+}
+
+#endif
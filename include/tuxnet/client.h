@@ -0,0 +1,283 @@
+#ifndef CLIENT_H_INCLUDE
+#define CLIENT_H_INCLUDE
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "tuxnet/lockable.h"
+#include "tuxnet/peer.h"
+#include "tuxnet/socket.h"
+#include "tuxnet/socket_address.h"
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    /**
+     * Outbound TCP connections.
+     *
+     * connect() starts a non-blocking connect() and returns right away. A
+     * connector thread (started by the first connect()) waits for the
+     * sockets to become writable with epoll, checks SO_ERROR and enforces
+     * connect timeouts. Established connections become peers, which run on
+     * the same kind of event loop as the peers of a server, with the same
+     * read/write API and on_connect / on_receive / on_disconnect events.
+     * Attempts that fail or time out fire on_connect_error() instead.
+     *
+     * Derive from this class and override the events, like with
+     * tuxnet::server.
+     */
+    class client
+    {
+
+        friend class peer;
+        friend class socket;
+
+        /// Connection attempt in progress.
+        struct pending_connect
+        {
+            /// Socket connecting.
+            socket* sock;
+            /// When the attempt times out (see stats_clock()), 0 for never.
+            uint64_t deadline;
+        };
+
+        // Private member variables. ------------------------------------------
+
+        /// Source address options for new connections.
+        connect_options m_connect_options;
+        /// Established connections whose peer thread didn't finish yet.
+        int m_connected;
+        /// Signalled when a peer thread finished.
+        std::condition_variable m_peer_gone;
+        /// Epoll file descriptor the connector thread waits on.
+        int m_epoll_fd;
+        /// Sockets whose connections ended, deleted by the connector.
+        sockets m_finished;
+        /// Keepalive enabled?
+        bool m_keepalive;
+        /// Keepalive interval.
+        int m_keepalive_interval;
+        /// Keepalive retries.
+        int m_keepalive_retries;
+        /// Keepalive timeout.
+        int m_keepalive_timeout;
+        /// Guards m_connect_options, m_connected, m_finished, m_pending and
+        /// starting m_thread.
+        std::mutex m_lock;
+        /// Connection attempts in progress.
+        std::vector<pending_connect> m_pending;
+        /// Sockets of all connections and attempts.
+        lockable<sockets> m_sockets;
+        /// Counters of the connector and peer threads.
+        stats_registry m_stats;
+        /// Set to stop the connector thread.
+        std::atomic<bool> m_stopping;
+        /// Connector thread.
+        std::thread m_thread;
+        /// eventfd waking the connector thread up.
+        int m_wake_fd;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Completes a connection attempt the socket became writable for.
+         * @param sock : Socket to complete.
+         */
+        void m_complete(socket* sock);
+
+        /**
+         * Deletes sockets of ended connections.
+         *
+         * Called by the connector thread only, so sockets handed over by
+         * m_release() are deleted after the peer thread left them.
+         */
+        void m_delete_finished();
+
+        /// Fails connection attempts which ran out of time.
+        void m_expire();
+
+        /**
+         * Gets how long the connector thread may wait for events.
+         * @return Returns milliseconds until the nearest deadline, at most
+         *         1000.
+         */
+        int m_next_timeout();
+
+        /**
+         * Counts a peer thread as finished.
+         *
+         * Called by the thread once it's done with the client's counters,
+         * the very last thing it does.
+         */
+        void m_peer_done();
+
+        /**
+         * Hands over a socket whose connection ended.
+         * @param sock : Socket to delete.
+         */
+        void m_release(socket* sock);
+
+        /**
+         * Forgets a connection attempt.
+         * @param sock : Socket of the attempt.
+         * @return Returns false if it wasn't pending anymore.
+         */
+        bool m_remove_pending(socket* sock);
+
+        /// Waits for connection attempts to complete until stopped.
+        void m_run();
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor.
+            client();
+
+            /**
+             * Destructor.
+             *
+             * Stops the connector thread and closes all connections, see
+             * close_all().
+             */
+            virtual ~client();
+
+            client(const client&) = delete;
+            client& operator=(const client&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Configures the source address of new connections.
+             *
+             * Applies to connections started afterwards. See
+             * tuxnet::connect_options for the available options.
+             *
+             * @param options : Connect options to use.
+             */
+            void configure_connect(const connect_options& options);
+
+            /**
+             * @brief Configures TCP keepalive settings.
+             *
+             * Applies to connections started afterwards. See
+             * tuxnet::server::configure_keepalive() for details.
+             *
+             * @param enabled : Set to false to disable, or true to enable.
+             * @param timeout : (optional) Idle time before probing.
+             * @param interval : (optional) Delay between keepalive probes.
+             * @param retries : (optional) Failed probes before giving up.
+             */
+            void configure_keepalive(bool enabled, int timeout=10,
+                int interval=5, int retries=3);
+
+            /**
+             * @brief Starts connecting to a remote address.
+             *
+             * Returns as soon as the connection attempt started. Once it
+             * completes, on_connect() fires from the connector thread and the
+             * peer starts receiving. If it fails, or doesn't complete within
+             * the timeout, on_connect_error() fires instead.
+             *
+             * @param saddr : Address to connect to, copied.
+             * @param timeout_ms : (optional) Milliseconds the attempt may
+             *                     take, 0 leaves it to the kernel, -1 uses
+             *                     config connect_timeout_ms.
+             * @param context : (optional) Attached to the peer before
+             *                  on_connect() fires (see
+             *                  peer::get_context()), or passed to
+             *                  on_connect_error().
+             * @return Returns false if the attempt couldn't be started.
+             */
+            bool connect(const socket_address* const saddr,
+                int timeout_ms=-1, void* context=nullptr);
+
+            /**
+             * @brief Gets the number of established connections.
+             * @return Returns the number of connected peers.
+             */
+            int num_connections();
+
+            /**
+             * @brief Gets the number of connection attempts in progress.
+             * @return Returns the number of pending attempts.
+             */
+            int num_pending();
+
+            /**
+             * @brief Gets the client's counters.
+             * @return Returns counters summed over the connector and peer
+             *         threads.
+             */
+            stats_snapshot stats();
+
+        protected:
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Stops connecting and closes all connections.
+             *
+             * Attempts still in progress fail with ECANCELED through
+             * on_connect_error(). The client can connect again afterwards.
+             * Waits (up to 5 seconds) for the peer threads to finish, so
+             * on_disconnect() has fired for every connection when it
+             * returns. Call it first thing in the destructor of a derived
+             * class, while its events can still be dispatched to it.
+             */
+            void close_all();
+
+            // Events. --------------------------------------------------------
+
+            /**
+             * @brief on_connect event.
+             *
+             * Fires from the connector thread once a connection is
+             * established, before the peer starts receiving.
+             *
+             * @param remote_peer : peer object representing the connection.
+             */
+            virtual void on_connect(peer* remote_peer);
+
+            /**
+             * @brief on_connect_error event.
+             *
+             * Fires from the connector thread when a connection attempt
+             * failed or timed out, or from close_all() for attempts it
+             * cancelled.
+             *
+             * @param saddr : Address the attempt was for.
+             * @param error : errno value, ETIMEDOUT for timeouts, ECANCELED
+             *                for attempts cancelled by close_all().
+             * @param context : Context passed to connect().
+             */
+            virtual void on_connect_error(const socket_address* saddr,
+                int error, void* context);
+
+            /**
+             * @brief on_receive event.
+             *
+             * Fires from the peer's thread whenever data can be read, see
+             * tuxnet::server::on_receive().
+             *
+             * @param remote_peer : peer object representing the connection.
+             */
+            virtual void on_receive(peer* remote_peer);
+
+            /**
+             * @brief on_disconnect event.
+             *
+             * Fires when a connection is closed, by either side.
+             *
+             * @param remote_peer : peer object representing the connection.
+             */
+            virtual void on_disconnect(peer* remote_peer);
+
+    };
+
+}
+
+#endif
@@ -1,32 +1,140 @@
+#ifndef TUXNET_CONFIG_H_INCLUDE
+#define TUXNET_CONFIG_H_INCLUDE
+
+#include <atomic>
 #include <mutex>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace tuxnet
 {
     /**
      * The tuxnet configuration interface.
+     *
+     * Every parameter has a getter and a validating setter, and can also be
+     * set by name from a key=value file or from the environment :
+     *
+     * | key                            | environment variable                  | live |
+     * | ------------------------------ | ------------------------------------- | ---- |
+     * | busy_poll_usec                 | TUXNET_BUSY_POLL_USEC                 | yes  |
+     * | connect_timeout_ms             | TUXNET_CONNECT_TIMEOUT_MS             | yes  |
+     * | flight_recorder_events         | TUXNET_FLIGHT_RECORDER_EVENTS         | no   |
+     * | listen_socket_epoll_max_events | TUXNET_LISTEN_SOCKET_EPOLL_MAX_EVENTS | yes  |
+     * | listen_socket_epoll_min_events | TUXNET_LISTEN_SOCKET_EPOLL_MIN_EVENTS | yes  |
+     * | listen_socket_epoll_timeout    | TUXNET_LISTEN_SOCKET_EPOLL_TIMEOUT    | yes  |
+     * | peer_socket_epoll_max_events   | TUXNET_PEER_SOCKET_EPOLL_MAX_EVENTS   | yes  |
+     * | peer_socket_epoll_min_events   | TUXNET_PEER_SOCKET_EPOLL_MIN_EVENTS   | yes  |
+     * | peer_socket_epoll_timeout      | TUXNET_PEER_SOCKET_EPOLL_TIMEOUT      | yes  |
+     * | perf_counters                  | TUXNET_PERF_COUNTERS                  | no   |
+     * | rx_timestamps                  | TUXNET_RX_TIMESTAMPS                  | no   |
+     * | server_max_threads             | TUXNET_SERVER_MAX_THREADS             | no   |
+     * | server_min_threads             | TUXNET_SERVER_MIN_THREADS             | no   |
+     * | tcp_info_interval_ms           | TUXNET_TCP_INFO_INTERVAL_MS           | yes  |
+     * | watchdog_threshold_ms          | TUXNET_WATCHDOG_THRESHOLD_MS          | yes  |
+     *
+     * When the config singleton is first used, the file named by the
+     * TUXNET_CONFIG environment variable (if any) is loaded, followed by the
+     * TUXNET_* environment variables.
+     *
+     * Parameters marked live are picked up by running event loops, the
+     * others only take effect for sockets and threads created afterwards.
+     * reload() re-reads the last loaded file and applies only the live
+     * parameters, so it's safe to call on a running server (for instance
+     * from a SIGHUP handler thread).
      */
     class config
     {
 
+        /// Describes a parameter that can be set by name.
+        struct option
+        {
+            /// Key used in files, lower case.
+            const char* name;
+            /// Member holding the value.
+            std::atomic<int> config::* member;
+            /// Smallest accepted value.
+            int min;
+            /// Largest accepted value.
+            int max;
+            /// True if running event loops pick up changes.
+            bool live;
+        };
+
+        /// Collection of (key, value) pairs read from a file or environment.
+        typedef std::vector<std::pair<std::string, std::string>> settings;
+
         // Private member variables. ------------------------------------------
 
-        /// Maximum number of client threads.
-        int m_client_max_threads;
-        /// Minimum number of client threads.
-        int m_client_min_threads;
+        /// Microseconds to busy-poll before blocking in epoll_wait.
+        std::atomic<int> m_busy_poll_usec;
+        /// Time a client connection attempt may take (ms).
+        std::atomic<int> m_connect_timeout_ms;
+        /// Events kept per thread by the flight recorder.
+        std::atomic<int> m_flight_recorder_events;
         /// Holds singleton pointer to itself, instantiated on first use.
         static std::unique_ptr<config> m_instance;
         /// once_flag indicating if instance has already been allocated.
         static std::once_flag m_instance_allocated;
         /// Epoll event buffer size for listen sockets.
-        int m_listen_socket_epoll_max_events;
+        std::atomic<int> m_listen_socket_epoll_max_events;
+        /// Smallest adaptive epoll event buffer size for listen sockets.
+        std::atomic<int> m_listen_socket_epoll_min_events;
+        /// epoll_wait timeout for listen sockets (ms).
+        std::atomic<int> m_listen_socket_epoll_timeout;
+        /// Serializes loading, reloading and the min/max setters.
+        std::mutex m_lock;
+        /// Table of parameters that can be set by name.
+        static const option m_options[];
+        /// Path of the last loaded file.
+        std::string m_path;
         /// Epoll event buffer size for peer sockets.
-        int m_peer_socket_epoll_max_events;
+        std::atomic<int> m_peer_socket_epoll_max_events;
+        /// Smallest adaptive epoll event buffer size for peer sockets.
+        std::atomic<int> m_peer_socket_epoll_min_events;
+        /// epoll_wait timeout for peer sockets (ms).
+        std::atomic<int> m_peer_socket_epoll_timeout;
+        /// Whether event loops count hardware events (0 or 1).
+        std::atomic<int> m_perf_counters;
+        /// Whether peers measure receive queueing delay (0 or 1).
+        std::atomic<int> m_rx_timestamps;
         /// Maximum number of server threads.
-        int m_server_max_threads;
+        std::atomic<int> m_server_max_threads;
         /// Minimum number of server threads.
-        int m_server_min_threads;
+        std::atomic<int> m_server_min_threads;
+        /// Time between TCP_INFO samples of all peers (ms).
+        std::atomic<int> m_tcp_info_interval_ms;
+        /// Time an event loop may stay away from epoll_wait (ms).
+        std::atomic<int> m_watchdog_threshold_ms;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Validates and applies a set of values.
+         *
+         * Either all values are applied, or none are.
+         *
+         * @param values : (key, value) pairs to apply.
+         * @param origin : Where the values came from, used in messages.
+         * @param live_only : Skip (and report) changes to parameters that
+         *                    can't change on a running server.
+         * @return Returns true if the values were valid and applied.
+         */
+        bool m_apply(const settings& values, const std::string& origin,
+            bool live_only);
+
+        /// Finds the option with the given key, or returns nullptr.
+        static const option* m_find(const std::string& key);
+
+        /**
+         * Reads key=value pairs from a file.
+         * @return Returns true on success.
+         */
+        static bool m_read_file(const std::string& path, settings& values);
+
+        /// Sets a single option after validating its range.
+        bool m_set(std::atomic<int> config::* member, int value);
 
         public:
 
@@ -45,27 +153,260 @@ namespace tuxnet
              **/
             static config& get();
 
-            /// Get maximum number of threads for communication with clients.
-            int const get_client_max_threads();
+            /**
+             * Get busy-poll duration.
+             *
+             * When higher than 0, event loops call epoll_wait without
+             * blocking for up to this many microseconds before they block,
+             * and accepted sockets get SO_BUSY_POLL set to the same value
+             * (when permitted). This lowers wakeup latency at the cost of
+             * CPU time, which is mostly worth it on dedicated machines.
+             */
+            int const get_busy_poll_usec();
 
-            /// Get minimum number of threads for communication with clients.
-            int const get_client_min_threads();
+            /**
+             * Get time a client connection attempt may take.
+             * @return Returns the timeout in milliseconds, 0 means attempts
+             *         only fail when the kernel gives up.
+             */
+            int const get_connect_timeout_ms();
 
-            /// Get epoll event buffer size for listen sockets.
+            /**
+             * Get number of events the flight recorder keeps per thread.
+             * @return Returns the ring size, 0 means the flight recorder is
+             *         disabled.
+             */
+            int const get_flight_recorder_events();
+
+            /**
+             * Get epoll event buffer size for listen sockets.
+             *
+             * Event buffers are sized adaptively from recent readiness
+             * counts, this is the largest size they grow to.
+             */
             int const get_listen_socket_epoll_max_events();
-            
-            /// Get epoll event buffer size for peer sockets.
+
+            /// Get smallest adaptive epoll event buffer size for listen sockets.
+            int const get_listen_socket_epoll_min_events();
+
+            /**
+             * Get epoll_wait timeout for listen sockets.
+             * @return Returns the timeout in milliseconds, -1 means wait
+             *         indefinitely.
+             */
+            int const get_listen_socket_epoll_timeout();
+
+            /**
+             * Get epoll event buffer size for peer sockets.
+             *
+             * Event buffers are sized adaptively from recent readiness
+             * counts, this is the largest size they grow to.
+             */
             int const get_peer_socket_epoll_max_events();
 
+            /// Get smallest adaptive epoll event buffer size for peer sockets.
+            int const get_peer_socket_epoll_min_events();
+
+            /**
+             * Get epoll_wait timeout for peer sockets.
+             * @return Returns the timeout in milliseconds, -1 means wait
+             *         indefinitely.
+             */
+            int const get_peer_socket_epoll_timeout();
+
+            /**
+             * Get whether event loops count hardware events.
+             * @return Returns 1 if enabled, 0 if disabled.
+             */
+            int const get_perf_counters();
+
+            /**
+             * Get whether peers measure receive queueing delay.
+             * @return Returns 1 if enabled, 0 if disabled.
+             */
+            int const get_rx_timestamps();
+
             /// Get maximum number of threads for accepting connections.
             int const get_server_max_threads();
 
             /// Get minimum number of threads for accepting connections.
             int const get_server_min_threads();
 
+            /**
+             * Get time between TCP_INFO samples of all peers.
+             * @return Returns the interval in milliseconds, 0 means the TCP
+             *         sampler is disabled.
+             */
+            int const get_tcp_info_interval_ms();
+
+            /**
+             * Get event loop stall threshold.
+             *
+             * The watchdog reports event loops which haven't returned to
+             * epoll_wait for longer than this, typically because of a slow
+             * callback.
+             *
+             * @return Returns the threshold in milliseconds, 0 means the
+             *         watchdog is disabled.
+             */
+            int const get_watchdog_threshold_ms();
+
+            /**
+             * Set busy-poll duration in microseconds, 0 disables.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_busy_poll_usec(int usec);
+
+            /**
+             * Set time a client connection attempt may take in milliseconds,
+             * 0 leaves it to the kernel (see tuxnet::client::connect()).
+             * @return Returns false if the value is out of range.
+             */
+            bool set_connect_timeout_ms(int timeout);
+
+            /**
+             * Set number of events the flight recorder keeps per thread, 0
+             * disables it.
+             *
+             * Every thread that records gets a ring of this many 32 byte
+             * events the first time it does, see flight_recorder.
+             *
+             * @return Returns false if the value is out of range.
+             */
+            bool set_flight_recorder_events(int events);
+
+            /**
+             * Set epoll event buffer size for listen sockets.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_listen_socket_epoll_max_events(int events);
+
+            /**
+             * Set smallest adaptive epoll event buffer size for listen
+             * sockets.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_listen_socket_epoll_min_events(int events);
+
+            /**
+             * Set epoll_wait timeout for listen sockets in milliseconds, -1
+             * waits indefinitely.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_listen_socket_epoll_timeout(int timeout);
+
+            /**
+             * Set epoll event buffer size for peer sockets.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_peer_socket_epoll_max_events(int events);
+
+            /**
+             * Set smallest adaptive epoll event buffer size for peer sockets.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_peer_socket_epoll_min_events(int events);
+
+            /**
+             * Set epoll_wait timeout for peer sockets in milliseconds, -1
+             * waits indefinitely.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_peer_socket_epoll_timeout(int timeout);
+
+            /**
+             * Set whether event loops count hardware events (1) or not (0).
+             *
+             * Every event loop thread then opens its own group of hardware
+             * counters (see perf_group), which costs four file descriptors
+             * and two read() calls per epoll wakeup.
+             *
+             * @return Returns false if the value is out of range.
+             */
+            bool set_perf_counters(int enabled);
+
+            /**
+             * Set whether peers measure receive queueing delay (1) or not
+             * (0).
+             *
+             * Peers accepted afterwards ask the kernel for software receive
+             * timestamps (SO_TIMESTAMPING) and read with recvmsg(), so the
+             * time data waited in the socket before on_receive() started can
+             * be recorded as LATENCY_RECEIVE_QUEUE.
+             *
+             * @return Returns false if the value is out of range.
+             */
+            bool set_rx_timestamps(int enabled);
+
+            /**
+             * Set maximum number of threads for accepting connections.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_server_max_threads(int threads);
+
+            /**
+             * Set minimum number of threads for accepting connections.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_server_min_threads(int threads);
+
+            /**
+             * Set time between TCP_INFO samples of all peers in
+             * milliseconds, 0 disables the TCP sampler.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_tcp_info_interval_ms(int interval);
+
+            /**
+             * Set event loop stall threshold in milliseconds, 0 disables
+             * the watchdog.
+             * @return Returns false if the value is out of range.
+             */
+            bool set_watchdog_threshold_ms(int threshold);
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Sets a parameter by name.
+             *
+             * @param key : Parameter name, as listed in the table above.
+             * @param value : New value.
+             * @return Returns false if the key is unknown or the value is
+             *         invalid.
+             */
+            bool set(const std::string& key, const std::string& value);
+
+            /**
+             * Loads parameters from a file.
+             *
+             * The file holds one `key = value` pair per line. Empty lines and
+             * lines starting with `#` are ignored. Nothing is applied if any
+             * line is invalid.
+             *
+             * @param path : Path of the file.
+             * @return Returns true if the file was loaded.
+             */
+            bool load_file(const std::string& path);
+
+            /**
+             * Loads parameters from TUXNET_* environment variables.
+             * @return Returns true if all variables found were valid.
+             */
+            bool load_env();
+
+            /**
+             * Re-reads the last loaded file and applies the live parameters.
+             *
+             * Changes to parameters which can't be changed on a running
+             * server are reported and ignored. Nothing is applied if the file
+             * is invalid.
+             *
+             * @return Returns true if the file was reloaded.
+             */
+            bool reload();
 
-            /// @todo setters.
-    
     };
 
 }
+
+#endif
@@ -0,0 +1,304 @@
+/**
+ * Pooled keep-alive connections to upstream services.
+ **/
+
+#ifndef TUXNET_CONNECTION_POOL_H_INCLUDE
+#define TUXNET_CONNECTION_POOL_H_INCLUDE
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "tuxnet/client.h"
+#include "tuxnet/peer.h"
+#include "tuxnet/socket_address.h"
+
+namespace tuxnet
+{
+
+    /// Limits of a connection pool, applied to every backend.
+    struct pool_options
+    {
+        /// Idle connections kept per backend, more are closed on release.
+        int max_idle = 8;
+        /// Connections per backend, counting busy, idle and connecting ones.
+        int max_total = 64;
+        /// Idle connections per backend a thread keeps for itself.
+        int thread_cache = 2;
+        /// Milliseconds between health checks of idle connections, 0 never.
+        int health_check_ms = 5000;
+        /// Idle connections unused for longer are closed, 0 never.
+        int idle_timeout_ms = 60000;
+        /// Connect timeout, see tuxnet::client::connect().
+        int connect_timeout_ms = -1;
+    };
+
+    /// Connections and counters of a single backend.
+    struct pool_backend_stats
+    {
+        /// Established connections not in use.
+        int idle;
+        /// Established connections in use.
+        int busy;
+        /// Connection attempts in progress.
+        int connecting;
+        /// Times acquire() handed out a connection used before.
+        uint64_t reused;
+        /// Connection attempts started.
+        uint64_t created;
+        /// Connection attempts which failed.
+        uint64_t failed;
+        /// Idle connections closed by health checks or the idle timeout.
+        uint64_t expired;
+    };
+
+    /**
+     * Pool of keep-alive connections, keyed by backend address.
+     *
+     * acquire() hands out an idle connection to the backend, or starts a
+     * new one if the backend has fewer than max_total connections, and
+     * release() gives it back once the request/response exchange is done.
+     *
+     * A connection released by the thread which acquired it goes to a small
+     * cache of that thread first, so a thread (such as the peer thread of a
+     * server connection forwarding requests) keeps reusing its own
+     * connections without taking a lock. Connections released elsewhere
+     * (such as from on_response()), or when that cache is full, go to the
+     * backend's shared idle list. A thread which finds neither an idle
+     * connection nor room for a new one takes back connections idling in
+     * the caches of other threads, so cached connections never count
+     * against max_total unused. A connection is handed out by whoever
+     * flips its state from idle to busy first, so the health checker and
+     * the connection's own thread can't race an acquire.
+     *
+     * Idle connections are checked in the background every health_check_ms:
+     * anything to read (EOF, or data nobody asked for) or a TCP state other
+     * than established means the connection can't be reused, and it's
+     * closed, as are connections idle for longer than idle_timeout_ms.
+     * Closing an idle connection is left to its own thread by shutting the
+     * socket down, so no peer is deleted under someone else's feet.
+     *
+     * Use tuxnet::client::configure_connect() to pick the source address
+     * and port range, which keeps heavy fan-out from running out of
+     * ephemeral ports.
+     *
+     * Derive from this class and override on_response() to read responses,
+     * which fires from the connection's thread, like on_receive.
+     */
+    class connection_pool : public client
+    {
+
+        struct backend;
+        struct connection;
+        struct thread_cache;
+
+        // Private member variables. ------------------------------------------
+
+        /// Backends by m_key().
+        std::unordered_map<uint64_t, backend*> m_backends;
+        /// Health checker thread.
+        std::thread m_checker;
+        /// Set to stop the health checker.
+        bool m_checker_stopping;
+        /// Wakes the health checker up to stop.
+        std::condition_variable m_checker_wake;
+        /// Wakes acquire() calls waiting for a connection.
+        std::condition_variable m_available;
+        /// Unique id of the pool, for the thread caches.
+        const uint64_t m_id;
+        /// Limits.
+        const pool_options m_options;
+        /// Guards m_backends, the backends and m_checker_stopping.
+        std::mutex m_pool_lock;
+        /// Threads in acquire() which found no thread cached connection.
+        std::atomic<int> m_waiting;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Gets the backend of an address, creating it if needed.
+         *
+         * Call with m_pool_lock held.
+         *
+         * @param key : m_key() of the address.
+         * @param saddr : Address of the backend.
+         * @return Returns the backend.
+         */
+        backend* m_backend(uint64_t key, const socket_address* saddr);
+
+        /**
+         * Closes idle connections which are broken or unused for too long.
+         *
+         * Takes the connections to check with m_pool_lock held, which keeps
+         * their peers from being deleted meanwhile, then unlocks it to probe
+         * them through duplicates of their sockets.
+         *
+         * @param lock : Holds m_pool_lock, held again on return.
+         */
+        void m_check(std::unique_lock<std::mutex>& lock);
+
+        /**
+         * Gets the key of a backend address.
+         * @param saddr : IPv4 address of the backend.
+         * @return Returns the address and port in a single number.
+         */
+        static uint64_t m_key(const socket_address* saddr);
+
+        /// Runs health checks until stopped.
+        void m_run_checker();
+
+        /**
+         * Hands out an idle connection.
+         * @param conn : Connection to take.
+         * @return Returns false if the connection wasn't idle.
+         */
+        static bool m_take(connection* conn);
+
+        /**
+         * Gets the cache of the calling thread.
+         * @return Returns the connections the thread released last.
+         */
+        static thread_cache& m_thread_cache();
+
+        /**
+         * Puts an idle connection back in its backend's idle list, unless
+         * it's dead.
+         * @param conn : Connection released.
+         */
+        void m_to_idle(connection* conn);
+
+        /**
+         * Drops a reference to a connection, deleting it with the last.
+         * @param conn : Connection to drop.
+         */
+        static void m_unref(connection* conn);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             *
+             * Starts the health checker if health_check_ms is set.
+             *
+             * @param options : (optional) Limits of the pool.
+             */
+            connection_pool(const pool_options& options=pool_options());
+
+            /**
+             * Destructor.
+             *
+             * Stops the health checker and closes all connections.
+             */
+            virtual ~connection_pool();
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Gets a connection to a backend.
+             *
+             * Tries the connections released by the calling thread, then the
+             * backend's idle list. If there is no idle connection and the
+             * backend has room, a new connection is started, and
+             * on_available() fires once it's established.
+             *
+             * @param saddr : IPv4 address of the backend.
+             * @param timeout_ms : (optional) Milliseconds to wait for a
+             *                     connection, 0 to return right away.
+             * @return Returns a connection, owned by the caller until
+             *         release(), or nullptr with errno set to EAGAIN (none
+             *         available), ETIMEDOUT, or the error of a connection
+             *         attempt which failed while waiting.
+             */
+            peer* acquire(const socket_address* const saddr,
+                int timeout_ms=0);
+
+            /**
+             * @brief Gets the connections and counters of a backend.
+             * @param saddr : IPv4 address of the backend.
+             * @return Returns all zeros for unknown backends.
+             */
+            pool_backend_stats backend_stats(
+                const socket_address* const saddr);
+
+            /**
+             * @brief Gets the limits of the pool.
+             * @return Returns the options the pool was created with.
+             */
+            const pool_options& get_options() const;
+
+            /**
+             * @brief Gives a connection back to the pool.
+             *
+             * The connection becomes idle, unless it's not reusable (such
+             * as after an incomplete response) or the backend already has
+             * max_idle idle connections, in which case it's closed.
+             *
+             * @param remote_peer : Connection returned by acquire().
+             * @param reusable : (optional) Set to false to close it.
+             */
+            void release(peer* remote_peer, bool reusable=true);
+
+        protected:
+
+            // Events. --------------------------------------------------------
+
+            /**
+             * @brief on_available event.
+             *
+             * Fires from the connector thread when a connection started by
+             * acquire() was established and is idle.
+             *
+             * @param saddr : Address of the backend.
+             */
+            virtual void on_available(const socket_address* saddr);
+
+            /**
+             * @brief on_backend_error event.
+             *
+             * Fires from the connector thread when a connection attempt
+             * failed or timed out.
+             *
+             * @param saddr : Address of the backend.
+             * @param error : errno value, ETIMEDOUT for timeouts.
+             */
+            virtual void on_backend_error(const socket_address* saddr,
+                int error);
+
+            /**
+             * @brief on_lost event.
+             *
+             * Fires from the connection's thread when an acquired connection
+             * closed before it was released. The peer is deleted afterwards.
+             *
+             * @param remote_peer : Connection that closed.
+             */
+            virtual void on_lost(peer* remote_peer);
+
+            /**
+             * @brief on_response event.
+             *
+             * Fires from the connection's thread whenever data can be read
+             * from an acquired connection.
+             *
+             * @param remote_peer : Connection to read from.
+             */
+            virtual void on_response(peer* remote_peer);
+
+            // Client events, used by the pool. -------------------------------
+
+            void on_connect(peer* remote_peer) override final;
+            void on_connect_error(const socket_address* saddr, int error,
+                void* context) override final;
+            void on_receive(peer* remote_peer) override final;
+            void on_disconnect(peer* remote_peer) override final;
+
+    };
+
+}
+
+#endif
@@ -1,9 +1,88 @@
 #ifndef TUXNET_EVENT_H_INCLUDE
 #define TUXNET_EVENT_H_INCLUDE
 
+#include <sys/epoll.h>
+#include <vector>
+
 namespace tuxnet
 {
 
+    /**
+     * Adaptively sized epoll event buffer.
+     *
+     * Wraps epoll_wait() with an event array which is sized from recent
+     * readiness counts : it doubles whenever a wait fills it completely, and
+     * halves when the moving average of events per wakeup drops below a
+     * quarter of its size. The size always stays within the bounds passed
+     * to wait(), which may change between calls.
+     *
+     * Optionally, wait() first busy-polls for a while (epoll_wait with a zero
+     * timeout) before blocking, trading CPU for lower wakeup latency.
+     *
+     * An event_batch is meant to be used by a single thread.
+     */
+    class event_batch
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Moving average of events per wakeup, in 1/16ths.
+        int m_average;
+        /// Event buffer, sized to the current batch size.
+        std::vector<epoll_event> m_events;
+        /// Batch size to use for the next wait.
+        int m_next_size;
+
+        // Private member functions. ------------------------------------------
+
+        /// Resizes the buffer to a new batch size.
+        void m_resize(int size);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param size : Initial batch size.
+             */
+            event_batch(int size=1);
+
+            // Getters. -------------------------------------------------------
+
+            /**
+             * Gets the current batch size.
+             * @return Returns the maximum number of events the next wait()
+             *         can return.
+             */
+            int get_size() const;
+
+            /**
+             * Gets an event returned by the last wait().
+             * @param n : Event index, lower than the value wait() returned.
+             * @return Returns the event.
+             */
+            epoll_event& operator[](int n);
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Waits for events.
+             *
+             * @param epoll_fd : Epoll file descriptor to wait on.
+             * @param min_events : Smallest batch size to shrink to.
+             * @param max_events : Largest batch size to grow to.
+             * @param timeout : Milliseconds to block, -1 blocks indefinitely.
+             * @param busy_poll_usec : Microseconds to busy-poll before
+             *                         blocking, 0 disables busy-polling.
+             * @return Returns the number of events, or -1 on error (errno is
+             *         set by epoll_wait).
+             */
+            int wait(int epoll_fd, int min_events, int max_events,
+                int timeout, int busy_poll_usec=0);
+
+    };
+
     /**
      * Creates an event listener.
      *
@@ -0,0 +1,133 @@
+/**
+ * Per thread recording of connection lifecycle events.
+ **/
+
+#ifndef TUXNET_FLIGHT_RECORDER_H_INCLUDE
+#define TUXNET_FLIGHT_RECORDER_H_INCLUDE
+
+#include <cstdint>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/types.h>
+
+namespace tuxnet
+{
+
+    /// Events recorded by the flight recorder.
+    enum flight_event_type
+    {
+        /// A connection was accepted.
+        FLIGHT_ACCEPT = 0,
+        /// The first bytes of a connection were received, value is the size.
+        FLIGHT_FIRST_BYTE,
+        /// recv() returned, value is the size, 0 at EOF or -errno.
+        FLIGHT_READ,
+        /// send() returned, value is the size or -errno.
+        FLIGHT_WRITE,
+        /// recv() had nothing to read.
+        FLIGHT_EAGAIN,
+        /// epoll reported EPOLLHUP or EPOLLERR, value is the event mask.
+        FLIGHT_HANGUP,
+        /// peer::disconnect() was called, value is the disconnect_reason.
+        FLIGHT_DISCONNECT,
+        /// socket::remove_peer() dropped the peer.
+        FLIGHT_REMOVE,
+        /// An outbound connection was established.
+        FLIGHT_CONNECT,
+        /// Number of event types.
+        FLIGHT_EVENT_COUNT
+    };
+
+    /**
+     * Gets the name of a flight recorder event type.
+     * @return Returns a lower case name, such as "first_byte".
+     */
+    const char* flight_event_name(flight_event_type type);
+
+    /// A recorded event.
+    struct flight_event
+    {
+        /// When the event happened (see stats_clock()).
+        uint64_t time;
+        /// Thread that recorded the event.
+        pid_t thread;
+        /// Event type.
+        flight_event_type type;
+        /// File descriptor of the connection.
+        int fd;
+        /// Remote IPv4 address in network byte order, 0 if unknown.
+        in_addr_t ip;
+        /// Remote port, 0 if unknown.
+        in_port_t port;
+        /// Type specific value.
+        int32_t value;
+    };
+
+    /// Collection of flight recorder events.
+    typedef std::vector<flight_event> flight_events;
+
+    /**
+     * Keeps the most recent connection lifecycle events of every thread.
+     *
+     * Every thread records into its own ring of config flight_recorder_events
+     * compact 32 byte events, allocated the first time it records. Recording
+     * never locks or allocates: the thread owns the ring, and each slot is
+     * guarded by a sequence number so dumps running in other threads (or in
+     * a signal handler) skip slots that are being overwritten.
+     *
+     * Rings of threads that exit stay readable, since for a thread per peer
+     * server they hold the last moments of a connection. The 64 most
+     * recently retired rings are kept; older ones are handed to new threads.
+     * Memory is bounded by the peak number of recording threads plus those.
+     */
+    class flight_recorder
+    {
+
+        public:
+
+            flight_recorder() = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Writes all recorded events as text.
+             *
+             * Events are grouped per thread, oldest first. Only uses
+             * async-signal-safe functions, so it can be called from a
+             * signal handler.
+             *
+             * @param fd : File descriptor to write to.
+             * @return Returns false if writing failed.
+             */
+            static bool dump(int fd);
+
+            /**
+             * Dumps all recorded events to stderr when a signal arrives.
+             * @param signal : Signal to install the handler for, such as
+             *                 SIGUSR2.
+             * @return Returns false if the handler couldn't be installed.
+             */
+            static bool dump_on_signal(int signal);
+
+            /**
+             * Gets all recorded events.
+             * @return Returns the events of all threads, oldest first.
+             */
+            static flight_events events();
+
+            /**
+             * Records an event in the calling thread's ring.
+             * @param type : Event type.
+             * @param fd : File descriptor of the connection.
+             * @param ip : Remote IPv4 address in network byte order.
+             * @param port : Remote port.
+             * @param value : (optional) Type specific value.
+             */
+            static void record(flight_event_type type, int fd, in_addr_t ip,
+                in_port_t port, int32_t value=0);
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * Fixed memory tracking of the busiest remote addresses.
+ **/
+
+#ifndef TUXNET_HEAVY_HITTERS_H_INCLUDE
+#define TUXNET_HEAVY_HITTERS_H_INCLUDE
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <netinet/in.h>
+#include "tuxnet/ip_address.h"
+
+namespace tuxnet
+{
+
+    /// What heavy_hitters ranks remote addresses by.
+    enum heavy_hitter_metric
+    {
+        /// Accepted connections.
+        HEAVY_HITTER_CONNECTIONS = 0,
+        /// Received bytes.
+        HEAVY_HITTER_BYTES,
+        /// Number of metrics.
+        HEAVY_HITTER_METRIC_COUNT
+    };
+
+    /// Estimated counts of a single remote address.
+    struct heavy_hitter
+    {
+        /// Remote address.
+        ip4_address ip;
+        /// Accepted connections, never underestimated.
+        uint64_t connections;
+        /// Received bytes, never underestimated.
+        uint64_t bytes;
+    };
+
+    /// Collection of heavy hitters.
+    typedef std::vector<heavy_hitter> heavy_hitter_list;
+
+    /**
+     * Count-min sketch of 32 bit keys.
+     *
+     * Every key is counted in one counter of each of m_depth rows, picked by
+     * a different hash per row. Keys sharing a counter add up, so the
+     * smallest of a key's counters is an upper bound of its count, which
+     * overestimates by at most 2/m_width of the total with high probability.
+     * Memory is fixed at m_depth * m_width counters. Counters are relaxed
+     * atomics, so any thread can add.
+     */
+    class count_min_sketch
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Number of rows.
+        static const int m_depth = 4;
+        /// log2 of the number of counters per row.
+        static const int m_width_bits = 11;
+        /// Number of counters per row.
+        static const int m_width = 1 << m_width_bits;
+
+        /// Counters, row after row.
+        std::atomic<uint64_t> m_counts[m_depth * m_width];
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Gets the counter index of a key in a row.
+         * @param row : Row, 0 to m_depth - 1.
+         * @param key : Key to hash.
+         * @return Returns an index into m_counts.
+         */
+        static int m_index(int row, uint32_t key);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor, all counts start at 0.
+            count_min_sketch();
+
+            count_min_sketch(const count_min_sketch&) = delete;
+            count_min_sketch& operator=(const count_min_sketch&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Counts a key.
+             * @param key : Key to count.
+             * @param count : Amount to add.
+             * @return Returns the estimated count of the key afterwards.
+             */
+            uint64_t add(uint32_t key, uint64_t count);
+
+            /// Resets all counts to 0.
+            void clear();
+
+            /**
+             * Estimates the count of a key.
+             * @param key : Key to look up.
+             * @return Returns an upper bound of the key's count.
+             */
+            uint64_t estimate(uint32_t key) const;
+
+    };
+
+    /**
+     * Tracks the remote addresses with the most connections and bytes.
+     *
+     * Every metric has a count_min_sketch and a table of m_capacity
+     * candidates. Counting costs the sketch's m_depth hashed increments plus
+     * a scan of the candidate table; the table's lock is only taken when an
+     * address that isn't a candidate yet overtakes the smallest candidate.
+     * Memory is constant no matter how many addresses are seen.
+     *
+     * Counts cover everything since construction or the last clear().
+     */
+    class heavy_hitters
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Candidates tracked per metric.
+        static const int m_capacity = 16;
+
+        /// Candidate addresses per metric in network byte order, 0 if free.
+        std::atomic<uint32_t> m_candidates[HEAVY_HITTER_METRIC_COUNT]
+            [m_capacity];
+        /// Guards replacing candidates.
+        std::mutex m_lock;
+        /// Counts per metric.
+        count_min_sketch m_sketches[HEAVY_HITTER_METRIC_COUNT];
+        /**
+         * Smallest candidate estimate per metric when the table was last
+         * changed, 0 while it has free slots. Estimates only grow, so this
+         * never exceeds the current smallest one.
+         */
+        std::atomic<uint64_t> m_thresholds[HEAVY_HITTER_METRIC_COUNT];
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Makes an address a candidate, replacing the smallest one.
+         * @param metric : Metric to update the candidates of.
+         * @param ip : Address in network byte order.
+         * @param estimate : Estimated count of the address.
+         */
+        void m_promote(heavy_hitter_metric metric, uint32_t ip,
+            uint64_t estimate);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor.
+            heavy_hitters();
+
+            heavy_hitters(const heavy_hitters&) = delete;
+            heavy_hitters& operator=(const heavy_hitters&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Counts for an address.
+             * @param metric : Metric to count.
+             * @param ip : Address in network byte order, 0 is ignored.
+             * @param count : (optional) Amount to add.
+             */
+            void add(heavy_hitter_metric metric, in_addr_t ip,
+                uint64_t count=1);
+
+            /// Forgets all counts and candidates.
+            void clear();
+
+            /**
+             * Gets the busiest addresses.
+             * @param metric : Metric to rank by.
+             * @param count : (optional) Maximum number of addresses, at most
+             *                16.
+             * @return Returns the addresses, busiest first, with estimates of
+             *         both metrics.
+             */
+            heavy_hitter_list top(heavy_hitter_metric metric,
+                int count=m_capacity);
+
+    };
+
+}
+
+#endif
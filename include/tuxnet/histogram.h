@@ -0,0 +1,184 @@
+/**
+ * Log-bucketed latency histograms.
+ **/
+
+#ifndef TUXNET_HISTOGRAM_H_INCLUDE
+#define TUXNET_HISTOGRAM_H_INCLUDE
+
+#include <atomic>
+#include <cstdint>
+
+namespace tuxnet
+{
+
+    /**
+     * Bucket layout shared by histogram and histogram_snapshot.
+     *
+     * Values below 2^sub_bucket_bits get a bucket each. Above that, every
+     * power of two is split into 2^sub_bucket_bits linear buckets, the same
+     * scheme HdrHistogram uses. A value recorded in a bucket is reported as
+     * the highest value of that bucket, which is at most 1/16 (6.25%) above
+     * the real value. Values above max_value are clamped.
+     */
+    struct histogram_buckets
+    {
+        /// Number of linear sub-buckets per power of two, as a power of two.
+        static const int sub_bucket_bits = 4;
+        /// Number of bits of the largest recordable value.
+        static const int value_bits = 40;
+        /// Number of buckets.
+        static const int count =
+            (value_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+        /// Largest recordable value (about 18 minutes in nanoseconds).
+        static const uint64_t max_value = (uint64_t(1) << value_bits) - 1;
+
+        /**
+         * Gets the bucket a value is counted in.
+         * @param value : Value to look up, clamped to max_value.
+         * @return Returns a bucket index lower than count.
+         */
+        static int index(uint64_t value);
+
+        /**
+         * Gets the highest value counted in a bucket.
+         * @param index : Bucket index.
+         * @return Returns the highest value which maps to the bucket.
+         */
+        static uint64_t highest(int index);
+    };
+
+    /**
+     * Histogram recorded into by a single thread.
+     *
+     * record() does a relaxed load and store on one counter, other threads
+     * can read a consistent-enough copy at any time with
+     * histogram_snapshot::add().
+     */
+    class histogram
+    {
+
+        friend class histogram_snapshot;
+
+        // Private member variables. ------------------------------------------
+
+        /// Counts per bucket.
+        std::atomic<uint64_t> m_counts[histogram_buckets::count];
+        /// Sum of all recorded values.
+        std::atomic<uint64_t> m_sum;
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor, all buckets start empty.
+            histogram();
+
+            histogram(const histogram&) = delete;
+            histogram& operator=(const histogram&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Records a value. Only the owning thread may call this.
+             * @param value : Value to record.
+             */
+            void record(uint64_t value)
+            {
+                std::atomic<uint64_t>& counter =
+                    m_counts[histogram_buckets::index(value)];
+                counter.store(counter.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+                m_sum.store(m_sum.load(std::memory_order_relaxed) + value,
+                    std::memory_order_relaxed);
+            }
+
+    };
+
+    /**
+     * Plain copy of one or more histograms, used to merge and query them.
+     */
+    class histogram_snapshot
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Counts per bucket.
+        uint64_t m_counts[histogram_buckets::count];
+        /// Sum of all recorded values.
+        uint64_t m_sum;
+        /// Sum of all counts.
+        uint64_t m_total;
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor, all buckets start empty.
+            histogram_snapshot();
+
+            // Getters. -------------------------------------------------------
+
+            /**
+             * Gets the count of a single bucket.
+             * @param index : Bucket index, see histogram_buckets.
+             * @return Returns the number of values counted in the bucket.
+             */
+            uint64_t bucket(int index) const;
+
+            /// Gets the number of recorded values.
+            uint64_t count() const;
+
+            /**
+             * Gets the highest recorded value.
+             * @return Returns the highest value of the highest non-empty
+             *         bucket, or 0 if the histogram is empty.
+             */
+            uint64_t max() const;
+
+            /**
+             * Gets a percentile.
+             * @param percentile : Percentile, between 0 and 100.
+             * @return Returns the highest value of the bucket holding the
+             *         percentile, or 0 if the histogram is empty.
+             */
+            uint64_t percentile(double percentile) const;
+
+            /// Gets the exact sum of all recorded values.
+            uint64_t sum() const;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Adds the counts of a live histogram.
+             * @param other : Histogram to merge in.
+             */
+            void add(const histogram& other);
+
+            /**
+             * Adds the counts of another snapshot.
+             * @param other : Snapshot to merge in.
+             */
+            void add(const histogram_snapshot& other);
+
+            /// Empties all buckets.
+            void clear();
+
+            /**
+             * Records a value.
+             * @param value : Value to record.
+             * @param count : (optional) Number of times to record it.
+             */
+            void record(uint64_t value, uint64_t count=1);
+
+            /**
+             * Subtracts the counts of an earlier snapshot of the same
+             * histograms, leaving what was recorded in between.
+             * @param earlier : Snapshot taken before this one.
+             */
+            void subtract(const histogram_snapshot& earlier);
+
+    };
+
+}
+
+#endif
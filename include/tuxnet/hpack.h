@@ -0,0 +1,320 @@
+/**
+ * HPACK header compression for HTTP/2 (RFC 7541).
+ **/
+
+#ifndef TUXNET_HPACK_H_INCLUDE
+#define TUXNET_HPACK_H_INCLUDE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tuxnet/http.h"
+
+namespace tuxnet
+{
+
+    /// Entries of the HPACK static table.
+    const size_t hpack_static_count = 61;
+
+    /**
+     * HPACK dynamic table.
+     *
+     * Entries are copied back to back into a single buffer, which is twice
+     * the table's size and compacted once its end is reached, and indexed
+     * by a ring of offsets, so adding and evicting entries doesn't allocate
+     * memory.
+     */
+    class hpack_table
+    {
+
+        /// Position of an entry in the buffer.
+        struct entry
+        {
+            size_t offset;
+            uint32_t name_length;
+            uint32_t value_length;
+        };
+
+        // Private member variables. ------------------------------------------
+
+        /// Names and values, starting at m_base.
+        std::string m_data;
+        /// Offset of the start of m_data.
+        size_t m_base;
+        /// Entries, a ring holding as many as can possibly fit.
+        std::vector<entry> m_ring;
+        /// Position of the newest entry in the ring.
+        size_t m_newest;
+        /// Entries in the table.
+        size_t m_count;
+        /// Size of the table, 32 bytes of overhead per entry included.
+        size_t m_size;
+        /// Most the table can hold.
+        size_t m_max_size;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Evicts the oldest entries until the table has room.
+         * @param room : Bytes needed.
+         */
+        void m_evict(size_t room);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param max_size : (optional) Most the table can hold.
+             */
+            hpack_table(size_t max_size=4096);
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Adds an entry, evicting old ones to make room.
+             *
+             * Entries larger than the table empty it and aren't added.
+             *
+             * @param name : Field name.
+             * @param value : Field value.
+             */
+            void add(std::string_view name, std::string_view value);
+
+            /**
+             * @brief Finds an entry.
+             * @param name : Field name.
+             * @param value : Field value.
+             * @param exact : Set if the value matched too.
+             * @return Returns the entry's index (0 for the newest) plus one,
+             *         0 if no entry has that name.
+             */
+            size_t find(std::string_view name, std::string_view value,
+                bool& exact) const;
+
+            /**
+             * @brief Gets an entry.
+             *
+             * Its views are valid until the next entry is added.
+             *
+             * @param index : Index of the entry, 0 for the newest.
+             * @param field : Set to the entry.
+             * @return Returns false if there's no such entry.
+             */
+            bool get(size_t index, http_header& field) const;
+
+            /**
+             * @brief Gets the number of entries.
+             * @return Returns the number of entries.
+             */
+            size_t get_count() const;
+
+            /**
+             * @brief Gets the size of the table.
+             * @return Returns the bytes used, entry overhead included.
+             */
+            size_t get_size() const;
+
+            /**
+             * @brief Gets the most the table can hold.
+             * @return Returns the maximum size.
+             */
+            size_t get_max_size() const;
+
+            /**
+             * @brief Changes the most the table can hold.
+             * @param max_size : New maximum size, evicting what's over.
+             */
+            void set_max_size(size_t max_size);
+
+    };
+
+    /**
+     * HPACK decoder, one per connection.
+     *
+     * Decoded fields point into the header block for literals sent as is,
+     * into the static table for static entries, and into a storage buffer
+     * for everything else (Huffman-coded literals and dynamic entries,
+     * which can be evicted by the same block).
+     */
+    class hpack_decoder
+    {
+
+        /// Where a decoded string is.
+        struct location
+        {
+            /// Start of the string, nullptr if it's in the storage buffer.
+            const char* data;
+            /// Offset of the string in the storage buffer.
+            size_t offset;
+            /// Length of the string.
+            size_t length;
+        };
+
+        /// Decoded field.
+        struct field
+        {
+            location name;
+            location value;
+        };
+
+        // Private member variables. ------------------------------------------
+
+        /// Dynamic table.
+        hpack_table m_table;
+        /// Most the encoder may set the table's size to.
+        const size_t m_max_table_size;
+        /// Largest header list accepted, as defined by HTTP/2.
+        const size_t m_max_list_size;
+        /// Fields of the block being decoded.
+        std::vector<field> m_fields;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Decodes a string literal.
+         * @param in : Start of the literal, moved past it.
+         * @param end : End of the header block.
+         * @param storage : Storage buffer.
+         * @param out : Set to where the decoded string is.
+         * @return Returns false if the literal is malformed.
+         */
+        bool m_string(const uint8_t*& in, const uint8_t* end,
+            std::string& storage, location& out);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param max_table_size : (optional) Most the encoder may set
+             *                         the dynamic table's size to.
+             * @param max_list_size : (optional) Largest header list
+             *                        accepted, 0 for no limit.
+             */
+            hpack_decoder(size_t max_table_size=4096,
+                size_t max_list_size=65536);
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Decodes a complete header block.
+             *
+             * A block which fails to decode leaves the dynamic table out of
+             * step with the encoder's, so the connection has to be closed
+             * (with COMPRESSION_ERROR).
+             *
+             * @param data : Header block.
+             * @param length : Bytes in the header block.
+             * @param headers : Set to the fields, in order, pointing into
+             *                  the block, the static table or storage.
+             * @param storage : Cleared, then holds decoded strings.
+             * @return Returns false if the block is malformed or its
+             *         header list too large.
+             */
+            bool decode(const char* data, size_t length,
+                std::vector<http_header>& headers, std::string& storage);
+
+    };
+
+    /**
+     * HPACK encoder, one per connection.
+     *
+     * Fields found in the static or dynamic table are sent as an index,
+     * others are sent as literals (Huffman-coded when that's shorter) and,
+     * unless told otherwise, added to the dynamic table.
+     */
+    class hpack_encoder
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Dynamic table.
+        hpack_table m_table;
+        /// Most the encoder lets the table hold, whatever the decoder allows.
+        const size_t m_capacity;
+        /// Smallest size set since the last block, SIZE_MAX if none.
+        size_t m_smallest_update;
+        /// Whether the table's size changed since the last block.
+        bool m_size_changed;
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param max_size : (optional) Most the dynamic table holds.
+             */
+            hpack_encoder(size_t max_size=4096);
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Starts a header block.
+             *
+             * Sends pending dynamic table size updates, call it before
+             * encoding the block's first field.
+             *
+             * @param out : Header block to append to.
+             */
+            void begin(std::string& out);
+
+            /**
+             * @brief Encodes a field.
+             * @param out : Header block to append to.
+             * @param name : Field name, lowercase.
+             * @param value : Field value.
+             * @param index : (optional) Whether to add the field to the
+             *                dynamic table, false for values unlikely to
+             *                be sent again.
+             */
+            void encode(std::string& out, std::string_view name,
+                std::string_view value, bool index=true);
+
+            /**
+             * @brief Applies the decoder's SETTINGS_HEADER_TABLE_SIZE.
+             * @param limit : Most the decoder allows the table to hold.
+             */
+            void set_limit(size_t limit);
+
+    };
+
+    /**
+     * Gets an entry of the HPACK static table.
+     * @param index : Index of the entry, 1 to hpack_static_count.
+     * @return Returns the entry.
+     */
+    const http_header& hpack_static_entry(size_t index);
+
+    /**
+     * Decodes a Huffman-coded string.
+     * @param out : String to append to.
+     * @param data : Huffman-coded string.
+     * @param length : Bytes in the coded string.
+     * @return Returns false if the string isn't validly coded.
+     */
+    bool hpack_huffman_decode(std::string& out, const char* data,
+        size_t length);
+
+    /**
+     * Huffman-codes a string.
+     * @param out : String to append to.
+     * @param data : String to code.
+     */
+    void hpack_huffman_encode(std::string& out, std::string_view data);
+
+    /**
+     * Gets the length of a string once Huffman-coded.
+     * @param data : String to code.
+     * @return Returns the length in bytes.
+     */
+    size_t hpack_huffman_length(std::string_view data);
+
+}
+
+#endif
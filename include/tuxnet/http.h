@@ -0,0 +1,254 @@
+/**
+ * Incremental HTTP/1.1 request parsing.
+ **/
+
+#ifndef TUXNET_HTTP_H_INCLUDE
+#define TUXNET_HTTP_H_INCLUDE
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace tuxnet
+{
+
+    /// Header field of a request, pointing into the input buffer.
+    struct http_header
+    {
+        /// Field name, as sent.
+        std::string_view name;
+        /// Field value, without surrounding whitespace.
+        std::string_view value;
+    };
+
+    /**
+     * Request parsed by http_parser.
+     *
+     * All views point into the buffer the request was parsed from, so they
+     * stay valid until that buffer is modified or freed.
+     */
+    struct http_request
+    {
+        /// Request method, such as GET.
+        std::string_view method;
+        /// Request target, such as /index.html?page=2.
+        std::string_view target;
+        /// Major HTTP version, 1 or 2.
+        int version_major;
+        /// Minor HTTP version, 0 or 1 (0 for HTTP/2).
+        int version_minor;
+        /// Header fields in the order they were received.
+        std::vector<http_header> headers;
+        /// Body, already decoded if it was sent chunked.
+        std::string_view body;
+        /// Whether the body was sent chunked.
+        bool chunked;
+        /// Whether the connection stays open after the response.
+        bool keep_alive;
+        /// Bytes the request took in the input, head and body.
+        size_t length;
+
+        /**
+         * Gets a header field.
+         * @param name : Field name, matched case-insensitively.
+         * @return Returns the value of the first matching field, or an
+         *         empty view if there's none.
+         */
+        std::string_view header(std::string_view name) const;
+    };
+
+    /**
+     * Resumable, zero-copy HTTP/1.1 request parser.
+     *
+     * parse() is given everything received for the current request so far,
+     * and picks up where the previous call left off, so data arriving a few
+     * bytes at a time isn't scanned over and over. Header lines are scanned
+     * 16 bytes at a time with SSE2 (where available) for line ends and
+     * control characters. Nothing is copied : the request's fields are views
+     * into the input, and chunked bodies are decoded in place, moving each
+     * chunk down over the chunk headers before it.
+     *
+     * Requests with both Content-Length and Transfer-Encoding, obsolete line
+     * folding, whitespace before a header colon or more than one Host are
+     * rejected, which keeps requests from being read differently by a proxy
+     * in front. HTTP/1.1 requests must have a Host.
+     *
+     * A parser handles a single connection, one request after the other.
+     */
+    class http_parser
+    {
+
+        /// Position of a header field while its request is incomplete.
+        struct field
+        {
+            uint32_t name;
+            uint32_t name_length;
+            uint32_t value;
+            uint32_t value_length;
+        };
+
+        /// Parsing states.
+        enum parse_state
+        {
+            PARSE_HEAD = 0,
+            PARSE_BODY,
+            PARSE_CHUNK_SIZE,
+            PARSE_CHUNK_DATA,
+            PARSE_CHUNK_END,
+            PARSE_TRAILER
+        };
+
+        // Private member variables. ------------------------------------------
+
+        /// Largest head accepted, request line and trailers included.
+        const size_t m_max_head;
+        /// Largest body accepted.
+        const size_t m_max_body;
+        /// Current state.
+        parse_state m_state;
+        /// Where parsing resumes.
+        size_t m_offset;
+        /// Start of the line being parsed.
+        size_t m_line;
+        /// Bytes the head took, once known.
+        size_t m_head_length;
+        /// End of the (decoded) body.
+        size_t m_body_end;
+        /// Body or chunk bytes still expected.
+        uint64_t m_remaining;
+        /// Header fields of the current request.
+        std::vector<field> m_fields;
+        /// Position of the method.
+        field m_request_line;
+        /// Minor HTTP version of the current request, -1 until known.
+        int m_version_minor;
+        /// Whether the current request is chunked.
+        bool m_chunked;
+        /// Whether the client waits for 100 Continue before the body.
+        bool m_expect_continue;
+        /// Status code describing the last error, 0 if none.
+        int m_error;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Fails the current request.
+         * @param status : Status code to answer with.
+         * @return Returns -1.
+         */
+        int m_fail(int status);
+
+        /**
+         * Fills in a request once it's complete, and starts the next one.
+         * @param data : Input the request starts at.
+         * @param request : Request to fill in.
+         * @return Returns 1.
+         */
+        int m_finish(const char* data, http_request& request);
+
+        /**
+         * Works out how the body is delimited, once the head is complete.
+         * @param data : Input the request starts at.
+         * @return Returns 0, or a status code if the body is unacceptable.
+         */
+        int m_framing(const char* data);
+
+        /**
+         * Parses a header line.
+         * @param data : Input the request starts at.
+         * @param start : Start of the line.
+         * @param end : End of the line, line terminator excluded.
+         * @return Returns false if the line is malformed.
+         */
+        bool m_parse_header(const char* data, size_t start, size_t end);
+
+        /**
+         * Parses the request line.
+         * @param data : Input the request starts at.
+         * @param start : Start of the line.
+         * @param end : End of the line, line terminator excluded.
+         * @return Returns 0, or a status code if the line is unacceptable.
+         */
+        int m_parse_request_line(const char* data, size_t start,
+            size_t end);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param max_head : (optional) Largest head accepted.
+             * @param max_body : (optional) Largest body accepted.
+             */
+            http_parser(size_t max_head=65536, size_t max_body=8388608);
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Parses the request at the start of the input.
+             *
+             * Call again with the same input and whatever was received
+             * since, until it returns 1. Chunked bodies are decoded in
+             * place, so the input must be writable, and bytes before the
+             * last input length must not change between calls.
+             *
+             * @param data : Input the request starts at.
+             * @param length : Bytes received so far.
+             * @param request : Filled in once the request is complete.
+             * @return Returns 1 if the request is complete, 0 if more data
+             *         is needed, -1 if it's malformed (see get_error()).
+             */
+            int parse(char* data, size_t length, http_request& request);
+
+            /// Forgets the request being parsed.
+            void reset();
+
+            /**
+             * @brief Checks whether the client waits for 100 Continue.
+             *
+             * That's while the body of an HTTP/1.1 request with Expect:
+             * 100-continue is incomplete.
+             *
+             * @return Returns true if the client should be sent an interim
+             *         100 Continue response.
+             */
+            bool expects_continue() const;
+
+            /**
+             * @brief Gets why the last request was rejected.
+             * @return Returns a status code, such as 400 for malformed
+             *         requests, 413 for bodies over max_body, 431 for heads
+             *         over max_head, 501 for transfer codings other than
+             *         chunked and 505 for HTTP versions other than 1.x.
+             */
+            int get_error() const;
+
+    };
+
+    /// Length of an HTTP date, such as "Sun, 06 Nov 1994 08:49:37 GMT".
+    const size_t http_date_length = 29;
+
+    /**
+     * Gets the current time as an HTTP date, for the Date header.
+     *
+     * Formatted at most once per second per thread : every thread keeps
+     * the last date it formatted, and only checks the (coarse) clock
+     * otherwise.
+     *
+     * @return Returns http_date_length characters, null terminated, owned
+     *         by the calling thread and updated by its next call.
+     */
+    const char* http_date();
+
+    /**
+     * Gets the reason phrase of a status code.
+     * @param status : HTTP status code.
+     * @return Returns the reason phrase, "Unknown" for unknown codes.
+     */
+    const char* http_status_text(int status);
+
+}
+
+#endif
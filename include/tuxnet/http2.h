@@ -0,0 +1,432 @@
+/**
+ * HTTP/2 framing and server-side connection state (RFC 7540).
+ **/
+
+#ifndef TUXNET_HTTP2_H_INCLUDE
+#define TUXNET_HTTP2_H_INCLUDE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tuxnet/hpack.h"
+#include "tuxnet/http.h"
+
+namespace tuxnet
+{
+
+    /// Frame types.
+    enum http2_frame_type
+    {
+        HTTP2_DATA = 0,
+        HTTP2_HEADERS,
+        HTTP2_PRIORITY,
+        HTTP2_RST_STREAM,
+        HTTP2_SETTINGS,
+        HTTP2_PUSH_PROMISE,
+        HTTP2_PING,
+        HTTP2_GOAWAY,
+        HTTP2_WINDOW_UPDATE,
+        HTTP2_CONTINUATION
+    };
+
+    /// Frame flags.
+    enum http2_frame_flag
+    {
+        HTTP2_FLAG_END_STREAM = 0x01,
+        HTTP2_FLAG_ACK = 0x01,
+        HTTP2_FLAG_END_HEADERS = 0x04,
+        HTTP2_FLAG_PADDED = 0x08,
+        HTTP2_FLAG_PRIORITY = 0x20
+    };
+
+    /// Error codes of RST_STREAM and GOAWAY.
+    enum http2_error
+    {
+        HTTP2_NO_ERROR = 0,
+        HTTP2_PROTOCOL_ERROR,
+        HTTP2_INTERNAL_ERROR,
+        HTTP2_FLOW_CONTROL_ERROR,
+        HTTP2_SETTINGS_TIMEOUT,
+        HTTP2_STREAM_CLOSED,
+        HTTP2_FRAME_SIZE_ERROR,
+        HTTP2_REFUSED_STREAM,
+        HTTP2_CANCEL,
+        HTTP2_COMPRESSION_ERROR,
+        HTTP2_CONNECT_ERROR,
+        HTTP2_ENHANCE_YOUR_CALM,
+        HTTP2_INADEQUATE_SECURITY,
+        HTTP2_HTTP_1_1_REQUIRED
+    };
+
+    /// Settings identifiers.
+    enum http2_setting
+    {
+        HTTP2_SETTINGS_HEADER_TABLE_SIZE = 1,
+        HTTP2_SETTINGS_ENABLE_PUSH,
+        HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS,
+        HTTP2_SETTINGS_INITIAL_WINDOW_SIZE,
+        HTTP2_SETTINGS_MAX_FRAME_SIZE,
+        HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE
+    };
+
+    /// Connection preface every client starts with.
+    const std::string_view http2_preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    /// Bytes in a frame header.
+    const size_t http2_frame_header_length = 9;
+
+    /// Settings of one end of an HTTP/2 connection.
+    struct http2_settings
+    {
+        /// Most the HPACK dynamic table decoding its headers may hold.
+        uint32_t header_table_size = 4096;
+        /// Whether server push is allowed (only sent by clients).
+        uint32_t enable_push = 1;
+        /// Most streams the other end may have open at once.
+        uint32_t max_concurrent_streams = 100;
+        /// Flow control window of every stream, to start with.
+        uint32_t initial_window_size = 65535;
+        /// Largest frame payload accepted.
+        uint32_t max_frame_size = 16384;
+        /// Largest header list accepted, 0 for no limit.
+        uint32_t max_header_list_size = 65536;
+    };
+
+    /// Frame header, decoded.
+    struct http2_frame_header
+    {
+        /// Payload length.
+        uint32_t length;
+        /// Frame type, see http2_frame_type.
+        uint8_t type;
+        /// Frame flags, see http2_frame_flag.
+        uint8_t flags;
+        /// Stream identifier, 0 for the connection.
+        uint32_t stream;
+    };
+
+    /**
+     * Decodes a frame header.
+     * @param data : http2_frame_header_length bytes.
+     * @param header : Set to the decoded header.
+     */
+    void http2_read_frame_header(const char* data,
+        http2_frame_header& header);
+
+    /**
+     * Appends a frame header.
+     * @param out : Buffer to append to.
+     * @param length : Payload length.
+     * @param type : Frame type.
+     * @param flags : Frame flags.
+     * @param stream : Stream identifier.
+     */
+    void http2_write_frame_header(std::string& out, uint32_t length,
+        uint8_t type, uint8_t flags, uint32_t stream);
+
+    /**
+     * Server side of an HTTP/2 connection.
+     *
+     * receive() is handed the connection's input buffer and parses frames
+     * in place : header blocks are decoded straight from the buffer (see
+     * hpack_decoder), and a request arriving whole (headers and, if any,
+     * a single DATA frame ending the stream) gets views into that buffer
+     * without being copied. Requests whose body comes in several frames
+     * are gathered per stream until their stream ends. on_request() fires
+     * once a request is complete, for every stream in turn, so any number
+     * of requests are multiplexed over the connection.
+     *
+     * Frames to send (responses, acknowledgements, window updates) are
+     * appended to an output buffer, which the owner of the connection
+     * writes out and clears once receive() returns, so all responses to a
+     * batch of requests go out together. Response bodies obey the peer's
+     * flow control windows : what the windows don't allow is kept per
+     * stream and sent as the peer's WINDOW_UPDATE frames come in. Received
+     * data is acknowledged as it's consumed.
+     *
+     * Server push and priorities aren't supported : PRIORITY frames and
+     * priority fields are ignored.
+     */
+    class http2_session
+    {
+
+        struct stream;
+
+        // Private member variables. ------------------------------------------
+
+        /// Our settings.
+        const http2_settings m_local;
+        /// The client's settings.
+        http2_settings m_remote;
+        /// Largest request body accepted.
+        const size_t m_max_body;
+        /// Receive window of the connection and of every stream.
+        const int64_t m_window;
+        /// Decoder of request headers.
+        hpack_decoder m_decoder;
+        /// Encoder of response headers.
+        hpack_encoder m_encoder;
+        /// Open streams.
+        std::vector<stream*> m_streams;
+        /// Closed streams, kept for reuse.
+        std::vector<stream*> m_free;
+        /// Highest stream opened by the client.
+        uint32_t m_last_stream;
+        /// Connection send window.
+        int64_t m_send_window;
+        /// Connection receive window.
+        int64_t m_receive_window;
+        /// Stream whose header block continues, 0 if none.
+        uint32_t m_continued;
+        /// Flags of the HEADERS frame being continued.
+        uint8_t m_continued_flags;
+        /// Header block gathered from CONTINUATION frames.
+        std::string m_header_block;
+        /// Fields of the last header block.
+        std::vector<http_header> m_fields;
+        /// Decoded strings of the last header block.
+        std::string m_storage;
+        /// Request handed to on_request().
+        http_request m_request;
+        /// Header block of the response being sent.
+        std::string m_block;
+        /// Lowercased name of a response header line.
+        std::string m_name;
+        /// Frames to send.
+        std::string m_output;
+        /// Whether the client preface was received.
+        bool m_preface;
+        /// Whether the connection is going away.
+        bool m_closing;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Applies the payload of a SETTINGS frame.
+         * @param data : Settings.
+         * @param length : Bytes of settings.
+         * @return Returns HTTP2_NO_ERROR, or the connection error.
+         */
+        int m_apply_settings(const char* data, size_t length);
+
+        /**
+         * Builds the request out of a header block's fields.
+         * @param fields : Decoded fields.
+         * @return Returns false if the request is malformed.
+         */
+        bool m_build_request(const std::vector<http_header>& fields);
+
+        /**
+         * Closes a stream and keeps it for reuse.
+         * @param s : Stream to close.
+         */
+        void m_close(stream* s);
+
+        /**
+         * Handles a DATA frame.
+         * @param header : Frame header.
+         * @param payload : Frame payload, in the input buffer.
+         * @return Returns HTTP2_NO_ERROR, or the connection error.
+         */
+        int m_data(const http2_frame_header& header, char* payload);
+
+        /**
+         * Fires on_request() for a stream the client has ended.
+         * @param s : Stream of the request.
+         * @param body : Request body.
+         */
+        void m_dispatch(stream* s, std::string_view body);
+
+        /**
+         * Fails the connection with GOAWAY.
+         * @param error : Error code.
+         * @return Returns -1.
+         */
+        int m_fail(int error);
+
+        /**
+         * Finds an open stream.
+         * @param id : Stream identifier.
+         * @return Returns the stream, or nullptr.
+         */
+        stream* m_find(uint32_t id) const;
+
+        /**
+         * Sends what flow control now allows of a stream's pending data.
+         * @param s : Stream to flush.
+         */
+        void m_flush(stream* s);
+
+        /// Sends what flow control now allows of every stream's data.
+        void m_flush_all();
+
+        /**
+         * Handles a frame.
+         * @param header : Frame header.
+         * @param payload : Frame payload, in the input buffer.
+         * @return Returns HTTP2_NO_ERROR, or the connection error.
+         */
+        int m_frame(const http2_frame_header& header, char* payload);
+
+        /**
+         * Handles a complete header block.
+         * @param id : Stream it opens, or ends with trailers.
+         * @param flags : Flags of its HEADERS frame.
+         * @param block : Header block.
+         * @param length : Bytes in the header block.
+         * @return Returns HTTP2_NO_ERROR, or the connection error.
+         */
+        int m_headers(uint32_t id, uint8_t flags, const char* block,
+            size_t length);
+
+        /**
+         * Opens a stream.
+         * @param id : Stream identifier.
+         * @return Returns the stream.
+         */
+        stream* m_open(uint32_t id);
+
+        /**
+         * Writes DATA frames as far as the flow control windows allow.
+         * @param s : Stream to write to.
+         * @param data : Data to send.
+         * @param length : Bytes to send.
+         * @param end : Whether the data ends the stream.
+         * @return Returns the bytes written.
+         */
+        size_t m_write_data(stream* s, const char* data, size_t length,
+            bool end);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             *
+             * Queues our SETTINGS, the server's connection preface.
+             *
+             * @param settings : Our settings.
+             * @param max_body : Largest request body accepted, larger ones
+             *                   are answered with 413.
+             */
+            http2_session(const http2_settings& settings, size_t max_body);
+
+            http2_session(const http2_session&) = delete;
+            http2_session& operator=(const http2_session&) = delete;
+
+            /// Destructor.
+            virtual ~http2_session();
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Gets the frames waiting to be sent.
+             *
+             * Write them out and clear the buffer after every call which
+             * can add to it : receive(), upgrade() and the send methods
+             * outside of on_request().
+             *
+             * @return Returns the output buffer.
+             */
+            std::string& get_output();
+
+            /**
+             * @brief Gets the number of open streams.
+             * @return Returns streams open, or still sending.
+             */
+            size_t get_stream_count() const;
+
+            /**
+             * @brief Whether the connection is going away.
+             * @return Returns true once a GOAWAY was sent or received.
+             */
+            bool is_closing() const;
+
+            /**
+             * @brief Parses received frames.
+             *
+             * Fires on_request() for every request completed.
+             *
+             * @param data : Input, starting with the client preface on the
+             *               first call, then at a frame boundary.
+             * @param length : Bytes of input.
+             * @return Returns the bytes consumed (complete frames), or -1
+             *         if the connection has to be closed once the output
+             *         is sent.
+             */
+            int receive(char* data, size_t length);
+
+            /**
+             * @brief Resets a stream.
+             * @param id : Stream identifier.
+             * @param error : Error code.
+             */
+            void reset(uint32_t id, uint32_t error);
+
+            /**
+             * @brief Sends DATA on a stream.
+             *
+             * Data the flow control windows don't allow yet is copied and
+             * sent later.
+             *
+             * @param id : Stream identifier.
+             * @param data : Data, may be empty to just end the stream.
+             * @param end : Whether the data ends the stream.
+             * @return Returns false if the stream can't send data.
+             */
+            bool send_data(uint32_t id, std::string_view data, bool end);
+
+            /**
+             * @brief Sends response headers on a stream.
+             * @param id : Stream identifier.
+             * @param status : Status code.
+             * @param content_type : Content-Type, left out if empty.
+             * @param content_length : Content-Length, -1 to leave it out.
+             * @param headers : Extra header lines, each ending with CRLF,
+             *                  as for HTTP/1.1. Names are lowercased, and
+             *                  Date and connection-specific fields are
+             *                  dropped.
+             * @param end : Whether the headers end the stream.
+             * @return Returns false if the stream can't send headers.
+             */
+            bool send_headers(uint32_t id, int status,
+                std::string_view content_type, long content_length,
+                std::string_view headers, bool end);
+
+            /**
+             * @brief Takes over an HTTP/1.1 connection upgraded to h2c.
+             *
+             * Call once the 101 response is sent. Applies the request's
+             * HTTP2-Settings and answers the request on stream 1.
+             *
+             * @param settings : Value of the HTTP2-Settings header.
+             * @param request : Request which asked for the upgrade.
+             * @return Returns false if the settings are malformed.
+             */
+            bool upgrade(std::string_view settings, http_request& request);
+
+        protected:
+
+            // Events. --------------------------------------------------------
+
+            /**
+             * @brief on_request event.
+             *
+             * Fires when a request is complete. Answer with send_headers()
+             * and send_data(), during the event or later. The request and
+             * its views are only valid until it returns.
+             *
+             * @param id : Stream of the request.
+             * @param request : Request, with version_major set to 2.
+             */
+            virtual void on_request(uint32_t id,
+                const http_request& request) = 0;
+
+    };
+
+}
+
+#endif
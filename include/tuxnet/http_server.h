@@ -0,0 +1,392 @@
+/**
+ * HTTP/1.1, HTTP/2 (h2c) and WebSocket server.
+ **/
+
+#ifndef TUXNET_HTTP_SERVER_H_INCLUDE
+#define TUXNET_HTTP_SERVER_H_INCLUDE
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include "tuxnet/http.h"
+#include "tuxnet/http2.h"
+#include "tuxnet/peer.h"
+#include "tuxnet/response_cache.h"
+#include "tuxnet/server.h"
+#include "tuxnet/websocket.h"
+
+namespace tuxnet
+{
+
+    /// Limits of an HTTP server, applied to every connection.
+    struct http_options
+    {
+        /// Largest request head accepted, larger ones get a 431.
+        size_t max_head = 65536;
+        /// Largest request body accepted, larger ones get a 413.
+        size_t max_body = 8388608;
+        /// Requests served on an HTTP/1 connection before closing, 0 no limit.
+        int max_requests = 0;
+        /// Whether clients may switch to HTTP/2 over cleartext (h2c).
+        bool allow_http2 = true;
+        /// Settings announced to HTTP/2 clients.
+        http2_settings http2;
+        /// Largest WebSocket message accepted, larger ones close with 1009.
+        size_t max_message = 1048576;
+    };
+
+    /**
+     * HTTP/1.1 server with keep-alive and pipelining, and HTTP/2 (h2c).
+     *
+     * Received data goes into a buffer per connection, which http_parser
+     * parses in place, and on_request() fires for every complete request
+     * with views into that buffer. Connections stay open between requests
+     * unless the client asks otherwise (or speaks HTTP/1.0 without
+     * keep-alive), and requests pipelined back to back are answered one
+     * after the other, in order, from a single on_receive. Malformed
+     * requests are answered with the matching error status and the
+     * connection is closed.
+     *
+     * Unless http_options::allow_http2 is off, clients can also speak
+     * HTTP/2 over cleartext, either from the start (prior knowledge) or by
+     * asking for an Upgrade to h2c. Such connections are handed to an
+     * http2_session, and every stream's request goes through the same
+     * on_request() and respond() calls, so handlers serve both protocols
+     * without knowing which is in use (see http_request::version_major).
+     *
+     * A handler can also take an HTTP/1.1 connection over for WebSocket
+     * with accept_websocket(). From then on, on_message() fires for every
+     * complete message (fragments are put together, text is checked to be
+     * UTF-8), pings are answered and close frames are echoed before the
+     * connection is closed. To push updates as they happen, take a handle
+     * with get_websocket() : send_frame() and close_websocket() take it
+     * from any thread, even once the connection is gone.
+     *
+     * Derive from this class and override on_request(), which has to
+     * answer with respond() or respond_cached(), or with begin_chunked(),
+     * send_chunk() and end_chunked() for a body of unknown length, before
+     * it returns. A request left without a complete response closes the
+     * connection.
+     */
+    class http_server : public server
+    {
+
+        struct connection;
+        class http2_connection;
+        struct websocket_connection;
+
+        // Private member variables. ------------------------------------------
+
+        /// Limits.
+        const http_options m_options;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Writes out the frames an HTTP/2 connection queued.
+         * @param remote_peer : Connection to write to.
+         * @param conn : State of the connection.
+         * @return Returns false if the peer is gone, and conn with it.
+         */
+        bool m_flush_http2(peer* remote_peer, connection* conn);
+
+        /**
+         * Handles the frames received on a WebSocket connection.
+         * @param remote_peer : Connection the frames came in on.
+         * @param conn : State of the connection.
+         * @param data : Received data, unmasked in place.
+         * @param length : Bytes of data.
+         * @return Returns the bytes of complete frames handled, -1 if the
+         *         connection is to be closed.
+         */
+        int m_receive_websocket(peer* remote_peer, connection* conn,
+            char* data, size_t length);
+
+        /**
+         * Answers a malformed request and closes the connection.
+         * @param remote_peer : Connection of the request.
+         * @param conn : State of the connection.
+         * @param status : Status code to answer with.
+         */
+        void m_reject(peer* remote_peer, connection* conn, int status);
+
+        /**
+         * Sends a WebSocket frame, header and payload in a single writev.
+         *
+         * Writes under the connection's write lock, and only if it isn't
+         * closed yet, which keeps the peer from being deleted meanwhile.
+         *
+         * @param ws : WebSocket state of the connection.
+         * @param opcode : Opcode.
+         * @param payload : Payload.
+         * @param fin : Whether this is the last frame of its message.
+         * @return Returns true if the frame was sent.
+         */
+        bool m_send_frame(websocket_connection* ws, uint8_t opcode,
+            std::string_view payload, bool fin);
+
+        /**
+         * Switches a connection to HTTP/2, as its last request asked.
+         * @param remote_peer : Connection of the request.
+         * @param conn : State of the connection.
+         * @return Returns false if the peer is gone, and conn with it.
+         */
+        bool m_upgrade(peer* remote_peer, connection* conn);
+
+        /**
+         * Writes a response head.
+         * @param remote_peer : Connection to write to.
+         * @param conn : State of the connection.
+         * @param status : Status code.
+         * @param content_type : Content-Type, left out if empty.
+         * @param content_length : Content-Length, -1 for a chunked body.
+         * @param headers : Extra header lines, each ending with CRLF.
+         * @param body : Body to send along, unless the request was HEAD.
+         * @return Returns true if everything was sent.
+         */
+        bool m_write_head(peer* remote_peer, connection* conn, int status,
+            std::string_view content_type, long content_length,
+            std::string_view headers, std::string_view body);
+
+        public:
+
+            /// Handle to a WebSocket connection, see get_websocket().
+            typedef std::shared_ptr<websocket_connection> websocket_ref;
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param options : (optional) Limits of the server.
+             */
+            http_server(const http_options& options=http_options());
+
+            /// Destructor.
+            virtual ~http_server();
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Sends a complete response.
+             *
+             * Adds Content-Length and, when the connection is to be closed,
+             * Connection: close. The body is left out for HEAD requests.
+             *
+             * @param remote_peer : Connection passed to on_request().
+             * @param status : Status code.
+             * @param body : Response body.
+             * @param content_type : (optional) Content-Type, left out if
+             *                       empty.
+             * @param headers : (optional) Extra header lines, each ending
+             *                  with CRLF.
+             * @return Returns true if everything was sent.
+             */
+            bool respond(peer* remote_peer, int status,
+                std::string_view body,
+                std::string_view content_type="text/plain",
+                std::string_view headers=std::string_view());
+
+            /**
+             * @brief Sends a response serialized ahead of time.
+             *
+             * Sends the cached bytes as they are, in a single writev, with
+             * the current date in place of the Date value (if the response
+             * has one) and, when needed, a Connection header inserted
+             * before the blank line. The body is left out for HEAD
+             * requests.
+             *
+             * @param remote_peer : Connection passed to on_request().
+             * @param response : Response from a tuxnet::response_cache.
+             * @return Returns true if everything was sent.
+             */
+            bool respond_cached(peer* remote_peer,
+                const cached_response& response);
+
+            /**
+             * @brief Starts a response with a chunked body.
+             *
+             * HTTP/1.0 clients don't understand chunked bodies, theirs is
+             * sent as is and ends by closing the connection.
+             *
+             * @param remote_peer : Connection passed to on_request().
+             * @param status : Status code.
+             * @param content_type : (optional) Content-Type, left out if
+             *                       empty.
+             * @param headers : (optional) Extra header lines, each ending
+             *                  with CRLF.
+             * @return Returns true if the head was sent.
+             */
+            bool begin_chunked(peer* remote_peer, int status,
+                std::string_view content_type="text/plain",
+                std::string_view headers=std::string_view());
+
+            /**
+             * @brief Sends a chunk of a response started by begin_chunked().
+             * @param remote_peer : Connection passed to on_request().
+             * @param data : Chunk, empty chunks are skipped.
+             * @return Returns true if the chunk was sent.
+             */
+            bool send_chunk(peer* remote_peer, std::string_view data);
+
+            /**
+             * @brief Ends a response started by begin_chunked().
+             * @param remote_peer : Connection passed to on_request().
+             * @return Returns true if the last chunk was sent.
+             */
+            bool end_chunked(peer* remote_peer);
+
+            /**
+             * @brief Takes a connection over for WebSocket.
+             *
+             * Answers a WebSocket handshake with 101 Switching Protocols,
+             * after which the connection carries frames instead of
+             * requests. Requests which aren't a valid handshake (HTTP/2
+             * streams among them) are answered with a 400 instead.
+             *
+             * @param remote_peer : Connection passed to on_request().
+             * @param request : Request passed to on_request().
+             * @param headers : (optional) Extra header lines, each ending
+             *                  with CRLF, such as Sec-WebSocket-Protocol.
+             * @return Returns true if the connection is now a WebSocket.
+             */
+            bool accept_websocket(peer* remote_peer,
+                const http_request& request,
+                std::string_view headers=std::string_view());
+
+            /**
+             * @brief Gets a handle to send frames from any thread.
+             *
+             * Call it from the connection's thread, once accept_websocket()
+             * succeeded. The handle stays valid after the connection is
+             * gone : frames sent then are dropped.
+             *
+             * @param remote_peer : WebSocket connection.
+             * @return Returns the handle, or nullptr if the connection isn't
+             *         a WebSocket.
+             */
+            websocket_ref get_websocket(peer* remote_peer);
+
+            /**
+             * @brief Sends a WebSocket frame.
+             *
+             * Only from the connection's thread, such as from on_message() :
+             * other threads use a handle, see get_websocket().
+             *
+             * @param remote_peer : WebSocket connection.
+             * @param opcode : Opcode, WEBSOCKET_TEXT for text.
+             * @param payload : Payload, at most 125 bytes for control
+             *                  frames.
+             * @param fin : (optional) Whether this is the last frame of its
+             *              message, false to send a message in fragments.
+             * @return Returns false if the frame couldn't be sent, or if
+             *         the connection is closing.
+             */
+            bool send_frame(peer* remote_peer, websocket_opcode opcode,
+                std::string_view payload, bool fin=true);
+
+            /**
+             * @brief Sends a WebSocket frame from any thread.
+             *
+             * The header and payload go out with a single writev, under a
+             * lock, so frames sent from several threads don't interleave.
+             * A failed write from another thread than the connection's only
+             * shuts it down, and the connection's thread closes it.
+             *
+             * @param ws : Handle from get_websocket().
+             * @param opcode : Opcode, WEBSOCKET_TEXT for text.
+             * @param payload : Payload, at most 125 bytes for control
+             *                  frames.
+             * @param fin : (optional) Whether this is the last frame of its
+             *              message, false to send a message in fragments.
+             * @return Returns false if the frame couldn't be sent, or if
+             *         the connection is closing or gone.
+             */
+            bool send_frame(const websocket_ref& ws, websocket_opcode opcode,
+                std::string_view payload, bool fin=true);
+
+            /**
+             * @brief Starts closing a WebSocket connection.
+             *
+             * Sends a close frame, nothing can be sent after it. Messages
+             * still coming in are dropped, and the connection is closed
+             * when the client's close frame arrives. Only from the
+             * connection's thread, like send_frame().
+             *
+             * @param remote_peer : WebSocket connection.
+             * @param status : (optional) Status code, see websocket_status.
+             * @param reason : (optional) Reason, at most 123 bytes of UTF-8.
+             * @return Returns true if the close frame was sent.
+             */
+            bool close_websocket(peer* remote_peer,
+                int status=WEBSOCKET_NORMAL,
+                std::string_view reason=std::string_view());
+
+            /**
+             * @brief Starts closing a WebSocket connection from any thread.
+             * @param ws : Handle from get_websocket().
+             * @param status : (optional) Status code, see websocket_status.
+             * @param reason : (optional) Reason, at most 123 bytes of UTF-8.
+             * @return Returns true if the close frame was sent.
+             */
+            bool close_websocket(const websocket_ref& ws,
+                int status=WEBSOCKET_NORMAL,
+                std::string_view reason=std::string_view());
+
+            /**
+             * @brief Gets the limits of the server.
+             * @return Returns the options the server was created with.
+             */
+            const http_options& get_options() const;
+
+        protected:
+
+            // Events. --------------------------------------------------------
+
+            /**
+             * @brief on_request event.
+             *
+             * Fires from the connection's thread for every complete request,
+             * in the order requests were received. The request and its
+             * views are only valid until it returns. Answers 404 by
+             * default.
+             *
+             * @param remote_peer : Connection the request came in on.
+             * @param request : Parsed request.
+             */
+            virtual void on_request(peer* remote_peer,
+                const http_request& request);
+
+            /**
+             * @brief on_message event.
+             *
+             * Fires from the connection's thread for every complete
+             * message received on a WebSocket connection. The data is only
+             * valid until it returns.
+             *
+             * @param remote_peer : Connection the message came in on.
+             * @param opcode : WEBSOCKET_TEXT or WEBSOCKET_BINARY.
+             * @param data : Message, valid UTF-8 for text.
+             */
+            virtual void on_message(peer* remote_peer,
+                websocket_opcode opcode, std::string_view data);
+
+            /**
+             * @brief on_websocket_close event.
+             *
+             * Fires once a WebSocket connection is gone, however it ended.
+             * The peer can't be sent frames anymore.
+             *
+             * @param remote_peer : Connection that closed.
+             */
+            virtual void on_websocket_close(peer* remote_peer);
+
+            // Server events, used by the HTTP server. ------------------------
+
+            void on_receive(peer* remote_peer) override final;
+            void on_disconnect(peer* remote_peer) override final;
+
+    };
+
+}
+
+#endif
@@ -1,31 +1,146 @@
 #ifndef TUXNET_LOG_INCLUDE
 #define TUXNET_LOG_INCLUDE
 
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <type_traits>
+#include <vector>
+#include "tuxnet/log_sink.h"
 
 namespace tuxnet
 {
 
     /**
      * The tuxnet logging interface.
+     *
+     * Messages can be logged either as preformatted strings :
+     *
+     * ```
+     * log::get().info("Listening on port " + std::to_string(port));
+     * ```
+     *
+     * or as a registered format string plus arguments, which lets sinks
+     * such as binary_log_sink store the raw argument bytes instead of
+     * formatting text on the hot path :
+     *
+     * ```
+     * static const uint32_t fmt = log::get().register_format(
+     *     "Accepted fd {} from port {}");
+     * log::get().info(fmt, fd, port);
+     * ```
+     *
+     * Records go to the active log_sink, a text_log_sink by default.
      * @todo finish me.
      */
     class log
     {
 
         // Private member variables. ------------------------------------------
-        
+
+        /// Registered format strings by id.
+        std::vector<std::string> m_formats;
         /// Holds singleton pointer to itself, instantiated on first use.
         static std::unique_ptr<log> m_instance;
         /// once_flag indicating if instance has already been allocated.
         static std::once_flag m_instance_allocated;
+        /// Guards m_formats and m_sink replacement.
+        std::mutex m_lock;
+        /// Sink receiving log records, read without the lock.
+        std::atomic<log_sink*> m_sink;
+        /// Owns every sink ever set, replaced ones included.
+        std::vector<std::unique_ptr<log_sink>> m_sinks;
+
+        /// Maximum number of packed argument bytes per record.
+        static const size_t m_max_args_size = 256;
+
+        // Private member functions. ------------------------------------------
+
+        /// Packs an argument of integral type.
+        template<typename T>
+        static typename std::enable_if<std::is_integral<T>::value, void>::type
+        m_pack(char*& pos, char* const end, const T& value)
+        {
+            if (end - pos < 9) return;
+            if (std::is_signed<T>::value)
+            {
+                int64_t v = value;
+                *pos++ = LOG_ARG_INT;
+                memcpy(pos, &v, sizeof(v));
+            }
+            else
+            {
+                uint64_t v = value;
+                *pos++ = LOG_ARG_UINT;
+                memcpy(pos, &v, sizeof(v));
+            }
+            pos += 8;
+        }
+
+        /// Packs an argument of floating point type.
+        template<typename T>
+        static typename std::enable_if<std::is_floating_point<T>::value,
+            void>::type
+        m_pack(char*& pos, char* const end, const T& value)
+        {
+            if (end - pos < 9) return;
+            double v = value;
+            *pos++ = LOG_ARG_DOUBLE;
+            memcpy(pos, &v, sizeof(v));
+            pos += 8;
+        }
+
+        /// Packs a string argument, truncating it if needed.
+        static void m_pack_string(char*& pos, char* const end, const char* str,
+            size_t len)
+        {
+            if (end - pos < 3) return;
+            if (len > static_cast<size_t>(end - pos - 3)) len = end - pos - 3;
+            uint16_t l = len;
+            *pos++ = LOG_ARG_STRING;
+            memcpy(pos, &l, sizeof(l));
+            pos += sizeof(l);
+            memcpy(pos, str, len);
+            pos += len;
+        }
+
+        static void m_pack(char*& pos, char* const end, const char* value)
+        {
+            m_pack_string(pos, end, value, strlen(value));
+        }
+
+        static void m_pack(char*& pos, char* const end, const std::string& value)
+        {
+            m_pack_string(pos, end, value.data(), value.size());
+        }
+
+        /// Packs all arguments and hands the record to the sink.
+        template<typename... Arguments>
+        void m_write(log_level level, uint32_t format_id,
+            const Arguments&... args)
+        {
+            char buffer[m_max_args_size];
+            char* pos = buffer;
+            (m_pack(pos, buffer + sizeof(buffer), args), ...);
+            m_sink.load(std::memory_order_acquire)->write(level, format_id,
+                buffer, pos - buffer);
+        }
+
+        /// Flushes the sink and terminates after an error was logged.
+        void m_fatal();
 
         public:
 
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor.
+            log();
+
             // Getters / setters. ---------------------------------------------
-            
+
             /**
              * Get pointer to log instance.
              *
@@ -34,8 +149,42 @@ namespace tuxnet
              **/
             static log& get();
 
+            /**
+             * Gets a registered format string.
+             *
+             * @param format_id : Id returned by register_format().
+             * @return Returns the format string, or an empty string if the
+             *         id is unknown.
+             */
+            std::string get_format(uint32_t format_id);
+
+            /**
+             * Replaces the log sink.
+             *
+             * Previously registered format strings are passed on to the new
+             * sink. The log object takes ownership of the sink. Other threads
+             * may still be writing to the old sink, so it is flushed but only
+             * destroyed with the log object.
+             *
+             * @param sink : New log sink.
+             */
+            void set_sink(log_sink* sink);
+
             // Methods. -------------------------------------------------------
 
+            /**
+             * Registers a format string.
+             *
+             * Call this once (for instance to initialize a static variable)
+             * and log with the returned id afterwards. Each `{}` in the format
+             * string is replaced with the next argument when the record is
+             * turned into text.
+             *
+             * @param format : Format string.
+             * @return Returns the id of the format string.
+             */
+            uint32_t register_format(const std::string& format);
+
             /**
              * Log an informational message.
              *
@@ -43,6 +192,18 @@ namespace tuxnet
              **/
             void info(const std::string& message);
 
+            /**
+             * Log an informational record.
+             *
+             * @param format_id : Id returned by register_format().
+             * @param args : Arguments for the format string.
+             **/
+            template<typename... Arguments>
+            void info(uint32_t format_id, const Arguments&... args)
+            {
+                m_write(LOG_LEVEL_INFO, format_id, args...);
+            }
+
             /**
              * Log a debug message.
              *
@@ -50,6 +211,18 @@ namespace tuxnet
              **/
             void debug(const std::string& message);
 
+            /**
+             * Log a debug record.
+             *
+             * @param format_id : Id returned by register_format().
+             * @param args : Arguments for the format string.
+             **/
+            template<typename... Arguments>
+            void debug(uint32_t format_id, const Arguments&... args)
+            {
+                m_write(LOG_LEVEL_DEBUG, format_id, args...);
+            }
+
             /**
              * Log an error message.
              *
@@ -57,6 +230,18 @@ namespace tuxnet
              **/
             void error(const std::string& message);
 
+            /**
+             * Log an error record.
+             *
+             * @param format_id : Id returned by register_format().
+             * @param args : Arguments for the format string.
+             **/
+            template<typename... Arguments>
+            void error(uint32_t format_id, const Arguments&... args)
+            {
+                m_write(LOG_LEVEL_ERROR, format_id, args...);
+                m_fatal();
+            }
 
     };
 
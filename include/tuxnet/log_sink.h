@@ -0,0 +1,273 @@
+/**
+ * Log sink definitions.
+ *
+ * A log sink is the place tuxnet::log sends its records to. The default
+ * text_log_sink writes human readable lines to stdout/stderr, while the
+ * binary_log_sink stores records in a compact binary form in memory-mapped,
+ * size-rotated files which can be turned back into text offline with the
+ * log_decode tool.
+ **/
+
+#ifndef TUXNET_LOG_SINK_H_INCLUDE
+#define TUXNET_LOG_SINK_H_INCLUDE
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace tuxnet
+{
+
+    /// Severity of a log record.
+    enum log_level
+    {
+        LOG_LEVEL_DEBUG = 0,
+        LOG_LEVEL_INFO  = 1,
+        LOG_LEVEL_ERROR = 2
+    };
+
+    /// Type tags used when packing log arguments into raw bytes.
+    enum log_arg_type
+    {
+        LOG_ARG_INT    = 1,
+        LOG_ARG_UINT   = 2,
+        LOG_ARG_DOUBLE = 3,
+        LOG_ARG_STRING = 4
+    };
+
+    /**
+     * Turns a format string and packed arguments back into text.
+     *
+     * Every `{}` in the format string is replaced by the next argument.
+     *
+     * @param format : Format string the record was logged with.
+     * @param args : Packed argument bytes.
+     * @param args_size : Number of bytes in args.
+     * @return Returns the formatted message.
+     */
+    std::string format_log_args(const std::string& format, const char* args,
+        size_t args_size);
+
+    /**
+     * Base class for log sinks.
+     */
+    class log_sink
+    {
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Destructor.
+            virtual ~log_sink();
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Called whenever a new format string is registered.
+             *
+             * @param format_id : Id assigned to the format string.
+             * @param format : The format string.
+             */
+            virtual void define_format(uint32_t format_id,
+                const std::string& format);
+
+            /// Flushes any pending records to storage.
+            virtual void flush();
+
+            /**
+             * Writes a preformatted text message.
+             *
+             * @param level : Severity of the message.
+             * @param message : Message text.
+             */
+            virtual void write(log_level level, const std::string& message)=0;
+
+            /**
+             * Writes a record consisting of a format id and packed arguments.
+             *
+             * @param level : Severity of the record.
+             * @param format_id : Id of a registered format string.
+             * @param args : Packed argument bytes.
+             * @param args_size : Number of bytes in args.
+             */
+            virtual void write(log_level level, uint32_t format_id,
+                const char* args, size_t args_size)=0;
+
+    };
+
+    /**
+     * Log sink writing lines of text to output streams.
+     *
+     * This is the default sink. Debug and info messages go to the info
+     * stream (std::cout by default), errors go to the error stream
+     * (std::cerr by default).
+     */
+    class text_log_sink : public log_sink
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Stream receiving error messages.
+        std::ostream& m_error_stream;
+        /// Format strings by id.
+        std::vector<std::string> m_formats;
+        /// Stream receiving debug and info messages.
+        std::ostream& m_info_stream;
+        /// Serializes writes to the streams.
+        std::mutex m_lock;
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor writing to std::cout and std::cerr.
+            text_log_sink();
+
+            /**
+             * Constructor with custom streams.
+             *
+             * @param info_stream : Stream receiving debug and info messages.
+             * @param error_stream : Stream receiving error messages.
+             */
+            text_log_sink(std::ostream& info_stream,
+                std::ostream& error_stream);
+
+            // Methods. -------------------------------------------------------
+
+            void define_format(uint32_t format_id, const std::string& format);
+            void flush();
+            void write(log_level level, const std::string& message);
+            void write(log_level level, uint32_t format_id, const char* args,
+                size_t args_size);
+
+    };
+
+    /// Magic bytes at the start of every binary log file.
+    #define TUXNET_BINARY_LOG_MAGIC "TUXLOG01"
+
+    /// Record types found in binary log files.
+    enum binary_log_record_type
+    {
+        /// Marks the end of the used part of a file.
+        BINARY_LOG_RECORD_END    = 0,
+        /// Payload is a format string for format_id.
+        BINARY_LOG_RECORD_FORMAT = 1,
+        /// Payload is packed arguments for format_id.
+        BINARY_LOG_RECORD_EVENT  = 2
+    };
+
+    /// Header preceding every record in a binary log file.
+    struct binary_log_record
+    {
+        /// Size of the record including this header.
+        uint16_t size;
+        /// One of binary_log_record_type.
+        uint8_t type;
+        /// One of log_level.
+        uint8_t level;
+        /// Format string id.
+        uint32_t format_id;
+        /// Wall clock time in nanoseconds since the epoch.
+        uint64_t timestamp;
+    };
+
+    /**
+     * Log sink storing binary records in memory-mapped files.
+     *
+     * Each file is preallocated to a fixed size and mapped into memory, so
+     * logging a record is a timestamp and a memcpy. When a file is full it
+     * is rotated : `path` becomes `path.1`, `path.1` becomes `path.2` and so
+     * on, keeping at most max_files old files around.
+     *
+     * Every file starts with the format strings known at the time it was
+     * created, so each file can be decoded on its own.
+     */
+    class binary_log_sink : public log_sink
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// File descriptor of the current file.
+        int m_fd;
+        /// Format strings by id.
+        std::vector<std::string> m_formats;
+        /// Serializes writes and rotation.
+        std::mutex m_lock;
+        /// Start of the memory-mapped file.
+        char* m_map;
+        /// Size of each file.
+        size_t m_max_file_size;
+        /// Number of rotated files to keep.
+        int m_max_files;
+        /// Path of the current file.
+        std::string m_path;
+        /// Write offset into the current file.
+        size_t m_pos;
+
+        // Private member functions. ------------------------------------------
+
+        /// Truncates and unmaps the current file.
+        void m_close_file();
+
+        /// Creates and maps a fresh file at m_path.
+        bool m_open_file();
+
+        /**
+         * Appends a record to the current file, rotating if needed.
+         * Must be called with m_lock held.
+         */
+        void m_append(uint8_t type, uint8_t level, uint32_t format_id,
+            const char* payload, size_t payload_size);
+
+        /**
+         * Copies a record into the current file without rotating.
+         * @return Returns false if the record doesn't fit.
+         */
+        bool m_put(uint8_t type, uint8_t level, uint32_t format_id,
+            const char* payload, size_t payload_size);
+
+        /// Shifts old files and starts a new one.
+        bool m_rotate();
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             *
+             * @param path : Path of the log file.
+             * @param max_file_size : (optional) Size of each file in bytes.
+             * @param max_files : (optional) Number of rotated files to keep.
+             */
+            binary_log_sink(const std::string& path,
+                size_t max_file_size=64*1024*1024, int max_files=4);
+
+            /// Destructor.
+            ~binary_log_sink();
+
+            // Getters. -------------------------------------------------------
+
+            /**
+             * Checks if the sink has a usable file.
+             * @return Returns true if the log file could be opened.
+             */
+            bool is_open() const;
+
+            // Methods. -------------------------------------------------------
+
+            void define_format(uint32_t format_id, const std::string& format);
+            void flush();
+            void write(log_level level, const std::string& message);
+            void write(log_level level, uint32_t format_id, const char* args,
+                size_t args_size);
+
+    };
+
+}
+
+#endif
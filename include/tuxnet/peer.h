@@ -3,9 +3,13 @@
 
 #include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <unordered_map>
 #include <atomic>
+#include "tuxnet/event.h"
+#include "tuxnet/flight_recorder.h"
 #include "tuxnet/socket_address.h"
+#include "tuxnet/stats.h"
 
 namespace tuxnet
 {
@@ -25,6 +29,39 @@ namespace tuxnet
     /// Peer forward declaration.
     class peer;
 
+    /// TCP state of a peer connection, from TCP_INFO.
+    struct peer_tcp_info
+    {
+        /// False if TCP_INFO couldn't be read, all other fields are 0 then.
+        bool valid;
+        /// TCP state (TCP_ESTABLISHED, TCP_CLOSE_WAIT, ...).
+        uint8_t state;
+        /// Smoothed round trip time in microseconds.
+        uint32_t rtt_us;
+        /// Round trip time variation in microseconds.
+        uint32_t rtt_var_us;
+        /// Retransmission timeout in microseconds.
+        uint32_t rto_us;
+        /// Congestion window in segments.
+        uint32_t snd_cwnd;
+        /// Slow start threshold in segments.
+        uint32_t snd_ssthresh;
+        /// Maximum segment size for sending, in bytes.
+        uint32_t snd_mss;
+        /// Segments sent but not acknowledged yet.
+        uint32_t unacked;
+        /// Segments the kernel considers lost.
+        uint32_t lost;
+        /// Retransmission timeouts in a row without progress.
+        uint32_t backoff;
+        /// Segments retransmitted since the connection started.
+        uint32_t total_retrans;
+        /// Milliseconds since data was last received.
+        uint32_t last_data_recv_ms;
+        /// Bytes written to the peer through this object.
+        uint64_t bytes_sent;
+    };
+
     /// Collection of peers.
     typedef std::vector<peer*> peers;
 
@@ -36,8 +73,11 @@ namespace tuxnet
     class peer
     {
 
+        friend class socket;
+        friend class tcp_sampler;
+
         /// epoll event buffer.
-        epoll_event* m_epoll_events;
+        event_batch m_epoll_events;
         /// Peer state.
         std::atomic<peer_state> m_state;
         /// Socket file descriptor.
@@ -46,8 +86,94 @@ namespace tuxnet
         int m_epoll_fd;
         /// IP and port of peer.
         socket_address* m_saddr;
+        /// IPv4 address of peer in network byte order, 0 if not IPv4.
+        in_addr_t m_remote_ip;
+        /// Port of peer, 0 if not IPv4.
+        in_port_t m_remote_port;
         /// Pointer to parent socket.
         socket* const m_socket;
+        /// Whether the kernel timestamps received data (see rx_timestamps).
+        bool m_rx_timestamps;
+        /// Wall clock time on_receive() was last called, in nanoseconds.
+        uint64_t m_receive_start;
+        /// Set until the queueing delay of the current on_receive() is known.
+        bool m_receive_queue_pending;
+        /// Bytes written to the peer.
+        std::atomic<uint64_t> m_bytes_sent;
+        /// Set while the TCP sampler considers the peer retransmitting.
+        std::atomic<bool> m_retransmitting;
+        /// Whether the TCP sampler has seen the peer before (sampler only).
+        bool m_sampled;
+        /// bytes_sent at the previous sample (sampler only).
+        uint64_t m_sampled_bytes;
+        /// total_retrans at the previous sample (sampler only).
+        uint32_t m_sampled_retrans;
+        /// Set once data was received, for the flight recorder.
+        bool m_received;
+        /// Owner data attached to the connection, see set_context().
+        std::atomic<void*> m_context;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Records an event of this peer in the flight recorder.
+         * @param type : Event type.
+         * @param value : (optional) Type specific value.
+         */
+        void m_record(flight_event_type type, int32_t value=0)
+        {
+            flight_recorder::record(type, m_fd, m_remote_ip, m_remote_port,
+                value);
+        }
+
+        /**
+         * Receives data from the peer socket.
+         *
+         * Updates the thread's counters and disconnects the peer when the
+         * connection was closed or failed. EINTR is reported as EAGAIN.
+         *
+         * @param buffer : Buffer to receive into.
+         * @param length : Size of buffer.
+         * @param flags : Flags passed on to recv().
+         * @return Returns what recv() returned.
+         */
+        int m_recv(void* buffer, size_t length, int flags);
+
+        /**
+         * Receives data along with its kernel timestamp.
+         *
+         * The first timestamped read of every on_receive() records how long
+         * the data waited in the socket before the callback started, as
+         * LATENCY_RECEIVE_QUEUE. Data which arrived after that isn't
+         * counted, it didn't delay the callback.
+         *
+         * @param buffer : Buffer to receive into.
+         * @param length : Size of buffer.
+         * @param flags : Flags passed on to recvmsg().
+         * @return Returns what recvmsg() returned.
+         */
+        int m_recv_timestamped(void* buffer, size_t length, int flags);
+
+        /**
+         * Sends all given data to the peer socket.
+         *
+         * Updates the thread's counters and disconnects the peer on errors.
+         *
+         * @param data : Data to send.
+         * @param length : Number of bytes to send.
+         * @return Returns true if everything was sent.
+         */
+        bool m_send(const void* data, size_t length);
+
+        /**
+         * Handles a failed send, disconnecting the peer.
+         *
+         * From any thread but the peer's own, shuts the socket down instead,
+         * and the peer's thread disconnects it.
+         *
+         * @param error : errno value of the failure.
+         */
+        void m_send_failed(int error);
 
         public:
 
@@ -74,7 +200,13 @@ namespace tuxnet
             /// Destructor.
             ~peer();
 
-            // Getters. -------------------------------------------------------
+            // Getters / setters. ---------------------------------------------
+
+            /**
+             * Gets the data attached with set_context().
+             * @return Returns the attached pointer, nullptr by default.
+             */
+            void* get_context() const;
 
             /**
              * Get file descriptor.
@@ -96,6 +228,44 @@ namespace tuxnet
              */
             peer_state const get_state() const;
 
+            /**
+             * Checks whether the connection retransmits too much.
+             *
+             * Set by the server's TCP sampler (see tcp_sampler) when a large
+             * share of the segments sent since its previous sample had to be
+             * retransmitted, or when the connection keeps timing out, and
+             * cleared once it recovers.
+             *
+             * @return Returns true if the peer was flagged.
+             */
+            bool get_retransmitting() const;
+
+            /**
+             * Attaches data to the connection.
+             *
+             * For whoever owns the connection, such as tuxnet::connection_pool
+             * which keeps its bookkeeping here, so it can find it from the
+             * peer without a lookup.
+             *
+             * @param context : Pointer to attach, not owned by the peer.
+             */
+            void set_context(void* context);
+
+            /**
+             * Pauses or resumes on_receive events.
+             *
+             * While paused, the peer's thread only wakes up for hangups and
+             * errors, so data waiting in the socket stays there instead of
+             * firing on_receive over and over. A paused peer still
+             * disconnects once both directions of the connection are shut
+             * down. Safe to call from any thread as long as the peer isn't
+             * deleted meanwhile.
+             *
+             * @param receiving : Set to false to pause, true to resume.
+             * @return Returns false if the peer isn't monitored (yet).
+             */
+            bool set_receiving(bool receiving);
+
             // Methods. -------------------------------------------------------
 
             /**
@@ -109,6 +279,26 @@ namespace tuxnet
              */
             void poll();
 
+            /**
+             * Gets round trip time, congestion window, retransmissions and
+             * more from the kernel (TCP_INFO).
+             *
+             * Costs a single getsockopt() call, and can be called from any
+             * thread as long as the peer isn't deleted meanwhile.
+             *
+             * @return Returns the connection state, valid is false on error.
+             */
+            peer_tcp_info tcp_info();
+
+            /**
+             * Starts the thread which polls the peer until it disconnects.
+             *
+             * Call this after initialize() and after the on_connect event
+             * fired : the peer can be deleted by its thread as soon as it
+             * runs.
+             */
+            void start();
+
             /**
              * Reads up to a given number of characters from the 
              * peer socket.
@@ -138,7 +328,18 @@ namespace tuxnet
              */
             std::string read_all();
 
-            /// @todo Add functions for reading/writing raw bytes.
+            /**
+             * Reads whatever the peer sent, up to a given number of bytes.
+             *
+             * Doesn't block and doesn't allocate, so it's the cheapest way
+             * to consume a request.
+             *
+             * @param buffer : Buffer to read into.
+             * @param length : Size of buffer.
+             * @return Returns the number of bytes read, 0 if nothing was
+             *         available, -1 if the peer is or got disconnected.
+             */
+            int read_bytes(char* buffer, int length);
 
             /**
              * Send data to the remote peer.
@@ -147,8 +348,39 @@ namespace tuxnet
              */
             void write_string(std::string text);
 
-            /// Close connection to this peer.
-            void disconnect();
+            /**
+             * Send raw bytes to the remote peer.
+             *
+             * A failed write disconnects the peer. Written from another
+             * thread than the peer's own, the peer is only shut down, and
+             * its thread disconnects it.
+             *
+             * @param data : Data to send.
+             * @param length : Number of bytes to send.
+             * @return Returns true if everything was sent.
+             */
+            bool write_bytes(const char* data, int length);
+
+            /**
+             * Send several buffers to the remote peer at once.
+             *
+             * Gathers the buffers with a single sendmsg() (more if the
+             * socket doesn't take everything at once), so a response made
+             * of separate pieces goes out without copying them together.
+             *
+             * @param vec : Buffers to send, in order.
+             * @param count : Number of buffers.
+             * @return Returns true if everything was sent.
+             */
+            bool write_iovec(const iovec* vec, int count);
+
+            /**
+             * Close connection to this peer.
+             *
+             * @param reason : (optional) Why the connection is closed, used
+             *                 for statistics.
+             */
+            void disconnect(disconnect_reason reason=DISCONNECT_REASON_LOCAL);
 
     };
 
@@ -0,0 +1,113 @@
+/**
+ * Hardware performance counters of a single thread.
+ **/
+
+#ifndef TUXNET_PERF_H_INCLUDE
+#define TUXNET_PERF_H_INCLUDE
+
+#include <cstdint>
+
+namespace tuxnet
+{
+
+    /// Hardware events counted by a perf_group.
+    enum perf_counter
+    {
+        /// CPU cycles.
+        PERF_CYCLES = 0,
+        /// Retired instructions.
+        PERF_INSTRUCTIONS,
+        /// Last level cache misses.
+        PERF_CACHE_MISSES,
+        /// Mispredicted branches.
+        PERF_BRANCH_MISSES,
+        /// Number of counters.
+        PERF_COUNTER_COUNT
+    };
+
+    /**
+     * Gets the name of a performance counter.
+     * @return Returns a lower case name, such as "cache_misses".
+     */
+    const char* perf_counter_name(perf_counter counter);
+
+    /**
+     * Group of hardware counters following the thread that opened it.
+     *
+     * The counters are opened with perf_event_open() as a single group so
+     * they're always scheduled together, and read with a single read().
+     * Kernel time is counted when kernel.perf_event_paranoid allows it,
+     * otherwise only user space is. Counters the CPU (or hypervisor) doesn't
+     * support are left out and read as 0; if not even cycles can be counted
+     * the group doesn't open at all, which is logged once per process.
+     */
+    class perf_group
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// File descriptors, indexed by perf_counter, -1 if not open.
+        int m_fds[PERF_COUNTER_COUNT];
+        /// Position of every counter in the read buffer, -1 if not open.
+        int m_slots[PERF_COUNTER_COUNT];
+        /// Number of open counters.
+        int m_open;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Opens a single counter.
+         * @param counter : Counter to open.
+         * @param group_fd : Group leader, -1 to open the leader.
+         * @param exclude_kernel : Only count user space.
+         * @return Returns the file descriptor, -1 on error.
+         */
+        static int m_open_counter(perf_counter counter, int group_fd,
+            bool exclude_kernel);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor, doesn't open anything yet.
+            perf_group();
+
+            /// Destructor, closes the counters.
+            ~perf_group();
+
+            perf_group(const perf_group&) = delete;
+            perf_group& operator=(const perf_group&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Checks whether a counter is being counted.
+             * @param counter : Counter to check.
+             * @return Returns true if the counter is open.
+             */
+            bool available(perf_counter counter) const;
+
+            /// Closes the counters.
+            void close();
+
+            /**
+             * Opens the counters for the calling thread and starts them.
+             * @return Returns true if at least cycles are counted.
+             */
+            bool open();
+
+            /**
+             * Reads the counters.
+             *
+             * @param values : Receives the counts since open(), indexed by
+             *                 perf_counter, 0 for unavailable counters.
+             * @return Returns false on error or when the group wasn't
+             *         scheduled on the CPU at all.
+             */
+            bool read(uint64_t (&values)[PERF_COUNTER_COUNT]);
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,281 @@
+/**
+ * Pipelined request/response connections.
+ **/
+
+#ifndef TUXNET_PIPELINE_H_INCLUDE
+#define TUXNET_PIPELINE_H_INCLUDE
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include "tuxnet/client.h"
+#include "tuxnet/peer.h"
+
+namespace tuxnet
+{
+
+    /// Position of a frame found by framing_codec::decode().
+    struct frame_info
+    {
+        /// Bytes the whole frame takes, headers and delimiters included.
+        size_t length;
+        /// Offset of the payload within the frame.
+        size_t payload_offset;
+        /// Bytes of payload.
+        size_t payload_length;
+        /// Request id carried by the frame, if the codec is tagged.
+        uint64_t id;
+    };
+
+    /**
+     * Splits a byte stream into request and response frames.
+     *
+     * Codecs are stateless, so a single codec can serve any number of
+     * connections and threads.
+     */
+    class framing_codec
+    {
+
+        public:
+
+            /// Destructor.
+            virtual ~framing_codec();
+
+            /**
+             * Finds the first frame in received data.
+             * @param data : Received data.
+             * @param length : Number of bytes received.
+             * @param frame : Receives the frame's position.
+             * @return Returns 1 if a complete frame was found, 0 if more data
+             *         is needed, and -1 if the data is malformed.
+             */
+            virtual int decode(const char* data, size_t length,
+                frame_info& frame) const = 0;
+
+            /**
+             * Frames a request.
+             * @param id : Request id, only sent if the codec is tagged.
+             * @param payload : Request payload.
+             * @param length : Bytes of payload.
+             * @param out : Receives the frame, replacing its contents.
+             */
+            virtual void encode(uint64_t id, const char* payload,
+                size_t length, std::string& out) const = 0;
+
+            /**
+             * Whether responses carry the id of their request.
+             *
+             * Responses of untagged codecs are matched to requests in the
+             * order the requests were sent.
+             *
+             * @return Returns true if frame_info::id identifies responses.
+             */
+            virtual bool tagged() const = 0;
+
+    };
+
+    /// Newline terminated frames, matched in order.
+    class line_codec : public framing_codec
+    {
+
+        public:
+
+            int decode(const char* data, size_t length,
+                frame_info& frame) const override;
+            void encode(uint64_t id, const char* payload, size_t length,
+                std::string& out) const override;
+            bool tagged() const override;
+
+    };
+
+    /**
+     * Frames starting with a 32 bit big endian payload length.
+     *
+     * When tagged, the length is followed by a 64 bit big endian request id,
+     * which responses repeat, so they can come back in any order. The length
+     * doesn't include the header.
+     */
+    class length_prefixed_codec : public framing_codec
+    {
+
+        /// Whether frames carry a request id.
+        bool m_tagged;
+        /// Largest payload accepted.
+        uint32_t m_max_payload;
+
+        public:
+
+            /**
+             * Constructor.
+             * @param tagged : (optional) Whether frames carry a request id.
+             * @param max_payload : (optional) Larger frames are malformed.
+             */
+            length_prefixed_codec(bool tagged=false,
+                uint32_t max_payload=16777216);
+
+            int decode(const char* data, size_t length,
+                frame_info& frame) const override;
+            void encode(uint64_t id, const char* payload, size_t length,
+                std::string& out) const override;
+            bool tagged() const override;
+
+    };
+
+    /**
+     * Called once a request completes.
+     *
+     * Gets the response payload and 0, or nullptr, 0 and an errno value
+     * (ECONNRESET when the connection closed first).
+     */
+    typedef std::function<void(const char* payload, size_t length,
+        int error)> pipeline_completion;
+
+    /**
+     * Outbound connections sending requests without waiting for responses.
+     *
+     * send() frames a request with the codec and writes it right away, back
+     * to back with the requests before it, so a connection has up to
+     * window requests in flight instead of paying a round trip per request.
+     * Responses are decoded on the connection's thread and complete their
+     * requests in order, or by request id with a tagged codec. Once window
+     * requests are in flight, send() waits for a response (backpressure).
+     *
+     * Derive from this class and override on_ready() to start sending
+     * once a connection is established.
+     */
+    class pipelined_client : public client
+    {
+
+        struct pipeline;
+
+        // Private member variables. ------------------------------------------
+
+        /// Codec framing requests and responses.
+        const framing_codec* m_codec;
+        /// Requests in flight per connection.
+        const int m_window;
+        /// Guards the pipelines' references from the peers' contexts.
+        std::mutex m_pin_lock;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Completes a request with a response.
+         * @param state : Pipeline of the connection.
+         * @param data : Received frame.
+         * @param frame : Position of the frame.
+         * @return Returns false if no request was waiting for it.
+         */
+        bool m_complete(pipeline* state, const char* data,
+            const frame_info& frame);
+
+        /**
+         * Gets the pipeline of a connection, referenced.
+         *
+         * Takes the reference with m_pin_lock held, so on_disconnect() can't
+         * drop the connection's reference in between.
+         *
+         * @param remote_peer : Connection of the pipeline.
+         * @return Returns the pipeline, to m_unref(), or nullptr if the
+         *         connection closed.
+         */
+        pipeline* m_pin(peer* remote_peer);
+
+        /**
+         * Drops a reference to a pipeline, deleting it with the last.
+         * @param state : Pipeline to drop.
+         */
+        static void m_unref(pipeline* state);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param codec : Codec framing requests and responses, must
+             *                outlive the client.
+             * @param window : (optional) Requests in flight per connection.
+             */
+            pipelined_client(const framing_codec* codec, int window=128);
+
+            /// Destructor.
+            virtual ~pipelined_client();
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * @brief Gets the number of requests in flight.
+             * @param remote_peer : Connection to check.
+             * @return Returns requests sent and not completed yet.
+             */
+            int in_flight(peer* remote_peer);
+
+            /**
+             * @brief Sends a request.
+             *
+             * Safe to call from any thread until on_closed() returns;
+             * requests sent from several threads are written one after the
+             * other. A failed write from another thread than the
+             * connection's only shuts it down, and the connection's thread
+             * closes it. Don't wait for room from the connection's own
+             * thread, which is the one completing requests : use a timeout
+             * of 0 there.
+             *
+             * @param remote_peer : Connection to send on.
+             * @param payload : Request payload.
+             * @param length : Bytes of payload.
+             * @param done : Called once the request completes or fails.
+             * @param timeout_ms : (optional) Milliseconds to wait for room
+             *                     in the window, -1 waits as long as it
+             *                     takes, 0 doesn't wait.
+             * @return Returns false with errno set to EAGAIN (window full),
+             *         ETIMEDOUT or ENOTCONN if the request wasn't sent; done
+             *         isn't called then.
+             */
+            bool send(peer* remote_peer, const char* payload, size_t length,
+                pipeline_completion done, int timeout_ms=-1);
+
+            /**
+             * @brief Gets the number of requests in flight per connection.
+             * @return Returns the window the client was created with.
+             */
+            int get_window() const;
+
+        protected:
+
+            // Events. --------------------------------------------------------
+
+            /**
+             * @brief on_ready event.
+             *
+             * Fires from the connector thread once a connection is
+             * established, before the peer starts receiving.
+             *
+             * @param remote_peer : Connection to send on.
+             */
+            virtual void on_ready(peer* remote_peer);
+
+            /**
+             * @brief on_closed event.
+             *
+             * Fires when a connection closed, after its requests in flight
+             * failed. The peer is deleted afterwards.
+             *
+             * @param remote_peer : Connection that closed.
+             */
+            virtual void on_closed(peer* remote_peer);
+
+            // Client events, used by the pipeline. ---------------------------
+
+            void on_connect(peer* remote_peer) override final;
+            void on_receive(peer* remote_peer) override final;
+            void on_disconnect(peer* remote_peer) override final;
+
+    };
+
+}
+
+#endif
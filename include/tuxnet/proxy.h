@@ -0,0 +1,161 @@
+/**
+ * Zero-copy TCP proxy.
+ **/
+
+#ifndef TUXNET_PROXY_H_INCLUDE
+#define TUXNET_PROXY_H_INCLUDE
+
+#include <atomic>
+#include <cstdint>
+#include "tuxnet/peer.h"
+#include "tuxnet/server.h"
+#include "tuxnet/socket_address.h"
+
+namespace tuxnet
+{
+
+    /// Counters of a proxy.
+    struct proxy_stats
+    {
+        /// Connections accepted.
+        uint64_t accepted;
+        /// Accepted connections whose backend connection failed.
+        uint64_t failed;
+        /// Accepted connections not fully closed yet.
+        int active;
+        /// Bytes forwarded from clients to the backend.
+        uint64_t bytes_upstream;
+        /// Bytes forwarded from the backend to clients.
+        uint64_t bytes_downstream;
+    };
+
+    /**
+     * Layer 4 proxy forwarding TCP connections to a backend.
+     *
+     * Every accepted connection is paired with a new connection to the
+     * backend, and bytes are moved between the two with splice() through a
+     * pipe per direction, so the payload never gets copied to userspace.
+     * The accepted connection doesn't receive until the backend connection
+     * is established; if that fails, the accepted connection is closed.
+     *
+     * Each side is forwarded from its own peer thread. Writing to the other
+     * side blocks while its send buffer is full, which stops reading from
+     * this side until the other one catches up, so a slow reader throttles
+     * its writer through TCP flow control instead of data piling up in the
+     * proxy.
+     *
+     * Half-close is passed on : when one side shuts down its sending
+     * direction, the proxy shuts down sending to the other side and keeps
+     * forwarding the opposite direction. Both connections close once both
+     * directions ended, or as soon as either side fails or resets.
+     *
+     * Listen with tuxnet::server::listen() and run poll(), as with any
+     * server.
+     */
+    class proxy : public server
+    {
+
+        class upstream;
+        struct pair;
+
+        // Private member variables. ------------------------------------------
+
+        /// Address connections are forwarded to.
+        const ip4_socket_address m_backend;
+        /// Timeout of backend connections, see tuxnet::client::connect().
+        const int m_connect_timeout_ms;
+        /// Connections to the backend.
+        upstream* m_upstream;
+        /// Connections accepted.
+        std::atomic<uint64_t> m_accepted;
+        /// Accepted connections whose backend connection failed.
+        std::atomic<uint64_t> m_failed;
+        /// Pairs not deleted yet.
+        std::atomic<int> m_active;
+        /// Bytes forwarded from clients to the backend.
+        std::atomic<uint64_t> m_bytes_upstream;
+        /// Bytes forwarded from the backend to clients.
+        std::atomic<uint64_t> m_bytes_downstream;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Pairs an established backend connection with its client.
+         * @param backend_peer : Backend connection, carrying its pair.
+         */
+        void m_backend_connected(peer* backend_peer);
+
+        /**
+         * Closes and frees a pair whose sides are both done.
+         * @param conn : Pair to delete.
+         */
+        void m_delete(pair* conn);
+
+        /**
+         * Moves data received on one side to the other.
+         * @param conn : Pair of the connection.
+         * @param source : Peer data was received on.
+         */
+        void m_forward(pair* conn, peer* source);
+
+        /**
+         * Marks a side of a pair as done, and closes the other side.
+         *
+         * Deletes the pair once both sides are done.
+         *
+         * @param conn : Pair of the connection.
+         * @param side : Side which is done.
+         */
+        void m_side_done(pair* conn, int side);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param backend : Address to forward connections to.
+             * @param connect_timeout_ms : (optional) Timeout of backend
+             *                             connections, see
+             *                             tuxnet::client::connect().
+             */
+            proxy(const ip4_socket_address& backend,
+                int connect_timeout_ms=-1);
+
+            /**
+             * Destructor.
+             *
+             * Closes all backend connections, and with them their clients.
+             */
+            virtual ~proxy();
+
+            proxy(const proxy&) = delete;
+            proxy& operator=(const proxy&) = delete;
+
+            // Getters. -------------------------------------------------------
+
+            /**
+             * @brief Gets the backend address.
+             * @return Returns the address connections are forwarded to.
+             */
+            const ip4_socket_address& get_backend() const;
+
+            /**
+             * @brief Gets the proxy's counters.
+             * @return Returns connection and byte counts.
+             */
+            proxy_stats get_proxy_stats() const;
+
+        protected:
+
+            // Server events, used by the proxy. ------------------------------
+
+            void on_connect(peer* remote_peer) override final;
+            void on_receive(peer* remote_peer) override final;
+            void on_disconnect(peer* remote_peer) override final;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * Cache of serialized HTTP responses.
+ **/
+
+#ifndef TUXNET_RESPONSE_CACHE_H_INCLUDE
+#define TUXNET_RESPONSE_CACHE_H_INCLUDE
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace tuxnet
+{
+
+    /**
+     * Serialized response, immutable once cached.
+     *
+     * Shared by every thread sending it, see
+     * tuxnet::http_server::respond_cached().
+     */
+    struct cached_response
+    {
+        /// Status line, header lines, blank line and body.
+        std::string data;
+        /// Status code, from the status line.
+        int status;
+        /// Bytes of status line, CRLF included.
+        size_t status_length;
+        /// Bytes of status line and header lines, blank line included.
+        size_t head_length;
+        /// Offset of the Date value, std::string::npos if there's none.
+        size_t date_offset;
+        /// When it expires (see stats_clock()), 0 for never.
+        uint64_t expires;
+    };
+
+    /// Reference to a cached response, which stays valid once evicted.
+    typedef std::shared_ptr<const cached_response> cached_response_ptr;
+
+    /// Counters of a response cache.
+    struct response_cache_stats
+    {
+        /// Responses cached.
+        size_t entries;
+        /// Bytes cached, keys included.
+        size_t bytes;
+        /// Lookups which found a response.
+        uint64_t hits;
+        /// Lookups which didn't.
+        uint64_t misses;
+        /// Responses evicted to make room.
+        uint64_t evictions;
+        /// Responses dropped because their time to live ran out.
+        uint64_t expirations;
+    };
+
+    /**
+     * Size-bounded LRU cache of fully serialized HTTP responses.
+     *
+     * Handlers register the exact bytes of a response under a key, once,
+     * and answer later requests with the cached bytes, without formatting
+     * anything. Cached responses are immutable and reference counted, so an
+     * entry can be replaced, invalidated or evicted while other threads are
+     * still sending it.
+     *
+     * A Date header in a cached response isn't sent as cached :
+     * tuxnet::http_server::respond_cached() sends the current date of the
+     * calling thread (see http_date()) in its place, as a separate piece of
+     * the same writev.
+     *
+     * Responses expire after their time to live, or when invalidated. Once
+     * the cache holds more than max_bytes, the least recently used
+     * responses are evicted.
+     *
+     * Keys are spread over shards, each with its own lock, index and LRU
+     * list, so lookups of different keys rarely wait for each other. The
+     * LRU order is kept per shard : a put() evicts from its own shard
+     * first, then from the others.
+     */
+    class response_cache
+    {
+
+        /// Cached response and its key.
+        struct entry
+        {
+            std::string key;
+            cached_response_ptr response;
+        };
+
+        /// Keys sharing a lock.
+        struct shard
+        {
+            /// Entries, most recently used first.
+            std::list<entry> entries;
+            /// Entries by key, the keys pointing into the entries.
+            std::unordered_map<std::string_view, std::list<entry>::iterator>
+                index;
+            /// Lookups which found a response.
+            uint64_t hits = 0;
+            /// Lookups which didn't.
+            uint64_t misses = 0;
+            /// Responses evicted.
+            uint64_t evictions = 0;
+            /// Responses expired.
+            uint64_t expirations = 0;
+            /// Guards everything above.
+            std::mutex lock;
+        };
+
+        /// Number of shards.
+        static const size_t shard_count = 16;
+
+        // Private member variables. ------------------------------------------
+
+        /// Shards, picked by the hash of the key.
+        shard m_shards[shard_count];
+        /// Bytes cached, keys included.
+        std::atomic<size_t> m_bytes;
+        /// Most bytes cached.
+        const size_t m_max_bytes;
+        /// Time to live of responses put without one.
+        const int m_default_ttl_ms;
+
+        // Private member functions. ------------------------------------------
+
+        /**
+         * Removes an entry.
+         *
+         * Call with the shard's lock held.
+         *
+         * @param owner : Shard of the entry.
+         * @param it : Entry to remove.
+         */
+        void m_erase(shard& owner, std::list<entry>::iterator it);
+
+        /**
+         * Evicts the least recently used entries of a shard while the cache
+         * holds more than max_bytes.
+         *
+         * Call with the shard's lock held.
+         *
+         * @param owner : Shard to evict from.
+         * @param keep : Entries left in the shard at least.
+         */
+        void m_evict(shard& owner, size_t keep);
+
+        /**
+         * Gets the shard of a key.
+         * @param key : Key of a response.
+         * @return Returns the shard.
+         */
+        shard& m_shard(std::string_view key);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param max_bytes : (optional) Most bytes cached, keys
+             *                    included.
+             * @param default_ttl_ms : (optional) Time to live of responses
+             *                         put without one, 0 for never.
+             */
+            response_cache(size_t max_bytes=67108864, int default_ttl_ms=0);
+
+            response_cache(const response_cache&) = delete;
+            response_cache& operator=(const response_cache&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /// Removes all responses.
+            void clear();
+
+            /**
+             * @brief Gets a cached response.
+             *
+             * Marks it as the most recently used. Expired responses are
+             * removed, and not returned.
+             *
+             * @param key : Key the response was put under.
+             * @return Returns the response, or nullptr.
+             */
+            cached_response_ptr get(std::string_view key);
+
+            /**
+             * @brief Removes a cached response.
+             * @param key : Key the response was put under.
+             * @return Returns false if there was none.
+             */
+            bool invalidate(std::string_view key);
+
+            /**
+             * @brief Caches a serialized response.
+             *
+             * Replaces what was cached under the key. The response must be
+             * complete : status line, header lines, blank line and a body
+             * matching its Content-Length (or none). It shouldn't have a
+             * Connection header, which respond_cached() adds when needed.
+             *
+             * @param key : Key to cache the response under.
+             * @param response : Serialized response, see serialize().
+             * @param ttl_ms : (optional) Time to live in milliseconds, 0 for
+             *                 never, -1 for the cache's default.
+             * @return Returns the cached response, or nullptr if it doesn't
+             *         start with an HTTP/1.x status line, has no blank line
+             *         ending its head or is larger than the cache.
+             */
+            cached_response_ptr put(std::string_view key,
+                std::string response, int ttl_ms=-1);
+
+            /**
+             * @brief Gets the cache's counters.
+             * @return Returns entries, bytes and lookup counts.
+             */
+            response_cache_stats stats();
+
+            /**
+             * @brief Serializes a response for put().
+             *
+             * Includes a Date header (patched when sent) and Content-Length.
+             *
+             * @param status : Status code.
+             * @param body : Response body.
+             * @param content_type : (optional) Content-Type, left out if
+             *                       empty.
+             * @param headers : (optional) Extra header lines, each ending
+             *                  with CRLF.
+             * @return Returns the serialized response.
+             */
+            static std::string serialize(int status, std::string_view body,
+                std::string_view content_type="text/plain",
+                std::string_view headers=std::string_view());
+
+    };
+
+}
+
+#endif
@@ -2,11 +2,16 @@
 #define SERVER_H_INCLUDE
 
 #include <future>
+#include "tuxnet/admin.h"
+#include "tuxnet/heavy_hitters.h"
 #include "tuxnet/string.h"
 #include "tuxnet/socket_address.h"
 #include "tuxnet/peer.h"
 #include "tuxnet/lockable.h"
 #include "tuxnet/socket.h"
+#include "tuxnet/stats.h"
+#include "tuxnet/tcp_sampler.h"
+#include "tuxnet/watchdog.h"
 
 namespace tuxnet
 {
@@ -17,6 +22,10 @@ namespace tuxnet
 
         // Private member variables. ------------------------------------------
 
+        /// Admin listener serving metrics, nullptr if not enabled.
+        admin_listener* m_admin;
+        /// Remote addresses with the most connections and received bytes.
+        heavy_hitters m_heavy_hitters;
         /// Keepalive enabled?
         bool m_keepalive;
         /// Keepalive interval.
@@ -25,8 +34,16 @@ namespace tuxnet
         int m_keepalive_retries;
         /// Keepalive timeout.
         int m_keepalive_timeout;
+        /// Listen options used by listen() when none are given.
+        listen_options m_listen_options;
         /// Listening sockets.
         lockable<sockets> m_listen_sockets;
+        /// Counters of the server and peer threads.
+        stats_registry m_stats;
+        /// Samples TCP_INFO of all peers, started by poll().
+        tcp_sampler m_tcp_sampler;
+        /// Reports stalled event loops, started by poll().
+        watchdog m_watchdog;
 
         // Private member functions. ------------------------------------------
 
@@ -81,6 +98,16 @@ namespace tuxnet
             void configure_keepalive(bool enabled, int timeout=10, 
                 int interval=5, int retries=3);
 
+            /**
+             * @brief Configures the default listen socket tuning options.
+             *
+             * These are used by listen() calls which don't pass their own
+             * options. See tuxnet::listen_options for details.
+             *
+             * @param options : Listen options to use.
+             */
+            void configure_listen(const listen_options& options);
+
             /**
              * @brief Start listening for connections.
              *
@@ -92,6 +119,36 @@ namespace tuxnet
             virtual bool listen(const socket_addresses& saddrs, 
                 const layer4_protocol& proto);
 
+            /**
+             * @brief Start listening for connections with tuning options.
+             *
+             * Lets each group of listening sockets use its own backlog,
+             * TCP_DEFER_ACCEPT, TCP_FASTOPEN and buffer settings.
+             *
+             * @param saddrs : Array of socket address objects containing
+             *        ip/port/protocol information for which ports the server
+             *        should listen on.
+             * @param proto : Layer-4 protocol the server should listen on.
+             * @param options : Tuning options for these listening sockets.
+             */
+            virtual bool listen(const socket_addresses& saddrs,
+                const layer4_protocol& proto, const listen_options& options);
+
+            /**
+             * @brief Starts an admin listener serving metrics.
+             *
+             * Serves the counters of stats() and the histograms of latency()
+             * in the Prometheus text format on the given address, for
+             * instance 127.0.0.1:9100. The listener runs on its own
+             * low-priority thread (see tuxnet::admin_listener), it doesn't
+             * need poll() to be running. Calling this again moves the
+             * listener to the new address.
+             *
+             * @param saddr : Address/port pair to serve metrics on.
+             * @return Returns true on success, false on error.
+             */
+            bool listen_admin(const socket_address* const saddr);
+
             /**
              * Returns number of connected clients.
              * @return Number of connected clients.
@@ -107,6 +164,103 @@ namespace tuxnet
              */
             bool poll();
 
+            /**
+             * @brief Gets the server's counters.
+             *
+             * Every server and peer thread counts into its own cache-line
+             * aligned block without synchronization, this sums those blocks.
+             * Counts of threads that exited are included. It's cheap enough
+             * to call periodically from a monitoring thread.
+             *
+             * @return Returns the counters summed over all threads.
+             */
+            stats_snapshot stats();
+
+            /**
+             * @brief Gets event callback latency percentiles.
+             *
+             * Server and peer threads time every on_connect(), on_receive()
+             * and on_disconnect() call, as well as how long each event waited
+             * between epoll_wait() returning and its callback starting, in
+             * per-thread log-bucketed histograms. This merges them and
+             * returns p50/p99/p999/max over a rolling window. See
+             * tuxnet::stats_registry::latency() for how windows work.
+             *
+             * @param metric : Metric to summarize.
+             * @param window : (optional) Window length in seconds, 0 covers
+             *                 everything since the server was created.
+             * @return Returns the percentiles, in nanoseconds.
+             */
+            latency_summary latency(latency_metric metric, int window=0);
+
+            /**
+             * @brief Gets recent event loop stalls.
+             *
+             * While poll() runs, a watchdog thread reports event loops which
+             * haven't returned to epoll_wait within the configured threshold
+             * (see tuxnet::config::get_watchdog_threshold_ms()), along with
+             * the callback and peer they were busy with. Reports are also
+             * logged and counted in stats().
+             *
+             * @return Returns up to 64 recent reports, oldest first.
+             */
+            stall_reports stalls();
+
+            /**
+             * @brief Gets the distribution of TCP state over all peers.
+             *
+             * While poll() runs, a sampler thread reads TCP_INFO of every peer
+             * every tcp_info_interval_ms (see
+             * tuxnet::config::get_tcp_info_interval_ms()) and collects round
+             * trip times, congestion windows and unacked segments. Use
+             * peer::tcp_info() for the state of a single peer.
+             *
+             * @return Returns the summary of the last complete pass.
+             */
+            tcp_info_summary tcp_summary();
+
+            /**
+             * @brief Gets peers recently flagged as retransmitting.
+             *
+             * The sampler flags peers with a high retransmission ratio or
+             * repeated retransmission timeouts, see tuxnet::tcp_sampler.
+             * Flagged peers are also logged, and peer::get_retransmitting()
+             * returns true until they recover.
+             *
+             * @return Returns up to 64 recent reports, oldest first.
+             */
+            retransmit_reports retransmitting_peers();
+
+            /**
+             * @brief Gets the remote addresses with the most traffic.
+             *
+             * Accepted connections and received bytes are counted per IPv4
+             * address in count-min sketches of fixed size, so memory stays
+             * the same no matter how many clients connect. Estimates can be
+             * too high when many addresses are seen, never too low.
+             *
+             * @param metric : Metric to rank by.
+             * @param count : (optional) Maximum number of addresses, at most
+             *                16.
+             * @return Returns the addresses, busiest first.
+             */
+            heavy_hitter_list top_clients(heavy_hitter_metric metric,
+                int count=16);
+
+            /// Resets the counts behind top_clients().
+            void clear_top_clients();
+
+            /**
+             * @brief Gets busy and idle time per event loop thread.
+             *
+             * Busy time is everything outside epoll_wait, mostly callbacks.
+             * A thread that's close to 100% busy can't take more load, which
+             * makes this useful for capacity planning.
+             *
+             * @return Returns one entry per running server or peer thread.
+             */
+            thread_utilizations utilization();
+
         protected:
 
             // Events. --------------------------------------------------------
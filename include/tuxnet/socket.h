@@ -9,10 +9,12 @@
 #include <sys/epoll.h>
 #include <vector>
 #include <unordered_map>
+#include "tuxnet/heavy_hitters.h"
 #include "tuxnet/socket_address.h"
 #include "tuxnet/protocol.h"
 #include "tuxnet/lockable.h"
 #include "tuxnet/peer.h"
+#include "tuxnet/stats.h"
 
 namespace tuxnet
 {
@@ -20,6 +22,9 @@ namespace tuxnet
     // Forward declaration for tuxnet::server
     class server;
 
+    // Forward declaration for tuxnet::client
+    class client;
+
     /// Enum for the different states a socket can be in.
     enum socket_state
     {
@@ -56,6 +61,86 @@ namespace tuxnet
         SOCKET_STATE_CLOSED
     };
 
+    /**
+     * Tuning options for listening sockets.
+     *
+     * Pass these to tuxnet::server::listen() (or
+     * tuxnet::socket::set_listen_options()) before the socket starts
+     * listening. The defaults leave everything but the backlog at the
+     * kernel defaults.
+     *
+     * | option         | setsockopt option                | applied to       |
+     * | -------------- | -------------------------------- | ---------------- |
+     * | backlog        | listen() backlog argument        | listen socket    |
+     * | defer_accept   | IPPROTO_TCP, TCP_DEFER_ACCEPT    | listen socket    |
+     * | fastopen_queue | IPPROTO_TCP, TCP_FASTOPEN        | listen socket    |
+     * | receive_buffer | SOL_SOCKET, SO_RCVBUF            | listen socket    |
+     * | send_buffer    | SOL_SOCKET, SO_SNDBUF            | listen socket    |
+     * | nodelay        | IPPROTO_TCP, TCP_NODELAY         | accepted sockets |
+     * | quickack       | IPPROTO_TCP, TCP_QUICKACK        | accepted sockets |
+     *
+     * Buffer sizes are set before listen() so accepted connections inherit
+     * them and the TCP window scale is negotiated accordingly. TCP_NODELAY
+     * and TCP_QUICKACK are set on every accepted connection, since the
+     * latter isn't inherited from the listening socket.
+     */
+    struct listen_options
+    {
+        /**
+         * Maximum number of pending connections. A value lower than 1 uses
+         * net.core.somaxconn (read from /proc/sys/net/core/somaxconn).
+         */
+        int backlog = -1;
+        /**
+         * Only wake up for a new connection once it sent data, waiting at
+         * most this many seconds. 0 disables.
+         */
+        int defer_accept = 0;
+        /**
+         * Accept data in the SYN of TCP fast open clients, allowing up to
+         * this many pending fast open requests. 0 disables.
+         */
+        int fastopen_queue = 0;
+        /// Receive buffer size in bytes. 0 keeps the kernel default.
+        int receive_buffer = 0;
+        /// Send buffer size in bytes. 0 keeps the kernel default.
+        int send_buffer = 0;
+        /// Disable Nagle's algorithm on accepted connections.
+        bool nodelay = false;
+        /// Disable delayed ACKs on accepted connections.
+        bool quickack = false;
+    };
+
+    /**
+     * Source address options for outbound connections.
+     *
+     * Pass these to tuxnet::client::configure_connect() (or
+     * tuxnet::socket::set_connect_options()) before connecting. The defaults
+     * leave choosing the local address and port to connect().
+     *
+     * When a source address or port range is set, the socket is bound before
+     * connecting with IP_BIND_ADDRESS_NO_PORT, so the port is only picked by
+     * connect() once the destination is known. That lets the same local port
+     * be used towards different destinations, instead of bind() reserving it
+     * for good, which is what exhausts ephemeral ports under heavy fan-out.
+     *
+     * The port range is applied with IP_LOCAL_PORT_RANGE (Linux 6.3 and
+     * later). On older kernels the socket binds to the ports of the range
+     * round robin, with SO_REUSEADDR, until one is free.
+     */
+    struct connect_options
+    {
+        /// Local address to connect from, 0.0.0.0 lets the kernel pick.
+        ip4_address source;
+        /**
+         * Lowest local port to connect from. 0 (with source_port_max 0)
+         * uses net.ipv4.ip_local_port_range.
+         */
+        int source_port_min = 0;
+        /// Highest local port to connect from.
+        int source_port_max = 0;
+    };
+
     /**
      * Network socket.
      *
@@ -65,14 +150,13 @@ namespace tuxnet
     class socket
     {
 
+        friend class client;
         friend class server;
         friend class peer;
+        friend class tcp_sampler;
 
         // Private member variables. ------------------------------------------
 
-        /// epoll event buffer for events on the listening socket.
-        epoll_event* m_epoll_listener_events;
-
         /// Stores epoll file descriptor for polling the listening socket.
         int m_epoll_listener_fd;
 
@@ -91,15 +175,27 @@ namespace tuxnet
         /// Keepalive timeout (in seconds).
         int m_keepalive_timeout;
 
+        /// Source address options used when connecting.
+        connect_options m_connect_options;
+
+        /// Context given to the peer of a connection attempt.
+        void* m_connect_context;
+
+        /// Tuning options used when listening.
+        listen_options m_listen_options;
+
         /// Stores the local address/port pair.
         const socket_address* m_local_saddr;
 
         /// Stores the socket protocol.
         layer4_protocol m_proto;
 
-        /// Stores the remote address/port pair.
+        /// Stores the remote address/port pair, owned by the socket.
         const socket_address* m_remote_saddr;
 
+        /// Pointer to client object owning this socket, or nullptr.
+        client* m_client;
+
         /**
          * Pointer to server object owning this socket.
          * in case we're a listener socket.
@@ -109,6 +205,12 @@ namespace tuxnet
         /// Stores the current state of the socket.
         socket_state m_state;
 
+        /// Counters of the owning server, nullptr if there is none.
+        stats_registry* m_stats;
+
+        /// Busiest remote addresses of the owning server, or nullptr.
+        heavy_hitters* m_heavy_hitters;
+
         // Private member functions. ------------------------------------------
 
         void m_debug_peers();
@@ -120,6 +222,29 @@ namespace tuxnet
          */
         bool m_enable_keepalive(int fd);
 
+        /**
+         * @brief Applies listen options which need to be set on the
+         *        listening socket before calling listen().
+         * @return Returns true on success, false on error.
+         */
+        bool m_apply_listen_options();
+
+        /**
+         * @brief Applies listen options to an accepted connection.
+         * @param fd : File descriptor of the accepted connection.
+         * @return Returns true on success, false on error.
+         */
+        bool m_apply_peer_options(int fd);
+
+        /**
+         * @brief Binds a connecting socket to the source address options.
+         *
+         * Does nothing if m_connect_options leaves the source to connect().
+         *
+         * @return Returns true on success, false on error (errno is set).
+         */
+        bool m_bind_source();
+
         /// Binds the socket to an ipv4 address.
         bool m_ip4_bind();
 
@@ -139,6 +264,34 @@ namespace tuxnet
          */
         bool m_monitor_fd(int fd);
 
+        /**
+         * Reads net.core.somaxconn.
+         * @return Returns the system's maximum listen backlog, or SOMAXCONN
+         *         if it can't be read.
+         */
+        static int m_somaxconn();
+
+        /**
+         * Sets an integer socket option, logging (without exiting) on
+         * failure so callers can clean up the descriptor.
+         * @return Returns true on success, false otherwise.
+         */
+        bool m_setsockopt(int fd, int level, int option, int value,
+            const char* name);
+
+        /**
+         * @brief Completes a connection attempt started by connect().
+         *
+         * Once the socket is writable, checks whether the connection was
+         * established. If so, hands the file descriptor to a new peer,
+         * attaches m_connect_context to it, fires on_connect and starts the
+         * peer's thread.
+         *
+         * @return Returns 0 on success, the errno value of the failure
+         *         otherwise.
+         */
+        int m_finish_connect();
+
         /// Attempts to accept in incomming connection.
         /// @return Returns true on success, false otherwise.
         peer* m_try_accept();
@@ -211,6 +364,18 @@ namespace tuxnet
              */
             int get_keepalive_timeout() const;
 
+            /**
+             * @brief Gets the source address options used when connecting.
+             * @return Returns the connect options for this socket.
+             */
+            const connect_options& get_connect_options() const;
+
+            /**
+             * @brief Gets the tuning options used when listening.
+             * @return Returns the listen options for this socket.
+             */
+            const listen_options& get_listen_options() const;
+
             /**
              * @brief Gets ip/port information for local side of the 
              *        connection.
@@ -233,6 +398,16 @@ namespace tuxnet
              */
             const socket_address* const get_remote() const;
 
+            /**
+             * @brief Sets the source address options used when connecting.
+             *
+             * Must be called before connect(). See tuxnet::connect_options
+             * for the available options.
+             *
+             * @param options : Connect options to use.
+             */
+            void set_connect_options(const connect_options& options);
+
             /**
              * @brief Sets whether or not keepalive should be enabled for this 
              *        socket.
@@ -334,6 +509,16 @@ namespace tuxnet
              */
             void set_keepalive_timeout(int timeout);
 
+            /**
+             * @brief Sets the tuning options used when listening.
+             *
+             * Must be called before listen(). See tuxnet::listen_options for
+             * the available options.
+             *
+             * @param options : Listen options to use.
+             */
+            void set_listen_options(const listen_options& options);
+
             // Methods. -------------------------------------------------------
 
             /**
@@ -350,6 +535,23 @@ namespace tuxnet
             /// Closes the socket.
             void close();
 
+            /**
+             * @brief Starts connecting to an address/port pair.
+             *
+             * The connect is non-blocking : the socket is in the
+             * SOCKET_STATE_CONNECTING state until it becomes writable,
+             * which tuxnet::client waits for on its connector thread.
+             *
+             * @param saddr : socket_address object containing address/port,
+             *                copied.
+             * @param client_object : (optional) pointer to tuxnet::client
+             *                instance owning this socket.
+             * @return Returns true if the attempt started, false on failure
+             *         (errno is set).
+             */
+            bool connect(const socket_address* const saddr,
+                client* client_object=nullptr);
+
             /**
              * Disconnects a remote peer.
              *
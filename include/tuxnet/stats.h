@@ -0,0 +1,515 @@
+/**
+ * Per-thread network engine counters.
+ **/
+
+#ifndef TUXNET_STATS_H_INCLUDE
+#define TUXNET_STATS_H_INCLUDE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "tuxnet/histogram.h"
+#include "tuxnet/perf.h"
+#include "tuxnet/socket_address.h"
+
+namespace tuxnet
+{
+
+    /// Reasons a peer connection can end.
+    enum disconnect_reason
+    {
+        /// The application called disconnect().
+        DISCONNECT_REASON_LOCAL = 0,
+        /// The remote end closed the connection.
+        DISCONNECT_REASON_REMOTE,
+        /// A read, write or epoll call failed.
+        DISCONNECT_REASON_ERROR,
+        /// epoll reported EPOLLHUP or EPOLLERR.
+        DISCONNECT_REASON_HANGUP,
+        /// The listening socket was closed with the peer still connected.
+        DISCONNECT_REASON_SHUTDOWN,
+        /// Number of disconnect reasons.
+        DISCONNECT_REASON_COUNT
+    };
+
+    /// Latencies recorded by event loops.
+    enum latency_metric
+    {
+        /// Time spent in on_connect().
+        LATENCY_CONNECT = 0,
+        /// Time spent in on_receive().
+        LATENCY_RECEIVE,
+        /// Time spent in on_disconnect().
+        LATENCY_DISCONNECT,
+        /**
+         * Time between epoll_wait() returning and the on_connect() or
+         * on_receive() callback for the event starting.
+         */
+        LATENCY_DISPATCH_DELAY,
+        /**
+         * Time between the kernel receiving data and on_receive() starting,
+         * only recorded when rx_timestamps is enabled in the config.
+         */
+        LATENCY_RECEIVE_QUEUE,
+        /// Number of latency metrics.
+        LATENCY_METRIC_COUNT
+    };
+
+    /// Histograms of a single thread, one per latency_metric.
+    struct latency_histograms
+    {
+        /// Histograms, indexed by latency_metric.
+        histogram metrics[LATENCY_METRIC_COUNT];
+    };
+
+    /// Percentiles of a latency metric, all durations in nanoseconds.
+    struct latency_summary
+    {
+        /// Number of recorded values.
+        uint64_t count;
+        /// Median.
+        uint64_t p50;
+        /// 99th percentile.
+        uint64_t p99;
+        /// 99.9th percentile.
+        uint64_t p999;
+        /// Highest recorded value.
+        uint64_t max;
+        /// Seconds actually covered by the summary.
+        double seconds;
+    };
+
+    /**
+     * Gets the name of a disconnect reason.
+     * @return Returns a lower case name, such as "remote".
+     */
+    const char* disconnect_reason_name(disconnect_reason reason);
+
+    /**
+     * Gets the name of a latency metric.
+     * @return Returns a lower case name, such as "receive".
+     */
+    const char* latency_metric_name(latency_metric metric);
+
+    /**
+     * Gets a monotonic timestamp for latency measurements.
+     * @return Returns nanoseconds since an unspecified starting point.
+     */
+    inline uint64_t stats_clock()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Increments a counter owned by the calling thread.
+     *
+     * Counters have a single writer, so a relaxed load and store is enough
+     * and avoids the locked read-modify-write of fetch_add.
+     *
+     * @param counter : Counter to increment.
+     * @param n : (optional) Amount to add.
+     */
+    inline void stat_add(std::atomic<uint64_t>& counter, uint64_t n=1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+            std::memory_order_relaxed);
+    }
+
+    /**
+     * Counters for a single thread.
+     *
+     * Blocks are cache-line aligned so threads never write to the same cache
+     * line. Only the owning thread writes to a block, readers sum all blocks
+     * with relaxed loads (see stats_registry::snapshot()).
+     */
+    struct alignas(64) thread_stats
+    {
+        /// Accepted connections.
+        std::atomic<uint64_t> accepts;
+        /// Failed accept() calls (not counting EAGAIN).
+        std::atomic<uint64_t> accept_errors;
+        /// Bytes received from peers.
+        std::atomic<uint64_t> bytes_in;
+        /// Bytes sent to peers.
+        std::atomic<uint64_t> bytes_out;
+        /// Disconnects, indexed by disconnect_reason.
+        std::atomic<uint64_t> disconnects[DISCONNECT_REASON_COUNT];
+        /// Reads that returned EAGAIN.
+        std::atomic<uint64_t> eagain_spins;
+        /// Events returned by epoll_wait.
+        std::atomic<uint64_t> epoll_events;
+        /// epoll_wait calls that returned at least one event.
+        std::atomic<uint64_t> epoll_wakeups;
+        /// recv() calls.
+        std::atomic<uint64_t> recv_calls;
+        /// send() calls.
+        std::atomic<uint64_t> send_calls;
+        /**
+         * Latency histograms, allocated when the thread first records a
+         * latency so idle threads don't pay for them.
+         */
+        std::atomic<latency_histograms*> latency;
+
+        /// Nanoseconds spent outside epoll_wait().
+        std::atomic<uint64_t> busy_ns;
+        /// Nanoseconds spent in epoll_wait().
+        std::atomic<uint64_t> idle_ns;
+        /// busy_ns when the current thread attached.
+        std::atomic<uint64_t> attach_busy_ns;
+        /// idle_ns when the current thread attached.
+        std::atomic<uint64_t> attach_idle_ns;
+        /// When the loop last left epoll_wait(), 0 while it's waiting.
+        std::atomic<uint64_t> busy_since;
+        /// When the loop last entered epoll_wait(), 0 while it's busy.
+        std::atomic<uint64_t> idle_since;
+
+        /// Running callback as a latency_metric, -1 if none.
+        std::atomic<int> callback;
+        /// File descriptor of the peer the callback runs for.
+        std::atomic<int> callback_fd;
+        /// IPv4 address of that peer, in network byte order.
+        std::atomic<uint32_t> callback_ip;
+        /// Port of that peer.
+        std::atomic<uint16_t> callback_port;
+
+        /// Stalls reported by the watchdog (written by the watchdog only).
+        std::atomic<uint64_t> stalls;
+        /// busy_since of the last reported stall (watchdog only).
+        std::atomic<uint64_t> stall_reported;
+
+        /// Hardware event counts, indexed by perf_counter.
+        std::atomic<uint64_t> perf_counts[PERF_COUNTER_COUNT];
+        /// epoll events handled while hardware events were counted.
+        std::atomic<uint64_t> perf_events;
+        /**
+         * Hardware counters of the attached thread, nullptr when not
+         * counting (see config::set_perf_counters()).
+         */
+        std::atomic<perf_group*> perf;
+        /// Counter values when the current batch started (owner only).
+        uint64_t perf_start[PERF_COUNTER_COUNT];
+        /// epoll_events when the current batch started (owner only).
+        uint64_t perf_start_events;
+        /// Whether perf_start is valid (owner only).
+        bool perf_started;
+
+        /// Constructor, zeroes all counters.
+        thread_stats();
+
+        /**
+         * Marks the block as used by the calling thread, which is busy.
+         *
+         * Opens the thread's hardware counters if enabled in the config.
+         */
+        void attach();
+
+        /**
+         * Marks the start of a callback, for the watchdog.
+         *
+         * Nested callbacks (on_disconnect() called from on_receive() for
+         * instance) are attributed to the outer one.
+         *
+         * @param metric : Callback about to run.
+         * @param fd : File descriptor of the peer.
+         * @param saddr : Address of the peer.
+         * @return Returns false if another callback is already running, in
+         *         which case end_callback() must not be called.
+         */
+        bool begin_callback(latency_metric metric, int fd,
+            const socket_address* saddr);
+
+        /// Marks the end of the running callback.
+        void end_callback();
+
+        /// Marks the block as no longer used by a thread.
+        void detach();
+
+        /**
+         * Records a latency. Only the owning thread may call this.
+         * @param metric : What was measured.
+         * @param nanoseconds : Measured duration.
+         */
+        void record(latency_metric metric, uint64_t nanoseconds);
+
+        /**
+         * Call right before epoll_wait(), accounts busy time.
+         *
+         * Also adds the hardware events of the batch of events handled since
+         * the last wait_end().
+         */
+        void wait_begin();
+
+        /**
+         * Call right after epoll_wait(), accounts idle time.
+         *
+         * Also reads the hardware counters at the start of the batch.
+         *
+         * @return Returns the current time (see stats_clock()).
+         */
+        uint64_t wait_end();
+    };
+
+    /// Busy and idle time of a single event loop thread.
+    struct thread_utilization
+    {
+        /// Nanoseconds spent outside epoll_wait() since the thread started.
+        uint64_t busy_ns;
+        /// Nanoseconds spent in epoll_wait() since the thread started.
+        uint64_t idle_ns;
+        /// How long the loop has been away from epoll_wait(), 0 if waiting.
+        uint64_t busy_for_ns;
+        /// Busy time as a percentage of the thread's lifetime.
+        double utilization;
+    };
+
+    /// Collection of per-thread utilizations.
+    typedef std::vector<thread_utilization> thread_utilizations;
+
+    /**
+     * Snapshot of counters summed over all threads.
+     */
+    struct stats_snapshot
+    {
+        /// Accepted connections.
+        uint64_t accepts;
+        /// Failed accept() calls (not counting EAGAIN).
+        uint64_t accept_errors;
+        /// Bytes received from peers.
+        uint64_t bytes_in;
+        /// Bytes sent to peers.
+        uint64_t bytes_out;
+        /// Disconnects, indexed by disconnect_reason.
+        uint64_t disconnects[DISCONNECT_REASON_COUNT];
+        /// Reads that returned EAGAIN.
+        uint64_t eagain_spins;
+        /// Events returned by epoll_wait.
+        uint64_t epoll_events;
+        /// epoll_wait calls that returned at least one event.
+        uint64_t epoll_wakeups;
+        /// recv() calls.
+        uint64_t recv_calls;
+        /// send() calls.
+        uint64_t send_calls;
+        /// Nanoseconds spent outside epoll_wait(), over all threads.
+        uint64_t busy_ns;
+        /// Nanoseconds spent in epoll_wait(), over all threads.
+        uint64_t idle_ns;
+        /// Event loop stalls reported by the watchdog.
+        uint64_t stalls;
+        /// Number of threads currently holding a counter block.
+        uint64_t threads;
+        /// Hardware event counts, indexed by perf_counter.
+        uint64_t perf[PERF_COUNTER_COUNT];
+        /// epoll events handled while hardware events were counted.
+        uint64_t perf_events;
+        /// Number of threads currently counting hardware events.
+        uint64_t perf_threads;
+
+        /// Average number of events handled per epoll wakeup.
+        double events_per_wakeup() const;
+
+        /**
+         * Average hardware events per handled epoll event.
+         *
+         * Every epoll event is a connection or a request (or part of one)
+         * being dispatched, so this is the cost per request including the
+         * event loop's own overhead.
+         *
+         * @param counter : Counter to average.
+         * @return Returns 0 when no hardware events were counted.
+         */
+        double perf_per_event(perf_counter counter) const;
+
+        /// Total number of disconnects, for any reason.
+        uint64_t total_disconnects() const;
+
+        /// Busy time as a percentage of busy and idle time.
+        double utilization() const;
+    };
+
+    /**
+     * Hands out per-thread counter blocks and sums them on read.
+     *
+     * Threads running an event loop attach to a registry with a stats_scope
+     * and increment the counters of stats_registry::local(). Blocks of
+     * threads that exit are kept (with their counts) and handed to the next
+     * thread that attaches, so totals survive short-lived threads and memory
+     * stays bounded by the peak number of threads.
+     */
+    class stats_registry
+    {
+
+        /// Merged histograms taken at some point in time.
+        struct latency_sample
+        {
+            /// When the sample was taken (see stats_clock()).
+            uint64_t time;
+            /// Histograms, indexed by latency_metric.
+            histogram_snapshot metrics[LATENCY_METRIC_COUNT];
+        };
+
+        // Private member variables. ------------------------------------------
+
+        /// Blocks currently attached to a thread.
+        std::vector<thread_stats*> m_active;
+        /// Blocks ready to be reused.
+        std::vector<thread_stats*> m_free;
+        /// Recent latency samples, oldest first, at most one per second.
+        std::deque<latency_sample*> m_history;
+        /// Guards m_history.
+        std::mutex m_history_lock;
+        /// Guards m_active and m_free.
+        std::mutex m_lock;
+        /// When the registry was created (see stats_clock()).
+        uint64_t m_start;
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /// Constructor.
+            stats_registry();
+
+            /// Destructor.
+            ~stats_registry();
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Gets a counter block for a new thread.
+             * @return Returns a block, reused if one is available.
+             */
+            thread_stats* acquire();
+
+            /**
+             * Gets the counter block of the calling thread.
+             *
+             * Threads that aren't attached to any registry get a shared
+             * block which isn't counted anywhere.
+             *
+             * @return Returns the calling thread's counter block.
+             */
+            static thread_stats& local();
+
+            /**
+             * Gets latency percentiles over a rolling window.
+             *
+             * Windows are computed from merged samples of all threads'
+             * histograms, taken at most once per second by calls to this
+             * function and kept for max_latency_window seconds. The window
+             * starts at the newest sample which is at least `window` seconds
+             * old, so to get exact windows call this at least once per
+             * second (from a monitoring thread for instance); the seconds
+             * member of the result holds the span actually covered.
+             *
+             * @param metric : Metric to summarize.
+             * @param window : (optional) Window length in seconds, 0 covers
+             *                 everything since the registry was created.
+             * @return Returns the percentiles for the window.
+             */
+            latency_summary latency(latency_metric metric, int window=0);
+
+            /**
+             * Merges the latency histograms of all threads.
+             *
+             * Doesn't allocate, so it can be used to export histograms from
+             * a thread that must not touch the heap.
+             *
+             * @param metrics : Snapshots to add to, indexed by
+             *                  latency_metric.
+             */
+            void merge_latency(
+                histogram_snapshot (&metrics)[LATENCY_METRIC_COUNT]);
+
+            /// Longest supported rolling window, in seconds.
+            static const int max_latency_window = 60;
+
+            /**
+             * Gets busy and idle time of every running event loop thread.
+             * @return Returns one entry per attached thread.
+             */
+            thread_utilizations utilization();
+
+            /**
+             * Returns a block when its thread stops.
+             * @param block : Block obtained from acquire().
+             */
+            void release(thread_stats* block);
+
+            /**
+             * Sums the counters of all threads.
+             * @return Returns the totals.
+             */
+            stats_snapshot snapshot();
+
+            /**
+             * Calls a function for every block, including released ones.
+             *
+             * The registry is locked while the function runs.
+             *
+             * @param f : Function taking a `thread_stats&` and a bool which is
+             *            true if the block is attached to a running thread.
+             */
+            template<typename Function>
+            void for_each(Function f)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                for (auto it = m_active.begin(); it != m_active.end(); ++it)
+                {
+                    f(**it, true);
+                }
+                for (auto it = m_free.begin(); it != m_free.end(); ++it)
+                {
+                    f(**it, false);
+                }
+            }
+
+    };
+
+    /**
+     * Attaches the calling thread to a stats_registry for its lifetime.
+     *
+     * ```
+     * std::thread thread([registry](){
+     *     stats_scope scope(registry);
+     *     // ... event loop ...
+     * });
+     * ```
+     */
+    class stats_scope
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Block attached to the thread.
+        thread_stats* m_block;
+        /// Block that was attached before this scope.
+        thread_stats* m_previous;
+        /// Registry the block came from.
+        stats_registry* m_registry;
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor, attaches the calling thread.
+             * @param registry : Registry to attach to, nullptr does nothing.
+             */
+            stats_scope(stats_registry* registry);
+
+            /// Destructor, detaches the calling thread.
+            ~stats_scope();
+
+            stats_scope(const stats_scope&) = delete;
+            stats_scope& operator=(const stats_scope&) = delete;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * Periodic TCP_INFO sampling of all peers.
+ **/
+
+#ifndef TUXNET_TCP_SAMPLER_H_INCLUDE
+#define TUXNET_TCP_SAMPLER_H_INCLUDE
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tuxnet/histogram.h"
+#include "tuxnet/lockable.h"
+#include "tuxnet/peer.h"
+#include "tuxnet/socket.h"
+
+namespace tuxnet
+{
+
+    /// Describes a peer the sampler found retransmitting too much.
+    struct retransmit_report
+    {
+        /// When the peer was flagged (see stats_clock()).
+        uint64_t time;
+        /// File descriptor of the peer.
+        int fd;
+        /// Address of the peer as ip:port.
+        std::string peer;
+        /// Segments retransmitted since the previous sample.
+        uint32_t retransmits;
+        /// Retransmitted share of the segments sent since then (0 to 1).
+        double ratio;
+        /// TCP state when the peer was flagged.
+        peer_tcp_info info;
+    };
+
+    /// Collection of retransmit reports.
+    typedef std::vector<retransmit_report> retransmit_reports;
+
+    /// Distribution of TCP state over all peers, from a complete pass.
+    struct tcp_info_summary
+    {
+        /// When the pass finished (see stats_clock()), 0 if none did yet.
+        uint64_t time;
+        /// Number of peers sampled.
+        uint64_t peers;
+        /// Number of peers currently flagged as retransmitting.
+        uint64_t retransmitting;
+        /// Smoothed round trip times in microseconds.
+        histogram_snapshot rtt_us;
+        /// Congestion windows in segments.
+        histogram_snapshot snd_cwnd;
+        /// Unacknowledged segments.
+        histogram_snapshot unacked;
+    };
+
+    /**
+     * Samples TCP_INFO of every peer of a set of listening sockets.
+     *
+     * Every config tcp_info_interval_ms the sampler thread walks all peers,
+     * taking the socket's peer lock for at most m_batch_size peers at a time
+     * so accepting and disconnecting peers never wait long. Each peer costs
+     * one getsockopt(). Round trip times, congestion windows and unacked
+     * segments of a pass are collected into histograms.
+     *
+     * A peer gets flagged as retransmitting (see peer::get_retransmitting())
+     * when it hits one of two limits. One is at least m_min_retransmits
+     * retransmissions since the previous sample making up more than
+     * m_max_retransmit_ratio of the segments written to it. The other is at
+     * least m_max_backoff retransmission timeouts in a row. Newly flagged
+     * peers are logged and kept in a bounded list of reports.
+     *
+     * A pass without newly flagged peers allocates no memory. The thread
+     * runs with the SCHED_IDLE policy when permitted.
+     */
+    class tcp_sampler
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Peers sampled per lock of a socket's peer list.
+        static const size_t m_batch_size = 256;
+        /// Number of reports kept.
+        static const size_t m_max_reports = 64;
+        /// Retransmission timeouts in a row which flag a peer.
+        static const uint32_t m_max_backoff = 3;
+        /// Retransmitted share of sent segments which flags a peer.
+        static constexpr double m_max_retransmit_ratio = 0.05;
+        /// Fewer retransmissions than this between samples never flag.
+        static const uint32_t m_min_retransmits = 3;
+
+        /// Summary being built by the current pass (sampler thread only).
+        tcp_info_summary m_building;
+        /// Reports of peers flagged by the current pass (sampler thread only).
+        retransmit_reports m_flagged;
+        /// Registered log format for flagged peers.
+        const uint32_t m_flagged_format;
+        /// Sockets walked by the current pass (sampler thread only).
+        sockets m_listeners;
+        /// Guards m_reports, m_stopping and m_summary.
+        std::mutex m_lock;
+        /// Recent reports, oldest first.
+        std::deque<retransmit_report> m_reports;
+        /// Sockets whose peers are sampled.
+        lockable<sockets>* const m_sockets;
+        /// Set to stop the sampler thread.
+        bool m_stopping;
+        /// Summary of the last complete pass.
+        tcp_info_summary m_summary;
+        /// Sampler thread.
+        std::thread m_thread;
+        /// Wakes the sampler thread up when stopping.
+        std::condition_variable m_wake;
+
+        // Private member functions. ------------------------------------------
+
+        /// Samples all peers once.
+        void m_pass();
+
+        /// Samples TCP_INFO until stopped.
+        void m_run();
+
+        /**
+         * Samples a single peer, the socket's peer lock must be held.
+         * @param client : Peer to sample.
+         * @param flagged : Receives reports of newly flagged peers.
+         */
+        void m_sample(peer* client, retransmit_reports& flagged);
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param sockets : Sockets whose peers to sample, must outlive
+             *                  the sampler.
+             */
+            tcp_sampler(lockable<sockets>* sockets);
+
+            /// Destructor, stops the sampler thread.
+            ~tcp_sampler();
+
+            tcp_sampler(const tcp_sampler&) = delete;
+            tcp_sampler& operator=(const tcp_sampler&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Gets recently flagged peers.
+             * @return Returns up to 64 reports, oldest first.
+             */
+            retransmit_reports reports();
+
+            /// Starts the sampler thread, if it isn't running.
+            void start();
+
+            /// Stops the sampler thread.
+            void stop();
+
+            /**
+             * Gets the distribution of TCP state over all peers.
+             * @return Returns the summary of the last complete pass.
+             */
+            tcp_info_summary summary();
+
+    };
+
+}
+
+#endif
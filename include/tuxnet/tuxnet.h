@@ -6,5 +6,21 @@
 #include "tuxnet/ip_address.h"
 #include "tuxnet/socket_address.h"
 #include "tuxnet/server.h"
+#include "tuxnet/client.h"
+#include "tuxnet/connection_pool.h"
+#include "tuxnet/pipeline.h"
+#include "tuxnet/proxy.h"
+#include "tuxnet/http.h"
+#include "tuxnet/hpack.h"
+#include "tuxnet/http2.h"
+#include "tuxnet/http_server.h"
+#include "tuxnet/response_cache.h"
+#include "tuxnet/websocket.h"
+#include "tuxnet/admin.h"
+#include "tuxnet/stats.h"
+#include "tuxnet/flight_recorder.h"
+#include "tuxnet/heavy_hitters.h"
+#include "tuxnet/tcp_sampler.h"
+#include "tuxnet/watchdog.h"
 
 #endif
@@ -0,0 +1,111 @@
+/**
+ * Event loop stall detection.
+ **/
+
+#ifndef TUXNET_WATCHDOG_H_INCLUDE
+#define TUXNET_WATCHDOG_H_INCLUDE
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    /// Describes an event loop that stayed away from epoll_wait too long.
+    struct stall_report
+    {
+        /// When the stall was detected (see stats_clock()).
+        uint64_t time;
+        /// How long the loop had been busy when it was detected.
+        uint64_t busy_ns;
+        /// Callback that was running as a latency_metric, -1 if none.
+        int callback;
+        /// File descriptor of the peer the callback ran for, -1 if none.
+        int fd;
+        /// Address of that peer as ip:port, empty if unknown.
+        std::string peer;
+    };
+
+    /// Collection of stall reports.
+    typedef std::vector<stall_report> stall_reports;
+
+    /**
+     * Watches the event loops attached to a stats_registry.
+     *
+     * Event loops publish when they leave and re-enter epoll_wait and which
+     * callback they're running (see thread_stats). The watchdog thread wakes
+     * up a few times per threshold (config watchdog_threshold_ms) and
+     * reports every loop that has been busy for longer, once per busy
+     * period : it's logged, counted in the loop's stalls counter and kept in
+     * a bounded list of recent reports.
+     */
+    class watchdog
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Number of reports kept.
+        static const size_t m_max_reports = 64;
+
+        /// Guards m_reports and m_stopping.
+        std::mutex m_lock;
+        /// Recent reports, oldest first.
+        std::deque<stall_report> m_reports;
+        /// Registry to watch.
+        stats_registry* const m_stats;
+        /// Set to stop the watchdog thread.
+        bool m_stopping;
+        /// Watchdog thread.
+        std::thread m_thread;
+        /// Wakes the watchdog thread up when stopping.
+        std::condition_variable m_wake;
+
+        // Private member functions. ------------------------------------------
+
+        /// Checks all event loops once.
+        void m_check();
+
+        /// Checks event loops until stopped.
+        void m_run();
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param stats : Registry to watch, must outlive the watchdog.
+             */
+            watchdog(stats_registry* stats);
+
+            /// Destructor, stops the watchdog thread.
+            ~watchdog();
+
+            watchdog(const watchdog&) = delete;
+            watchdog& operator=(const watchdog&) = delete;
+
+            // Methods. -------------------------------------------------------
+
+            /**
+             * Gets recent stall reports.
+             * @return Returns up to 64 reports, oldest first.
+             */
+            stall_reports reports();
+
+            /// Starts the watchdog thread, if it isn't running.
+            void start();
+
+            /// Stops the watchdog thread.
+            void stop();
+
+    };
+
+}
+
+#endif
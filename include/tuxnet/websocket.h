@@ -0,0 +1,129 @@
+/**
+ * WebSocket framing and handshake (RFC 6455).
+ **/
+
+#ifndef TUXNET_WEBSOCKET_H_INCLUDE
+#define TUXNET_WEBSOCKET_H_INCLUDE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "tuxnet/http.h"
+
+namespace tuxnet
+{
+
+    /// Frame opcodes.
+    enum websocket_opcode
+    {
+        WEBSOCKET_CONTINUATION = 0x0,
+        WEBSOCKET_TEXT = 0x1,
+        WEBSOCKET_BINARY = 0x2,
+        WEBSOCKET_CLOSE = 0x8,
+        WEBSOCKET_PING = 0x9,
+        WEBSOCKET_PONG = 0xa
+    };
+
+    /// Status codes of close frames.
+    enum websocket_status
+    {
+        WEBSOCKET_NORMAL = 1000,
+        WEBSOCKET_GOING_AWAY = 1001,
+        WEBSOCKET_PROTOCOL_ERROR = 1002,
+        WEBSOCKET_UNSUPPORTED_DATA = 1003,
+        WEBSOCKET_NO_STATUS = 1005,
+        WEBSOCKET_INVALID_DATA = 1007,
+        WEBSOCKET_POLICY_VIOLATION = 1008,
+        WEBSOCKET_MESSAGE_TOO_BIG = 1009,
+        WEBSOCKET_INTERNAL_ERROR = 1011
+    };
+
+    /// Most bytes in a frame header, masking key included.
+    const size_t websocket_max_header_length = 14;
+
+    /// Frame header, decoded.
+    struct websocket_frame_header
+    {
+        /// Whether this is the last frame of its message.
+        bool fin;
+        /// Opcode, see websocket_opcode.
+        uint8_t opcode;
+        /// Whether the payload is masked, as it is from clients.
+        bool masked;
+        /// Masking key, in the order it was sent.
+        uint8_t mask[4];
+        /// Payload length.
+        uint64_t length;
+    };
+
+    /**
+     * Decodes a frame header.
+     * @param data : Received data, starting with the header.
+     * @param length : Bytes of data.
+     * @param header : Set to the decoded header.
+     * @return Returns the header's length, 0 if more data is needed or -1
+     *         if the header is malformed (reserved bits or opcodes, or a
+     *         fragmented or oversized control frame).
+     */
+    int websocket_read_frame_header(const char* data, size_t length,
+        websocket_frame_header& header);
+
+    /**
+     * Encodes an unmasked frame header, as servers send them.
+     * @param out : Room for websocket_max_header_length bytes.
+     * @param opcode : Opcode.
+     * @param length : Payload length.
+     * @param fin : (optional) Whether this is the last frame of its
+     *              message.
+     * @return Returns the header's length.
+     */
+    size_t websocket_write_frame_header(char* out, uint8_t opcode,
+        uint64_t length, bool fin=true);
+
+    /**
+     * @brief Unmasks (or masks) a payload in place.
+     *
+     * XORs 16 bytes at a time where SSE2 is available, 8 bytes at a time
+     * otherwise.
+     *
+     * @param data : Payload.
+     * @param length : Bytes of payload.
+     * @param mask : Masking key of the frame.
+     */
+    void websocket_unmask(char* data, size_t length, const uint8_t mask[4]);
+
+    /**
+     * @brief Checks that text is valid UTF-8.
+     *
+     * Skips runs of ASCII 16 bytes at a time where SSE2 is available and
+     * checks the rest sequence by sequence, rejecting overlong forms,
+     * surrogates and code points past U+10FFFF.
+     *
+     * @param data : Text.
+     * @param length : Bytes of text.
+     * @return Returns true if the text is valid UTF-8.
+     */
+    bool websocket_valid_utf8(const char* data, size_t length);
+
+    /**
+     * @brief Checks whether a request asks for a WebSocket handshake.
+     *
+     * That's a GET over HTTP/1.1 with Upgrade: websocket, Connection:
+     * upgrade, Sec-WebSocket-Version: 13 and a Sec-WebSocket-Key.
+     *
+     * @param request : Request.
+     * @return Returns true if the request is a valid handshake.
+     */
+    bool websocket_is_upgrade(const http_request& request);
+
+    /**
+     * Computes the Sec-WebSocket-Accept value answering a handshake.
+     * @param key : Sec-WebSocket-Key sent by the client.
+     * @return Returns the base64 encoded SHA-1 of the key and the GUID.
+     */
+    std::string websocket_accept_key(std::string_view key);
+
+}
+
+#endif
@@ -0,0 +1,308 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "tuxnet/admin.h"
+#include "tuxnet/log.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// Quantiles exported for every latency metric.
+        const double latency_quantiles[] = { 0.5, 0.99, 0.999 };
+
+        /// Converts nanoseconds to seconds.
+        inline double seconds(uint64_t nanoseconds)
+        {
+            return static_cast<double>(nanoseconds) / 1e9;
+        }
+
+    }
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    admin_listener::admin_listener(stats_registry* stats) :
+        m_body(new char[m_body_capacity]),
+        m_body_length(0),
+        m_fd(-1),
+        m_request(new char[m_request_capacity]),
+        m_stopping(false),
+        m_stats(stats)
+    {
+    }
+
+    // Destructor.
+    admin_listener::~admin_listener()
+    {
+        stop();
+        delete[] m_body;
+        delete[] m_request;
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Starts listening and serving scrapes.
+    bool admin_listener::listen(const socket_address* const saddr)
+    {
+        const ip4_socket_address* p4saddr =
+            dynamic_cast<const ip4_socket_address*>(saddr);
+        if (p4saddr == nullptr)
+        {
+            log::get().info("Admin listener needs an IPv4 socket address.");
+            return false;
+        }
+        if (m_fd != -1) stop();
+        m_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+        int enable = 1;
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        const sockaddr_in in_addr = p4saddr->get_sockaddr_in();
+        if ((::bind(m_fd, reinterpret_cast<const sockaddr*>(&in_addr),
+            sizeof(in_addr)) == -1) or (::listen(m_fd, 16) == -1))
+        {
+            std::string errstr = "Could not start admin listener: ";
+            errstr += strerror(errno);
+            errstr += " (errno=" + std::to_string(errno) + ")";
+            log::get().info(errstr);
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        m_stopping = false;
+        m_thread = std::thread([this](){ m_run(); });
+        return true;
+    }
+
+    // Stops serving and closes the listening socket.
+    void admin_listener::stop()
+    {
+        if (m_fd == -1) return;
+        m_stopping = true;
+        // Wakes up the blocking accept().
+        shutdown(m_fd, SHUT_RDWR);
+        if (m_thread.joinable() == true) m_thread.join();
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Appends formatted text to the response body.
+    void admin_listener::m_append(const char* format, ...)
+    {
+        int available = m_body_capacity - m_body_length;
+        if (available <= 0) return;
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(m_body + m_body_length, available, format,
+            args);
+        va_end(args);
+        if ((length < 0) or (length >= available))
+        {
+            // Truncated, stop after the last complete line.
+            m_body_length = m_body_capacity;
+            while ((m_body_length > 0) and (m_body[m_body_length - 1] != '\n'))
+            {
+                m_body_length--;
+            }
+            return;
+        }
+        m_body_length += length;
+    }
+
+    // Appends a counter with its HELP and TYPE lines.
+    void admin_listener::m_counter(const char* name, const char* help,
+        uint64_t value)
+    {
+        m_append("# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help,
+            name, name, static_cast<unsigned long long>(value));
+    }
+
+    // Handles a single scrape.
+    void admin_listener::m_handle(int fd)
+    {
+        timeval timeout = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        // Read the request head, its contents don't matter.
+        int length = 0;
+        while (length < m_request_capacity - 1)
+        {
+            ssize_t count = recv(fd, m_request + length,
+                m_request_capacity - 1 - length, 0);
+            if (count <= 0) return;
+            length += count;
+            m_request[length] = 0;
+            if (strstr(m_request, "\r\n\r\n") != nullptr) break;
+        }
+        m_render();
+        char head[256];
+        int head_length = snprintf(head, sizeof(head),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: %d\r\n"
+            "Connection: close\r\n\r\n", m_body_length);
+        if (m_send(fd, head, head_length) != true) return;
+        m_send(fd, m_body, m_body_length);
+    }
+
+    // Lowers the priority of the calling thread.
+    void admin_listener::m_lower_priority()
+    {
+        sched_param param = {};
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0)
+        {
+            return;
+        }
+        // Nice values are per thread on Linux.
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    }
+
+    // Renders all metrics into the response body.
+    void admin_listener::m_render()
+    {
+        m_body_length = 0;
+        stats_snapshot totals = m_stats->snapshot();
+        m_counter("tuxnet_accepts_total", "Accepted connections.",
+            totals.accepts);
+        m_counter("tuxnet_accept_errors_total",
+            "Failed accept() calls, not counting EAGAIN.",
+            totals.accept_errors);
+        m_counter("tuxnet_received_bytes_total", "Bytes received from peers.",
+            totals.bytes_in);
+        m_counter("tuxnet_sent_bytes_total", "Bytes sent to peers.",
+            totals.bytes_out);
+        m_counter("tuxnet_recv_calls_total", "recv() calls.",
+            totals.recv_calls);
+        m_counter("tuxnet_send_calls_total", "send() calls.",
+            totals.send_calls);
+        m_counter("tuxnet_eagain_total", "Reads that returned EAGAIN.",
+            totals.eagain_spins);
+        m_counter("tuxnet_epoll_wakeups_total",
+            "epoll_wait() calls that returned events.", totals.epoll_wakeups);
+        m_counter("tuxnet_epoll_events_total",
+            "Events returned by epoll_wait().", totals.epoll_events);
+        m_append("# HELP tuxnet_disconnects_total Closed connections.\n"
+            "# TYPE tuxnet_disconnects_total counter\n");
+        for (int n = 0; n < DISCONNECT_REASON_COUNT; ++n)
+        {
+            m_append("tuxnet_disconnects_total{reason=\"%s\"} %llu\n",
+                disconnect_reason_name(static_cast<disconnect_reason>(n)),
+                static_cast<unsigned long long>(totals.disconnects[n]));
+        }
+        m_append("# HELP tuxnet_loop_busy_seconds_total Time event loops "
+            "spent outside epoll_wait().\n"
+            "# TYPE tuxnet_loop_busy_seconds_total counter\n"
+            "tuxnet_loop_busy_seconds_total %.9g\n", seconds(totals.busy_ns));
+        m_append("# HELP tuxnet_loop_idle_seconds_total Time event loops "
+            "spent in epoll_wait().\n"
+            "# TYPE tuxnet_loop_idle_seconds_total counter\n"
+            "tuxnet_loop_idle_seconds_total %.9g\n", seconds(totals.idle_ns));
+        m_counter("tuxnet_loop_stalls_total",
+            "Event loops the watchdog found busy for too long.",
+            totals.stalls);
+        m_append("# HELP tuxnet_threads Threads running an event loop.\n"
+            "# TYPE tuxnet_threads gauge\ntuxnet_threads %llu\n",
+            static_cast<unsigned long long>(totals.threads));
+        // Hardware events, only present while some thread counts them.
+        if ((totals.perf_events != 0) or (totals.perf_threads != 0))
+        {
+            m_append("# HELP tuxnet_perf_threads Threads counting hardware "
+                "events.\n# TYPE tuxnet_perf_threads gauge\n"
+                "tuxnet_perf_threads %llu\n",
+                static_cast<unsigned long long>(totals.perf_threads));
+            m_counter("tuxnet_perf_counted_events_total",
+                "epoll events handled while hardware events were counted.",
+                totals.perf_events);
+            m_append("# HELP tuxnet_perf_hardware_events_total Hardware "
+                "events counted by event loops.\n"
+                "# TYPE tuxnet_perf_hardware_events_total counter\n");
+            for (int n = 0; n < PERF_COUNTER_COUNT; ++n)
+            {
+                m_append("tuxnet_perf_hardware_events_total{counter=\"%s\"} "
+                    "%llu\n", perf_counter_name(static_cast<perf_counter>(n)),
+                    static_cast<unsigned long long>(totals.perf[n]));
+            }
+        }
+        // Latencies, merged over all threads since start.
+        for (int n = 0; n < LATENCY_METRIC_COUNT; ++n) m_histograms[n].clear();
+        m_stats->merge_latency(m_histograms);
+        m_append("# HELP tuxnet_latency_seconds Event callback duration, "
+            "readiness-to-dispatch and receive queueing delay.\n"
+            "# TYPE tuxnet_latency_seconds summary\n");
+        for (int n = 0; n < LATENCY_METRIC_COUNT; ++n)
+        {
+            const histogram_snapshot& h = m_histograms[n];
+            const char* name = latency_metric_name(
+                static_cast<latency_metric>(n));
+            for (double quantile : latency_quantiles)
+            {
+                m_append("tuxnet_latency_seconds{metric=\"%s\","
+                    "quantile=\"%g\"} %.9g\n", name, quantile,
+                    seconds(h.percentile(quantile * 100)));
+            }
+            m_append("tuxnet_latency_seconds_sum{metric=\"%s\"} %.9g\n", name,
+                seconds(h.sum()));
+            m_append("tuxnet_latency_seconds_count{metric=\"%s\"} %llu\n",
+                name, static_cast<unsigned long long>(h.count()));
+        }
+        m_append("# HELP tuxnet_latency_max_seconds Highest event callback "
+            "duration, readiness-to-dispatch and receive queueing delay.\n"
+            "# TYPE tuxnet_latency_max_seconds gauge\n");
+        for (int n = 0; n < LATENCY_METRIC_COUNT; ++n)
+        {
+            m_append("tuxnet_latency_max_seconds{metric=\"%s\"} %.9g\n",
+                latency_metric_name(static_cast<latency_metric>(n)),
+                seconds(m_histograms[n].max()));
+        }
+    }
+
+    // Accepts and handles connections until stopped.
+    void admin_listener::m_run()
+    {
+        m_lower_priority();
+        while (m_stopping != true)
+        {
+            int fd = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd == -1)
+            {
+                if ((errno == EINTR) or (errno == ECONNABORTED)) continue;
+                if (m_stopping == true) break;
+                // Out of descriptors or similar, back off a little.
+                usleep(100000);
+                continue;
+            }
+            m_handle(fd);
+            ::close(fd);
+        }
+    }
+
+    // Sends a whole buffer.
+    bool admin_listener::m_send(int fd, const char* data, int length)
+    {
+        while (length > 0)
+        {
+            ssize_t count = ::send(fd, data, length, MSG_NOSIGNAL);
+            if (count == -1)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += count;
+            length -= count;
+        }
+        return true;
+    }
+
+}
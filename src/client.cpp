@@ -0,0 +1,423 @@
+#include <chrono>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include "tuxnet/client.h"
+#include "tuxnet/config.h"
+#include "tuxnet/event.h"
+#include "tuxnet/log.h"
+
+namespace tuxnet
+{
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    client::client() :
+        m_connect_options(),
+        m_connected(0),
+        m_epoll_fd(0),
+        m_keepalive(true),
+        m_keepalive_interval(5),
+        m_keepalive_retries(3),
+        m_keepalive_timeout(10),
+        m_sockets({}),
+        m_stopping(false),
+        m_wake_fd(0)
+    {
+    }
+
+    // Destructor.
+    client::~client()
+    {
+        close_all();
+        m_pending.clear();
+        m_finished.clear();
+        m_sockets.lock();
+        for (auto it = m_sockets.get().begin();
+            it != m_sockets.get().end(); ++it)
+        {
+            delete (*it);
+        }
+        sockets().swap(m_sockets.get());
+        m_sockets.unlock();
+        if (m_wake_fd != 0) ::close(m_wake_fd);
+        if (m_epoll_fd != 0) ::close(m_epoll_fd);
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Stops connecting and closes all connections.
+    void client::close_all()
+    {
+        if (m_thread.joinable() == true)
+        {
+            m_stopping = true;
+            uint64_t one = 1;
+            if (write(m_wake_fd, &one, sizeof(one)) == -1)
+            {
+                // The connector still wakes up within a second.
+            }
+            m_thread.join();
+            m_stopping = false;
+            // connect() starts over with a new connector.
+            ::close(m_wake_fd);
+            ::close(m_epoll_fd);
+            m_wake_fd = 0;
+            m_epoll_fd = 0;
+        }
+        // Nobody completes the attempts in progress anymore.
+        std::vector<pending_connect> cancelled;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            cancelled.swap(m_pending);
+        }
+        for (auto it = cancelled.begin(); it != cancelled.end(); ++it)
+        {
+            it->sock->m_state = SOCKET_STATE_CLOSED;
+            on_connect_error(it->sock->get_remote(), ECANCELED,
+                it->sock->m_connect_context);
+            m_release(it->sock);
+        }
+        // Peer threads delete their own peers, so only end the connections.
+        m_sockets.lock();
+        for (auto it = m_sockets.get().begin();
+            it != m_sockets.get().end(); ++it)
+        {
+            (*it)->m_peers.lock();
+            peers& connections = (*it)->m_peers.get();
+            for (auto cur = connections.begin(); cur != connections.end();
+                ++cur)
+            {
+                ::shutdown((*cur)->get_fd(), SHUT_RDWR);
+            }
+            (*it)->m_peers.unlock();
+        }
+        m_sockets.unlock();
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_peer_gone.wait_for(lock, std::chrono::seconds(5),
+            [this](){ return m_connected <= 0; });
+    }
+
+    // Configures the source address of new connections.
+    void client::configure_connect(const connect_options& options)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_connect_options = options;
+    }
+
+    // Configures TCP keepalive settings.
+    void client::configure_keepalive(bool enabled, int timeout, int interval,
+        int retries)
+    {
+        m_keepalive = enabled;
+        m_keepalive_timeout = timeout;
+        m_keepalive_interval = interval;
+        m_keepalive_retries = retries;
+    }
+
+    // Starts connecting to a remote address.
+    bool client::connect(const socket_address* const saddr, int timeout_ms,
+        void* context)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_thread.joinable() != true)
+            {
+                m_epoll_fd = create_event_listener();
+                if (m_epoll_fd == -1)
+                {
+                    m_epoll_fd = 0;
+                    return false;
+                }
+                m_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.ptr = nullptr;
+                if (
+                    (m_wake_fd == -1)
+                    or (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd,
+                        &event) == -1)
+                )
+                {
+                    log::get().info(std::string("Could not start the "
+                        "connector: ") + strerror(errno) + ".");
+                    if (m_wake_fd != -1) ::close(m_wake_fd);
+                    ::close(m_epoll_fd);
+                    m_wake_fd = 0;
+                    m_epoll_fd = 0;
+                    return false;
+                }
+                m_thread = std::thread([this](){ m_run(); });
+            }
+        }
+        socket* sock = new socket(L4_PROTO_TCP);
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            sock->set_connect_options(m_connect_options);
+        }
+        sock->m_connect_context = context;
+        sock->set_keepalive(m_keepalive);
+        sock->set_keepalive_interval(m_keepalive_interval);
+        sock->set_keepalive_retry(m_keepalive_retries);
+        sock->set_keepalive_timeout(m_keepalive_timeout);
+        if (sock->connect(saddr, this) != true)
+        {
+            delete sock;
+            return false;
+        }
+        if (timeout_ms < 0)
+        {
+            timeout_ms = config::get().get_connect_timeout_ms();
+        }
+        pending_connect attempt = { sock, 0 };
+        if (timeout_ms > 0)
+        {
+            attempt.deadline = stats_clock() + uint64_t(timeout_ms) * 1000000;
+        }
+        m_sockets.lock();
+        m_sockets.get().push_back(sock);
+        m_sockets.unlock();
+        // Holding the lock keeps the connector from expiring and deleting
+        // the socket before it's monitored.
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_pending.push_back(attempt);
+        epoll_event event = {};
+        event.events = EPOLLOUT | EPOLLONESHOT;
+        event.data.ptr = sock;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, sock->m_listen_socket_fd,
+            &event) == -1)
+        {
+            int error = errno;
+            log::get().info(std::string("Could not monitor a connection "
+                "attempt: ") + strerror(error) + ".");
+            m_pending.pop_back();
+            m_finished.push_back(sock);
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+
+    // Gets the number of established connections.
+    int client::num_connections()
+    {
+        int result = 0;
+        m_sockets.lock();
+        for (auto it = m_sockets.get().begin();
+            it != m_sockets.get().end(); ++it)
+        {
+            socket* cur_sock = (*it);
+            if (cur_sock == nullptr) continue;
+            result += cur_sock->m_peers.get().size();
+        }
+        m_sockets.unlock();
+        return result;
+    }
+
+    // Gets the number of connection attempts in progress.
+    int client::num_pending()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_pending.size();
+    }
+
+    // Gets the client's counters.
+    stats_snapshot client::stats()
+    {
+        return m_stats.snapshot();
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Completes a connection attempt the socket became writable for.
+    void client::m_complete(socket* sock)
+    {
+        if (m_remove_pending(sock) != true) return;
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, sock->m_listen_socket_fd,
+            nullptr);
+        {
+            // The peer thread may end before m_finish_connect() returns.
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_connected++;
+        }
+        int error = sock->m_finish_connect();
+        if (error == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_connected--;
+        }
+        on_connect_error(sock->get_remote(), error,
+            sock->m_connect_context);
+        m_release(sock);
+    }
+
+    // Deletes sockets of ended connections.
+    void client::m_delete_finished()
+    {
+        sockets finished;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            finished.swap(m_finished);
+        }
+        if (finished.empty() == true) return;
+        m_sockets.lock();
+        for (auto it = finished.begin(); it != finished.end(); ++it)
+        {
+            sockets& all = m_sockets.get();
+            for (auto found = all.begin(); found != all.end(); ++found)
+            {
+                if ((*found) != (*it)) continue;
+                all.erase(found);
+                break;
+            }
+        }
+        m_sockets.unlock();
+        for (auto it = finished.begin(); it != finished.end(); ++it)
+        {
+            delete (*it);
+        }
+    }
+
+    // Fails connection attempts which ran out of time.
+    void client::m_expire()
+    {
+        uint64_t now = stats_clock();
+        sockets expired;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            for (auto it = m_pending.begin(); it != m_pending.end();)
+            {
+                if ((it->deadline == 0) or (it->deadline > now))
+                {
+                    ++it;
+                    continue;
+                }
+                expired.push_back(it->sock);
+                it = m_pending.erase(it);
+            }
+        }
+        for (auto it = expired.begin(); it != expired.end(); ++it)
+        {
+            epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, (*it)->m_listen_socket_fd,
+                nullptr);
+            (*it)->m_state = SOCKET_STATE_CLOSED;
+            on_connect_error((*it)->get_remote(), ETIMEDOUT,
+                (*it)->m_connect_context);
+            m_release(*it);
+        }
+    }
+
+    // Gets how long the connector thread may wait for events.
+    int client::m_next_timeout()
+    {
+        uint64_t now = stats_clock();
+        uint64_t wait = 1000000000;
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto it = m_pending.begin(); it != m_pending.end(); ++it)
+        {
+            if (it->deadline == 0) continue;
+            if (it->deadline <= now) return 0;
+            if (it->deadline - now < wait) wait = it->deadline - now;
+        }
+        // Round up, so the deadline has passed when the wait ends.
+        return (wait + 999999) / 1000000;
+    }
+
+    // Counts a peer thread as finished.
+    void client::m_peer_done()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_connected--;
+        m_peer_gone.notify_all();
+    }
+
+    // Hands over a socket whose connection ended.
+    void client::m_release(socket* sock)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_finished.push_back(sock);
+    }
+
+    // Forgets a connection attempt.
+    bool client::m_remove_pending(socket* sock)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto it = m_pending.begin(); it != m_pending.end(); ++it)
+        {
+            if (it->sock != sock) continue;
+            m_pending.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    // Waits for connection attempts to complete until stopped.
+    void client::m_run()
+    {
+        stats_scope scope(&m_stats);
+        event_batch events(8);
+        while (m_stopping != true)
+        {
+            thread_stats& stats = stats_registry::local();
+            stats.wait_begin();
+            int event_count = events.wait(m_epoll_fd, 8, 256,
+                m_next_timeout());
+            stats.wait_end();
+            if ((event_count == -1) and (errno != EINTR))
+            {
+                log::get().info(std::string("Connector could not wait for "
+                    "events: ") + strerror(errno) + ".");
+                break;
+            }
+            if (event_count > 0)
+            {
+                stat_add(stats.epoll_wakeups);
+                stat_add(stats.epoll_events, event_count);
+            }
+            for (int n_event = 0; n_event < event_count; ++n_event)
+            {
+                socket* sock = static_cast<socket*>(events[n_event].data.ptr);
+                if (sock == nullptr)
+                {
+                    uint64_t count = 0;
+                    if (read(m_wake_fd, &count, sizeof(count)) == -1)
+                    {
+                        // Nothing to reset.
+                    }
+                    continue;
+                }
+                m_complete(sock);
+            }
+            m_expire();
+            m_delete_finished();
+        }
+    }
+
+    // Events. ----------------------------------------------------------------
+
+    // Connection established.
+    void client::on_connect(peer* remote_peer)
+    {
+    }
+
+    // Connection attempt failed.
+    void client::on_connect_error(const socket_address* saddr, int error,
+        void* context)
+    {
+    }
+
+    // Received data.
+    void client::on_receive(peer* remote_peer)
+    {
+    }
+
+    // Connection closed.
+    void client::on_disconnect(peer* remote_peer)
+    {
+    }
+
+}
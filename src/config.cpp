@@ -1,19 +1,62 @@
+#include <fstream>
+#include <stdlib.h>
+#include <ctype.h>
 #include "tuxnet/config.h"
+#include "tuxnet/log.h"
 
 namespace tuxnet
 {
 
     // Ctor(s) / dtor. --------------------------------------------------------
-    
+
     /// Init config class static members.
     std::unique_ptr<config> config::m_instance;
     std::once_flag config::m_instance_allocated;
 
+    /// Parameters that can be set by name.
+    const config::option config::m_options[] = {
+        { "busy_poll_usec", &config::m_busy_poll_usec, 0, 1000000, true },
+        { "connect_timeout_ms", &config::m_connect_timeout_ms, 0, 3600000,
+            true },
+        { "flight_recorder_events", &config::m_flight_recorder_events, 0,
+            65536, false },
+        { "listen_socket_epoll_max_events",
+            &config::m_listen_socket_epoll_max_events, 1, 65536, true },
+        { "listen_socket_epoll_min_events",
+            &config::m_listen_socket_epoll_min_events, 1, 65536, true },
+        { "listen_socket_epoll_timeout",
+            &config::m_listen_socket_epoll_timeout, -1, 3600000, true },
+        { "peer_socket_epoll_max_events",
+            &config::m_peer_socket_epoll_max_events, 1, 65536, true },
+        { "peer_socket_epoll_min_events",
+            &config::m_peer_socket_epoll_min_events, 1, 65536, true },
+        { "peer_socket_epoll_timeout",
+            &config::m_peer_socket_epoll_timeout, -1, 3600000, true },
+        { "perf_counters", &config::m_perf_counters, 0, 1, false },
+        { "rx_timestamps", &config::m_rx_timestamps, 0, 1, false },
+        { "server_max_threads", &config::m_server_max_threads, 1, 65536,
+            false },
+        { "server_min_threads", &config::m_server_min_threads, 1, 65536,
+            false },
+        { "tcp_info_interval_ms", &config::m_tcp_info_interval_ms, 0,
+            3600000, true },
+        { "watchdog_threshold_ms", &config::m_watchdog_threshold_ms, 0,
+            3600000, true },
+        { nullptr, nullptr, 0, 0, false }
+    };
+
     // Constructor.
-    config::config() : m_client_max_threads(10), m_client_min_threads(10),
-        m_listen_socket_epoll_max_events(30), 
-        m_peer_socket_epoll_max_events(30), m_server_max_threads(10), 
-        m_server_min_threads(10)
+    config::config() : m_busy_poll_usec(0), m_connect_timeout_ms(5000),
+        m_flight_recorder_events(256),
+        m_listen_socket_epoll_max_events(30),
+        m_listen_socket_epoll_min_events(8),
+        m_listen_socket_epoll_timeout(-1),
+        m_peer_socket_epoll_max_events(30),
+        m_peer_socket_epoll_min_events(1),
+        m_peer_socket_epoll_timeout(-1), m_perf_counters(0),
+        m_rx_timestamps(0), m_server_max_threads(10),
+        m_server_min_threads(10), m_tcp_info_interval_ms(1000),
+        m_watchdog_threshold_ms(1000)
     {
     }
 
@@ -24,20 +67,29 @@ namespace tuxnet
     {
         std::call_once(m_instance_allocated,[]{
             m_instance.reset(new config);
+            const char* path = getenv("TUXNET_CONFIG");
+            if (path != nullptr) m_instance->load_file(path);
+            m_instance->load_env();
         });
         return *m_instance.get();
     }
 
-    // Get minimum number of client threads.
-    int const config::get_client_max_threads()
+    // Get busy-poll duration.
+    int const config::get_busy_poll_usec()
     {
-        return m_client_max_threads;
+        return m_busy_poll_usec;
     }
 
-    // Get maximum number of client threads.
-    int const config::get_client_min_threads()
+    // Get time a client connection attempt may take.
+    int const config::get_connect_timeout_ms()
     {
-        return m_client_min_threads;
+        return m_connect_timeout_ms;
+    }
+
+    // Get number of events the flight recorder keeps per thread.
+    int const config::get_flight_recorder_events()
+    {
+        return m_flight_recorder_events;
     }
 
     // Get epoll event buffer size for listen sockets.
@@ -46,12 +98,48 @@ namespace tuxnet
         return m_listen_socket_epoll_max_events;
     }
 
+    // Get smallest epoll event buffer size for listen sockets.
+    int const config::get_listen_socket_epoll_min_events()
+    {
+        return m_listen_socket_epoll_min_events;
+    }
+
+    // Get epoll_wait timeout for listen sockets.
+    int const config::get_listen_socket_epoll_timeout()
+    {
+        return m_listen_socket_epoll_timeout;
+    }
+
     // Get epoll event buffer size for peer sockets.
     int const config::get_peer_socket_epoll_max_events()
     {
         return m_peer_socket_epoll_max_events;
     }
 
+    // Get smallest epoll event buffer size for peer sockets.
+    int const config::get_peer_socket_epoll_min_events()
+    {
+        return m_peer_socket_epoll_min_events;
+    }
+
+    // Get epoll_wait timeout for peer sockets.
+    int const config::get_peer_socket_epoll_timeout()
+    {
+        return m_peer_socket_epoll_timeout;
+    }
+
+    // Get whether event loops count hardware events.
+    int const config::get_perf_counters()
+    {
+        return m_perf_counters;
+    }
+
+    // Get whether peers measure receive queueing delay.
+    int const config::get_rx_timestamps()
+    {
+        return m_rx_timestamps;
+    }
+
     // Get max server threads.
     int const config::get_server_max_threads()
     {
@@ -64,5 +152,357 @@ namespace tuxnet
         return m_server_min_threads;
     }
 
+    // Get time between TCP_INFO samples.
+    int const config::get_tcp_info_interval_ms()
+    {
+        return m_tcp_info_interval_ms;
+    }
+
+    // Get event loop stall threshold.
+    int const config::get_watchdog_threshold_ms()
+    {
+        return m_watchdog_threshold_ms;
+    }
+
+    // Set busy-poll duration.
+    bool config::set_busy_poll_usec(int usec)
+    {
+        return m_set(&config::m_busy_poll_usec, usec);
+    }
+
+    // Set time a client connection attempt may take.
+    bool config::set_connect_timeout_ms(int timeout)
+    {
+        return m_set(&config::m_connect_timeout_ms, timeout);
+    }
+
+    // Set number of events the flight recorder keeps per thread.
+    bool config::set_flight_recorder_events(int events)
+    {
+        return m_set(&config::m_flight_recorder_events, events);
+    }
+
+    // Set epoll event buffer size for listen sockets.
+    bool config::set_listen_socket_epoll_max_events(int events)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (events < m_listen_socket_epoll_min_events)
+        {
+            log::get().info("listen_socket_epoll_max_events can't be lower "
+                "than listen_socket_epoll_min_events.");
+            return false;
+        }
+        return m_set(&config::m_listen_socket_epoll_max_events, events);
+    }
+
+    // Set smallest epoll event buffer size for listen sockets.
+    bool config::set_listen_socket_epoll_min_events(int events)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (events > m_listen_socket_epoll_max_events)
+        {
+            log::get().info("listen_socket_epoll_min_events can't be higher "
+                "than listen_socket_epoll_max_events.");
+            return false;
+        }
+        return m_set(&config::m_listen_socket_epoll_min_events, events);
+    }
+
+    // Set epoll_wait timeout for listen sockets.
+    bool config::set_listen_socket_epoll_timeout(int timeout)
+    {
+        return m_set(&config::m_listen_socket_epoll_timeout, timeout);
+    }
+
+    // Set epoll event buffer size for peer sockets.
+    bool config::set_peer_socket_epoll_max_events(int events)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (events < m_peer_socket_epoll_min_events)
+        {
+            log::get().info("peer_socket_epoll_max_events can't be lower "
+                "than peer_socket_epoll_min_events.");
+            return false;
+        }
+        return m_set(&config::m_peer_socket_epoll_max_events, events);
+    }
+
+    // Set smallest epoll event buffer size for peer sockets.
+    bool config::set_peer_socket_epoll_min_events(int events)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (events > m_peer_socket_epoll_max_events)
+        {
+            log::get().info("peer_socket_epoll_min_events can't be higher "
+                "than peer_socket_epoll_max_events.");
+            return false;
+        }
+        return m_set(&config::m_peer_socket_epoll_min_events, events);
+    }
+
+    // Set epoll_wait timeout for peer sockets.
+    bool config::set_peer_socket_epoll_timeout(int timeout)
+    {
+        return m_set(&config::m_peer_socket_epoll_timeout, timeout);
+    }
+
+    // Set whether event loops count hardware events.
+    bool config::set_perf_counters(int enabled)
+    {
+        return m_set(&config::m_perf_counters, enabled);
+    }
+
+    // Set whether peers measure receive queueing delay.
+    bool config::set_rx_timestamps(int enabled)
+    {
+        return m_set(&config::m_rx_timestamps, enabled);
+    }
+
+    // Set max server threads.
+    bool config::set_server_max_threads(int threads)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (threads < m_server_min_threads)
+        {
+            log::get().info("server_max_threads can't be lower than "
+                "server_min_threads.");
+            return false;
+        }
+        return m_set(&config::m_server_max_threads, threads);
+    }
+
+    // Set min server threads.
+    bool config::set_server_min_threads(int threads)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (threads > m_server_max_threads)
+        {
+            log::get().info("server_min_threads can't be higher than "
+                "server_max_threads.");
+            return false;
+        }
+        return m_set(&config::m_server_min_threads, threads);
+    }
+
+    // Set time between TCP_INFO samples.
+    bool config::set_tcp_info_interval_ms(int interval)
+    {
+        return m_set(&config::m_tcp_info_interval_ms, interval);
+    }
+
+    // Set event loop stall threshold.
+    bool config::set_watchdog_threshold_ms(int threshold)
+    {
+        return m_set(&config::m_watchdog_threshold_ms, threshold);
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Sets a parameter by name.
+    bool config::set(const std::string& key, const std::string& value)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_apply({ { key, value } }, "config::set()", false);
+    }
+
+    // Loads parameters from a file.
+    bool config::load_file(const std::string& path)
+    {
+        settings values;
+        if (m_read_file(path, values) != true) return false;
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_apply(values, path, false) != true) return false;
+        m_path = path;
+        return true;
+    }
+
+    // Loads parameters from the environment.
+    bool config::load_env()
+    {
+        settings values;
+        for (const option* opt = m_options; opt->name != nullptr; ++opt)
+        {
+            std::string name = "TUXNET_";
+            for (const char* c = opt->name; *c != 0; ++c)
+            {
+                name += toupper(*c);
+            }
+            const char* value = getenv(name.c_str());
+            if (value != nullptr) values.push_back({ opt->name, value });
+        }
+        if (values.empty()) return true;
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_apply(values, "environment", false);
+    }
+
+    // Re-reads the last loaded file.
+    bool config::reload()
+    {
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            path = m_path;
+        }
+        if (path.empty())
+        {
+            log::get().info("No config file loaded, nothing to reload.");
+            return false;
+        }
+        settings values;
+        if (m_read_file(path, values) != true) return false;
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_apply(values, path, true);
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Validates and applies a set of values.
+    bool config::m_apply(const settings& values, const std::string& origin,
+        bool live_only)
+    {
+        // Start from the current values so cross-checks see the result.
+        int count = 0;
+        while (m_options[count].name != nullptr) ++count;
+        std::vector<int> candidate(count);
+        std::vector<bool> changed(count, false);
+        for (int n = 0; n < count; ++n)
+        {
+            candidate[n] = this->*(m_options[n].member);
+        }
+        for (auto it = values.begin(); it != values.end(); ++it)
+        {
+            const option* opt = m_find(it->first);
+            if (opt == nullptr)
+            {
+                log::get().info(origin + ": unknown config key '"
+                    + it->first + "'.");
+                return false;
+            }
+            char* end = nullptr;
+            long value = strtol(it->second.c_str(), &end, 10);
+            if ((it->second.empty()) or (*end != 0)
+                or (value < opt->min) or (value > opt->max))
+            {
+                log::get().info(origin + ": invalid value '" + it->second
+                    + "' for " + it->first + " (expected "
+                    + std::to_string(opt->min) + " to "
+                    + std::to_string(opt->max) + ").");
+                return false;
+            }
+            int n = opt - m_options;
+            if (value == candidate[n]) continue;
+            if ((live_only == true) and (opt->live != true))
+            {
+                log::get().info(origin + ": " + it->first + " can't be "
+                    "changed on a running server, ignoring.");
+                continue;
+            }
+            candidate[n] = value;
+            changed[n] = true;
+        }
+        // Check min/max pairs.
+        auto value_of = [&](std::atomic<int> config::* member) {
+            for (int n = 0; n < count; ++n)
+            {
+                if (m_options[n].member == member) return candidate[n];
+            }
+            return 0;
+        };
+        const struct {
+            std::atomic<int> config::* min;
+            std::atomic<int> config::* max;
+            const char* message;
+        } pairs[] = {
+            { &config::m_listen_socket_epoll_min_events,
+                &config::m_listen_socket_epoll_max_events,
+                "listen_socket_epoll_min_events can't be higher than "
+                "listen_socket_epoll_max_events." },
+            { &config::m_peer_socket_epoll_min_events,
+                &config::m_peer_socket_epoll_max_events,
+                "peer_socket_epoll_min_events can't be higher than "
+                "peer_socket_epoll_max_events." },
+            { &config::m_server_min_threads, &config::m_server_max_threads,
+                "server_min_threads can't be higher than "
+                "server_max_threads." }
+        };
+        for (auto& pair : pairs)
+        {
+            if (value_of(pair.min) > value_of(pair.max))
+            {
+                log::get().info(origin + ": " + pair.message);
+                return false;
+            }
+        }
+        for (int n = 0; n < count; ++n)
+        {
+            if (changed[n] == true) this->*(m_options[n].member) = candidate[n];
+        }
+        return true;
+    }
+
+    // Finds an option by key.
+    const config::option* config::m_find(const std::string& key)
+    {
+        for (const option* opt = m_options; opt->name != nullptr; ++opt)
+        {
+            if (key == opt->name) return opt;
+        }
+        return nullptr;
+    }
+
+    // Reads key=value pairs from a file.
+    bool config::m_read_file(const std::string& path, settings& values)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            log::get().info("Could not open config file " + path + ".");
+            return false;
+        }
+        std::string line;
+        int line_number = 0;
+        auto trim = [](const std::string& s) {
+            size_t first = s.find_first_not_of(" \t\r");
+            if (first == std::string::npos) return std::string();
+            size_t last = s.find_last_not_of(" \t\r");
+            return s.substr(first, last - first + 1);
+        };
+        while (std::getline(in, line))
+        {
+            ++line_number;
+            line = trim(line);
+            if ((line.empty()) or (line[0] == '#')) continue;
+            size_t pos = line.find('=');
+            if (pos == std::string::npos)
+            {
+                log::get().info(path + ":" + std::to_string(line_number)
+                    + ": expected key = value.");
+                return false;
+            }
+            values.push_back({ trim(line.substr(0, pos)),
+                trim(line.substr(pos + 1)) });
+        }
+        return true;
+    }
+
+    // Sets a single option after validating its range.
+    bool config::m_set(std::atomic<int> config::* member, int value)
+    {
+        for (const option* opt = m_options; opt->name != nullptr; ++opt)
+        {
+            if (opt->member != member) continue;
+            if ((value < opt->min) or (value > opt->max))
+            {
+                log::get().info("Invalid value " + std::to_string(value)
+                    + " for " + opt->name + " (expected "
+                    + std::to_string(opt->min) + " to "
+                    + std::to_string(opt->max) + ").");
+                return false;
+            }
+            this->*member = value;
+            return true;
+        }
+        return false;
+    }
 
 }
@@ -0,0 +1,656 @@
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "tuxnet/connection_pool.h"
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// States of a pooled connection.
+        enum connection_state
+        {
+            /// Established and not in use.
+            CONNECTION_IDLE = 0,
+            /// Handed out by acquire().
+            CONNECTION_BUSY,
+            /// Idle, being checked or closed by the pool.
+            CONNECTION_CHECKING,
+            /// Released to be closed.
+            CONNECTION_CLOSING,
+            /// Closed, only thread caches still refer to it.
+            CONNECTION_DEAD
+        };
+
+        /// Source of pool ids.
+        std::atomic<uint64_t> next_pool_id(1);
+
+        // Probes an idle socket, returns false if it's broken.
+        bool probe(int fd)
+        {
+            // Nothing to read is the only healthy answer.
+            char byte;
+            if (
+                (recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) != -1)
+                or ((errno != EAGAIN) and (errno != EWOULDBLOCK))
+            )
+            {
+                return false;
+            }
+            struct ::tcp_info info = {};
+            socklen_t length = sizeof(info);
+            return (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length)
+                != 0) or (info.tcpi_state == TCP_ESTABLISHED);
+        }
+
+        /// Counts a thread as waiting for a connection while in scope.
+        class waiting_scope
+        {
+            std::atomic<int>& m_count;
+
+            public:
+
+                waiting_scope(std::atomic<int>& count) : m_count(count)
+                {
+                    m_count.fetch_add(1, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                }
+
+                ~waiting_scope()
+                {
+                    m_count.fetch_sub(1, std::memory_order_relaxed);
+                }
+        };
+
+        // Removes a connection from a list, if it's in it.
+        template <typename T>
+        void remove_from(std::vector<T*>& list, T* item)
+        {
+            auto found = std::find(list.begin(), list.end(), item);
+            if (found != list.end()) list.erase(found);
+        }
+
+    }
+
+    /// Connections to a single backend address.
+    struct connection_pool::backend
+    {
+        /// Address of the backend.
+        ip4_socket_address saddr;
+        /// Established connections, guarded by m_pool_lock.
+        std::vector<connection*> all;
+        /// Idle connections not cached by a thread, guarded by m_pool_lock.
+        std::vector<connection*> idle;
+        /// Connection attempts in progress, guarded by m_pool_lock.
+        int connecting = 0;
+        /// Attempts which failed so far, guarded by m_pool_lock.
+        uint64_t failures = 0;
+        /// errno of the last failed attempt, guarded by m_pool_lock.
+        int last_error = 0;
+        /// Idle connections, wherever they are.
+        std::atomic<int> idle_count{0};
+        /// Counters, see pool_backend_stats.
+        std::atomic<uint64_t> reused{0};
+        std::atomic<uint64_t> created{0};
+        std::atomic<uint64_t> expired{0};
+    };
+
+    /// An established pooled connection.
+    struct connection_pool::connection
+    {
+        /// The connection, valid until it's dead.
+        peer* remote;
+        /// Backend it connects to.
+        backend* owner;
+        /// Id of the pool.
+        uint64_t pool;
+        /// Key of the backend.
+        uint64_t key;
+        /// The pool, valid until it's dead.
+        connection_pool* parent;
+        /// connection_state.
+        std::atomic<int> state;
+        /// References : the pool's until it's dead, and thread caches'.
+        std::atomic<int> references;
+        /// When it became idle (see stats_clock()).
+        std::atomic<uint64_t> idle_since;
+        /// Cache of the thread which acquired it last, while busy.
+        thread_cache* holder;
+        /// Times it was handed out, while busy.
+        uint64_t handouts;
+    };
+
+    /// Connections released by a thread, referenced until taken.
+    struct connection_pool::thread_cache
+    {
+        std::vector<connection*> entries;
+
+        // Gives the connections still open back to their pools, so they
+        // don't stay idle with nobody to take them.
+        ~thread_cache()
+        {
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if ((*it)->state.load(std::memory_order_acquire)
+                    != CONNECTION_DEAD)
+                {
+                    (*it)->parent->m_to_idle(*it);
+                }
+                m_unref(*it);
+            }
+        }
+    };
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    connection_pool::connection_pool(const pool_options& options) :
+        m_checker_stopping(false),
+        m_id(next_pool_id.fetch_add(1, std::memory_order_relaxed)),
+        m_options(options),
+        m_waiting(0)
+    {
+        if (m_options.health_check_ms > 0)
+        {
+            m_checker = std::thread([this](){ m_run_checker(); });
+        }
+    }
+
+    // Destructor.
+    connection_pool::~connection_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_pool_lock);
+            m_checker_stopping = true;
+        }
+        m_checker_wake.notify_all();
+        if (m_checker.joinable() == true) m_checker.join();
+        close_all();
+        std::lock_guard<std::mutex> lock(m_pool_lock);
+        for (auto it = m_backends.begin(); it != m_backends.end(); ++it)
+        {
+            backend* owner = it->second;
+            for (auto conn = owner->all.begin(); conn != owner->all.end();
+                ++conn)
+            {
+                // Still open if its thread didn't finish in time.
+                (*conn)->remote->set_context(nullptr);
+                (*conn)->state.store(CONNECTION_DEAD,
+                    std::memory_order_release);
+                m_unref(*conn);
+            }
+            delete owner;
+        }
+        m_backends.clear();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Gets a connection to a backend.
+    peer* connection_pool::acquire(const socket_address* const saddr,
+        int timeout_ms)
+    {
+        if ((saddr == nullptr) or (saddr->get_protocol() != L3_PROTO_IP4))
+        {
+            errno = EAFNOSUPPORT;
+            return nullptr;
+        }
+        uint64_t key = m_key(saddr);
+        // The thread's own connections first, without locking.
+        std::vector<connection*>& cached = m_thread_cache().entries;
+        for (size_t n = cached.size(); n-- > 0;)
+        {
+            connection* conn = cached[n];
+            bool dead = conn->state.load(std::memory_order_acquire)
+                == CONNECTION_DEAD;
+            if ((dead != true) and ((conn->pool != m_id)
+                or (conn->key != key)))
+            {
+                continue;
+            }
+            cached.erase(cached.begin() + n);
+            peer* result = conn->remote;
+            // Still referenced by the pool if it could be taken.
+            bool taken = (dead != true) and (m_take(conn) == true);
+            m_unref(conn);
+            if (taken == true) return result;
+        }
+        uint64_t deadline = 0;
+        if (timeout_ms > 0)
+        {
+            deadline = stats_clock() + uint64_t(timeout_ms) * 1000000;
+        }
+        bool started = false;
+        std::unique_lock<std::mutex> lock(m_pool_lock);
+        // Either release() caching a connection sees this, and wakes the
+        // thread up, or the scans below see the connection idle.
+        waiting_scope waiting(m_waiting);
+        backend* owner = m_backend(key, saddr);
+        uint64_t failures = owner->failures;
+        while (true)
+        {
+            for (size_t n = owner->idle.size(); n-- > 0;)
+            {
+                connection* conn = owner->idle[n];
+                // Being checked, and back in a moment if it's fine.
+                if (conn->state.load(std::memory_order_acquire)
+                    == CONNECTION_CHECKING)
+                {
+                    continue;
+                }
+                owner->idle.erase(owner->idle.begin() + n);
+                if (m_take(conn) == true) return conn->remote;
+            }
+            bool full = (owner->connecting + int(owner->all.size())
+                >= m_options.max_total);
+            if (full == true)
+            {
+                // Take back connections idling in other threads' caches.
+                for (auto it = owner->all.begin(); it != owner->all.end();
+                    ++it)
+                {
+                    if (m_take(*it) == true) return (*it)->remote;
+                }
+            }
+            if (owner->failures != failures)
+            {
+                errno = owner->last_error;
+                return nullptr;
+            }
+            if ((started != true) and (full != true))
+            {
+                owner->connecting++;
+                started = true;
+                lock.unlock();
+                bool connecting = connect(&owner->saddr,
+                    m_options.connect_timeout_ms);
+                int error = errno;
+                lock.lock();
+                if (connecting != true)
+                {
+                    owner->connecting--;
+                    owner->failures++;
+                    owner->last_error = error;
+                    errno = error;
+                    return nullptr;
+                }
+                owner->created.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            uint64_t now = stats_clock();
+            if ((deadline == 0) or (now >= deadline))
+            {
+                errno = (deadline == 0) ? EAGAIN : ETIMEDOUT;
+                return nullptr;
+            }
+            m_available.wait_for(lock,
+                std::chrono::nanoseconds(deadline - now));
+        }
+    }
+
+    // Gets the connections and counters of a backend.
+    pool_backend_stats connection_pool::backend_stats(
+        const socket_address* const saddr)
+    {
+        pool_backend_stats result = {};
+        if ((saddr == nullptr) or (saddr->get_protocol() != L3_PROTO_IP4))
+        {
+            return result;
+        }
+        std::lock_guard<std::mutex> lock(m_pool_lock);
+        auto found = m_backends.find(m_key(saddr));
+        if (found == m_backends.end()) return result;
+        backend* owner = found->second;
+        result.idle = owner->idle_count.load(std::memory_order_relaxed);
+        result.busy = int(owner->all.size()) - result.idle;
+        result.connecting = owner->connecting;
+        result.reused = owner->reused.load(std::memory_order_relaxed);
+        result.created = owner->created.load(std::memory_order_relaxed);
+        result.failed = owner->failures;
+        result.expired = owner->expired.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    // Gets the limits of the pool.
+    const pool_options& connection_pool::get_options() const
+    {
+        return m_options;
+    }
+
+    // Gives a connection back to the pool.
+    void connection_pool::release(peer* remote_peer, bool reusable)
+    {
+        if (remote_peer == nullptr) return;
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if (conn == nullptr) return;
+        int expected = CONNECTION_BUSY;
+        backend* owner = conn->owner;
+        if (
+            (reusable != true)
+            or (remote_peer->get_state() != PEER_STATE_CONNECTED)
+            or (owner->idle_count.load(std::memory_order_relaxed)
+                >= m_options.max_idle)
+        )
+        {
+            if (conn->state.compare_exchange_strong(expected,
+                CONNECTION_CLOSING, std::memory_order_acq_rel) == true)
+            {
+                // Its own thread sees the shutdown and disconnects.
+                shutdown(remote_peer->get_fd(), SHUT_RDWR);
+            }
+            return;
+        }
+        // Keeps it around once idle, whatever its thread does.
+        conn->references.fetch_add(1, std::memory_order_relaxed);
+        conn->idle_since.store(stats_clock(), std::memory_order_relaxed);
+        owner->idle_count.fetch_add(1, std::memory_order_relaxed);
+        if (conn->state.compare_exchange_strong(expected, CONNECTION_IDLE,
+            std::memory_order_acq_rel) != true)
+        {
+            owner->idle_count.fetch_sub(1, std::memory_order_relaxed);
+            m_unref(conn);
+            return;
+        }
+        // Only the thread which acquired it is likely to acquire it again.
+        thread_cache& cache = m_thread_cache();
+        int mine = 0;
+        for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it)
+        {
+            if (((*it)->pool == m_id) and ((*it)->key == conn->key)) ++mine;
+        }
+        if ((conn->holder == &cache) and (mine < m_options.thread_cache))
+        {
+            cache.entries.push_back(conn);
+            // Other threads may be waiting to take it back.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_waiting.load(std::memory_order_relaxed) > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_pool_lock);
+                }
+                m_available.notify_all();
+            }
+            return;
+        }
+        m_to_idle(conn);
+        m_unref(conn);
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Gets the backend of an address, creating it if needed.
+    connection_pool::backend* connection_pool::m_backend(uint64_t key,
+        const socket_address* saddr)
+    {
+        auto found = m_backends.find(key);
+        if (found != m_backends.end()) return found->second;
+        backend* owner = new backend;
+        owner->saddr = *static_cast<const ip4_socket_address*>(saddr);
+        m_backends[key] = owner;
+        return owner;
+    }
+
+    // Closes idle connections which are broken or unused for too long.
+    void connection_pool::m_check(std::unique_lock<std::mutex>& lock)
+    {
+        uint64_t now = stats_clock();
+        uint64_t timeout = uint64_t(m_options.idle_timeout_ms) * 1000000;
+        // Connections to probe, referenced, with duplicates of their sockets
+        // which stay valid when their peers are deleted.
+        std::vector<std::pair<connection*, int>> checked;
+        for (auto it = m_backends.begin(); it != m_backends.end(); ++it)
+        {
+            backend* owner = it->second;
+            for (auto conn = owner->all.begin(); conn != owner->all.end();
+                ++conn)
+            {
+                int expected = CONNECTION_IDLE;
+                if ((*conn)->state.compare_exchange_strong(expected,
+                    CONNECTION_CHECKING, std::memory_order_acq_rel) != true)
+                {
+                    continue;
+                }
+                int fd = (*conn)->remote->get_fd();
+                if (
+                    (timeout != 0) and (now - (*conn)->idle_since
+                        .load(std::memory_order_relaxed) > timeout)
+                )
+                {
+                    owner->expired.fetch_add(1, std::memory_order_relaxed);
+                    // Its own thread sees the shutdown and disconnects.
+                    shutdown(fd, SHUT_RDWR);
+                    continue;
+                }
+                fd = dup(fd);
+                if (fd == -1)
+                {
+                    (*conn)->state.store(CONNECTION_IDLE,
+                        std::memory_order_release);
+                    continue;
+                }
+                (*conn)->references.fetch_add(1, std::memory_order_relaxed);
+                checked.push_back({ *conn, fd });
+            }
+        }
+        if (checked.empty() == true) return;
+        lock.unlock();
+        for (auto it = checked.begin(); it != checked.end(); ++it)
+        {
+            connection* conn = it->first;
+            if (probe(it->second) == true)
+            {
+                // Unless it closed meanwhile.
+                int expected = CONNECTION_CHECKING;
+                conn->state.compare_exchange_strong(expected,
+                    CONNECTION_IDLE, std::memory_order_acq_rel);
+            }
+            else
+            {
+                conn->owner->expired.fetch_add(1, std::memory_order_relaxed);
+                shutdown(it->second, SHUT_RDWR);
+            }
+            close(it->second);
+            m_unref(conn);
+        }
+        lock.lock();
+    }
+
+    // Gets the key of a backend address.
+    uint64_t connection_pool::m_key(const socket_address* saddr)
+    {
+        const ip4_socket_address* p4saddr =
+            static_cast<const ip4_socket_address*>(saddr);
+        return (uint64_t(p4saddr->get_ip().as_in_addr().s_addr) << 16)
+            | p4saddr->get_port();
+    }
+
+    // Runs health checks until stopped.
+    void connection_pool::m_run_checker()
+    {
+        std::unique_lock<std::mutex> lock(m_pool_lock);
+        while (m_checker_stopping != true)
+        {
+            m_checker_wake.wait_for(lock,
+                std::chrono::milliseconds(m_options.health_check_ms));
+            if (m_checker_stopping == true) break;
+            m_check(lock);
+        }
+    }
+
+    // Hands out an idle connection.
+    bool connection_pool::m_take(connection* conn)
+    {
+        int expected = CONNECTION_IDLE;
+        if (conn->state.compare_exchange_strong(expected, CONNECTION_BUSY,
+            std::memory_order_acq_rel) != true)
+        {
+            return false;
+        }
+        conn->owner->idle_count.fetch_sub(1, std::memory_order_relaxed);
+        if (conn->handouts++ > 0)
+        {
+            conn->owner->reused.fetch_add(1, std::memory_order_relaxed);
+        }
+        conn->holder = &m_thread_cache();
+        return true;
+    }
+
+    // Gets the cache of the calling thread.
+    connection_pool::thread_cache& connection_pool::m_thread_cache()
+    {
+        thread_local thread_cache cache;
+        return cache;
+    }
+
+    // Puts an idle connection back in its backend's idle list.
+    void connection_pool::m_to_idle(connection* conn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_pool_lock);
+            // Unless it closed meanwhile, or a stale cache entry of another
+            // thread already put it there.
+            std::vector<connection*>& idle = conn->owner->idle;
+            if (
+                (conn->state.load(std::memory_order_acquire)
+                    != CONNECTION_DEAD)
+                and (std::find(idle.begin(), idle.end(), conn) == idle.end())
+            )
+            {
+                idle.push_back(conn);
+            }
+        }
+        m_available.notify_one();
+    }
+
+    // Drops a reference to a connection, deleting it with the last.
+    void connection_pool::m_unref(connection* conn)
+    {
+        if (conn->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete conn;
+        }
+    }
+
+    // Events. ----------------------------------------------------------------
+
+    // Connection to a backend is available.
+    void connection_pool::on_available(const socket_address* saddr)
+    {
+    }
+
+    // Connection attempt to a backend failed.
+    void connection_pool::on_backend_error(const socket_address* saddr,
+        int error)
+    {
+    }
+
+    // Acquired connection closed.
+    void connection_pool::on_lost(peer* remote_peer)
+    {
+    }
+
+    // Data arrived on an acquired connection.
+    void connection_pool::on_response(peer* remote_peer)
+    {
+    }
+
+    // Connection established, it starts out idle.
+    void connection_pool::on_connect(peer* remote_peer)
+    {
+        backend* owner = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_pool_lock);
+            auto found = m_backends.find(m_key(remote_peer->get_saddr()));
+            if (found == m_backends.end()) return;
+            owner = found->second;
+            connection* conn = new connection;
+            conn->remote = remote_peer;
+            conn->owner = owner;
+            conn->pool = m_id;
+            conn->key = found->first;
+            conn->parent = this;
+            conn->state = CONNECTION_IDLE;
+            conn->references = 1;
+            conn->idle_since = stats_clock();
+            conn->holder = nullptr;
+            conn->handouts = 0;
+            remote_peer->set_context(conn);
+            owner->connecting--;
+            owner->all.push_back(conn);
+            owner->idle.push_back(conn);
+            owner->idle_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_available.notify_all();
+        on_available(&owner->saddr);
+    }
+
+    // Connection attempt failed.
+    void connection_pool::on_connect_error(const socket_address* saddr,
+        int error, void* context)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_pool_lock);
+            auto found = m_backends.find(m_key(saddr));
+            if (found == m_backends.end()) return;
+            found->second->connecting--;
+            found->second->failures++;
+            found->second->last_error = error;
+        }
+        m_available.notify_all();
+        on_backend_error(saddr, error);
+    }
+
+    // Received data.
+    void connection_pool::on_receive(peer* remote_peer)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if (conn == nullptr) return;
+        int expected = CONNECTION_IDLE;
+        if (conn->state.compare_exchange_strong(expected,
+            CONNECTION_CHECKING, std::memory_order_acq_rel) == true)
+        {
+            // Nobody asked: the backend closed it, or is out of sync.
+            conn->owner->expired.fetch_add(1, std::memory_order_relaxed);
+            remote_peer->disconnect();
+            return;
+        }
+        if (expected == CONNECTION_BUSY) on_response(remote_peer);
+    }
+
+    // Connection closed.
+    void connection_pool::on_disconnect(peer* remote_peer)
+    {
+        int previous = CONNECTION_DEAD;
+        connection* conn = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_pool_lock);
+            conn = static_cast<connection*>(remote_peer->get_context());
+            if (conn == nullptr) return;
+            remote_peer->set_context(nullptr);
+            previous = conn->state.exchange(CONNECTION_DEAD,
+                std::memory_order_acq_rel);
+            backend* owner = conn->owner;
+            remove_from(owner->all, conn);
+            remove_from(owner->idle, conn);
+            if (
+                (previous == CONNECTION_IDLE)
+                or (previous == CONNECTION_CHECKING)
+            )
+            {
+                owner->idle_count.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        m_available.notify_all();
+        if (previous == CONNECTION_BUSY) on_lost(remote_peer);
+        m_unref(conn);
+    }
+
+}
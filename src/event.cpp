@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 #include <string>
 #include "tuxnet/log.h"
 #include "tuxnet/event.h"
@@ -9,6 +10,97 @@
 namespace tuxnet
 {
 
+    /*************************************************************************
+     * event_batch                                                           *
+     *************************************************************************/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    event_batch::event_batch(int size) : m_average(0), m_next_size(size)
+    {
+        m_resize(size);
+    }
+
+    // Getters. ---------------------------------------------------------------
+
+    // Gets the current batch size.
+    int event_batch::get_size() const
+    {
+        return m_events.size();
+    }
+
+    // Gets an event returned by the last wait().
+    epoll_event& event_batch::operator[](int n)
+    {
+        return m_events[n];
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Waits for events.
+    int event_batch::wait(int epoll_fd, int min_events, int max_events,
+        int timeout, int busy_poll_usec)
+    {
+        if (min_events < 1) min_events = 1;
+        if (max_events < min_events) max_events = min_events;
+        // Apply the size picked after the previous wait, within bounds.
+        int size = m_next_size;
+        if (size < min_events) size = min_events;
+        if (size > max_events) size = max_events;
+        m_resize(size);
+        int event_count = 0;
+        if (busy_poll_usec > 0)
+        {
+            timespec start = {};
+            timespec now = {};
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            long budget = busy_poll_usec * 1000L;
+            do
+            {
+                event_count = epoll_wait(epoll_fd, m_events.data(), size, 0);
+                if (event_count != 0) break;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+            }
+            while ((now.tv_sec - start.tv_sec) * 1000000000L
+                + (now.tv_nsec - start.tv_nsec) < budget);
+        }
+        if (event_count == 0)
+        {
+            event_count = epoll_wait(epoll_fd, m_events.data(), size,
+                timeout);
+        }
+        if (event_count <= 0) return event_count;
+        /* Track readiness and pick the batch size for the next call. The
+         * events just returned have to stay valid, so the buffer itself is
+         * only resized at the start of the next wait. */
+        m_average += event_count - m_average / 16;
+        if ((event_count == size) and (size < max_events))
+        {
+            m_next_size = size * 2 < max_events ? size * 2 : max_events;
+        }
+        else if ((m_average / 16 < size / 4) and (size > min_events))
+        {
+            m_next_size = size / 2 > min_events ? size / 2 : min_events;
+        }
+        return event_count;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Resizes the buffer to a new batch size.
+    void event_batch::m_resize(int size)
+    {
+        if (size < 1) size = 1;
+        if (size_t(size) == m_events.size()) return;
+        std::vector<epoll_event> events(size);
+        m_events.swap(events);
+    }
+
+    /*************************************************************************
+     * Event monitoring                                                      *
+     *************************************************************************/
+
     // Creates an event listener. 
     int create_event_listener()
     {
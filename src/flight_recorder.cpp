@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "tuxnet/config.h"
+#include "tuxnet/flight_recorder.h"
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// Names of flight_event_type values.
+        const char* const flight_event_names[FLIGHT_EVENT_COUNT] =
+        {
+            "accept", "first_byte", "read", "write", "eagain", "hangup",
+            "disconnect", "remove", "connect"
+        };
+
+        /// Number of rings of exited threads kept for dumps.
+        const size_t max_retired = 64;
+
+        /// Words per event slot.
+        const int slot_words = 4;
+
+        /**
+         * Ring of events owned by a single thread.
+         *
+         * A slot is the time, fd and value, address, port and type, and a
+         * sequence number which is 0 while the slot is being written and
+         * the event number plus 1 once it's complete.
+         */
+        struct flight_ring
+        {
+            /// Next ring in the list of all rings.
+            flight_ring* next;
+            /// Thread owning the ring, or that owned it last.
+            std::atomic<pid_t> thread;
+            /// Set while the owning thread runs.
+            std::atomic<bool> active;
+            /// Number of slots, a power of 2.
+            uint64_t capacity;
+            /// Events recorded so far.
+            std::atomic<uint64_t> head;
+            /// Value of head when the current owner took the ring.
+            std::atomic<uint64_t> start;
+            /// Slots, slot_words per slot.
+            std::atomic<uint64_t>* words;
+        };
+
+        /// All rings ever allocated, newest first, never shrinks.
+        std::atomic<flight_ring*> all_rings(nullptr);
+
+        // Gets the lock guarding retired_rings. Like the rings, it's never
+        // destroyed, as threads still running at exit retire theirs late.
+        std::mutex& retired_lock()
+        {
+            static std::mutex* lock = new std::mutex;
+            return *lock;
+        }
+
+        // Gets the rings of exited threads, oldest first.
+        std::deque<flight_ring*>& retired_rings()
+        {
+            static std::deque<flight_ring*>* rings =
+                new std::deque<flight_ring*>;
+            return *rings;
+        }
+
+        /// Hands the ring of a thread back when the thread exits.
+        struct ring_owner
+        {
+            /// Ring of the thread, nullptr if it doesn't have one yet.
+            flight_ring* ring = nullptr;
+            /// Set if the thread doesn't record.
+            bool disabled = false;
+
+            ~ring_owner()
+            {
+                if (ring == nullptr) return;
+                ring->active.store(false, std::memory_order_release);
+                std::lock_guard<std::mutex> lock(retired_lock());
+                retired_rings().push_back(ring);
+            }
+        };
+
+        /// Ring owner of the calling thread.
+        thread_local ring_owner t_owner;
+
+        // Gets a ring for the calling thread, nullptr if disabled.
+        flight_ring* acquire_ring()
+        {
+            int events = config::get().get_flight_recorder_events();
+            if (events <= 0) return nullptr;
+            pid_t thread = syscall(SYS_gettid);
+            {
+                std::lock_guard<std::mutex> lock(retired_lock());
+                std::deque<flight_ring*>& retired = retired_rings();
+                if (retired.size() > max_retired)
+                {
+                    flight_ring* ring = retired.front();
+                    retired.pop_front();
+                    ring->start.store(ring->head.load(
+                        std::memory_order_relaxed), std::memory_order_relaxed);
+                    ring->thread.store(thread, std::memory_order_relaxed);
+                    ring->active.store(true, std::memory_order_release);
+                    return ring;
+                }
+            }
+            uint64_t capacity = 1;
+            while (capacity < uint64_t(events)) capacity <<= 1;
+            flight_ring* ring = new flight_ring;
+            ring->thread = thread;
+            ring->active = true;
+            ring->capacity = capacity;
+            ring->head = 0;
+            ring->start = 0;
+            ring->words = new std::atomic<uint64_t>[capacity * slot_words];
+            for (uint64_t n = 0; n < capacity * slot_words; ++n)
+            {
+                ring->words[n].store(0, std::memory_order_relaxed);
+            }
+            ring->next = all_rings.load(std::memory_order_relaxed);
+            while (all_rings.compare_exchange_weak(ring->next, ring,
+                std::memory_order_release, std::memory_order_relaxed) != true)
+            {
+            }
+            return ring;
+        }
+
+        /**
+         * Reads an event from a ring.
+         * @param ring : Ring to read from.
+         * @param number : Event number.
+         * @param event : Receives the event.
+         * @return Returns false if the slot no longer (or not yet) holds
+         *         the event.
+         */
+        bool read_event(const flight_ring* ring, uint64_t number,
+            flight_event& event)
+        {
+            const std::atomic<uint64_t>* slot =
+                ring->words + (number & (ring->capacity - 1)) * slot_words;
+            uint64_t sequence = slot[3].load(std::memory_order_acquire);
+            if (sequence != number + 1) return false;
+            uint64_t time = slot[0].load(std::memory_order_relaxed);
+            uint64_t fd_value = slot[1].load(std::memory_order_relaxed);
+            uint64_t address = slot[2].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot[3].load(std::memory_order_relaxed) != sequence)
+            {
+                return false;
+            }
+            event.time = time;
+            event.thread = ring->thread.load(std::memory_order_relaxed);
+            event.fd = int32_t(uint32_t(fd_value));
+            event.value = int32_t(uint32_t(fd_value >> 32));
+            event.ip = in_addr_t(uint32_t(address));
+            event.port = in_port_t(address >> 32);
+            event.type = flight_event_type((address >> 48) & 0xffff);
+            return true;
+        }
+
+        /// Fixed size text buffer, only uses async-signal-safe calls.
+        class dump_writer
+        {
+            char m_buffer[4096];
+            int m_fd;
+            size_t m_length;
+            bool m_ok;
+
+            public:
+
+                /// Constructor.
+                dump_writer(int fd) : m_fd(fd), m_length(0), m_ok(true)
+                {
+                }
+
+                /// Appends a string.
+                void add(const char* text)
+                {
+                    while (*text != '\0')
+                    {
+                        if (m_length == sizeof(m_buffer)) flush();
+                        m_buffer[m_length++] = *text++;
+                    }
+                }
+
+                /// Appends an unsigned number.
+                void add(uint64_t value)
+                {
+                    char digits[24];
+                    int count = 0;
+                    do
+                    {
+                        digits[count++] = '0' + value % 10;
+                        value /= 10;
+                    } while (value != 0);
+                    char text[24];
+                    for (int n = 0; n < count; ++n)
+                    {
+                        text[n] = digits[count - 1 - n];
+                    }
+                    text[count] = '\0';
+                    add(text);
+                }
+
+                /// Appends a signed number.
+                void add_signed(int64_t value)
+                {
+                    if (value < 0)
+                    {
+                        add("-");
+                        add(uint64_t(-(value + 1)) + 1);
+                        return;
+                    }
+                    add(uint64_t(value));
+                }
+
+                /// Writes out the buffer.
+                bool flush()
+                {
+                    size_t done = 0;
+                    while ((done < m_length) and (m_ok == true))
+                    {
+                        ssize_t count = write(m_fd, m_buffer + done,
+                            m_length - done);
+                        if ((count == -1) and (errno == EINTR)) continue;
+                        if (count <= 0) m_ok = false;
+                        else done += count;
+                    }
+                    m_length = 0;
+                    return m_ok;
+                }
+        };
+
+        // Dumps the events when a signal arrives.
+        void dump_signal_handler(int signal)
+        {
+            int error = errno;
+            flight_recorder::dump(STDERR_FILENO);
+            errno = error;
+        }
+
+    }
+
+    // Gets the name of a flight recorder event type.
+    const char* flight_event_name(flight_event_type type)
+    {
+        if ((type < 0) or (type >= FLIGHT_EVENT_COUNT)) return "";
+        return flight_event_names[type];
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Writes all recorded events as text.
+    bool flight_recorder::dump(int fd)
+    {
+        dump_writer out(fd);
+        out.add("flight recorder dump at ");
+        out.add(stats_clock());
+        out.add("\n");
+        for (
+            const flight_ring* ring = all_rings.load(
+                std::memory_order_acquire);
+            ring != nullptr;
+            ring = ring->next
+        )
+        {
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = ring->start.load(std::memory_order_relaxed);
+            if (head - first > ring->capacity) first = head - ring->capacity;
+            if (first == head) continue;
+            out.add("thread ");
+            out.add(uint64_t(ring->thread.load(std::memory_order_relaxed)));
+            if (ring->active.load(std::memory_order_relaxed) != true)
+            {
+                out.add(" (exited)");
+            }
+            out.add("\n");
+            for (uint64_t number = first; number < head; ++number)
+            {
+                flight_event event;
+                if (read_event(ring, number, event) != true) continue;
+                out.add("  ");
+                out.add(event.time);
+                out.add(" ");
+                out.add(flight_event_name(event.type));
+                out.add(" fd=");
+                out.add_signed(event.fd);
+                out.add(" peer=");
+                const uint8_t* ip = reinterpret_cast<const uint8_t*>(
+                    &event.ip);
+                for (int n = 0; n < 4; ++n)
+                {
+                    if (n > 0) out.add(".");
+                    out.add(uint64_t(ip[n]));
+                }
+                out.add(":");
+                out.add(uint64_t(event.port));
+                out.add(" value=");
+                out.add_signed(event.value);
+                out.add("\n");
+            }
+        }
+        return out.flush();
+    }
+
+    // Dumps all recorded events to stderr when a signal arrives.
+    bool flight_recorder::dump_on_signal(int signal)
+    {
+        struct sigaction action = {};
+        action.sa_handler = dump_signal_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        return sigaction(signal, &action, nullptr) == 0;
+    }
+
+    // Gets all recorded events.
+    flight_events flight_recorder::events()
+    {
+        flight_events result;
+        for (
+            const flight_ring* ring = all_rings.load(
+                std::memory_order_acquire);
+            ring != nullptr;
+            ring = ring->next
+        )
+        {
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = ring->start.load(std::memory_order_relaxed);
+            if (head - first > ring->capacity) first = head - ring->capacity;
+            for (uint64_t number = first; number < head; ++number)
+            {
+                flight_event event;
+                if (read_event(ring, number, event) == true)
+                {
+                    result.push_back(event);
+                }
+            }
+        }
+        std::stable_sort(result.begin(), result.end(),
+            [](const flight_event& a, const flight_event& b){
+                return a.time < b.time;
+            });
+        return result;
+    }
+
+    // Records an event in the calling thread's ring.
+    void flight_recorder::record(flight_event_type type, int fd, in_addr_t ip,
+        in_port_t port, int32_t value)
+    {
+        ring_owner& owner = t_owner;
+        flight_ring* ring = owner.ring;
+        if (ring == nullptr)
+        {
+            if (owner.disabled == true) return;
+            ring = acquire_ring();
+            if (ring == nullptr)
+            {
+                owner.disabled = true;
+                return;
+            }
+            owner.ring = ring;
+        }
+        uint64_t number = ring->head.load(std::memory_order_relaxed);
+        std::atomic<uint64_t>* slot =
+            ring->words + (number & (ring->capacity - 1)) * slot_words;
+        // Invalidate the slot before touching its contents.
+        slot[3].store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot[0].store(stats_clock(), std::memory_order_relaxed);
+        slot[1].store(uint64_t(uint32_t(fd))
+            | (uint64_t(uint32_t(value)) << 32), std::memory_order_relaxed);
+        slot[2].store(uint64_t(uint32_t(ip)) | (uint64_t(port) << 32)
+            | (uint64_t(type) << 48), std::memory_order_relaxed);
+        slot[3].store(number + 1, std::memory_order_release);
+        ring->head.store(number + 1, std::memory_order_release);
+    }
+
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include "tuxnet/heavy_hitters.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// Odd multipliers of the per row multiply-shift hashes.
+        const uint64_t row_seeds[] =
+        {
+            0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+            0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL
+        };
+
+    }
+
+    /***** count_min_sketch *****/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    count_min_sketch::count_min_sketch()
+    {
+        clear();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Counts a key.
+    uint64_t count_min_sketch::add(uint32_t key, uint64_t count)
+    {
+        uint64_t estimate = UINT64_MAX;
+        for (int row = 0; row < m_depth; ++row)
+        {
+            uint64_t value = m_counts[m_index(row, key)].fetch_add(count,
+                std::memory_order_relaxed) + count;
+            if (value < estimate) estimate = value;
+        }
+        return estimate;
+    }
+
+    // Resets all counts to 0.
+    void count_min_sketch::clear()
+    {
+        for (int n = 0; n < m_depth * m_width; ++n)
+        {
+            m_counts[n].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Estimates the count of a key.
+    uint64_t count_min_sketch::estimate(uint32_t key) const
+    {
+        uint64_t estimate = UINT64_MAX;
+        for (int row = 0; row < m_depth; ++row)
+        {
+            uint64_t value =
+                m_counts[m_index(row, key)].load(std::memory_order_relaxed);
+            if (value < estimate) estimate = value;
+        }
+        return estimate;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Gets the counter index of a key in a row.
+    int count_min_sketch::m_index(int row, uint32_t key)
+    {
+        static_assert(sizeof(row_seeds) / sizeof(row_seeds[0]) >= m_depth,
+            "Every row needs a seed.");
+        return row * m_width
+            + int((uint64_t(key) * row_seeds[row]) >> (64 - m_width_bits));
+    }
+
+    /***** heavy_hitters *****/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    heavy_hitters::heavy_hitters()
+    {
+        clear();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Counts for an address.
+    void heavy_hitters::add(heavy_hitter_metric metric, in_addr_t ip,
+        uint64_t count)
+    {
+        if ((metric < 0) or (metric >= HEAVY_HITTER_METRIC_COUNT)) return;
+        if (ip == 0) return;
+        uint64_t estimate = m_sketches[metric].add(ip, count);
+        if (estimate <= m_thresholds[metric].load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        std::atomic<uint32_t>* candidates = m_candidates[metric];
+        for (int n = 0; n < m_capacity; ++n)
+        {
+            if (candidates[n].load(std::memory_order_relaxed) == ip) return;
+        }
+        m_promote(metric, ip, estimate);
+    }
+
+    // Forgets all counts and candidates.
+    void heavy_hitters::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (int metric = 0; metric < HEAVY_HITTER_METRIC_COUNT; ++metric)
+        {
+            m_sketches[metric].clear();
+            m_thresholds[metric].store(0, std::memory_order_relaxed);
+            for (int n = 0; n < m_capacity; ++n)
+            {
+                m_candidates[metric][n].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Gets the busiest addresses.
+    heavy_hitter_list heavy_hitters::top(heavy_hitter_metric metric,
+        int count)
+    {
+        heavy_hitter_list result;
+        if ((metric < 0) or (metric >= HEAVY_HITTER_METRIC_COUNT))
+        {
+            return result;
+        }
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (int n = 0; n < m_capacity; ++n)
+        {
+            uint32_t ip = m_candidates[metric][n].load(
+                std::memory_order_relaxed);
+            if (ip == 0) continue;
+            in_addr addr = {};
+            addr.s_addr = ip;
+            heavy_hitter entry = { ip4_address(addr),
+                m_sketches[HEAVY_HITTER_CONNECTIONS].estimate(ip),
+                m_sketches[HEAVY_HITTER_BYTES].estimate(ip) };
+            result.push_back(entry);
+        }
+        std::sort(result.begin(), result.end(),
+            [metric](const heavy_hitter& a, const heavy_hitter& b){
+                if (metric == HEAVY_HITTER_CONNECTIONS)
+                {
+                    return a.connections > b.connections;
+                }
+                return a.bytes > b.bytes;
+            });
+        if ((count >= 0) and (size_t(count) < result.size()))
+        {
+            result.erase(result.begin() + count, result.end());
+        }
+        return result;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Makes an address a candidate, replacing the smallest one.
+    void heavy_hitters::m_promote(heavy_hitter_metric metric, uint32_t ip,
+        uint64_t estimate)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::atomic<uint32_t>* candidates = m_candidates[metric];
+        count_min_sketch& sketch = m_sketches[metric];
+        int smallest = -1;
+        uint64_t smallest_estimate = UINT64_MAX;
+        for (int n = 0; n < m_capacity; ++n)
+        {
+            uint32_t candidate = candidates[n].load(std::memory_order_relaxed);
+            // Another thread may have promoted it in the meantime.
+            if (candidate == ip) return;
+            uint64_t value = (candidate == 0) ? 0 : sketch.estimate(candidate);
+            if (value < smallest_estimate)
+            {
+                smallest = n;
+                smallest_estimate = value;
+            }
+        }
+        if (estimate > smallest_estimate)
+        {
+            candidates[smallest].store(ip, std::memory_order_relaxed);
+        }
+        // Only a full table has a threshold.
+        uint64_t threshold = UINT64_MAX;
+        for (int n = 0; n < m_capacity; ++n)
+        {
+            uint32_t candidate = candidates[n].load(std::memory_order_relaxed);
+            uint64_t value = (candidate == 0) ? 0 : sketch.estimate(candidate);
+            if (value < threshold) threshold = value;
+        }
+        m_thresholds[metric].store(threshold, std::memory_order_relaxed);
+    }
+
+}
@@ -0,0 +1,165 @@
+#include <cmath>
+#include "tuxnet/histogram.h"
+
+namespace tuxnet
+{
+
+    /*************************************************************************
+     * histogram_buckets                                                     *
+     *************************************************************************/
+
+    // Gets the bucket a value is counted in.
+    int histogram_buckets::index(uint64_t value)
+    {
+        if (value > max_value) value = max_value;
+        if (value < (uint64_t(1) << sub_bucket_bits))
+        {
+            return static_cast<int>(value);
+        }
+        int shift = (63 - __builtin_clzll(value)) - sub_bucket_bits;
+        return (shift << sub_bucket_bits) + static_cast<int>(value >> shift);
+    }
+
+    // Gets the highest value counted in a bucket.
+    uint64_t histogram_buckets::highest(int index)
+    {
+        if (index < (1 << sub_bucket_bits)) return index;
+        int shift = (index >> sub_bucket_bits) - 1;
+        uint64_t mantissa = index - (shift << sub_bucket_bits);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    /*************************************************************************
+     * histogram                                                             *
+     *************************************************************************/
+
+    // Constructor.
+    histogram::histogram()
+    {
+        for (int n = 0; n < histogram_buckets::count; ++n) m_counts[n] = 0;
+        m_sum = 0;
+    }
+
+    /*************************************************************************
+     * histogram_snapshot                                                    *
+     *************************************************************************/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    histogram_snapshot::histogram_snapshot()
+    {
+        clear();
+    }
+
+    // Getters. ---------------------------------------------------------------
+
+    // Gets the count of a single bucket.
+    uint64_t histogram_snapshot::bucket(int index) const
+    {
+        if ((index < 0) or (index >= histogram_buckets::count)) return 0;
+        return m_counts[index];
+    }
+
+    // Gets the number of recorded values.
+    uint64_t histogram_snapshot::count() const
+    {
+        return m_total;
+    }
+
+    // Gets the highest recorded value.
+    uint64_t histogram_snapshot::max() const
+    {
+        for (int n = histogram_buckets::count - 1; n >= 0; --n)
+        {
+            if (m_counts[n] != 0) return histogram_buckets::highest(n);
+        }
+        return 0;
+    }
+
+    // Gets a percentile.
+    uint64_t histogram_snapshot::percentile(double percentile) const
+    {
+        if (m_total == 0) return 0;
+        if (percentile < 0) percentile = 0;
+        if (percentile > 100) percentile = 100;
+        uint64_t rank = static_cast<uint64_t>(
+            std::ceil(percentile / 100 * m_total));
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (int n = 0; n < histogram_buckets::count; ++n)
+        {
+            seen += m_counts[n];
+            if (seen >= rank) return histogram_buckets::highest(n);
+        }
+        return max();
+    }
+
+    // Gets the exact sum of all recorded values.
+    uint64_t histogram_snapshot::sum() const
+    {
+        return m_sum;
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Adds the counts of a live histogram.
+    void histogram_snapshot::add(const histogram& other)
+    {
+        for (int n = 0; n < histogram_buckets::count; ++n)
+        {
+            uint64_t count = other.m_counts[n].load(std::memory_order_relaxed);
+            m_counts[n] += count;
+            m_total += count;
+        }
+        m_sum += other.m_sum.load(std::memory_order_relaxed);
+    }
+
+    // Adds the counts of another snapshot.
+    void histogram_snapshot::add(const histogram_snapshot& other)
+    {
+        for (int n = 0; n < histogram_buckets::count; ++n)
+        {
+            m_counts[n] += other.m_counts[n];
+        }
+        m_sum += other.m_sum;
+        m_total += other.m_total;
+    }
+
+    // Empties all buckets.
+    void histogram_snapshot::clear()
+    {
+        for (int n = 0; n < histogram_buckets::count; ++n) m_counts[n] = 0;
+        m_sum = 0;
+        m_total = 0;
+    }
+
+    // Records a value.
+    void histogram_snapshot::record(uint64_t value, uint64_t count)
+    {
+        m_counts[histogram_buckets::index(value)] += count;
+        m_sum += value * count;
+        m_total += count;
+    }
+
+    // Subtracts the counts of an earlier snapshot.
+    void histogram_snapshot::subtract(const histogram_snapshot& earlier)
+    {
+        m_sum = (m_sum > earlier.m_sum) ? m_sum - earlier.m_sum : 0;
+        m_total = 0;
+        for (int n = 0; n < histogram_buckets::count; ++n)
+        {
+            // Counters only grow, guard against mismatched snapshots anyway.
+            if (m_counts[n] > earlier.m_counts[n])
+            {
+                m_counts[n] -= earlier.m_counts[n];
+            }
+            else
+            {
+                m_counts[n] = 0;
+            }
+            m_total += m_counts[n];
+        }
+    }
+
+}
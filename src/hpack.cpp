@@ -0,0 +1,789 @@
+#include <stdint.h>
+#include <string.h>
+#include "tuxnet/hpack.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// HPACK static table (RFC 7541 appendix A), index 1 first.
+        const http_header static_table[hpack_static_count] = {
+            { ":authority", "" },
+            { ":method", "GET" },
+            { ":method", "POST" },
+            { ":path", "/" },
+            { ":path", "/index.html" },
+            { ":scheme", "http" },
+            { ":scheme", "https" },
+            { ":status", "200" },
+            { ":status", "204" },
+            { ":status", "206" },
+            { ":status", "304" },
+            { ":status", "400" },
+            { ":status", "404" },
+            { ":status", "500" },
+            { "accept-charset", "" },
+            { "accept-encoding", "gzip, deflate" },
+            { "accept-language", "" },
+            { "accept-ranges", "" },
+            { "accept", "" },
+            { "access-control-allow-origin", "" },
+            { "age", "" },
+            { "allow", "" },
+            { "authorization", "" },
+            { "cache-control", "" },
+            { "content-disposition", "" },
+            { "content-encoding", "" },
+            { "content-language", "" },
+            { "content-length", "" },
+            { "content-location", "" },
+            { "content-range", "" },
+            { "content-type", "" },
+            { "cookie", "" },
+            { "date", "" },
+            { "etag", "" },
+            { "expect", "" },
+            { "expires", "" },
+            { "from", "" },
+            { "host", "" },
+            { "if-match", "" },
+            { "if-modified-since", "" },
+            { "if-none-match", "" },
+            { "if-range", "" },
+            { "if-unmodified-since", "" },
+            { "last-modified", "" },
+            { "link", "" },
+            { "location", "" },
+            { "max-forwards", "" },
+            { "proxy-authenticate", "" },
+            { "proxy-authorization", "" },
+            { "range", "" },
+            { "referer", "" },
+            { "refresh", "" },
+            { "retry-after", "" },
+            { "server", "" },
+            { "set-cookie", "" },
+            { "strict-transport-security", "" },
+            { "transfer-encoding", "" },
+            { "user-agent", "" },
+            { "vary", "" },
+            { "via", "" },
+            { "www-authenticate", "" }
+        };
+
+        /// Huffman codes of every octet, then EOS (RFC 7541 appendix B).
+        const uint32_t huffman_codes[257] = {
+            0x00001ff8, 0x007fffd8, 0x0fffffe2, 0x0fffffe3, 0x0fffffe4,
+            0x0fffffe5, 0x0fffffe6, 0x0fffffe7, 0x0fffffe8, 0x00ffffea,
+            0x3ffffffc, 0x0fffffe9, 0x0fffffea, 0x3ffffffd, 0x0fffffeb,
+            0x0fffffec, 0x0fffffed, 0x0fffffee, 0x0fffffef, 0x0ffffff0,
+            0x0ffffff1, 0x0ffffff2, 0x3ffffffe, 0x0ffffff3, 0x0ffffff4,
+            0x0ffffff5, 0x0ffffff6, 0x0ffffff7, 0x0ffffff8, 0x0ffffff9,
+            0x0ffffffa, 0x0ffffffb, 0x00000014, 0x000003f8, 0x000003f9,
+            0x00000ffa, 0x00001ff9, 0x00000015, 0x000000f8, 0x000007fa,
+            0x000003fa, 0x000003fb, 0x000000f9, 0x000007fb, 0x000000fa,
+            0x00000016, 0x00000017, 0x00000018, 0x00000000, 0x00000001,
+            0x00000002, 0x00000019, 0x0000001a, 0x0000001b, 0x0000001c,
+            0x0000001d, 0x0000001e, 0x0000001f, 0x0000005c, 0x000000fb,
+            0x00007ffc, 0x00000020, 0x00000ffb, 0x000003fc, 0x00001ffa,
+            0x00000021, 0x0000005d, 0x0000005e, 0x0000005f, 0x00000060,
+            0x00000061, 0x00000062, 0x00000063, 0x00000064, 0x00000065,
+            0x00000066, 0x00000067, 0x00000068, 0x00000069, 0x0000006a,
+            0x0000006b, 0x0000006c, 0x0000006d, 0x0000006e, 0x0000006f,
+            0x00000070, 0x00000071, 0x00000072, 0x000000fc, 0x00000073,
+            0x000000fd, 0x00001ffb, 0x0007fff0, 0x00001ffc, 0x00003ffc,
+            0x00000022, 0x00007ffd, 0x00000003, 0x00000023, 0x00000004,
+            0x00000024, 0x00000005, 0x00000025, 0x00000026, 0x00000027,
+            0x00000006, 0x00000074, 0x00000075, 0x00000028, 0x00000029,
+            0x0000002a, 0x00000007, 0x0000002b, 0x00000076, 0x0000002c,
+            0x00000008, 0x00000009, 0x0000002d, 0x00000077, 0x00000078,
+            0x00000079, 0x0000007a, 0x0000007b, 0x00007ffe, 0x000007fc,
+            0x00003ffd, 0x00001ffd, 0x0ffffffc, 0x000fffe6, 0x003fffd2,
+            0x000fffe7, 0x000fffe8, 0x003fffd3, 0x003fffd4, 0x003fffd5,
+            0x007fffd9, 0x003fffd6, 0x007fffda, 0x007fffdb, 0x007fffdc,
+            0x007fffdd, 0x007fffde, 0x00ffffeb, 0x007fffdf, 0x00ffffec,
+            0x00ffffed, 0x003fffd7, 0x007fffe0, 0x00ffffee, 0x007fffe1,
+            0x007fffe2, 0x007fffe3, 0x007fffe4, 0x001fffdc, 0x003fffd8,
+            0x007fffe5, 0x003fffd9, 0x007fffe6, 0x007fffe7, 0x00ffffef,
+            0x003fffda, 0x001fffdd, 0x000fffe9, 0x003fffdb, 0x003fffdc,
+            0x007fffe8, 0x007fffe9, 0x001fffde, 0x007fffea, 0x003fffdd,
+            0x003fffde, 0x00fffff0, 0x001fffdf, 0x003fffdf, 0x007fffeb,
+            0x007fffec, 0x001fffe0, 0x001fffe1, 0x003fffe0, 0x001fffe2,
+            0x007fffed, 0x003fffe1, 0x007fffee, 0x007fffef, 0x000fffea,
+            0x003fffe2, 0x003fffe3, 0x003fffe4, 0x007ffff0, 0x003fffe5,
+            0x003fffe6, 0x007ffff1, 0x03ffffe0, 0x03ffffe1, 0x000fffeb,
+            0x0007fff1, 0x003fffe7, 0x007ffff2, 0x003fffe8, 0x01ffffec,
+            0x03ffffe2, 0x03ffffe3, 0x03ffffe4, 0x07ffffde, 0x07ffffdf,
+            0x03ffffe5, 0x00fffff1, 0x01ffffed, 0x0007fff2, 0x001fffe3,
+            0x03ffffe6, 0x07ffffe0, 0x07ffffe1, 0x03ffffe7, 0x07ffffe2,
+            0x00fffff2, 0x001fffe4, 0x001fffe5, 0x03ffffe8, 0x03ffffe9,
+            0x0ffffffd, 0x07ffffe3, 0x07ffffe4, 0x07ffffe5, 0x000fffec,
+            0x00fffff3, 0x000fffed, 0x001fffe6, 0x003fffe9, 0x001fffe7,
+            0x001fffe8, 0x007ffff3, 0x003fffea, 0x003fffeb, 0x01ffffee,
+            0x01ffffef, 0x00fffff4, 0x00fffff5, 0x03ffffea, 0x007ffff4,
+            0x03ffffeb, 0x07ffffe6, 0x03ffffec, 0x03ffffed, 0x07ffffe7,
+            0x07ffffe8, 0x07ffffe9, 0x07ffffea, 0x07ffffeb, 0x0ffffffe,
+            0x07ffffec, 0x07ffffed, 0x07ffffee, 0x07ffffef, 0x07fffff0,
+            0x03ffffee, 0x3fffffff
+        };
+
+        /// Bit lengths of the Huffman codes.
+        const uint8_t huffman_lengths[257] = {
+            13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+            28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+            6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+            5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+            13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+            7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+            15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+            6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+            20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+            24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+            22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+            21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+            26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+            19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+            20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+            26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+            30
+        };
+
+        /// Huffman decoding steps.
+        enum huffman_flags
+        {
+            HUFFMAN_EMIT = 1,
+            HUFFMAN_ACCEPT = 2,
+            HUFFMAN_FAIL = 4
+        };
+
+        /// Huffman decoding step : where 4 bits lead from a tree node.
+        struct huffman_step
+        {
+            /// Node reached, by number.
+            uint8_t next;
+            /// HUFFMAN_* flags.
+            uint8_t flags;
+            /// Octet decoded on the way, with HUFFMAN_EMIT.
+            uint8_t symbol;
+        };
+
+        /// Huffman decoding state machine, a nibble at a time.
+        struct huffman_machine
+        {
+            /// Steps by internal tree node (256 of them) and nibble.
+            huffman_step steps[256][16];
+
+            // Builds the machine from the code table.
+            huffman_machine()
+            {
+                // Code tree, node 0 is the root, leaves have a symbol.
+                int16_t children[513][2];
+                int16_t symbols[513];
+                memset(children, 0xff, sizeof(children));
+                memset(symbols, 0xff, sizeof(symbols));
+                int nodes = 1;
+                for (int symbol = 0; symbol < 257; ++symbol)
+                {
+                    int node = 0;
+                    for (int bit = huffman_lengths[symbol] - 1; bit >= 0;
+                        --bit)
+                    {
+                        int branch = (huffman_codes[symbol] >> bit) & 1;
+                        if (children[node][branch] < 0)
+                        {
+                            children[node][branch] = nodes++;
+                        }
+                        node = children[node][branch];
+                    }
+                    symbols[node] = symbol;
+                }
+                // Number the internal nodes, the root first.
+                int16_t numbers[513];
+                int16_t internal[256];
+                int count = 0;
+                for (int node = 0; node < nodes; ++node)
+                {
+                    numbers[node] = -1;
+                    if (symbols[node] < 0)
+                    {
+                        numbers[node] = count;
+                        internal[count++] = node;
+                    }
+                }
+                // Padding is up to 7 bits of EOS, which starts with ones.
+                bool accepting[513] = {};
+                for (int node = 0, depth = 0; depth <= 7; ++depth)
+                {
+                    accepting[node] = true;
+                    node = children[node][1];
+                }
+                for (int number = 0; number < count; ++number)
+                {
+                    for (int nibble = 0; nibble < 16; ++nibble)
+                    {
+                        huffman_step& step = steps[number][nibble];
+                        step.next = 0;
+                        step.flags = 0;
+                        step.symbol = 0;
+                        int node = internal[number];
+                        for (int bit = 3; bit >= 0; --bit)
+                        {
+                            node = children[node][(nibble >> bit) & 1];
+                            if (symbols[node] == 256)
+                            {
+                                step.flags = HUFFMAN_FAIL;
+                                break;
+                            }
+                            if (symbols[node] >= 0)
+                            {
+                                step.flags = HUFFMAN_EMIT;
+                                step.symbol = symbols[node];
+                                node = 0;
+                            }
+                        }
+                        if (step.flags == HUFFMAN_FAIL) continue;
+                        step.next = numbers[node];
+                        if (accepting[node] == true)
+                        {
+                            step.flags |= HUFFMAN_ACCEPT;
+                        }
+                    }
+                }
+            }
+        };
+
+        /// Decoding state machine, built on first use.
+        const huffman_machine& get_huffman_machine()
+        {
+            static const huffman_machine machine;
+            return machine;
+        }
+
+        // Appends an integer with an N-bit prefix.
+        void encode_integer(std::string& out, uint8_t first, int prefix,
+            size_t value)
+        {
+            size_t limit = (size_t(1) << prefix) - 1;
+            if (value < limit)
+            {
+                out.push_back(char(first | value));
+                return;
+            }
+            out.push_back(char(first | limit));
+            value -= limit;
+            while (value >= 128)
+            {
+                out.push_back(char((value & 127) | 128));
+                value >>= 7;
+            }
+            out.push_back(char(value));
+        }
+
+        // Reads an integer with an N-bit prefix.
+        bool decode_integer(const uint8_t*& in, const uint8_t* end,
+            int prefix, size_t& value)
+        {
+            if (in == end) return false;
+            size_t limit = (size_t(1) << prefix) - 1;
+            value = *in++ & limit;
+            if (value < limit) return true;
+            // Nothing sensible needs more than 28 more bits.
+            for (int shift = 0; shift <= 21; shift += 7)
+            {
+                if (in == end) return false;
+                uint8_t byte = *in++;
+                value += size_t(byte & 127) << shift;
+                if ((byte & 128) == 0) return true;
+            }
+            return false;
+        }
+
+        // Appends a string literal, Huffman-coded if that's shorter.
+        void encode_string(std::string& out, std::string_view data)
+        {
+            size_t coded = hpack_huffman_length(data);
+            if (coded < data.size())
+            {
+                encode_integer(out, 0x80, 7, coded);
+                hpack_huffman_encode(out, data);
+                return;
+            }
+            encode_integer(out, 0, 7, data.size());
+            out.append(data.data(), data.size());
+        }
+
+        // Finds a field in the static table.
+        size_t find_static(std::string_view name, std::string_view value,
+            bool& exact)
+        {
+            size_t found = 0;
+            exact = false;
+            for (size_t index = 0; index < hpack_static_count; ++index)
+            {
+                if (static_table[index].name != name) continue;
+                if (static_table[index].value == value)
+                {
+                    exact = true;
+                    return index + 1;
+                }
+                if (found == 0) found = index + 1;
+            }
+            return found;
+        }
+
+    }
+
+    /***** hpack_table *****/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    hpack_table::hpack_table(size_t max_size) :
+        m_data(),
+        m_base(0),
+        m_ring(),
+        m_newest(0),
+        m_count(0),
+        m_size(0),
+        m_max_size(0)
+    {
+        set_max_size(max_size);
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Adds an entry.
+    void hpack_table::add(std::string_view name, std::string_view value)
+    {
+        size_t size = name.size() + value.size() + 32;
+        if (size > m_max_size)
+        {
+            m_evict(m_max_size);
+            return;
+        }
+        m_evict(size);
+        size_t length = name.size() + value.size();
+        if (m_data.size() + length > m_data.capacity())
+        {
+            // Drop what evicted entries left at the start.
+            size_t start = m_data.size();
+            if (m_count > 0)
+            {
+                size_t oldest = (m_newest + m_ring.size() - m_count + 1)
+                    % m_ring.size();
+                start = m_ring[oldest].offset - m_base;
+            }
+            m_data.erase(0, start);
+            m_base += start;
+        }
+        m_newest = (m_newest + 1) % m_ring.size();
+        entry& added = m_ring[m_newest];
+        added.offset = m_base + m_data.size();
+        added.name_length = name.size();
+        added.value_length = value.size();
+        m_data.append(name.data(), name.size());
+        m_data.append(value.data(), value.size());
+        m_count++;
+        m_size += size;
+    }
+
+    // Finds an entry.
+    size_t hpack_table::find(std::string_view name, std::string_view value,
+        bool& exact) const
+    {
+        size_t found = 0;
+        exact = false;
+        http_header field;
+        for (size_t index = 0; index < m_count; ++index)
+        {
+            get(index, field);
+            if (field.name != name) continue;
+            if (field.value == value)
+            {
+                exact = true;
+                return index + 1;
+            }
+            if (found == 0) found = index + 1;
+        }
+        return found;
+    }
+
+    // Gets an entry.
+    bool hpack_table::get(size_t index, http_header& field) const
+    {
+        if (index >= m_count) return false;
+        const entry& found = m_ring[
+            (m_newest + m_ring.size() - index) % m_ring.size()];
+        const char* start = m_data.data() + (found.offset - m_base);
+        field.name = std::string_view(start, found.name_length);
+        field.value = std::string_view(start + found.name_length,
+            found.value_length);
+        return true;
+    }
+
+    // Gets the number of entries.
+    size_t hpack_table::get_count() const
+    {
+        return m_count;
+    }
+
+    // Gets the size of the table.
+    size_t hpack_table::get_size() const
+    {
+        return m_size;
+    }
+
+    // Gets the most the table can hold.
+    size_t hpack_table::get_max_size() const
+    {
+        return m_max_size;
+    }
+
+    // Changes the most the table can hold.
+    void hpack_table::set_max_size(size_t max_size)
+    {
+        if (max_size < m_max_size) m_evict(m_max_size - max_size);
+        if (max_size > m_max_size)
+        {
+            // Move the entries to a bigger ring and buffer, oldest first.
+            std::vector<entry> ring(max_size / 32 + 1);
+            std::string data;
+            data.reserve(max_size * 2);
+            http_header field;
+            for (size_t n = 0; n < m_count; ++n)
+            {
+                get(m_count - 1 - n, field);
+                entry& moved = ring[n];
+                moved.offset = data.size();
+                moved.name_length = field.name.size();
+                moved.value_length = field.value.size();
+                data.append(field.name.data(), field.name.size());
+                data.append(field.value.data(), field.value.size());
+            }
+            m_ring.swap(ring);
+            m_data.swap(data);
+            m_base = 0;
+            m_newest = (m_count > 0) ? m_count - 1 : m_ring.size() - 1;
+        }
+        m_max_size = max_size;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Evicts the oldest entries until the table has room.
+    void hpack_table::m_evict(size_t room)
+    {
+        while ((m_count > 0) and (m_size + room > m_max_size))
+        {
+            size_t oldest = (m_newest + m_ring.size() - m_count + 1)
+                % m_ring.size();
+            const entry& evicted = m_ring[oldest];
+            m_size -= evicted.name_length + evicted.value_length + 32;
+            m_count--;
+        }
+        if (m_count == 0)
+        {
+            m_data.clear();
+            m_base = 0;
+        }
+    }
+
+    /***** hpack_decoder *****/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    hpack_decoder::hpack_decoder(size_t max_table_size,
+        size_t max_list_size) :
+        m_table(max_table_size),
+        m_max_table_size(max_table_size),
+        m_max_list_size(max_list_size),
+        m_fields()
+    {
+        m_fields.reserve(64);
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Decodes a complete header block.
+    bool hpack_decoder::decode(const char* data, size_t length,
+        std::vector<http_header>& headers, std::string& storage)
+    {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+        const uint8_t* end = in + length;
+        headers.clear();
+        storage.clear();
+        m_fields.clear();
+        size_t list_size = 0;
+        while (in < end)
+        {
+            uint8_t first = *in;
+            size_t index = 0;
+            field decoded;
+            if ((first & 0xe0) == 0x20)
+            {
+                // Dynamic table size update, only before the first field.
+                size_t size;
+                if (
+                    (m_fields.empty() != true)
+                    or (decode_integer(in, end, 5, size) != true)
+                    or (size > m_max_table_size)
+                )
+                {
+                    return false;
+                }
+                m_table.set_max_size(size);
+                continue;
+            }
+            bool indexed = ((first & 0x80) != 0);
+            bool incremental = ((first & 0xc0) == 0x40);
+            int prefix = (indexed == true) ? 7
+                : ((incremental == true) ? 6 : 4);
+            if (decode_integer(in, end, prefix, index) != true) return false;
+            if (index > 0)
+            {
+                // The name, and the value if indexed, come from a table.
+                http_header entry;
+                if (index <= hpack_static_count)
+                {
+                    entry = static_table[index - 1];
+                    decoded.name = { entry.name.data(), 0,
+                        entry.name.size() };
+                    decoded.value = { entry.value.data(), 0,
+                        entry.value.size() };
+                }
+                else
+                {
+                    if (
+                        m_table.get(index - hpack_static_count - 1, entry)
+                        != true
+                    )
+                    {
+                        return false;
+                    }
+                    // The entry can be evicted before the block ends.
+                    decoded.name = { nullptr, storage.size(),
+                        entry.name.size() };
+                    storage.append(entry.name.data(), entry.name.size());
+                    decoded.value = { nullptr, storage.size(),
+                        entry.value.size() };
+                    storage.append(entry.value.data(), entry.value.size());
+                }
+            }
+            else if (indexed == true) return false;
+            else if (m_string(in, end, storage, decoded.name) != true)
+            {
+                return false;
+            }
+            if (
+                (indexed != true)
+                and (m_string(in, end, storage, decoded.value) != true)
+            )
+            {
+                return false;
+            }
+            list_size += decoded.name.length + decoded.value.length + 32;
+            if ((m_max_list_size > 0) and (list_size > m_max_list_size))
+            {
+                return false;
+            }
+            m_fields.push_back(decoded);
+            if (incremental == true)
+            {
+                const char* base = storage.data();
+                const location& name = decoded.name;
+                const location& value = decoded.value;
+                m_table.add(
+                    std::string_view((name.data != nullptr)
+                        ? name.data : base + name.offset, name.length),
+                    std::string_view((value.data != nullptr)
+                        ? value.data : base + value.offset, value.length));
+            }
+        }
+        // Storage doesn't move anymore, resolve the offsets.
+        const char* base = storage.data();
+        for (const field& decoded : m_fields)
+        {
+            const location& name = decoded.name;
+            const location& value = decoded.value;
+            headers.push_back(http_header{
+                std::string_view((name.data != nullptr)
+                    ? name.data : base + name.offset, name.length),
+                std::string_view((value.data != nullptr)
+                    ? value.data : base + value.offset, value.length)
+            });
+        }
+        return true;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Decodes a string literal.
+    bool hpack_decoder::m_string(const uint8_t*& in, const uint8_t* end,
+        std::string& storage, location& out)
+    {
+        if (in == end) return false;
+        bool huffman = ((*in & 0x80) != 0);
+        size_t length;
+        if (
+            (decode_integer(in, end, 7, length) != true)
+            or (length > size_t(end - in))
+        )
+        {
+            return false;
+        }
+        const char* data = reinterpret_cast<const char*>(in);
+        in += length;
+        if (huffman != true)
+        {
+            out = { data, 0, length };
+            return true;
+        }
+        out.data = nullptr;
+        out.offset = storage.size();
+        if (hpack_huffman_decode(storage, data, length) != true)
+        {
+            return false;
+        }
+        out.length = storage.size() - out.offset;
+        return true;
+    }
+
+    /***** hpack_encoder *****/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    hpack_encoder::hpack_encoder(size_t max_size) :
+        m_table(max_size),
+        m_capacity(max_size),
+        m_smallest_update(SIZE_MAX),
+        m_size_changed(false)
+    {
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Starts a header block.
+    void hpack_encoder::begin(std::string& out)
+    {
+        if (m_size_changed != true) return;
+        // The decoder has to see the smallest size to evict the same way.
+        if (m_smallest_update < m_table.get_max_size())
+        {
+            encode_integer(out, 0x20, 5, m_smallest_update);
+        }
+        encode_integer(out, 0x20, 5, m_table.get_max_size());
+        m_smallest_update = SIZE_MAX;
+        m_size_changed = false;
+    }
+
+    // Encodes a field.
+    void hpack_encoder::encode(std::string& out, std::string_view name,
+        std::string_view value, bool index)
+    {
+        bool exact;
+        size_t found = find_static(name, value, exact);
+        if (exact == true)
+        {
+            encode_integer(out, 0x80, 7, found);
+            return;
+        }
+        bool dynamic_exact;
+        size_t dynamic = m_table.find(name, value, dynamic_exact);
+        if (dynamic_exact == true)
+        {
+            encode_integer(out, 0x80, 7, hpack_static_count + dynamic);
+            return;
+        }
+        if ((found == 0) and (dynamic > 0))
+        {
+            found = hpack_static_count + dynamic;
+        }
+        if (index == true)
+        {
+            encode_integer(out, 0x40, 6, found);
+            m_table.add(name, value);
+        }
+        else encode_integer(out, 0, 4, found);
+        if (found == 0) encode_string(out, name);
+        encode_string(out, value);
+    }
+
+    // Applies the decoder's SETTINGS_HEADER_TABLE_SIZE.
+    void hpack_encoder::set_limit(size_t limit)
+    {
+        size_t size = (limit < m_capacity) ? limit : m_capacity;
+        if (size == m_table.get_max_size()) return;
+        m_table.set_max_size(size);
+        if (size < m_smallest_update) m_smallest_update = size;
+        m_size_changed = true;
+    }
+
+    /***** Functions *****/
+
+    // Gets an entry of the static table.
+    const http_header& hpack_static_entry(size_t index)
+    {
+        return static_table[index - 1];
+    }
+
+    // Decodes a Huffman-coded string.
+    bool hpack_huffman_decode(std::string& out, const char* data,
+        size_t length)
+    {
+        const huffman_machine& machine = get_huffman_machine();
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+        uint8_t state = 0;
+        bool accept = true;
+        for (size_t n = 0; n < length; ++n)
+        {
+            const huffman_step* step = &machine.steps[state][in[n] >> 4];
+            for (int half = 0; half < 2; ++half)
+            {
+                if ((step->flags & HUFFMAN_FAIL) != 0) return false;
+                if ((step->flags & HUFFMAN_EMIT) != 0)
+                {
+                    out.push_back(char(step->symbol));
+                }
+                state = step->next;
+                accept = ((step->flags & HUFFMAN_ACCEPT) != 0);
+                step = &machine.steps[state][in[n] & 15];
+            }
+        }
+        return accept;
+    }
+
+    // Huffman-codes a string.
+    void hpack_huffman_encode(std::string& out, std::string_view data)
+    {
+        uint64_t bits = 0;
+        int count = 0;
+        for (unsigned char c : data)
+        {
+            bits = (bits << huffman_lengths[c]) | huffman_codes[c];
+            count += huffman_lengths[c];
+            while (count >= 8)
+            {
+                count -= 8;
+                out.push_back(char(bits >> count));
+            }
+        }
+        // Pad with the start of EOS, all ones.
+        if (count > 0)
+        {
+            out.push_back(char((bits << (8 - count)) | (0xff >> count)));
+        }
+    }
+
+    // Gets the length of a string once Huffman-coded.
+    size_t hpack_huffman_length(std::string_view data)
+    {
+        size_t bits = 0;
+        for (unsigned char c : data) bits += huffman_lengths[c];
+        return (bits + 7) / 8;
+    }
+
+}
@@ -0,0 +1,601 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "tuxnet/http.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// Most header fields accepted in a request.
+        const size_t max_fields = 100;
+
+        /// Longest chunk size line accepted, extensions included.
+        const size_t max_chunk_line = 1024;
+
+        // Finds the first line feed or forbidden control character.
+        const char* scan_line(const char* pos, const char* end)
+        {
+#if defined(__SSE2__)
+            const __m128i control = _mm_set1_epi8(0x1f);
+            const __m128i tab = _mm_set1_epi8('\t');
+            const __m128i cr = _mm_set1_epi8('\r');
+            const __m128i del = _mm_set1_epi8(0x7f);
+            while (end - pos >= 16)
+            {
+                __m128i chunk = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(pos));
+                // Bytes up to 0x1f, the line feed among them.
+                __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(chunk, control),
+                    chunk);
+                __m128i allowed = _mm_or_si128(_mm_cmpeq_epi8(chunk, tab),
+                    _mm_cmpeq_epi8(chunk, cr));
+                __m128i hits = _mm_or_si128(_mm_andnot_si128(allowed, low),
+                    _mm_cmpeq_epi8(chunk, del));
+                int mask = _mm_movemask_epi8(hits);
+                if (mask != 0) return pos + __builtin_ctz(mask);
+                pos += 16;
+            }
+#endif
+            for (; pos < end; ++pos)
+            {
+                unsigned char c = static_cast<unsigned char>(*pos);
+                if (
+                    ((c < 0x20) and (c != '\t') and (c != '\r'))
+                    or (c == 0x7f)
+                )
+                {
+                    return pos;
+                }
+            }
+            return end;
+        }
+
+        // Compares two strings, ignoring ASCII case.
+        bool iequals(std::string_view a, std::string_view b)
+        {
+            if (a.size() != b.size()) return false;
+            for (size_t n = 0; n < a.size(); ++n)
+            {
+                char x = a[n];
+                char y = b[n];
+                if ((x >= 'A') and (x <= 'Z')) x += 'a' - 'A';
+                if ((y >= 'A') and (y <= 'Z')) y += 'a' - 'A';
+                if (x != y) return false;
+            }
+            return true;
+        }
+
+        // Strips spaces and tabs from both ends.
+        std::string_view trim(std::string_view text)
+        {
+            while (
+                (text.empty() != true)
+                and ((text.front() == ' ') or (text.front() == '\t'))
+            )
+            {
+                text.remove_prefix(1);
+            }
+            while (
+                (text.empty() != true)
+                and ((text.back() == ' ') or (text.back() == '\t'))
+            )
+            {
+                text.remove_suffix(1);
+            }
+            return text;
+        }
+
+        // Checks a comma separated list for a token.
+        bool has_token(std::string_view list, std::string_view token)
+        {
+            while (list.empty() != true)
+            {
+                size_t comma = list.find(',');
+                if (iequals(trim(list.substr(0, comma)), token) == true)
+                {
+                    return true;
+                }
+                if (comma == std::string_view::npos) break;
+                list.remove_prefix(comma + 1);
+            }
+            return false;
+        }
+
+        // Parses a decimal number, digits only.
+        bool parse_decimal(std::string_view text, uint64_t& value)
+        {
+            if ((text.empty() == true) or (text.size() > 18)) return false;
+            value = 0;
+            for (char c : text)
+            {
+                if ((c < '0') or (c > '9')) return false;
+                value = value * 10 + (c - '0');
+            }
+            return true;
+        }
+
+    }
+
+    /***** http_request *****/
+
+    // Gets a header field.
+    std::string_view http_request::header(std::string_view name) const
+    {
+        for (auto it = headers.begin(); it != headers.end(); ++it)
+        {
+            if (iequals(it->name, name) == true) return it->value;
+        }
+        return std::string_view();
+    }
+
+    /***** http_parser *****/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    http_parser::http_parser(size_t max_head, size_t max_body) :
+        m_max_head(max_head),
+        m_max_body(max_body)
+    {
+        m_fields.reserve(32);
+        reset();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Parses the request at the start of the input.
+    int http_parser::parse(char* data, size_t length, http_request& request)
+    {
+        if (m_error != 0) return -1;
+        while (true)
+        {
+            switch (m_state)
+            {
+                case PARSE_HEAD:
+                case PARSE_TRAILER:
+                {
+                    const char* found = scan_line(data + m_offset,
+                        data + length);
+                    if (found == data + length)
+                    {
+                        m_offset = length;
+                        if (length - m_line > m_max_head) return m_fail(431);
+                        return 0;
+                    }
+                    if (*found != '\n') return m_fail(400);
+                    size_t end = found - data;
+                    m_offset = end + 1;
+                    if ((end > m_line) and (data[end - 1] == '\r')) end--;
+                    // A carriage return is only allowed at the line end.
+                    if (memchr(data + m_line, '\r', end - m_line) != nullptr)
+                    {
+                        return m_fail(400);
+                    }
+                    size_t start = m_line;
+                    m_line = m_offset;
+                    if (m_state == PARSE_TRAILER)
+                    {
+                        // Trailer fields aren't kept.
+                        if (end == start) return m_finish(data, request);
+                        if (m_offset - m_remaining > m_max_head)
+                        {
+                            return m_fail(431);
+                        }
+                        continue;
+                    }
+                    if (m_offset > m_max_head) return m_fail(431);
+                    if (m_version_minor == -1)
+                    {
+                        // Empty lines before a request are ignored.
+                        if (end == start) continue;
+                        int status = m_parse_request_line(data, start, end);
+                        if (status != 0) return m_fail(status);
+                        continue;
+                    }
+                    if (end != start)
+                    {
+                        if (m_fields.size() >= max_fields) return m_fail(431);
+                        if (m_parse_header(data, start, end) != true)
+                        {
+                            return m_fail(400);
+                        }
+                        continue;
+                    }
+                    m_head_length = m_offset;
+                    m_body_end = m_offset;
+                    int status = m_framing(data);
+                    if (status != 0) return m_fail(status);
+                    continue;
+                }
+                case PARSE_BODY:
+                {
+                    if (length - m_head_length < m_remaining) return 0;
+                    m_offset = m_head_length + m_remaining;
+                    m_body_end = m_offset;
+                    return m_finish(data, request);
+                }
+                case PARSE_CHUNK_SIZE:
+                {
+                    const char* found = scan_line(data + m_offset,
+                        data + length);
+                    if (found == data + length)
+                    {
+                        m_offset = length;
+                        if (length - m_line > max_chunk_line)
+                        {
+                            return m_fail(400);
+                        }
+                        return 0;
+                    }
+                    if (*found != '\n') return m_fail(400);
+                    const char* pos = data + m_line;
+                    uint64_t size = 0;
+                    int digits = 0;
+                    for (; pos < found; ++pos, ++digits)
+                    {
+                        char c = *pos;
+                        int value = -1;
+                        if ((c >= '0') and (c <= '9')) value = c - '0';
+                        else if ((c >= 'a') and (c <= 'f'))
+                        {
+                            value = c - 'a' + 10;
+                        }
+                        else if ((c >= 'A') and (c <= 'F'))
+                        {
+                            value = c - 'A' + 10;
+                        }
+                        if (value == -1) break;
+                        if (digits == 15) return m_fail(413);
+                        size = size * 16 + value;
+                    }
+                    // Chunk extensions are ignored.
+                    if (
+                        (digits == 0)
+                        or ((pos < found) and (*pos != ';') and (*pos != '\r')
+                            and (*pos != ' ') and (*pos != '\t'))
+                    )
+                    {
+                        return m_fail(400);
+                    }
+                    m_offset = found - data + 1;
+                    m_line = m_offset;
+                    if (size == 0)
+                    {
+                        // Remember where the trailers start.
+                        m_remaining = m_offset;
+                        m_state = PARSE_TRAILER;
+                        continue;
+                    }
+                    if (m_body_end - m_head_length + size > m_max_body)
+                    {
+                        return m_fail(413);
+                    }
+                    m_remaining = size;
+                    m_state = PARSE_CHUNK_DATA;
+                    continue;
+                }
+                case PARSE_CHUNK_DATA:
+                {
+                    size_t available = length - m_offset;
+                    if (available > m_remaining) available = m_remaining;
+                    if (available == 0) return 0;
+                    // Decode in place, right behind the previous chunk.
+                    if (m_body_end != m_offset)
+                    {
+                        memmove(data + m_body_end, data + m_offset,
+                            available);
+                    }
+                    m_body_end += available;
+                    m_offset += available;
+                    m_remaining -= available;
+                    if (m_remaining > 0) return 0;
+                    m_state = PARSE_CHUNK_END;
+                    continue;
+                }
+                case PARSE_CHUNK_END:
+                {
+                    if (length - m_offset < 1) return 0;
+                    if (data[m_offset] == '\r')
+                    {
+                        if (length - m_offset < 2) return 0;
+                        if (data[m_offset + 1] != '\n') return m_fail(400);
+                        m_offset += 2;
+                    }
+                    else if (data[m_offset] == '\n') m_offset++;
+                    else return m_fail(400);
+                    m_line = m_offset;
+                    m_state = PARSE_CHUNK_SIZE;
+                    continue;
+                }
+            }
+        }
+    }
+
+    // Forgets the request being parsed.
+    void http_parser::reset()
+    {
+        m_state = PARSE_HEAD;
+        m_offset = 0;
+        m_line = 0;
+        m_head_length = 0;
+        m_body_end = 0;
+        m_remaining = 0;
+        m_fields.clear();
+        m_request_line = field();
+        m_version_minor = -1;
+        m_chunked = false;
+        m_expect_continue = false;
+        m_error = 0;
+    }
+
+    // Checks whether the client waits for 100 Continue.
+    bool http_parser::expects_continue() const
+    {
+        return m_expect_continue;
+    }
+
+    // Gets why the last request was rejected.
+    int http_parser::get_error() const
+    {
+        return m_error;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Fails the current request.
+    int http_parser::m_fail(int status)
+    {
+        m_error = status;
+        return -1;
+    }
+
+    // Fills in a request once it's complete, and starts the next one.
+    int http_parser::m_finish(const char* data, http_request& request)
+    {
+        request.method = std::string_view(data + m_request_line.name,
+            m_request_line.name_length);
+        request.target = std::string_view(data + m_request_line.value,
+            m_request_line.value_length);
+        request.version_major = 1;
+        request.version_minor = m_version_minor;
+        request.headers.clear();
+        for (auto it = m_fields.begin(); it != m_fields.end(); ++it)
+        {
+            http_header header = {
+                std::string_view(data + it->name, it->name_length),
+                std::string_view(data + it->value, it->value_length)
+            };
+            request.headers.push_back(header);
+        }
+        request.body = std::string_view(data + m_head_length,
+            m_body_end - m_head_length);
+        request.chunked = m_chunked;
+        std::string_view connection = request.header("Connection");
+        if (m_version_minor == 0)
+        {
+            request.keep_alive = has_token(connection, "keep-alive");
+        }
+        else request.keep_alive = (has_token(connection, "close") != true);
+        request.length = m_offset;
+        reset();
+        return 1;
+    }
+
+    // Works out how the body is delimited.
+    int http_parser::m_framing(const char* data)
+    {
+        bool has_length = false;
+        uint64_t length = 0;
+        bool has_encoding = false;
+        int codings = 0;
+        std::string_view last_coding;
+        int hosts = 0;
+        bool expect_continue = false;
+        for (auto it = m_fields.begin(); it != m_fields.end(); ++it)
+        {
+            std::string_view name(data + it->name, it->name_length);
+            std::string_view value(data + it->value, it->value_length);
+            if (iequals(name, "Content-Length") == true)
+            {
+                uint64_t parsed = 0;
+                if (parse_decimal(value, parsed) != true) return 400;
+                if ((has_length == true) and (parsed != length)) return 400;
+                has_length = true;
+                length = parsed;
+            }
+            else if (iequals(name, "Transfer-Encoding") == true)
+            {
+                // Repeated fields make up a single list.
+                has_encoding = true;
+                while (value.empty() != true)
+                {
+                    size_t comma = value.find(',');
+                    std::string_view coding = trim(value.substr(0, comma));
+                    if (coding.empty() != true)
+                    {
+                        codings++;
+                        last_coding = coding;
+                    }
+                    if (comma == std::string_view::npos) break;
+                    value.remove_prefix(comma + 1);
+                }
+            }
+            else if (iequals(name, "Host") == true) hosts++;
+            else if (iequals(name, "Expect") == true)
+            {
+                expect_continue = iequals(value, "100-continue");
+            }
+        }
+        // HTTP/1.1 requests name a single host, HTTP/1.0 ones at most one.
+        if ((hosts > 1) or ((hosts == 0) and (m_version_minor == 1)))
+        {
+            return 400;
+        }
+        if (has_encoding == true)
+        {
+            // Either could be what a proxy in front went by.
+            if (has_length == true) return 400;
+            // Without chunked last, the body has no length.
+            if (iequals(last_coding, "chunked") != true) return 400;
+            // The only coding decoded.
+            if (codings != 1) return 501;
+            m_chunked = true;
+            m_expect_continue = (expect_continue == true)
+                and (m_version_minor == 1);
+            m_state = PARSE_CHUNK_SIZE;
+            return 0;
+        }
+        if (length > m_max_body) return 413;
+        m_expect_continue = (expect_continue == true)
+            and (m_version_minor == 1) and (length > 0);
+        m_remaining = length;
+        m_state = PARSE_BODY;
+        return 0;
+    }
+
+    // Parses a header line.
+    bool http_parser::m_parse_header(const char* data, size_t start,
+        size_t end)
+    {
+        const char* line = data + start;
+        // Obsolete line folding.
+        if ((line[0] == ' ') or (line[0] == '\t')) return false;
+        const char* colon = static_cast<const char*>(memchr(line, ':',
+            end - start));
+        if ((colon == nullptr) or (colon == line)) return false;
+        if ((colon[-1] == ' ') or (colon[-1] == '\t')) return false;
+        std::string_view value = trim(std::string_view(colon + 1,
+            data + end - colon - 1));
+        field found = {
+            uint32_t(start),
+            uint32_t(colon - line),
+            uint32_t(value.data() - data),
+            uint32_t(value.size())
+        };
+        m_fields.push_back(found);
+        return true;
+    }
+
+    // Parses the request line.
+    int http_parser::m_parse_request_line(const char* data, size_t start,
+        size_t end)
+    {
+        const char* line = data + start;
+        const char* line_end = data + end;
+        const char* space = static_cast<const char*>(memchr(line, ' ',
+            end - start));
+        if ((space == nullptr) or (space == line)) return 400;
+        const char* target = space + 1;
+        const char* target_end = static_cast<const char*>(memchr(target, ' ',
+            line_end - target));
+        if ((target_end == nullptr) or (target_end == target)) return 400;
+        std::string_view version(target_end + 1, line_end - target_end - 1);
+        if (
+            (version.size() != 8)
+            or (version.substr(0, 5) != "HTTP/")
+            or (version[6] != '.')
+            or (version[5] < '0') or (version[5] > '9')
+            or (version[7] < '0') or (version[7] > '9')
+        )
+        {
+            return 400;
+        }
+        if (version[5] != '1') return 505;
+        // Later 1.x versions are answered as 1.1.
+        m_version_minor = (version[7] == '0') ? 0 : 1;
+        m_request_line.name = start;
+        m_request_line.name_length = space - line;
+        m_request_line.value = target - data;
+        m_request_line.value_length = target_end - target;
+        return 0;
+    }
+
+    /***** Dates *****/
+
+    // Gets the current time as an HTTP date.
+    const char* http_date()
+    {
+        static const char days[7][4] = {
+            "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+        };
+        static const char months[12][4] = {
+            "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+        };
+        thread_local char t_date[http_date_length + 1] = "";
+        thread_local time_t t_second = -1;
+        timespec now = {};
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        if (now.tv_sec == t_second) return t_date;
+        t_second = now.tv_sec;
+        tm fields = {};
+        gmtime_r(&t_second, &fields);
+        // Formatted by hand, every field has a fixed width.
+        auto two_digits = [](char* out, int value){
+            out[0] = char('0' + value / 10 % 10);
+            out[1] = char('0' + value % 10);
+        };
+        int year = fields.tm_year + 1900;
+        memcpy(t_date, "Sun, 00 Jan 0000 00:00:00 GMT", http_date_length);
+        memcpy(t_date, days[fields.tm_wday], 3);
+        two_digits(t_date + 5, fields.tm_mday);
+        memcpy(t_date + 8, months[fields.tm_mon], 3);
+        two_digits(t_date + 12, year / 100);
+        two_digits(t_date + 14, year % 100);
+        two_digits(t_date + 17, fields.tm_hour);
+        two_digits(t_date + 20, fields.tm_min);
+        two_digits(t_date + 23, fields.tm_sec);
+        t_date[http_date_length] = '\0';
+        return t_date;
+    }
+
+    /***** Status codes *****/
+
+    // Gets the reason phrase of a status code.
+    const char* http_status_text(int status)
+    {
+        switch (status)
+        {
+            case 100: return "Continue";
+            case 101: return "Switching Protocols";
+            case 200: return "OK";
+            case 201: return "Created";
+            case 202: return "Accepted";
+            case 204: return "No Content";
+            case 206: return "Partial Content";
+            case 301: return "Moved Permanently";
+            case 302: return "Found";
+            case 303: return "See Other";
+            case 304: return "Not Modified";
+            case 307: return "Temporary Redirect";
+            case 308: return "Permanent Redirect";
+            case 400: return "Bad Request";
+            case 401: return "Unauthorized";
+            case 403: return "Forbidden";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 408: return "Request Timeout";
+            case 411: return "Length Required";
+            case 413: return "Content Too Large";
+            case 414: return "URI Too Long";
+            case 415: return "Unsupported Media Type";
+            case 426: return "Upgrade Required";
+            case 429: return "Too Many Requests";
+            case 431: return "Request Header Fields Too Large";
+            case 500: return "Internal Server Error";
+            case 501: return "Not Implemented";
+            case 502: return "Bad Gateway";
+            case 503: return "Service Unavailable";
+            case 504: return "Gateway Timeout";
+            case 505: return "HTTP Version Not Supported";
+        }
+        return "Unknown";
+    }
+
+}
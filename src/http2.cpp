@@ -0,0 +1,999 @@
+#include <charconv>
+#include <string.h>
+#include "tuxnet/http2.h"
+
+namespace tuxnet
+{
+
+    /// State of a stream.
+    struct http2_session::stream
+    {
+        /// Stream identifier.
+        uint32_t id;
+        /// What the client lets us send.
+        int64_t send_window;
+        /// What we let the client send.
+        int64_t receive_window;
+        /// Whether the client ended its side.
+        bool remote_closed;
+        /// Whether response headers were sent.
+        bool headers_sent;
+        /// Whether the response is complete, its END_STREAM maybe pending.
+        bool local_closed;
+        /// Whether END_STREAM was sent.
+        bool end_sent;
+        /// Request header fields, kept while the body comes in.
+        std::vector<http_header> fields;
+        /// Strings the fields point to.
+        std::string storage;
+        /// Request body gathered so far.
+        std::string body;
+        /// Response data waiting for flow control.
+        std::string pending;
+        /// Bytes of pending already sent.
+        size_t pending_sent;
+    };
+
+    namespace
+    {
+
+        /// Largest flow control window.
+        const int64_t max_window = 0x7fffffff;
+
+        /// Flow control window of a connection, to start with.
+        const int64_t default_window = 65535;
+
+        /// Room a stream's buffers may keep once it's closed.
+        const size_t kept_capacity = 65536;
+
+        // Reads a 32 bit big endian number.
+        uint32_t read_u32(const char* data)
+        {
+            const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+            return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16)
+                | (uint32_t(in[2]) << 8) | uint32_t(in[3]);
+        }
+
+        // Appends a 32 bit big endian number.
+        void write_u32(std::string& out, uint32_t value)
+        {
+            char bytes[4] = {
+                char(value >> 24), char(value >> 16), char(value >> 8),
+                char(value)
+            };
+            out.append(bytes, 4);
+        }
+
+        // Appends a setting.
+        void write_setting(std::string& out, uint16_t id, uint32_t value)
+        {
+            out.push_back(char(id >> 8));
+            out.push_back(char(id));
+            write_u32(out, value);
+        }
+
+        // Removes the padding of a DATA or HEADERS frame.
+        bool strip_padding(uint8_t flags, char*& payload, size_t& length)
+        {
+            if ((flags & HTTP2_FLAG_PADDED) == 0) return true;
+            if (length < 1) return false;
+            size_t padding = uint8_t(payload[0]);
+            payload++;
+            length--;
+            if (padding > length) return false;
+            length -= padding;
+            return true;
+        }
+
+        // Decodes base64url, as used by HTTP2-Settings.
+        bool base64url_decode(std::string_view in, std::string& out)
+        {
+            uint32_t bits = 0;
+            int count = 0;
+            for (char c : in)
+            {
+                int value;
+                if ((c >= 'A') and (c <= 'Z')) value = c - 'A';
+                else if ((c >= 'a') and (c <= 'z')) value = c - 'a' + 26;
+                else if ((c >= '0') and (c <= '9')) value = c - '0' + 52;
+                else if (c == '-') value = 62;
+                else if (c == '_') value = 63;
+                else if (c == '=') break;
+                else return false;
+                bits = (bits << 6) | value;
+                count += 6;
+                if (count >= 8)
+                {
+                    count -= 8;
+                    out.push_back(char(bits >> count));
+                }
+            }
+            return true;
+        }
+
+        // Whether a field is specific to an HTTP/1.1 connection.
+        bool is_connection_field(std::string_view name)
+        {
+            return (name == "connection") or (name == "keep-alive")
+                or (name == "proxy-connection")
+                or (name == "transfer-encoding") or (name == "upgrade");
+        }
+
+    }
+
+    /***** Functions *****/
+
+    // Decodes a frame header.
+    void http2_read_frame_header(const char* data,
+        http2_frame_header& header)
+    {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+        header.length = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8)
+            | uint32_t(in[2]);
+        header.type = in[3];
+        header.flags = in[4];
+        header.stream = read_u32(data + 5) & 0x7fffffff;
+    }
+
+    // Appends a frame header.
+    void http2_write_frame_header(std::string& out, uint32_t length,
+        uint8_t type, uint8_t flags, uint32_t stream)
+    {
+        char bytes[http2_frame_header_length] = {
+            char(length >> 16), char(length >> 8), char(length),
+            char(type), char(flags),
+            char(stream >> 24), char(stream >> 16), char(stream >> 8),
+            char(stream)
+        };
+        out.append(bytes, http2_frame_header_length);
+    }
+
+    /***** http2_session *****/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    http2_session::http2_session(const http2_settings& settings,
+        size_t max_body) :
+        m_local(settings),
+        m_remote(),
+        m_max_body(max_body),
+        // Until it sees our SETTINGS, the client assumes the defaults.
+        m_window((settings.initial_window_size > default_window)
+            ? settings.initial_window_size : default_window),
+        m_decoder((settings.header_table_size > 4096)
+            ? settings.header_table_size : 4096,
+            settings.max_header_list_size),
+        m_encoder(),
+        m_streams(),
+        m_free(),
+        m_last_stream(0),
+        m_send_window(default_window),
+        m_receive_window(m_window),
+        m_continued(0),
+        m_continued_flags(0),
+        m_header_block(),
+        m_fields(),
+        m_storage(),
+        m_request(),
+        m_block(),
+        m_name(),
+        m_output(),
+        m_preface(false),
+        m_closing(false)
+    {
+        m_streams.reserve(settings.max_concurrent_streams);
+        m_fields.reserve(64);
+        m_request.headers.reserve(64);
+        // Our SETTINGS, then the connection's share of a bigger window.
+        std::string payload;
+        write_setting(payload, HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS,
+            settings.max_concurrent_streams);
+        write_setting(payload, HTTP2_SETTINGS_INITIAL_WINDOW_SIZE,
+            settings.initial_window_size);
+        write_setting(payload, HTTP2_SETTINGS_MAX_FRAME_SIZE,
+            settings.max_frame_size);
+        if (settings.header_table_size != 4096)
+        {
+            write_setting(payload, HTTP2_SETTINGS_HEADER_TABLE_SIZE,
+                settings.header_table_size);
+        }
+        if (settings.max_header_list_size > 0)
+        {
+            write_setting(payload, HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE,
+                settings.max_header_list_size);
+        }
+        http2_write_frame_header(m_output, payload.size(), HTTP2_SETTINGS, 0,
+            0);
+        m_output += payload;
+        if (m_window > default_window)
+        {
+            http2_write_frame_header(m_output, 4, HTTP2_WINDOW_UPDATE, 0, 0);
+            write_u32(m_output, m_window - default_window);
+        }
+    }
+
+    // Destructor.
+    http2_session::~http2_session()
+    {
+        for (stream* s : m_streams) delete s;
+        for (stream* s : m_free) delete s;
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Gets the frames waiting to be sent.
+    std::string& http2_session::get_output()
+    {
+        return m_output;
+    }
+
+    // Gets the number of open streams.
+    size_t http2_session::get_stream_count() const
+    {
+        return m_streams.size();
+    }
+
+    // Whether the connection is going away.
+    bool http2_session::is_closing() const
+    {
+        return m_closing;
+    }
+
+    // Parses received frames.
+    int http2_session::receive(char* data, size_t length)
+    {
+        size_t offset = 0;
+        if (m_preface != true)
+        {
+            size_t check = (length < http2_preface.size())
+                ? length : http2_preface.size();
+            if (memcmp(data, http2_preface.data(), check) != 0)
+            {
+                return m_fail(HTTP2_PROTOCOL_ERROR);
+            }
+            if (length < http2_preface.size()) return 0;
+            offset = http2_preface.size();
+            m_preface = true;
+        }
+        while (length - offset >= http2_frame_header_length)
+        {
+            http2_frame_header header;
+            http2_read_frame_header(data + offset, header);
+            if (header.length > m_local.max_frame_size)
+            {
+                return m_fail(HTTP2_FRAME_SIZE_ERROR);
+            }
+            size_t size = http2_frame_header_length + header.length;
+            if (length - offset < size) break;
+            int error = m_frame(header,
+                data + offset + http2_frame_header_length);
+            if (error != HTTP2_NO_ERROR) return m_fail(error);
+            offset += size;
+            // The client sent GOAWAY.
+            if (m_closing == true) return -1;
+        }
+        return offset;
+    }
+
+    // Resets a stream.
+    void http2_session::reset(uint32_t id, uint32_t error)
+    {
+        http2_write_frame_header(m_output, 4, HTTP2_RST_STREAM, 0, id);
+        write_u32(m_output, error);
+        stream* s = m_find(id);
+        if (s != nullptr) m_close(s);
+    }
+
+    // Sends DATA on a stream.
+    bool http2_session::send_data(uint32_t id, std::string_view data,
+        bool end)
+    {
+        stream* s = m_find(id);
+        if (
+            (s == nullptr) or (s->headers_sent != true)
+            or (s->local_closed == true)
+        )
+        {
+            return false;
+        }
+        if (end == true) s->local_closed = true;
+        size_t sent = 0;
+        if (s->pending.size() == s->pending_sent)
+        {
+            sent = m_write_data(s, data.data(), data.size(), end);
+        }
+        // Whatever the windows didn't allow goes out with WINDOW_UPDATE.
+        s->pending.append(data.data() + sent, data.size() - sent);
+        if ((s->end_sent == true) and (s->remote_closed == true))
+        {
+            m_close(s);
+        }
+        return true;
+    }
+
+    // Sends response headers on a stream.
+    bool http2_session::send_headers(uint32_t id, int status,
+        std::string_view content_type, long content_length,
+        std::string_view headers, bool end)
+    {
+        stream* s = m_find(id);
+        if ((s == nullptr) or (s->headers_sent == true)) return false;
+        char digits[24];
+        std::to_chars_result result;
+        m_block.clear();
+        m_encoder.begin(m_block);
+        result = std::to_chars(digits, digits + sizeof(digits), status);
+        m_encoder.encode(m_block, ":status",
+            std::string_view(digits, result.ptr - digits));
+        m_encoder.encode(m_block, "date",
+            std::string_view(http_date(), http_date_length));
+        if (content_type.empty() != true)
+        {
+            m_encoder.encode(m_block, "content-type", content_type);
+        }
+        if (content_length >= 0)
+        {
+            result = std::to_chars(digits, digits + sizeof(digits),
+                content_length);
+            // Lengths vary too much to be worth a table entry.
+            m_encoder.encode(m_block, "content-length",
+                std::string_view(digits, result.ptr - digits), false);
+        }
+        size_t pos = 0;
+        while (pos < headers.size())
+        {
+            size_t line_end = headers.find("\r\n", pos);
+            if (line_end == std::string_view::npos) line_end = headers.size();
+            std::string_view line = headers.substr(pos, line_end - pos);
+            pos = line_end + 2;
+            size_t colon = line.find(':');
+            if ((colon == std::string_view::npos) or (colon == 0)) continue;
+            m_name.assign(line.data(), colon);
+            for (char& c : m_name)
+            {
+                if ((c >= 'A') and (c <= 'Z')) c += 'a' - 'A';
+            }
+            if ((m_name == "date") or (is_connection_field(m_name) == true))
+            {
+                continue;
+            }
+            std::string_view value = line.substr(colon + 1);
+            while (
+                (value.empty() != true)
+                and ((value.front() == ' ') or (value.front() == '\t'))
+            )
+            {
+                value.remove_prefix(1);
+            }
+            while (
+                (value.empty() != true)
+                and ((value.back() == ' ') or (value.back() == '\t'))
+            )
+            {
+                value.remove_suffix(1);
+            }
+            m_encoder.encode(m_block, m_name, value);
+        }
+        // HEADERS, then CONTINUATION for blocks larger than a frame.
+        size_t offset = 0;
+        do
+        {
+            size_t length = m_block.size() - offset;
+            if (length > m_remote.max_frame_size)
+            {
+                length = m_remote.max_frame_size;
+            }
+            uint8_t flags = 0;
+            if (offset + length == m_block.size())
+            {
+                flags |= HTTP2_FLAG_END_HEADERS;
+            }
+            if ((offset == 0) and (end == true))
+            {
+                flags |= HTTP2_FLAG_END_STREAM;
+            }
+            http2_write_frame_header(m_output, length,
+                (offset == 0) ? HTTP2_HEADERS : HTTP2_CONTINUATION, flags,
+                id);
+            m_output.append(m_block, offset, length);
+            offset += length;
+        } while (offset < m_block.size());
+        s->headers_sent = true;
+        if (end == true)
+        {
+            s->local_closed = true;
+            s->end_sent = true;
+            if (s->remote_closed == true) m_close(s);
+        }
+        return true;
+    }
+
+    // Takes over an HTTP/1.1 connection upgraded to h2c.
+    bool http2_session::upgrade(std::string_view settings,
+        http_request& request)
+    {
+        std::string payload;
+        if (
+            (base64url_decode(settings, payload) != true)
+            or (payload.size() % 6 != 0)
+            or (m_apply_settings(payload.data(), payload.size())
+                != HTTP2_NO_ERROR)
+        )
+        {
+            return false;
+        }
+        // The request is stream 1, which the client has already ended.
+        stream* s = m_open(1);
+        s->remote_closed = true;
+        m_last_stream = 1;
+        request.version_major = 2;
+        request.version_minor = 0;
+        on_request(1, request);
+        s = m_find(1);
+        if ((s != nullptr) and (s->end_sent == true)) m_close(s);
+        return true;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Applies the payload of a SETTINGS frame.
+    int http2_session::m_apply_settings(const char* data, size_t length)
+    {
+        int64_t window_delta = 0;
+        for (size_t offset = 0; offset + 6 <= length; offset += 6)
+        {
+            uint16_t id = (uint16_t(uint8_t(data[offset])) << 8)
+                | uint8_t(data[offset + 1]);
+            uint32_t value = read_u32(data + offset + 2);
+            switch (id)
+            {
+                case HTTP2_SETTINGS_HEADER_TABLE_SIZE:
+                    m_remote.header_table_size = value;
+                    m_encoder.set_limit(value);
+                    break;
+                case HTTP2_SETTINGS_ENABLE_PUSH:
+                    if (value > 1) return HTTP2_PROTOCOL_ERROR;
+                    m_remote.enable_push = value;
+                    break;
+                case HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS:
+                    m_remote.max_concurrent_streams = value;
+                    break;
+                case HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+                    if (value > max_window) return HTTP2_FLOW_CONTROL_ERROR;
+                    // Applies to open streams too.
+                    window_delta += int64_t(value)
+                        - m_remote.initial_window_size;
+                    for (stream* s : m_streams)
+                    {
+                        s->send_window += int64_t(value)
+                            - m_remote.initial_window_size;
+                        if (s->send_window > max_window)
+                        {
+                            return HTTP2_FLOW_CONTROL_ERROR;
+                        }
+                    }
+                    m_remote.initial_window_size = value;
+                    break;
+                case HTTP2_SETTINGS_MAX_FRAME_SIZE:
+                    if ((value < 16384) or (value > 16777215))
+                    {
+                        return HTTP2_PROTOCOL_ERROR;
+                    }
+                    m_remote.max_frame_size = value;
+                    break;
+                case HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE:
+                    m_remote.max_header_list_size = value;
+                    break;
+                default:
+                    // Unknown settings are ignored.
+                    break;
+            }
+        }
+        if (window_delta > 0) m_flush_all();
+        return HTTP2_NO_ERROR;
+    }
+
+    // Builds the request out of a header block's fields.
+    bool http2_session::m_build_request(
+        const std::vector<http_header>& fields)
+    {
+        http_request& request = m_request;
+        request.method = std::string_view();
+        request.target = std::string_view();
+        request.headers.clear();
+        std::string_view scheme;
+        std::string_view authority;
+        bool regular = false;
+        bool host = false;
+        for (const http_header& field : fields)
+        {
+            if (field.name.empty() == true) return false;
+            if (field.name[0] == ':')
+            {
+                // Pseudo-headers come first, once each.
+                std::string_view* slot = nullptr;
+                if (regular == true) return false;
+                if (field.name == ":method") slot = &request.method;
+                else if (field.name == ":path") slot = &request.target;
+                else if (field.name == ":scheme") slot = &scheme;
+                else if (field.name == ":authority") slot = &authority;
+                else return false;
+                if (slot->empty() != true) return false;
+                *slot = field.value;
+                continue;
+            }
+            regular = true;
+            for (char c : field.name)
+            {
+                if ((c >= 'A') and (c <= 'Z')) return false;
+            }
+            if (is_connection_field(field.name) == true) return false;
+            if ((field.name == "te") and (field.value != "trailers"))
+            {
+                return false;
+            }
+            if (field.name == "host") host = true;
+            request.headers.push_back(field);
+        }
+        if (
+            (request.method.empty() == true)
+            or (request.target.empty() == true)
+            or (scheme.empty() == true)
+        )
+        {
+            return false;
+        }
+        // Handlers look for Host, whatever the protocol.
+        if ((host != true) and (authority.empty() != true))
+        {
+            request.headers.push_back(http_header{ "host", authority });
+        }
+        request.version_major = 2;
+        request.version_minor = 0;
+        request.body = std::string_view();
+        request.chunked = false;
+        request.keep_alive = true;
+        request.length = 0;
+        return true;
+    }
+
+    // Closes a stream and keeps it for reuse.
+    void http2_session::m_close(stream* s)
+    {
+        for (size_t n = 0; n < m_streams.size(); ++n)
+        {
+            if (m_streams[n] != s) continue;
+            m_streams[n] = m_streams.back();
+            m_streams.pop_back();
+            break;
+        }
+        s->id = 0;
+        s->fields.clear();
+        s->storage.clear();
+        s->body.clear();
+        s->pending.clear();
+        if (s->body.capacity() > kept_capacity) std::string().swap(s->body);
+        if (s->pending.capacity() > kept_capacity)
+        {
+            std::string().swap(s->pending);
+        }
+        m_free.push_back(s);
+    }
+
+    // Handles a DATA frame.
+    int http2_session::m_data(const http2_frame_header& header,
+        char* payload)
+    {
+        if (header.stream == 0) return HTTP2_PROTOCOL_ERROR;
+        // Flow control counts padding too.
+        if (header.length > m_receive_window)
+        {
+            return HTTP2_FLOW_CONTROL_ERROR;
+        }
+        m_receive_window -= header.length;
+        if (m_receive_window < m_window / 2)
+        {
+            http2_write_frame_header(m_output, 4, HTTP2_WINDOW_UPDATE, 0, 0);
+            write_u32(m_output, m_window - m_receive_window);
+            m_receive_window = m_window;
+        }
+        size_t length = header.length;
+        if (strip_padding(header.flags, payload, length) != true)
+        {
+            return HTTP2_PROTOCOL_ERROR;
+        }
+        stream* s = m_find(header.stream);
+        if (s == nullptr)
+        {
+            if (header.stream > m_last_stream) return HTTP2_PROTOCOL_ERROR;
+            // Frames still in flight when the stream closed are dropped.
+            return HTTP2_NO_ERROR;
+        }
+        if (s->remote_closed == true)
+        {
+            reset(header.stream, HTTP2_STREAM_CLOSED);
+            return HTTP2_NO_ERROR;
+        }
+        if (header.length > s->receive_window)
+        {
+            reset(header.stream, HTTP2_FLOW_CONTROL_ERROR);
+            return HTTP2_NO_ERROR;
+        }
+        s->receive_window -= header.length;
+        if (s->body.size() + length > m_max_body)
+        {
+            // Answer before the request is complete, then stop it.
+            const char* text = http_status_text(413);
+            send_headers(s->id, 413, "text/plain", strlen(text),
+                std::string_view(), false);
+            send_data(s->id, text, true);
+            reset(header.stream, HTTP2_NO_ERROR);
+            return HTTP2_NO_ERROR;
+        }
+        if ((header.flags & HTTP2_FLAG_END_STREAM) != 0)
+        {
+            s->remote_closed = true;
+            // A body in a single frame is used where it is.
+            if (s->body.empty() == true)
+            {
+                m_dispatch(s, std::string_view(payload, length));
+                return HTTP2_NO_ERROR;
+            }
+            s->body.append(payload, length);
+            m_dispatch(s, s->body);
+            return HTTP2_NO_ERROR;
+        }
+        s->body.append(payload, length);
+        if (s->receive_window < m_window / 2)
+        {
+            http2_write_frame_header(m_output, 4, HTTP2_WINDOW_UPDATE, 0,
+                s->id);
+            write_u32(m_output, m_window - s->receive_window);
+            s->receive_window = m_window;
+        }
+        return HTTP2_NO_ERROR;
+    }
+
+    // Fires on_request() for a stream the client has ended.
+    void http2_session::m_dispatch(stream* s, std::string_view body)
+    {
+        // Requests with a body had their head put aside.
+        if (s->fields.empty() != true) m_build_request(s->fields);
+        m_request.body = body;
+        uint32_t id = s->id;
+        on_request(id, m_request);
+        s = m_find(id);
+        if ((s != nullptr) and (s->end_sent == true)) m_close(s);
+    }
+
+    // Fails the connection with GOAWAY.
+    int http2_session::m_fail(int error)
+    {
+        if (m_closing != true)
+        {
+            http2_write_frame_header(m_output, 8, HTTP2_GOAWAY, 0, 0);
+            write_u32(m_output, m_last_stream);
+            write_u32(m_output, error);
+            m_closing = true;
+        }
+        return -1;
+    }
+
+    // Finds an open stream.
+    http2_session::stream* http2_session::m_find(uint32_t id) const
+    {
+        for (stream* s : m_streams)
+        {
+            if (s->id == id) return s;
+        }
+        return nullptr;
+    }
+
+    // Sends what flow control now allows of a stream's pending data.
+    void http2_session::m_flush(stream* s)
+    {
+        size_t left = s->pending.size() - s->pending_sent;
+        if (
+            (left == 0)
+            and ((s->local_closed != true) or (s->end_sent == true))
+        )
+        {
+            return;
+        }
+        s->pending_sent += m_write_data(s, s->pending.data() + s->pending_sent,
+            left, s->local_closed);
+        if (s->pending_sent == s->pending.size())
+        {
+            s->pending.clear();
+            s->pending_sent = 0;
+        }
+        if ((s->end_sent == true) and (s->remote_closed == true))
+        {
+            m_close(s);
+        }
+    }
+
+    // Flushes every stream.
+    void http2_session::m_flush_all()
+    {
+        size_t n = 0;
+        while ((n < m_streams.size()) and (m_send_window > 0))
+        {
+            stream* s = m_streams[n];
+            m_flush(s);
+            // Closing a stream moves the last one in its place.
+            if ((n < m_streams.size()) and (m_streams[n] == s)) n++;
+        }
+    }
+
+    // Handles a frame.
+    int http2_session::m_frame(const http2_frame_header& header,
+        char* payload)
+    {
+        if (
+            (m_continued != 0)
+            and (
+                (header.type != HTTP2_CONTINUATION)
+                or (header.stream != m_continued)
+            )
+        )
+        {
+            return HTTP2_PROTOCOL_ERROR;
+        }
+        size_t length = header.length;
+        switch (header.type)
+        {
+            case HTTP2_DATA:
+                return m_data(header, payload);
+            case HTTP2_HEADERS:
+                if ((header.stream == 0) or (header.stream % 2 == 0))
+                {
+                    return HTTP2_PROTOCOL_ERROR;
+                }
+                if (strip_padding(header.flags, payload, length) != true)
+                {
+                    return HTTP2_PROTOCOL_ERROR;
+                }
+                if ((header.flags & HTTP2_FLAG_PRIORITY) != 0)
+                {
+                    if (length < 5) return HTTP2_FRAME_SIZE_ERROR;
+                    payload += 5;
+                    length -= 5;
+                }
+                if ((header.flags & HTTP2_FLAG_END_HEADERS) == 0)
+                {
+                    m_continued = header.stream;
+                    m_continued_flags = header.flags;
+                    m_header_block.assign(payload, length);
+                    return HTTP2_NO_ERROR;
+                }
+                return m_headers(header.stream, header.flags, payload,
+                    length);
+            case HTTP2_CONTINUATION:
+                if (m_continued == 0) return HTTP2_PROTOCOL_ERROR;
+                m_header_block.append(payload, length);
+                if (
+                    m_header_block.size() > m_local.max_header_list_size
+                        + m_local.max_frame_size
+                )
+                {
+                    return HTTP2_ENHANCE_YOUR_CALM;
+                }
+                if ((header.flags & HTTP2_FLAG_END_HEADERS) == 0)
+                {
+                    return HTTP2_NO_ERROR;
+                }
+                m_continued = 0;
+                return m_headers(header.stream, m_continued_flags,
+                    m_header_block.data(), m_header_block.size());
+            case HTTP2_PRIORITY:
+                if (header.stream == 0) return HTTP2_PROTOCOL_ERROR;
+                if (length != 5) reset(header.stream, HTTP2_FRAME_SIZE_ERROR);
+                return HTTP2_NO_ERROR;
+            case HTTP2_RST_STREAM:
+            {
+                if (header.stream == 0) return HTTP2_PROTOCOL_ERROR;
+                if (length != 4) return HTTP2_FRAME_SIZE_ERROR;
+                if (header.stream > m_last_stream)
+                {
+                    return HTTP2_PROTOCOL_ERROR;
+                }
+                stream* s = m_find(header.stream);
+                if (s != nullptr) m_close(s);
+                return HTTP2_NO_ERROR;
+            }
+            case HTTP2_SETTINGS:
+            {
+                if (header.stream != 0) return HTTP2_PROTOCOL_ERROR;
+                if ((header.flags & HTTP2_FLAG_ACK) != 0)
+                {
+                    return (length == 0)
+                        ? HTTP2_NO_ERROR : HTTP2_FRAME_SIZE_ERROR;
+                }
+                if (length % 6 != 0) return HTTP2_FRAME_SIZE_ERROR;
+                // Acknowledged before the data the settings let through.
+                http2_write_frame_header(m_output, 0, HTTP2_SETTINGS,
+                    HTTP2_FLAG_ACK, 0);
+                return m_apply_settings(payload, length);
+            }
+            case HTTP2_PING:
+                if (header.stream != 0) return HTTP2_PROTOCOL_ERROR;
+                if (length != 8) return HTTP2_FRAME_SIZE_ERROR;
+                if ((header.flags & HTTP2_FLAG_ACK) == 0)
+                {
+                    http2_write_frame_header(m_output, 8, HTTP2_PING,
+                        HTTP2_FLAG_ACK, 0);
+                    m_output.append(payload, 8);
+                }
+                return HTTP2_NO_ERROR;
+            case HTTP2_GOAWAY:
+                if (header.stream != 0) return HTTP2_PROTOCOL_ERROR;
+                m_closing = true;
+                return HTTP2_NO_ERROR;
+            case HTTP2_WINDOW_UPDATE:
+            {
+                if (length != 4) return HTTP2_FRAME_SIZE_ERROR;
+                int64_t increment = read_u32(payload) & 0x7fffffff;
+                if (header.stream == 0)
+                {
+                    if (increment == 0) return HTTP2_PROTOCOL_ERROR;
+                    m_send_window += increment;
+                    if (m_send_window > max_window)
+                    {
+                        return HTTP2_FLOW_CONTROL_ERROR;
+                    }
+                    m_flush_all();
+                    return HTTP2_NO_ERROR;
+                }
+                stream* s = m_find(header.stream);
+                if (s == nullptr)
+                {
+                    return (header.stream > m_last_stream)
+                        ? HTTP2_PROTOCOL_ERROR : HTTP2_NO_ERROR;
+                }
+                s->send_window += increment;
+                if ((increment == 0) or (s->send_window > max_window))
+                {
+                    reset(header.stream, (increment == 0)
+                        ? HTTP2_PROTOCOL_ERROR : HTTP2_FLOW_CONTROL_ERROR);
+                    return HTTP2_NO_ERROR;
+                }
+                m_flush(s);
+                return HTTP2_NO_ERROR;
+            }
+            case HTTP2_PUSH_PROMISE:
+                // Clients can't push.
+                return HTTP2_PROTOCOL_ERROR;
+            default:
+                // Unknown frame types are ignored.
+                return HTTP2_NO_ERROR;
+        }
+    }
+
+    // Handles a complete header block.
+    int http2_session::m_headers(uint32_t id, uint8_t flags,
+        const char* block, size_t length)
+    {
+        if (m_decoder.decode(block, length, m_fields, m_storage) != true)
+        {
+            return HTTP2_COMPRESSION_ERROR;
+        }
+        bool end = ((flags & HTTP2_FLAG_END_STREAM) != 0);
+        stream* s = m_find(id);
+        if (id <= m_last_stream)
+        {
+            // Trailers, which have to end the stream.
+            if ((s == nullptr) or (s->remote_closed == true))
+            {
+                return HTTP2_STREAM_CLOSED;
+            }
+            if (end != true)
+            {
+                reset(id, HTTP2_PROTOCOL_ERROR);
+                return HTTP2_NO_ERROR;
+            }
+            s->remote_closed = true;
+            m_dispatch(s, s->body);
+            return HTTP2_NO_ERROR;
+        }
+        m_last_stream = id;
+        if (m_streams.size() >= m_local.max_concurrent_streams)
+        {
+            reset(id, HTTP2_REFUSED_STREAM);
+            return HTTP2_NO_ERROR;
+        }
+        if (m_build_request(m_fields) != true)
+        {
+            reset(id, HTTP2_PROTOCOL_ERROR);
+            return HTTP2_NO_ERROR;
+        }
+        s = m_open(id);
+        if (end == true)
+        {
+            s->remote_closed = true;
+            m_dispatch(s, std::string_view());
+            return HTTP2_NO_ERROR;
+        }
+        // The body comes later, keep the head until then.
+        size_t size = 0;
+        for (const http_header& field : m_fields)
+        {
+            size += field.name.size() + field.value.size();
+        }
+        s->storage.reserve(size);
+        for (const http_header& field : m_fields)
+        {
+            size_t name = s->storage.size();
+            s->storage.append(field.name.data(), field.name.size());
+            size_t value = s->storage.size();
+            s->storage.append(field.value.data(), field.value.size());
+            s->fields.push_back(http_header{
+                std::string_view(s->storage.data() + name,
+                    field.name.size()),
+                std::string_view(s->storage.data() + value,
+                    field.value.size())
+            });
+        }
+        return HTTP2_NO_ERROR;
+    }
+
+    // Opens a stream.
+    http2_session::stream* http2_session::m_open(uint32_t id)
+    {
+        stream* s;
+        if (m_free.empty() == true) s = new stream();
+        else
+        {
+            s = m_free.back();
+            m_free.pop_back();
+        }
+        s->id = id;
+        s->send_window = m_remote.initial_window_size;
+        s->receive_window = m_window;
+        s->remote_closed = false;
+        s->headers_sent = false;
+        s->local_closed = false;
+        s->end_sent = false;
+        s->pending_sent = 0;
+        m_streams.push_back(s);
+        return s;
+    }
+
+    // Writes DATA frames as far as the flow control windows allow.
+    size_t http2_session::m_write_data(stream* s, const char* data,
+        size_t length, bool end)
+    {
+        size_t sent = 0;
+        while (true)
+        {
+            int64_t room = (m_send_window < s->send_window)
+                ? m_send_window : s->send_window;
+            size_t count = length - sent;
+            if (room <= 0) count = 0;
+            else if (count > size_t(room)) count = room;
+            if (count > m_remote.max_frame_size)
+            {
+                count = m_remote.max_frame_size;
+            }
+            bool last = (sent + count == length);
+            // An empty frame can end a stream, whatever the windows.
+            if ((count == 0) and ((last != true) or (end != true))) break;
+            http2_write_frame_header(m_output, count, HTTP2_DATA,
+                ((last == true) and (end == true))
+                    ? HTTP2_FLAG_END_STREAM : 0,
+                s->id);
+            m_output.append(data + sent, count);
+            m_send_window -= count;
+            s->send_window -= count;
+            sent += count;
+            if (last == true)
+            {
+                if (end == true) s->end_sent = true;
+                break;
+            }
+        }
+        return sent;
+    }
+
+}
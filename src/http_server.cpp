@@ -0,0 +1,1029 @@
+#include <atomic>
+#include <charconv>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <strings.h>
+#include "tuxnet/http_server.h"
+
+namespace tuxnet
+{
+
+    /// Response progress of the request being answered.
+    enum http_response_state
+    {
+        HTTP_RESPONSE_NONE = 0,
+        HTTP_RESPONSE_CHUNKED,
+        HTTP_RESPONSE_DONE
+    };
+
+    /// Input and request state of a connection.
+    struct http_server::connection
+    {
+        /// Parser of the request at the start of input.
+        http_parser parser;
+        /// Last request parsed, reused.
+        http_request request;
+        /// Received data, sized to its capacity.
+        std::vector<char> input;
+        /// Bytes of input in use.
+        size_t used;
+        /// Requests answered so far.
+        int served;
+        /// Minor HTTP version of the request being answered.
+        int version_minor;
+        /// Whether the connection stays open after the response.
+        bool keep_alive;
+        /// Whether the response goes without a body (HEAD).
+        bool head_only;
+        /// Response progress.
+        http_response_state response;
+        /// Set while on_request() runs.
+        bool dispatching;
+        /// Set if the peer disconnected while on_request() ran.
+        bool closed;
+        /// Whether the request being received was sent 100 Continue.
+        bool continued;
+        /// HTTP/2 state, once the connection switched to it.
+        http2_connection* h2;
+        /// HTTP/2 stream of the request being answered.
+        uint32_t stream;
+        /// WebSocket state, once the connection switched to it.
+        websocket_ref ws;
+
+        /**
+         * Constructor.
+         * @param options : Limits of the server.
+         */
+        connection(const http_options& options) :
+            parser(options.max_head, options.max_body),
+            request(),
+            input(initial_input),
+            used(0),
+            served(0),
+            version_minor(1),
+            keep_alive(true),
+            head_only(false),
+            response(HTTP_RESPONSE_NONE),
+            dispatching(false),
+            closed(false),
+            continued(false),
+            h2(nullptr),
+            stream(0),
+            ws()
+        {
+            request.headers.reserve(32);
+        }
+
+        /// Destructor.
+        ~connection();
+
+        /// Initial size of the input buffer.
+        static const size_t initial_input = 16384;
+    };
+
+    /// HTTP/2 state of a connection, answering through the server.
+    class http_server::http2_connection : public http2_session
+    {
+
+        // Private member variables. ------------------------------------------
+
+        /// Server answering the requests.
+        http_server* m_server;
+        /// Connection.
+        peer* m_peer;
+        /// State of the connection.
+        connection* m_conn;
+
+        public:
+
+            // Ctor(s) / dtor. ------------------------------------------------
+
+            /**
+             * Constructor.
+             * @param owner : Server answering the requests.
+             * @param remote_peer : Connection.
+             * @param conn : State of the connection.
+             */
+            http2_connection(http_server* owner, peer* remote_peer,
+                connection* conn) :
+                http2_session(owner->m_options.http2,
+                    owner->m_options.max_body),
+                m_server(owner),
+                m_peer(remote_peer),
+                m_conn(conn)
+            {
+            }
+
+        protected:
+
+            // Events. --------------------------------------------------------
+
+            // Hands a stream's request to the server.
+            void on_request(uint32_t id, const http_request& request)
+                override
+            {
+                // The handler hung up on an earlier stream.
+                if (m_conn->closed == true) return;
+                m_conn->stream = id;
+                m_conn->served++;
+                m_conn->version_minor = 1;
+                m_conn->keep_alive = true;
+                m_conn->head_only = (request.method == "HEAD");
+                m_conn->response = HTTP_RESPONSE_NONE;
+                m_server->on_request(m_peer, request);
+                if (m_conn->closed == true) return;
+                // Only the stream goes, not the connection.
+                if (m_conn->response != HTTP_RESPONSE_DONE)
+                {
+                    reset(id, HTTP2_INTERNAL_ERROR);
+                }
+            }
+
+    };
+
+    /// WebSocket state of a connection, shared with threads sending frames.
+    struct http_server::websocket_connection
+    {
+        /// Serializes frames, so concurrent senders don't interleave them.
+        std::mutex write_lock;
+        /// The connection, guarded by write_lock and valid until closed.
+        peer* remote = nullptr;
+        /// Set once the connection closed, guarded by write_lock.
+        bool closed = false;
+        /// Set once a close frame was sent, nothing may follow it.
+        std::atomic<bool> close_sent{false};
+        /// Opcode of the fragmented message coming in, 0 if none.
+        uint8_t opcode = 0;
+        /// Fragments of that message so far.
+        std::string message;
+    };
+
+    // Destructor.
+    http_server::connection::~connection()
+    {
+        delete h2;
+    }
+
+    namespace
+    {
+
+        /// Largest body copied next to its head, larger ones are gathered.
+        const size_t max_copied_body = 65536;
+
+        /// Room for chunk headers in the input, on top of the limits.
+        const size_t chunk_slack = 65536;
+
+        /// Output an HTTP/2 connection keeps between writes.
+        const size_t max_kept_output = 1048576;
+
+        /// Response buffer of the calling thread.
+        thread_local std::string t_response;
+
+        /// WebSocket the calling thread writes a frame to.
+        thread_local const void* t_writing = nullptr;
+
+        // Appends a number in a given base.
+        void append_number(std::string& out, unsigned long value, int base)
+        {
+            char digits[24];
+            std::to_chars_result result = std::to_chars(digits,
+                digits + sizeof(digits), value, base);
+            out.append(digits, result.ptr - digits);
+        }
+
+        // Whether a close frame's status code may be sent by a client.
+        bool valid_close_status(int status)
+        {
+            return ((status >= 1000) and (status <= 1003))
+                or ((status >= 1007) and (status <= 1011))
+                or ((status >= 3000) and (status <= 4999));
+        }
+
+        // Whether a request asks to switch to h2c.
+        bool wants_h2c(const http_request& request)
+        {
+            if (
+                (request.version_minor != 1)
+                or (request.body.empty() != true)
+            )
+            {
+                return false;
+            }
+            bool upgrade = false;
+            bool settings = false;
+            for (const http_header& header : request.headers)
+            {
+                if (
+                    (header.name.size() == 7)
+                    and (strncasecmp(header.name.data(), "upgrade", 7) == 0)
+                )
+                {
+                    // A list of protocols, h2c among them.
+                    for (size_t pos = 0; pos + 3 <= header.value.size();
+                        ++pos)
+                    {
+                        if (
+                            (strncasecmp(header.value.data() + pos, "h2c", 3)
+                                == 0)
+                            and (
+                                (pos + 3 == header.value.size())
+                                or (header.value[pos + 3] == ',')
+                                or (header.value[pos + 3] == ' ')
+                            )
+                        )
+                        {
+                            upgrade = true;
+                        }
+                    }
+                }
+                else if (
+                    (header.name.size() == 14)
+                    and (strncasecmp(header.name.data(), "http2-settings", 14)
+                        == 0)
+                )
+                {
+                    settings = true;
+                }
+            }
+            return (upgrade == true) and (settings == true);
+        }
+
+    }
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    http_server::http_server(const http_options& options) :
+        server(),
+        m_options(options)
+    {
+    }
+
+    // Destructor.
+    http_server::~http_server()
+    {
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Sends a complete response.
+    bool http_server::respond(peer* remote_peer, int status,
+        std::string_view body, std::string_view content_type,
+        std::string_view headers)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if ((conn == nullptr) or (conn->response != HTTP_RESPONSE_NONE))
+        {
+            return false;
+        }
+        conn->response = HTTP_RESPONSE_DONE;
+        if (conn->h2 != nullptr)
+        {
+            bool end = (conn->head_only == true) or (body.empty() == true);
+            if (
+                conn->h2->send_headers(conn->stream, status, content_type,
+                    body.size(), headers, end) != true
+            )
+            {
+                return false;
+            }
+            return (end == true)
+                or (conn->h2->send_data(conn->stream, body, true) == true);
+        }
+        return m_write_head(remote_peer, conn, status, content_type,
+            body.size(), headers, body);
+    }
+
+    // Sends a response serialized ahead of time.
+    bool http_server::respond_cached(peer* remote_peer,
+        const cached_response& response)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if ((conn == nullptr) or (conn->response != HTTP_RESPONSE_NONE))
+        {
+            return false;
+        }
+        conn->response = HTTP_RESPONSE_DONE;
+        if (conn->h2 != nullptr)
+        {
+            // Re-encoded with HPACK : status, then the header lines.
+            std::string_view data = response.data;
+            size_t lines = response.status_length;
+            std::string_view head = data.substr(lines,
+                response.head_length - 2 - lines);
+            std::string_view body = data.substr(response.head_length);
+            bool end = (conn->head_only == true) or (body.empty() == true);
+            if (
+                conn->h2->send_headers(conn->stream, response.status,
+                    std::string_view(), -1, head, end) != true
+            )
+            {
+                return false;
+            }
+            return (end == true)
+                or (conn->h2->send_data(conn->stream, body, true) == true);
+        }
+        char* data = const_cast<char*>(response.data.data());
+        size_t end = (conn->head_only == true)
+            ? response.head_length : response.data.size();
+        iovec vec[5];
+        int count = 0;
+        size_t offset = 0;
+        if (response.date_offset != std::string::npos)
+        {
+            vec[count++] = { data, response.date_offset };
+            vec[count++] = {
+                const_cast<char*>(http_date()), http_date_length
+            };
+            offset = response.date_offset + http_date_length;
+        }
+        const char* connection_header = nullptr;
+        if (conn->keep_alive != true)
+        {
+            connection_header = "Connection: close\r\n";
+        }
+        else if (conn->version_minor == 0)
+        {
+            connection_header = "Connection: keep-alive\r\n";
+        }
+        if (connection_header != nullptr)
+        {
+            // Goes before the blank line ending the head.
+            size_t blank = response.head_length - 2;
+            vec[count++] = { data + offset, blank - offset };
+            vec[count++] = {
+                const_cast<char*>(connection_header),
+                strlen(connection_header)
+            };
+            offset = blank;
+        }
+        vec[count++] = { data + offset, end - offset };
+        return remote_peer->write_iovec(vec, count);
+    }
+
+    // Starts a response with a chunked body.
+    bool http_server::begin_chunked(peer* remote_peer, int status,
+        std::string_view content_type, std::string_view headers)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if ((conn == nullptr) or (conn->response != HTTP_RESPONSE_NONE))
+        {
+            return false;
+        }
+        conn->response = HTTP_RESPONSE_CHUNKED;
+        if (conn->h2 != nullptr)
+        {
+            return conn->h2->send_headers(conn->stream, status, content_type,
+                -1, headers, conn->head_only);
+        }
+        // The end of an HTTP/1.0 body is the end of the connection.
+        if (conn->version_minor == 0) conn->keep_alive = false;
+        return m_write_head(remote_peer, conn, status, content_type, -1,
+            headers, std::string_view());
+    }
+
+    // Sends a chunk of a response started by begin_chunked().
+    bool http_server::send_chunk(peer* remote_peer, std::string_view data)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if ((conn == nullptr) or (conn->response != HTTP_RESPONSE_CHUNKED))
+        {
+            return false;
+        }
+        if ((data.empty() == true) or (conn->head_only == true)) return true;
+        if (conn->h2 != nullptr)
+        {
+            return conn->h2->send_data(conn->stream, data, false);
+        }
+        if (conn->version_minor == 0)
+        {
+            return remote_peer->write_bytes(data.data(), data.size());
+        }
+        std::string& out = t_response;
+        out.clear();
+        append_number(out, data.size(), 16);
+        out.append("\r\n", 2);
+        if (data.size() > max_copied_body)
+        {
+            iovec vec[3] = {
+                { &out[0], out.size() },
+                { const_cast<char*>(data.data()), data.size() },
+                { const_cast<char*>("\r\n"), 2 }
+            };
+            return remote_peer->write_iovec(vec, 3);
+        }
+        out.append(data.data(), data.size());
+        out.append("\r\n", 2);
+        return remote_peer->write_bytes(out.data(), out.size());
+    }
+
+    // Ends a response started by begin_chunked().
+    bool http_server::end_chunked(peer* remote_peer)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if ((conn == nullptr) or (conn->response != HTTP_RESPONSE_CHUNKED))
+        {
+            return false;
+        }
+        conn->response = HTTP_RESPONSE_DONE;
+        if ((conn->head_only == true) or (conn->version_minor == 0))
+        {
+            return true;
+        }
+        if (conn->h2 != nullptr)
+        {
+            return conn->h2->send_data(conn->stream, std::string_view(),
+                true);
+        }
+        return remote_peer->write_bytes("0\r\n\r\n", 5);
+    }
+
+    // Takes a connection over for WebSocket.
+    bool http_server::accept_websocket(peer* remote_peer,
+        const http_request& request, std::string_view headers)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if ((conn == nullptr) or (conn->response != HTTP_RESPONSE_NONE))
+        {
+            return false;
+        }
+        if ((conn->h2 != nullptr) or (websocket_is_upgrade(request) != true))
+        {
+            // Tells clients of other versions which one is spoken.
+            respond(remote_peer, 400, http_status_text(400), "text/plain",
+                "Sec-WebSocket-Version: 13\r\n");
+            return false;
+        }
+        conn->response = HTTP_RESPONSE_DONE;
+        conn->keep_alive = true;
+        std::string& out = t_response;
+        out.clear();
+        out.append("HTTP/1.1 101 Switching Protocols\r\n"
+            "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: ");
+        out.append(websocket_accept_key(request.header("sec-websocket-key")));
+        out.append("\r\n", 2);
+        out.append(headers.data(), headers.size());
+        out.append("\r\n", 2);
+        if (remote_peer->write_bytes(out.data(), out.size()) != true)
+        {
+            return false;
+        }
+        conn->ws = std::make_shared<websocket_connection>();
+        conn->ws->remote = remote_peer;
+        return true;
+    }
+
+    // Gets a handle to send frames from any thread.
+    http_server::websocket_ref http_server::get_websocket(peer* remote_peer)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if (conn == nullptr) return websocket_ref();
+        return conn->ws;
+    }
+
+    // Sends a WebSocket frame.
+    bool http_server::send_frame(peer* remote_peer, websocket_opcode opcode,
+        std::string_view payload, bool fin)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if (conn == nullptr) return false;
+        // Keeps the state around should the write close the connection.
+        websocket_ref ws = conn->ws;
+        return send_frame(ws, opcode, payload, fin);
+    }
+
+    // Sends a WebSocket frame, from any thread.
+    bool http_server::send_frame(const websocket_ref& ws,
+        websocket_opcode opcode, std::string_view payload, bool fin)
+    {
+        if (ws == nullptr) return false;
+        return m_send_frame(ws.get(), opcode, payload, fin);
+    }
+
+    // Starts closing a WebSocket connection.
+    bool http_server::close_websocket(peer* remote_peer, int status,
+        std::string_view reason)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if (conn == nullptr) return false;
+        websocket_ref ws = conn->ws;
+        return close_websocket(ws, status, reason);
+    }
+
+    // Starts closing a WebSocket connection, from any thread.
+    bool http_server::close_websocket(const websocket_ref& ws, int status,
+        std::string_view reason)
+    {
+        char payload[125] = { char(status >> 8), char(status) };
+        size_t length = (reason.size() < 123) ? reason.size() : 123;
+        if (length > 0) memcpy(payload + 2, reason.data(), length);
+        return send_frame(ws, WEBSOCKET_CLOSE,
+            std::string_view(payload, length + 2));
+    }
+
+    // Gets the limits of the server.
+    const http_options& http_server::get_options() const
+    {
+        return m_options;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Writes out the frames an HTTP/2 connection queued.
+    bool http_server::m_flush_http2(peer* remote_peer, connection* conn)
+    {
+        std::string& out = conn->h2->get_output();
+        if (out.empty() == true) return true;
+        if (remote_peer->write_bytes(out.data(), out.size()) != true)
+        {
+            return false;
+        }
+        out.clear();
+        // Don't hold on to what a large response needed.
+        if (out.capacity() > max_kept_output) std::string().swap(out);
+        return true;
+    }
+
+    // Handles the frames received on a WebSocket connection.
+    int http_server::m_receive_websocket(peer* remote_peer,
+        connection* conn, char* data, size_t length)
+    {
+        websocket_connection* ws = conn->ws.get();
+        size_t offset = 0;
+        while (offset < length)
+        {
+            websocket_frame_header header;
+            int found = websocket_read_frame_header(data + offset,
+                length - offset, header);
+            if (found == 0) break;
+            // Clients mask every frame.
+            if ((found < 0) or (header.masked != true))
+            {
+                close_websocket(remote_peer, WEBSOCKET_PROTOCOL_ERROR);
+                return -1;
+            }
+            if (header.length > m_options.max_message)
+            {
+                close_websocket(remote_peer, WEBSOCKET_MESSAGE_TOO_BIG);
+                return -1;
+            }
+            if (length - offset - found < header.length) break;
+            char* payload = data + offset + found;
+            size_t size = header.length;
+            websocket_unmask(payload, size, header.mask);
+            offset += found + size;
+            if (header.opcode == WEBSOCKET_PING)
+            {
+                m_send_frame(ws, WEBSOCKET_PONG,
+                    std::string_view(payload, size), true);
+                if (conn->closed == true) return -1;
+                continue;
+            }
+            if (header.opcode == WEBSOCKET_PONG) continue;
+            if (header.opcode == WEBSOCKET_CLOSE)
+            {
+                // This answers our own close frame.
+                if (ws->close_sent == true) return -1;
+                int status = WEBSOCKET_NO_STATUS;
+                std::string_view reason;
+                if (size >= 2)
+                {
+                    status = (uint8_t(payload[0]) << 8) | uint8_t(payload[1]);
+                    reason = std::string_view(payload + 2, size - 2);
+                }
+                if (
+                    (size == 1)
+                    or ((size >= 2) and (valid_close_status(status) != true))
+                )
+                {
+                    status = WEBSOCKET_PROTOCOL_ERROR;
+                }
+                else if (
+                    websocket_valid_utf8(reason.data(), reason.size()) != true
+                )
+                {
+                    status = WEBSOCKET_INVALID_DATA;
+                }
+                // Echoes the client's status, then closes.
+                if (status != WEBSOCKET_NO_STATUS)
+                {
+                    close_websocket(remote_peer, status);
+                }
+                else send_frame(remote_peer, WEBSOCKET_CLOSE, reason);
+                return -1;
+            }
+            std::string_view message(payload, size);
+            if (header.opcode == WEBSOCKET_CONTINUATION)
+            {
+                if (ws->opcode == 0)
+                {
+                    close_websocket(remote_peer, WEBSOCKET_PROTOCOL_ERROR);
+                    return -1;
+                }
+                if (ws->message.size() + size > m_options.max_message)
+                {
+                    close_websocket(remote_peer, WEBSOCKET_MESSAGE_TOO_BIG);
+                    return -1;
+                }
+                ws->message.append(payload, size);
+                if (header.fin != true) continue;
+                message = ws->message;
+            }
+            else
+            {
+                if (ws->opcode != 0)
+                {
+                    close_websocket(remote_peer, WEBSOCKET_PROTOCOL_ERROR);
+                    return -1;
+                }
+                if (header.fin != true)
+                {
+                    ws->opcode = header.opcode;
+                    ws->message.assign(payload, size);
+                    continue;
+                }
+                // A message in a single frame is used where it is.
+                ws->opcode = header.opcode;
+            }
+            websocket_opcode opcode = websocket_opcode(ws->opcode);
+            ws->opcode = 0;
+            // Messages still coming in after our close frame are dropped.
+            if (ws->close_sent != true)
+            {
+                if (
+                    (opcode == WEBSOCKET_TEXT)
+                    and (websocket_valid_utf8(message.data(), message.size())
+                        != true)
+                )
+                {
+                    close_websocket(remote_peer, WEBSOCKET_INVALID_DATA);
+                    return -1;
+                }
+                on_message(remote_peer, opcode, message);
+                if (conn->closed == true) return -1;
+            }
+            ws->message.clear();
+            if (ws->message.capacity() > max_kept_output)
+            {
+                std::string().swap(ws->message);
+            }
+        }
+        return int(offset);
+    }
+
+    // Answers a malformed request and closes the connection.
+    void http_server::m_reject(peer* remote_peer, connection* conn,
+        int status)
+    {
+        conn->version_minor = 1;
+        conn->keep_alive = false;
+        conn->head_only = false;
+        conn->response = HTTP_RESPONSE_DONE;
+        const char* text = http_status_text(status);
+        if (m_write_head(remote_peer, conn, status, "text/plain",
+            strlen(text), std::string_view(), text) != true)
+        {
+            // Already disconnected.
+            return;
+        }
+        remote_peer->disconnect();
+    }
+
+    // Sends a WebSocket frame, header and payload in a single writev.
+    bool http_server::m_send_frame(websocket_connection* ws, uint8_t opcode,
+        std::string_view payload, bool fin)
+    {
+        char head[websocket_max_header_length];
+        size_t head_length = websocket_write_frame_header(head, opcode,
+            payload.size(), fin);
+        iovec vec[2] = {
+            { head, head_length },
+            { const_cast<char*>(payload.data()), payload.size() }
+        };
+        std::lock_guard<std::mutex> lock(ws->write_lock);
+        if ((ws->closed == true) or (ws->close_sent == true)) return false;
+        if (opcode == WEBSOCKET_CLOSE) ws->close_sent = true;
+        // A failure on the connection's thread disconnects it right away.
+        t_writing = ws;
+        bool sent = ws->remote->write_iovec(vec, 2);
+        t_writing = nullptr;
+        return sent;
+    }
+
+    // Switches a connection to HTTP/2, as its last request asked.
+    bool http_server::m_upgrade(peer* remote_peer, connection* conn)
+    {
+        static const char switching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+            "Connection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+        if (
+            remote_peer->write_bytes(switching, sizeof(switching) - 1)
+            != true
+        )
+        {
+            return false;
+        }
+        conn->h2 = new http2_connection(this, remote_peer, conn);
+        conn->dispatching = true;
+        bool upgraded = conn->h2->upgrade(
+            conn->request.header("http2-settings"), conn->request);
+        conn->dispatching = false;
+        if (conn->closed == true)
+        {
+            delete conn;
+            return false;
+        }
+        if (upgraded != true)
+        {
+            remote_peer->disconnect();
+            return false;
+        }
+        return m_flush_http2(remote_peer, conn);
+    }
+
+    // Writes a response head.
+    bool http_server::m_write_head(peer* remote_peer, connection* conn,
+        int status, std::string_view content_type, long content_length,
+        std::string_view headers, std::string_view body)
+    {
+        std::string& out = t_response;
+        out.clear();
+        out.append("HTTP/1.1 ", 9);
+        append_number(out, status, 10);
+        out.push_back(' ');
+        out.append(http_status_text(status));
+        out.append("\r\nDate: ", 8);
+        out.append(http_date(), http_date_length);
+        out.append("\r\n", 2);
+        if (conn->keep_alive != true) out.append("Connection: close\r\n");
+        else if (conn->version_minor == 0)
+        {
+            out.append("Connection: keep-alive\r\n");
+        }
+        if (content_type.empty() != true)
+        {
+            out.append("Content-Type: ", 14);
+            out.append(content_type.data(), content_type.size());
+            out.append("\r\n", 2);
+        }
+        if (content_length >= 0)
+        {
+            out.append("Content-Length: ", 16);
+            append_number(out, content_length, 10);
+            out.append("\r\n", 2);
+        }
+        else if (conn->version_minor != 0)
+        {
+            out.append("Transfer-Encoding: chunked\r\n");
+        }
+        out.append(headers.data(), headers.size());
+        out.append("\r\n", 2);
+        if ((conn->head_only == true) or (body.empty() == true))
+        {
+            return remote_peer->write_bytes(out.data(), out.size());
+        }
+        if (body.size() > max_copied_body)
+        {
+            iovec vec[2] = {
+                { &out[0], out.size() },
+                { const_cast<char*>(body.data()), body.size() }
+            };
+            return remote_peer->write_iovec(vec, 2);
+        }
+        out.append(body.data(), body.size());
+        return remote_peer->write_bytes(out.data(), out.size());
+    }
+
+    // Events. ----------------------------------------------------------------
+
+    // Request received.
+    void http_server::on_request(peer* remote_peer,
+        const http_request& request)
+    {
+        respond(remote_peer, 404, "Not Found");
+    }
+
+    // Message received on a WebSocket connection.
+    void http_server::on_message(peer* remote_peer, websocket_opcode opcode,
+        std::string_view data)
+    {
+    }
+
+    // WebSocket connection closed.
+    void http_server::on_websocket_close(peer* remote_peer)
+    {
+    }
+
+    // Parses received data and answers complete requests.
+    void http_server::on_receive(peer* remote_peer)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if (conn == nullptr)
+        {
+            conn = new connection(m_options);
+            remote_peer->set_context(conn);
+        }
+        while (true)
+        {
+            // A WebSocket frame is the most a connection buffers then.
+            size_t limit = (conn->ws != nullptr)
+                ? m_options.max_message + websocket_max_header_length
+                : m_options.max_head + m_options.max_body + chunk_slack;
+            if (conn->used == conn->input.size())
+            {
+                // Only an unfinished body can fill the buffer.
+                if (conn->input.size() >= limit)
+                {
+                    m_reject(remote_peer, conn, 413);
+                    return;
+                }
+                size_t size = conn->input.size() * 2;
+                conn->input.resize((size < limit) ? size : limit);
+            }
+            size_t room = conn->input.size() - conn->used;
+            int count = remote_peer->read_bytes(
+                conn->input.data() + conn->used, room);
+            // Disconnected, and on_disconnect() freed the connection.
+            if (count < 0) return;
+            conn->used += count;
+            size_t offset = 0;
+            bool preface = false;
+            if (
+                (conn->h2 == nullptr) and (conn->served == 0)
+                and (m_options.allow_http2 == true)
+            )
+            {
+                // HTTP/2 with prior knowledge starts with its preface.
+                size_t check = (conn->used < http2_preface.size())
+                    ? conn->used : http2_preface.size();
+                if (
+                    memcmp(conn->input.data(), http2_preface.data(), check)
+                    == 0
+                )
+                {
+                    preface = true;
+                    if (check == http2_preface.size())
+                    {
+                        conn->h2 = new http2_connection(this, remote_peer,
+                            conn);
+                    }
+                }
+            }
+            while (
+                (preface != true) and (conn->h2 == nullptr)
+                and (conn->ws == nullptr) and (offset < conn->used)
+            )
+            {
+                int found = conn->parser.parse(conn->input.data() + offset,
+                    conn->used - offset, conn->request);
+                if (found == 0)
+                {
+                    // The client holds the body back until told to go on.
+                    if (
+                        (conn->parser.expects_continue() == true)
+                        and (conn->continued != true)
+                    )
+                    {
+                        static const char go_on[] =
+                            "HTTP/1.1 100 Continue\r\n\r\n";
+                        conn->continued = true;
+                        if (
+                            remote_peer->write_bytes(go_on,
+                                sizeof(go_on) - 1) != true
+                        )
+                        {
+                            return;
+                        }
+                    }
+                    break;
+                }
+                if (found < 0)
+                {
+                    m_reject(remote_peer, conn, conn->parser.get_error());
+                    return;
+                }
+                offset += conn->request.length;
+                conn->continued = false;
+                if (
+                    (m_options.allow_http2 == true)
+                    and (wants_h2c(conn->request) == true)
+                )
+                {
+                    // What follows is the client's HTTP/2 preface.
+                    if (m_upgrade(remote_peer, conn) != true) return;
+                    break;
+                }
+                conn->served++;
+                conn->version_minor = conn->request.version_minor;
+                conn->keep_alive = (conn->request.keep_alive == true)
+                    and (
+                        (m_options.max_requests <= 0)
+                        or (conn->served < m_options.max_requests)
+                    );
+                conn->head_only = (conn->request.method == "HEAD");
+                conn->response = HTTP_RESPONSE_NONE;
+                conn->dispatching = true;
+                on_request(remote_peer, conn->request);
+                conn->dispatching = false;
+                if (conn->closed == true)
+                {
+                    delete conn;
+                    return;
+                }
+                if (
+                    (conn->response != HTTP_RESPONSE_DONE)
+                    or (conn->keep_alive != true)
+                )
+                {
+                    remote_peer->disconnect();
+                    return;
+                }
+                // What follows are WebSocket frames.
+                if (conn->ws != nullptr) break;
+            }
+            if (conn->h2 != nullptr)
+            {
+                // Frames are parsed where they are, answers go out at once.
+                conn->dispatching = true;
+                int consumed = conn->h2->receive(conn->input.data() + offset,
+                    conn->used - offset);
+                conn->dispatching = false;
+                if (conn->closed == true)
+                {
+                    delete conn;
+                    return;
+                }
+                if (m_flush_http2(remote_peer, conn) != true) return;
+                if (consumed < 0)
+                {
+                    remote_peer->disconnect();
+                    return;
+                }
+                offset += consumed;
+            }
+            if (conn->ws != nullptr)
+            {
+                conn->dispatching = true;
+                int consumed = m_receive_websocket(remote_peer, conn,
+                    conn->input.data() + offset, conn->used - offset);
+                conn->dispatching = false;
+                if (conn->closed == true)
+                {
+                    delete conn;
+                    return;
+                }
+                if (consumed < 0)
+                {
+                    remote_peer->disconnect();
+                    return;
+                }
+                offset += consumed;
+            }
+            // The next request starts at the start of the buffer.
+            if (offset > 0)
+            {
+                memmove(conn->input.data(), conn->input.data() + offset,
+                    conn->used - offset);
+                conn->used -= offset;
+            }
+            if (size_t(count) < room) break;
+        }
+    }
+
+    // Frees the state of a connection.
+    void http_server::on_disconnect(peer* remote_peer)
+    {
+        connection* conn = static_cast<connection*>(
+            remote_peer->get_context());
+        if (conn == nullptr) return;
+        remote_peer->set_context(nullptr);
+        if (conn->ws != nullptr)
+        {
+            // Waits for a frame being written from another thread, the peer
+            // goes once this returns.
+            if (t_writing != conn->ws.get())
+            {
+                std::lock_guard<std::mutex> lock(conn->ws->write_lock);
+                conn->ws->closed = true;
+            }
+            else conn->ws->closed = true;
+            on_websocket_close(remote_peer);
+        }
+        // on_receive() frees it once on_request() returns.
+        if (conn->dispatching == true) conn->closed = true;
+        else delete conn;
+    }
+
+}
@@ -9,7 +9,18 @@ namespace tuxnet
     /// Init log class static members.
     std::unique_ptr<log> log::m_instance;
     std::once_flag log::m_instance_allocated;
-    std::mutex m_lock;
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    log::log() : m_sink(new text_log_sink())
+    {
+        m_sinks.emplace_back(m_sink.load());
+        // Format 0 is used for preformatted string messages.
+        register_format("{}");
+    }
+
+    // Getters / setters. -----------------------------------------------------
 
     // Get pointer to log instance.
     log& log::get()
@@ -21,27 +32,69 @@ namespace tuxnet
         return *m_instance.get();
     }
 
+    // Gets a registered format string.
+    std::string log::get_format(uint32_t format_id)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (format_id >= m_formats.size()) return "";
+        return m_formats[format_id];
+    }
+
+    // Replaces the log sink.
+    void log::set_sink(log_sink* sink)
+    {
+        if (sink == nullptr) return;
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (size_t id = 0; id < m_formats.size(); ++id)
+        {
+            sink->define_format(id, m_formats[id]);
+        }
+        m_sinks.emplace_back(sink);
+        m_sink.exchange(sink, std::memory_order_acq_rel)->flush();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Registers a format string.
+    uint32_t log::register_format(const std::string& format)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        uint32_t format_id = m_formats.size();
+        m_formats.push_back(format);
+        m_sink.load(std::memory_order_acquire)->define_format(format_id,
+            format);
+        return format_id;
+    }
+
     //  Log an informational message.
     void log::info(const std::string& message)
     {
-        std::lock_guard<std::mutex> lock(m_lock);
-        std::cout << message << std::endl;
+        m_sink.load(std::memory_order_acquire)->write(LOG_LEVEL_INFO,
+            message);
     }
 
     // Log a debug message.
     void log::debug(const std::string& message)
     {
-        std::lock_guard<std::mutex> lock(m_lock);
-        std::cout << message << std::endl;
+        m_sink.load(std::memory_order_acquire)->write(LOG_LEVEL_DEBUG,
+            message);
     }
 
     // Log an error message.
     void log::error(const std::string& message)
     {
-        std::lock_guard<std::mutex> lock(m_lock);
-        std::cerr << message << std::endl;
-        exit(1);
+        m_sink.load(std::memory_order_acquire)->write(LOG_LEVEL_ERROR,
+            message);
+        m_fatal();
     }
 
+    // Private methods. -------------------------------------------------------
+
+    // Flushes the sink and terminates.
+    void log::m_fatal()
+    {
+        m_sink.load(std::memory_order_acquire)->flush();
+        exit(1);
+    }
 
 }
@@ -0,0 +1,362 @@
+#include <iostream>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "tuxnet/log_sink.h"
+
+namespace tuxnet
+{
+
+    /*************************************************************************
+     * Argument formatting                                                   *
+     *************************************************************************/
+
+    // Turns a format string and packed arguments back into text.
+    std::string format_log_args(const std::string& format, const char* args,
+        size_t args_size)
+    {
+        std::string result;
+        const char* pos = args;
+        const char* const end = args + args_size;
+        size_t last = 0;
+        size_t found = 0;
+        while ((found = format.find("{}", last)) != std::string::npos)
+        {
+            result.append(format, last, found - last);
+            last = found + 2;
+            if (pos >= end)
+            {
+                result += "{}";
+                continue;
+            }
+            char type = *pos++;
+            if ((type == LOG_ARG_INT) and (end - pos >= 8))
+            {
+                int64_t v;
+                memcpy(&v, pos, sizeof(v));
+                result += std::to_string(v);
+                pos += 8;
+            }
+            else if ((type == LOG_ARG_UINT) and (end - pos >= 8))
+            {
+                uint64_t v;
+                memcpy(&v, pos, sizeof(v));
+                result += std::to_string(v);
+                pos += 8;
+            }
+            else if ((type == LOG_ARG_DOUBLE) and (end - pos >= 8))
+            {
+                double v;
+                memcpy(&v, pos, sizeof(v));
+                result += std::to_string(v);
+                pos += 8;
+            }
+            else if ((type == LOG_ARG_STRING) and (end - pos >= 2))
+            {
+                uint16_t len;
+                memcpy(&len, pos, sizeof(len));
+                pos += sizeof(len);
+                if (len > end - pos) len = end - pos;
+                result.append(pos, len);
+                pos += len;
+            }
+            else
+            {
+                // Corrupt or truncated arguments, stop decoding.
+                result += "{?}";
+                pos = end;
+            }
+        }
+        result.append(format, last, std::string::npos);
+        return result;
+    }
+
+    /*************************************************************************
+     * log_sink                                                              *
+     *************************************************************************/
+
+    // Destructor.
+    log_sink::~log_sink()
+    {
+    }
+
+    // Called whenever a new format string is registered.
+    void log_sink::define_format(uint32_t format_id, const std::string& format)
+    {
+    }
+
+    // Flushes pending records.
+    void log_sink::flush()
+    {
+    }
+
+    /*************************************************************************
+     * text_log_sink                                                         *
+     *************************************************************************/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor writing to std::cout and std::cerr.
+    text_log_sink::text_log_sink() :
+        m_error_stream(std::cerr), m_info_stream(std::cout)
+    {
+    }
+
+    // Constructor with custom streams.
+    text_log_sink::text_log_sink(std::ostream& info_stream,
+        std::ostream& error_stream) :
+        m_error_stream(error_stream), m_info_stream(info_stream)
+    {
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Remembers a format string.
+    void text_log_sink::define_format(uint32_t format_id,
+        const std::string& format)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_formats.size() <= format_id) m_formats.resize(format_id + 1);
+        m_formats[format_id] = format;
+    }
+
+    // Flushes the streams.
+    void text_log_sink::flush()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_info_stream.flush();
+        m_error_stream.flush();
+    }
+
+    // Writes a preformatted message.
+    void text_log_sink::write(log_level level, const std::string& message)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (level == LOG_LEVEL_ERROR)
+        {
+            m_error_stream << message << std::endl;
+        }
+        else
+        {
+            m_info_stream << message << std::endl;
+        }
+    }
+
+    // Formats a record and writes it.
+    void text_log_sink::write(log_level level, uint32_t format_id,
+        const char* args, size_t args_size)
+    {
+        std::string message;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (format_id < m_formats.size())
+            {
+                message = format_log_args(m_formats[format_id], args,
+                    args_size);
+            }
+        }
+        write(level, message);
+    }
+
+    /*************************************************************************
+     * binary_log_sink                                                       *
+     *************************************************************************/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    binary_log_sink::binary_log_sink(const std::string& path,
+        size_t max_file_size, int max_files) :
+        m_fd(-1), m_map(nullptr), m_max_file_size(max_file_size),
+        m_max_files(max_files), m_path(path), m_pos(0)
+    {
+        if (m_max_file_size < 4096) m_max_file_size = 4096;
+        if (m_max_files < 0) m_max_files = 0;
+        m_open_file();
+    }
+
+    // Destructor.
+    binary_log_sink::~binary_log_sink()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_close_file();
+    }
+
+    // Getters. ---------------------------------------------------------------
+
+    // Checks if the sink has a usable file.
+    bool binary_log_sink::is_open() const
+    {
+        return m_map != nullptr;
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Stores a format string in the current file.
+    void binary_log_sink::define_format(uint32_t format_id,
+        const std::string& format)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_formats.size() <= format_id) m_formats.resize(format_id + 1);
+        m_formats[format_id] = format;
+        m_append(BINARY_LOG_RECORD_FORMAT, 0, format_id, format.data(),
+            format.size());
+    }
+
+    // Schedules the mapped pages to be written back.
+    void binary_log_sink::flush()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_map == nullptr) return;
+        msync(m_map, m_pos, MS_ASYNC);
+    }
+
+    // Writes a preformatted message as format 0 with a single string.
+    void binary_log_sink::write(log_level level, const std::string& message)
+    {
+        char buffer[1024];
+        size_t len = message.size();
+        if (len > sizeof(buffer) - 3) len = sizeof(buffer) - 3;
+        uint16_t l = len;
+        buffer[0] = LOG_ARG_STRING;
+        memcpy(buffer + 1, &l, sizeof(l));
+        memcpy(buffer + 3, message.data(), len);
+        write(level, 0, buffer, len + 3);
+    }
+
+    // Writes a record.
+    void binary_log_sink::write(log_level level, uint32_t format_id,
+        const char* args, size_t args_size)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_append(BINARY_LOG_RECORD_EVENT, level, format_id, args, args_size);
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Appends a record, rotating the file if it's full.
+    void binary_log_sink::m_append(uint8_t type, uint8_t level,
+        uint32_t format_id, const char* payload, size_t payload_size)
+    {
+        if (m_map == nullptr) return;
+        if (m_put(type, level, format_id, payload, payload_size) == true)
+        {
+            return;
+        }
+        if (m_rotate() != true) return;
+        m_put(type, level, format_id, payload, payload_size);
+    }
+
+    // Truncates the file to what was written and unmaps it.
+    void binary_log_sink::m_close_file()
+    {
+        if (m_map != nullptr)
+        {
+            munmap(m_map, m_max_file_size);
+            m_map = nullptr;
+        }
+        if (m_fd != -1)
+        {
+            // Keep one zeroed header as end marker.
+            if (ftruncate(m_fd, m_pos + sizeof(binary_log_record)) == -1)
+            {
+                std::cerr << "Could not truncate binary log " << m_path
+                    << ": " << strerror(errno) << std::endl;
+            }
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    // Creates and maps a fresh file.
+    bool binary_log_sink::m_open_file()
+    {
+        m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+        if (m_fd == -1)
+        {
+            // Can't use log::error() here, we may be the active sink.
+            std::cerr << "Could not open binary log " << m_path << ": "
+                << strerror(errno) << std::endl;
+            return false;
+        }
+        if (ftruncate(m_fd, m_max_file_size) == -1)
+        {
+            std::cerr << "Could not size binary log " << m_path << ": "
+                << strerror(errno) << std::endl;
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        void* map = mmap(nullptr, m_max_file_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, m_fd, 0);
+        if (map == MAP_FAILED)
+        {
+            std::cerr << "Could not map binary log " << m_path << ": "
+                << strerror(errno) << std::endl;
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        m_map = static_cast<char*>(map);
+        memcpy(m_map, TUXNET_BINARY_LOG_MAGIC, 8);
+        m_pos = 8;
+        for (size_t id = 0; id < m_formats.size(); ++id)
+        {
+            m_put(BINARY_LOG_RECORD_FORMAT, 0, id, m_formats[id].data(),
+                m_formats[id].size());
+        }
+        return true;
+    }
+
+    // Copies a record into the current file if it fits.
+    bool binary_log_sink::m_put(uint8_t type, uint8_t level,
+        uint32_t format_id, const char* payload, size_t payload_size)
+    {
+        if (m_map == nullptr) return false;
+        if (payload_size > 0xFFFF - sizeof(binary_log_record))
+        {
+            payload_size = 0xFFFF - sizeof(binary_log_record);
+        }
+        size_t size = sizeof(binary_log_record) + payload_size;
+        // Keep room for the end marker.
+        if (m_pos + size + sizeof(binary_log_record) > m_max_file_size)
+        {
+            return false;
+        }
+        timespec now = {};
+        clock_gettime(CLOCK_REALTIME, &now);
+        binary_log_record header = {};
+        header.size = size;
+        header.type = type;
+        header.level = level;
+        header.format_id = format_id;
+        header.timestamp = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL
+            + now.tv_nsec;
+        memcpy(m_map + m_pos, &header, sizeof(header));
+        memcpy(m_map + m_pos + sizeof(header), payload, payload_size);
+        m_pos += size;
+        return true;
+    }
+
+    // Shifts old files and starts a new one.
+    bool binary_log_sink::m_rotate()
+    {
+        m_close_file();
+        if (m_max_files == 0)
+        {
+            unlink(m_path.c_str());
+        }
+        for (int n = m_max_files; n > 0; --n)
+        {
+            std::string from = m_path;
+            if (n > 1) from += "." + std::to_string(n - 1);
+            std::string to = m_path + "." + std::to_string(n);
+            rename(from.c_str(), to.c_str());
+        }
+        return m_open_file();
+    }
+
+}
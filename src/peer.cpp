@@ -1,35 +1,66 @@
 #include <unistd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <sys/ioctl.h>
 #include <thread>
 #include "tuxnet/log.h"
 #include "tuxnet/event.h"
 #include "tuxnet/socket_address.h"
 #include "tuxnet/socket.h"
+#include "tuxnet/client.h"
 #include "tuxnet/peer.h"
 #include "tuxnet/config.h"
+#include "tuxnet/stats.h"
 
 namespace tuxnet
 {
 
+    namespace
+    {
+
+        /// Peer polled by the calling thread, cleared when it's deleted.
+        thread_local peer* t_polled_peer = nullptr;
+
+        /// Gets the wall clock time kernel timestamps are taken with.
+        inline uint64_t realtime_clock()
+        {
+            timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+        }
+
+    }
+
     // IPV4 constructor.
     peer::peer(int fd, const sockaddr_in& in_addr, socket* const parent) : 
-        m_fd(fd), m_epoll_fd(0), 
+        m_fd(fd), m_epoll_fd(0), m_remote_ip(in_addr.sin_addr.s_addr),
+        m_remote_port(ntohs(in_addr.sin_port)),
         m_socket(parent), 
-        m_state(PEER_STATE_UNINITIALIZED)
+        m_state(PEER_STATE_UNINITIALIZED),
+        m_rx_timestamps(false), m_receive_start(0),
+        m_receive_queue_pending(false), m_bytes_sent(0),
+        m_retransmitting(false), m_sampled(false), m_sampled_bytes(0),
+        m_sampled_retrans(0), m_received(false), m_context(nullptr)
     {
         m_saddr = dynamic_cast<socket_address*>(
             new ip4_socket_address(in_addr)
         );
-        m_epoll_events = new epoll_event[
-            config::get().get_listen_socket_epoll_max_events()]();
     }
 
     // IPV6 constructor.
     /// @todo fixme
     peer::peer(int fd, const sockaddr_in6& in_addr, socket* const parent) : 
-        m_fd(fd), m_socket(parent), m_state(PEER_STATE_UNINITIALIZED)
+        m_fd(fd), m_remote_ip(0), m_remote_port(0), m_socket(parent),
+        m_state(PEER_STATE_UNINITIALIZED),
+        m_rx_timestamps(false), m_receive_start(0),
+        m_receive_queue_pending(false), m_bytes_sent(0),
+        m_retransmitting(false), m_sampled(false), m_sampled_bytes(0),
+        m_sampled_retrans(0), m_received(false), m_context(nullptr)
     {
         m_saddr = dynamic_cast<socket_address*>(
             new ip6_socket_address(in_addr)
@@ -40,6 +71,7 @@ namespace tuxnet
     // Destructor.
     peer::~peer()
     {
+        if (t_polled_peer == this) t_polled_peer = nullptr;
         if ((m_fd != 0) and (m_epoll_fd != 0))
         {
             free_monitor(m_fd, m_epoll_fd);
@@ -56,14 +88,15 @@ namespace tuxnet
             delete m_saddr;
             m_saddr = nullptr;
         }
-        if (m_epoll_events != nullptr)
-        {
-            delete[] m_epoll_events;
-            m_epoll_events = nullptr;
-        }
     }
 
-    // Getters. ---------------------------------------------------------------
+    // Getters / setters. -----------------------------------------------------
+
+    // Gets the data attached with set_context().
+    void* peer::get_context() const
+    {
+        return m_context.load(std::memory_order_acquire);
+    }
 
     // Get file descriptor.
     int peer::get_fd()
@@ -83,6 +116,31 @@ namespace tuxnet
         return m_state;
     }
 
+    // Checks whether the connection retransmits too much.
+    bool peer::get_retransmitting() const
+    {
+        return m_retransmitting.load(std::memory_order_relaxed);
+    }
+
+    // Attaches data to the connection.
+    void peer::set_context(void* context)
+    {
+        m_context.store(context, std::memory_order_release);
+    }
+
+    // Pauses or resumes on_receive events.
+    bool peer::set_receiving(bool receiving)
+    {
+        if ((m_fd == 0) or (m_epoll_fd == 0)) return false;
+        // EPOLLEXCLUSIVE can't be modified, so monitor the socket anew.
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, m_fd, nullptr);
+        epoll_event event = {};
+        event.data.fd = m_fd;
+        // Hangups and errors are reported without asking for them.
+        event.events = (receiving == true) ? EPOLLIN : 0;
+        return epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_fd, &event) == 0;
+    }
+
     // Methods. ---------------------------------------------------------------
 
     // Sets up peer for event monitoring.
@@ -91,46 +149,83 @@ namespace tuxnet
         m_epoll_fd = create_event_listener();
         if (m_epoll_fd == -1) return false;
         if (event_monitor(m_fd, m_epoll_fd) != true) return false;
+        if (config::get().get_rx_timestamps() == 1)
+        {
+            // Software timestamps work on any device, loopback included.
+            int flags = SOF_TIMESTAMPING_RX_SOFTWARE
+                | SOF_TIMESTAMPING_SOFTWARE;
+            m_rx_timestamps = (setsockopt(m_fd, SOL_SOCKET, SO_TIMESTAMPING,
+                &flags, sizeof(flags)) == 0);
+        }
         m_state = PEER_STATE_CONNECTED;
-        std::thread thread([this](){
-            while (this->m_state == PEER_STATE_CONNECTED)
-            {
-                this->poll();
-            }
-        });
-        thread.detach();
         return true;
     }
 
     void peer::poll()
     {
         if (m_state != PEER_STATE_CONNECTED) return;
-        /// @todo make last argument to epoll_wait configurable (timeout).
-        int event_count = epoll_wait(
+        thread_stats& stats = stats_registry::local();
+        stats.wait_begin();
+        // Batch size bounds and timeout can change on a running server.
+        int event_count = m_epoll_events.wait(
             m_epoll_fd, 
-            m_epoll_events, 
-            config::get().get_listen_socket_epoll_max_events(), 
-            -1);
+            config::get().get_peer_socket_epoll_min_events(),
+            config::get().get_peer_socket_epoll_max_events(), 
+            config::get().get_peer_socket_epoll_timeout(),
+            config::get().get_busy_poll_usec());
+        uint64_t ready = stats.wait_end();
+        if ((event_count == -1) and (errno == EINTR)) return;
         if (event_count == -1)
         {
-            disconnect();
+            disconnect(DISCONNECT_REASON_ERROR);
             return;
         }
+        if (event_count > 0)
+        {
+            stat_add(stats.epoll_wakeups);
+            stat_add(stats.epoll_events, event_count);
+        }
         for (int n_event = 0 ; n_event < event_count ; ++n_event)
         {
             int event_fd = m_epoll_events[n_event].data.fd;
+            uint32_t events = m_epoll_events[n_event].events;
+            bool hangup = (events & EPOLLERR) or (events & EPOLLHUP)
+                or (not (events & EPOLLIN));
             if (
-                (m_epoll_events[n_event].events & EPOLLERR)
-                or (m_epoll_events[n_event].events & EPOLLHUP)
-                or (not (m_epoll_events[n_event].events & EPOLLIN))
+                (hangup == true)
+                and (not (events & EPOLLERR))
+                and (events & EPOLLIN)
             )
             {
-                disconnect();
+                /* Both directions can be shut down while received data is
+                 * still waiting (a half-closed connection closing its other
+                 * half), deliver it before hanging up. */
+                int waiting = 0;
+                hangup = (ioctl(m_fd, FIONREAD, &waiting) == -1)
+                    or (waiting <= 0);
+            }
+            if (hangup == true)
+            {
+                m_record(FLIGHT_HANGUP, events);
+                disconnect(DISCONNECT_REASON_HANGUP);
                 return;
             }
             if (event_fd == m_fd)
             {
+                uint64_t start = stats_clock();
+                stats.record(LATENCY_DISPATCH_DELAY, start - ready);
+                bool tracked = stats.begin_callback(LATENCY_RECEIVE, m_fd,
+                    m_saddr);
+                if (m_rx_timestamps == true)
+                {
+                    m_receive_start = realtime_clock();
+                    m_receive_queue_pending = true;
+                }
                 m_socket->on_receive(this);
+                if (tracked == true) stats.end_callback();
+                stats.record(LATENCY_RECEIVE, stats_clock() - start);
+                // The callback may have disconnected and deleted the peer.
+                if (t_polled_peer != this) return;
             }
             else
             {
@@ -139,6 +234,63 @@ namespace tuxnet
         }
     }
 
+    // Gets TCP_INFO for the connection.
+    peer_tcp_info peer::tcp_info()
+    {
+        peer_tcp_info result = {};
+        struct ::tcp_info info = {};
+        socklen_t length = sizeof(info);
+        if (
+            (m_fd == 0)
+            or (getsockopt(m_fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
+        )
+        {
+            return result;
+        }
+        result.valid = true;
+        result.state = info.tcpi_state;
+        result.rtt_us = info.tcpi_rtt;
+        result.rtt_var_us = info.tcpi_rttvar;
+        result.rto_us = info.tcpi_rto;
+        result.snd_cwnd = info.tcpi_snd_cwnd;
+        result.snd_ssthresh = info.tcpi_snd_ssthresh;
+        result.snd_mss = info.tcpi_snd_mss;
+        result.unacked = info.tcpi_unacked;
+        result.lost = info.tcpi_lost;
+        result.backoff = info.tcpi_retransmits;
+        result.total_retrans = info.tcpi_total_retrans;
+        result.last_data_recv_ms = info.tcpi_last_data_recv;
+        result.bytes_sent = m_bytes_sent.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    // Starts the thread polling the peer.
+    void peer::start()
+    {
+        stats_registry* registry = m_socket->m_stats;
+        client* owner = m_socket->m_client;
+        std::thread thread([this, registry, owner](){
+            {
+                stats_scope scope(registry);
+                /* Peers are deleted when they disconnect, often from a
+                 * callback on this very thread, so stop as soon as that
+                 * happens. */
+                t_polled_peer = this;
+                while (
+                    (t_polled_peer == this)
+                    and (this->m_state == PEER_STATE_CONNECTED)
+                )
+                {
+                    this->poll();
+                }
+                t_polled_peer = nullptr;
+            }
+            // A client waits for this, its counters are released now.
+            if (owner != nullptr) owner->m_peer_done();
+        });
+        thread.detach();
+    }
+
     // Reads up to a given number of characters into string.
     std::string peer::read_string(int characters)
     {
@@ -154,29 +306,20 @@ namespace tuxnet
         while (read_so_far < characters)
         {
             if (m_state != PEER_STATE_CONNECTED) return result;
-            int count = recv(
-                m_fd, 
-                &buffer, 
-                sizeof(buffer) * sizeof(char),
-                MSG_DONTWAIT);
+            int count = m_recv(buffer, characters - read_so_far, MSG_DONTWAIT);
             if (count > 0)
             {
                 read_so_far += count;
-                buffer[read_so_far] = 0;
-                result += buffer;
+                result.append(buffer, count);
+            }
+            else if ((count == -1) and (errno == EAGAIN))
+            {
+                continue;
             }
             else
             {
-                if (errno == EAGAIN)
-                {
-                    continue;
-                }
-                else
-                {
-                    // Client disconnected.
-                    disconnect();
-                    return result;
-                }
+                // Client disconnected.
+                return result;
             }
         }
         return result;
@@ -196,7 +339,7 @@ namespace tuxnet
         while (true)
         {
             if (m_state != PEER_STATE_CONNECTED) return result;
-            int count = read(m_fd, &buffer, 1 * sizeof(char));
+            int count = m_recv(&buffer, 1 * sizeof(char), 0);
             if (count > 0)
             {
                 if (result.find(token) != std::string::npos)
@@ -208,18 +351,14 @@ namespace tuxnet
                     result += buffer;
                 }
             }
-            else
+            else if ((count == -1) and (errno == EAGAIN))
             {
-                if (errno == EAGAIN)
-                {
-                    continue;
-                }
-                else 
-                {
-                    // Client disconnected.
-                    disconnect();
-                    return result;
-                }
+                continue;
+            }
+            else 
+            {
+                // Client disconnected.
+                return result;
             }
         }
         return result;
@@ -239,7 +378,7 @@ namespace tuxnet
         while (true)
         {
             if (m_state != PEER_STATE_CONNECTED) return result;
-            int count = read(m_fd, &buffer, 1 * sizeof(char));
+            int count = m_recv(&buffer, 1 * sizeof(char), 0);
             if (count > 0)
             {
                 if ((buffer == '\n') or (buffer == '\r'))
@@ -254,18 +393,14 @@ namespace tuxnet
                     result += buffer;
                 }
             }
+            else if ((count == -1) and (errno == EAGAIN))
+            {
+                continue;
+            }
             else
             {
-                if (errno == EAGAIN)
-                {
-                    continue;
-                }
-                else
-                {
-                    // Client disconnected.
-                    disconnect();
-                    return result;
-                }
+                // Client disconnected.
+                return result;
             }
         }
         return result;
@@ -285,10 +420,7 @@ namespace tuxnet
         while (true)
         {
             if (m_state != PEER_STATE_CONNECTED) return result;
-            int count = recv(
-                m_fd, 
-                &buffer, 
-                sizeof(buffer) * sizeof(char),
+            int count = m_recv(&buffer, sizeof(buffer) * sizeof(char),
                 MSG_DONTWAIT);
             if (count > 0)
             {
@@ -301,52 +433,252 @@ namespace tuxnet
                     result += buffer;
                 }
             }
+            else if ((count == -1) and (errno == EAGAIN))
+            {
+                break;
+            }
             else
             {
-                if (errno == EAGAIN)
-                {
-                    break;
-                }
-                else
-                {
-                    // Client disconnected.
-                    disconnect();
-                    return result;
-                }
+                // Client disconnected.
+                return result;
             }
         }
         return result;
     }
 
+    // Reads available bytes into a buffer.
+    int peer::read_bytes(char* buffer, int length)
+    {
+        if ((m_state != PEER_STATE_CONNECTED) or (m_fd == 0)) return -1;
+        if (length <= 0) return 0;
+        int count = m_recv(buffer, length, MSG_DONTWAIT);
+        if (count > 0) return count;
+        if ((count == -1) and (errno == EAGAIN)) return 0;
+        // Client disconnected.
+        return -1;
+    }
 
     void peer::write_string(std::string text)
     {
         if (m_state != PEER_STATE_CONNECTED) return;
         if (m_fd == 0) return;
-        if (::send(m_fd, text.c_str(), text.length(), MSG_NOSIGNAL) 
-                == -1)
+        m_send(text.c_str(), text.length());
+    }
+
+    // Sends raw bytes.
+    bool peer::write_bytes(const char* data, int length)
+    {
+        if ((m_state != PEER_STATE_CONNECTED) or (m_fd == 0)) return false;
+        if (length <= 0) return true;
+        return m_send(data, length);
+    }
+
+    // Sends several buffers at once.
+    bool peer::write_iovec(const iovec* vec, int count)
+    {
+        if ((m_state != PEER_STATE_CONNECTED) or (m_fd == 0)) return false;
+        // sendmsg() takes the array as is, partial sends need a copy.
+        iovec pending[16];
+        if (count > 16)
         {
-            if (errno == EPIPE)
+            for (int n = 0; n < count; ++n)
             {
-                // Broken pipe. Lost connection mid-write.
-                disconnect();
-                return;
+                if (m_send(vec[n].iov_base, vec[n].iov_len) != true)
+                {
+                    return false;
+                }
             }
-            std::string errstr = "Could not write to peer: ";
-            errstr += strerror(errno);
-            errstr += " (errno=" + std::to_string(errno) + ")";
-            log::get().error(errstr);
-            disconnect();
+            return true;
+        }
+        int left = 0;
+        for (int n = 0; n < count; ++n)
+        {
+            if (vec[n].iov_len > 0) pending[left++] = vec[n];
         }
+        thread_stats& stats = stats_registry::local();
+        iovec* pos = pending;
+        while (left > 0)
+        {
+            msghdr message = {};
+            message.msg_iov = pos;
+            message.msg_iovlen = left;
+            ssize_t sent = ::sendmsg(m_fd, &message, MSG_NOSIGNAL);
+            stat_add(stats.send_calls);
+            if (sent == -1)
+            {
+                if (errno == EINTR) continue;
+                m_send_failed(errno);
+                return false;
+            }
+            m_record(FLIGHT_WRITE, sent);
+            stat_add(stats.bytes_out, sent);
+            stat_add(m_bytes_sent, sent);
+            // Skip what went out, the rest is sent from there.
+            while ((left > 0) and (size_t(sent) >= pos->iov_len))
+            {
+                sent -= pos->iov_len;
+                pos++;
+                left--;
+            }
+            if (left > 0)
+            {
+                pos->iov_base = static_cast<char*>(pos->iov_base) + sent;
+                pos->iov_len -= sent;
+            }
+        }
+        return true;
     }
 
     // Close connection to this peer.
-    void peer::disconnect()
+    void peer::disconnect(disconnect_reason reason)
     {
         if (m_state == PEER_STATE_CLOSING) return;
         m_state = PEER_STATE_CLOSING;
+        m_record(FLIGHT_DISCONNECT, reason);
+        stat_add(stats_registry::local().disconnects[reason]);
         m_socket->remove_peer(this);
     }
 
-}
+    // Private methods. -------------------------------------------------------
 
+    // Receives data, keeping count and disconnecting on errors.
+    int peer::m_recv(void* buffer, size_t length, int flags)
+    {
+        thread_stats& stats = stats_registry::local();
+        int count = 0;
+        if (m_rx_timestamps == true)
+        {
+            count = m_recv_timestamped(buffer, length, flags);
+        }
+        else
+        {
+            count = recv(m_fd, buffer, length, flags);
+        }
+        stat_add(stats.recv_calls);
+        if (count > 0)
+        {
+            if (m_received != true)
+            {
+                m_received = true;
+                m_record(FLIGHT_FIRST_BYTE, count);
+            }
+            m_record(FLIGHT_READ, count);
+            stat_add(stats.bytes_in, count);
+            if (m_socket->m_heavy_hitters != nullptr)
+            {
+                m_socket->m_heavy_hitters->add(HEAVY_HITTER_BYTES,
+                    m_remote_ip, count);
+            }
+        }
+        else if (count == 0)
+        {
+            m_record(FLIGHT_READ, 0);
+            disconnect(DISCONNECT_REASON_REMOTE);
+        }
+        else if ((errno == EAGAIN) or (errno == EWOULDBLOCK))
+        {
+            errno = EAGAIN;
+            m_record(FLIGHT_EAGAIN);
+            stat_add(stats.eagain_spins);
+        }
+        else if (errno != EINTR)
+        {
+            m_record(FLIGHT_READ, -errno);
+            disconnect(DISCONNECT_REASON_ERROR);
+        }
+        else
+        {
+            // Interrupted, let the caller retry like it would on EAGAIN.
+            errno = EAGAIN;
+        }
+        return count;
+    }
+
+    // Receives data along with its kernel timestamp.
+    int peer::m_recv_timestamped(void* buffer, size_t length, int flags)
+    {
+        iovec iov = { buffer, length };
+        char control[CMSG_SPACE(sizeof(scm_timestamping))];
+        msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        int count = recvmsg(m_fd, &message, flags);
+        if ((count <= 0) or (m_receive_queue_pending != true)) return count;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr;
+            cmsg = CMSG_NXTHDR(&message, cmsg))
+        {
+            if (
+                (cmsg->cmsg_level != SOL_SOCKET)
+                or (cmsg->cmsg_type != SCM_TIMESTAMPING)
+            )
+            {
+                continue;
+            }
+            // The software timestamp comes first.
+            scm_timestamping timestamps;
+            memcpy(&timestamps, CMSG_DATA(cmsg), sizeof(timestamps));
+            uint64_t received = uint64_t(timestamps.ts[0].tv_sec)
+                * 1000000000 + timestamps.ts[0].tv_nsec;
+            if (received == 0) break;
+            m_receive_queue_pending = false;
+            if (received <= m_receive_start)
+            {
+                stats_registry::local().record(LATENCY_RECEIVE_QUEUE,
+                    m_receive_start - received);
+            }
+            break;
+        }
+        return count;
+    }
+
+    // Sends data, keeping count and disconnecting on errors.
+    bool peer::m_send(const void* data, size_t length)
+    {
+        thread_stats& stats = stats_registry::local();
+        const char* pos = static_cast<const char*>(data);
+        while (length > 0)
+        {
+            ssize_t count = ::send(m_fd, pos, length, MSG_NOSIGNAL);
+            stat_add(stats.send_calls);
+            if (count == -1)
+            {
+                if (errno == EINTR) continue;
+                m_send_failed(errno);
+                return false;
+            }
+            m_record(FLIGHT_WRITE, count);
+            stat_add(stats.bytes_out, count);
+            stat_add(m_bytes_sent, count);
+            pos += count;
+            length -= count;
+        }
+        return true;
+    }
+
+    // Handles a failed send.
+    void peer::m_send_failed(int error)
+    {
+        m_record(FLIGHT_WRITE, -error);
+        // Lost connection mid-write, unless it's something else.
+        disconnect_reason reason = DISCONNECT_REASON_REMOTE;
+        if ((error != EPIPE) and (error != ECONNRESET))
+        {
+            std::string errstr = "Could not write to peer: ";
+            errstr += strerror(error);
+            errstr += " (errno=" + std::to_string(error) + ")";
+            log::get().info(errstr);
+            reason = DISCONNECT_REASON_ERROR;
+        }
+        if (t_polled_peer != this)
+        {
+            // Written from another thread : the peer's own thread sees the
+            // shutdown and disconnects, so the peer isn't deleted under it.
+            shutdown(m_fd, SHUT_RDWR);
+            return;
+        }
+        disconnect(reason);
+    }
+
+}
@@ -0,0 +1,167 @@
+#include <atomic>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "tuxnet/log.h"
+#include "tuxnet/perf.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// Names of perf_counter values.
+        const char* const perf_counter_names[PERF_COUNTER_COUNT] =
+        {
+            "cycles", "instructions", "cache_misses", "branch_misses"
+        };
+
+        /// perf_event_attr config of perf_counter values.
+        const uint64_t perf_counter_configs[PERF_COUNTER_COUNT] =
+        {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+
+        /// Set once the missing counters have been logged.
+        std::atomic<bool> unavailable_logged(false);
+
+    }
+
+    // Gets the name of a performance counter.
+    const char* perf_counter_name(perf_counter counter)
+    {
+        if ((counter < 0) or (counter >= PERF_COUNTER_COUNT)) return "";
+        return perf_counter_names[counter];
+    }
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    perf_group::perf_group() : m_open(0)
+    {
+        for (int n = 0; n < PERF_COUNTER_COUNT; ++n)
+        {
+            m_fds[n] = -1;
+            m_slots[n] = -1;
+        }
+    }
+
+    // Destructor.
+    perf_group::~perf_group()
+    {
+        close();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Checks whether a counter is being counted.
+    bool perf_group::available(perf_counter counter) const
+    {
+        if ((counter < 0) or (counter >= PERF_COUNTER_COUNT)) return false;
+        return m_fds[counter] != -1;
+    }
+
+    // Closes the counters.
+    void perf_group::close()
+    {
+        // Members first, then the leader.
+        for (int n = PERF_COUNTER_COUNT - 1; n >= 0; --n)
+        {
+            if (m_fds[n] != -1) ::close(m_fds[n]);
+            m_fds[n] = -1;
+            m_slots[n] = -1;
+        }
+        m_open = 0;
+    }
+
+    // Opens the counters for the calling thread.
+    bool perf_group::open()
+    {
+        close();
+        bool exclude_kernel = false;
+        int leader = m_open_counter(PERF_CYCLES, -1, exclude_kernel);
+        if ((leader == -1) and ((errno == EACCES) or (errno == EPERM)))
+        {
+            // Restricted by kernel.perf_event_paranoid, count user space.
+            exclude_kernel = true;
+            leader = m_open_counter(PERF_CYCLES, -1, exclude_kernel);
+        }
+        if (leader == -1)
+        {
+            if (unavailable_logged.exchange(true) != true)
+            {
+                int error = errno;
+                std::string errstr = "Hardware performance counters are "
+                    "unavailable: ";
+                errstr += strerror(error);
+                if ((error == EACCES) or (error == EPERM))
+                {
+                    errstr += " (check kernel.perf_event_paranoid)";
+                }
+                errstr += ".";
+                log::get().info(errstr);
+            }
+            return false;
+        }
+        m_fds[PERF_CYCLES] = leader;
+        m_slots[PERF_CYCLES] = m_open++;
+        for (int n = PERF_CYCLES + 1; n < PERF_COUNTER_COUNT; ++n)
+        {
+            int fd = m_open_counter(static_cast<perf_counter>(n), leader,
+                exclude_kernel);
+            // Not every CPU or hypervisor has every counter.
+            if (fd == -1) continue;
+            m_fds[n] = fd;
+            m_slots[n] = m_open++;
+        }
+        if (ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the counters.
+    bool perf_group::read(uint64_t (&values)[PERF_COUNTER_COUNT])
+    {
+        if (m_open == 0) return false;
+        // nr, time_enabled, time_running, then one value per counter.
+        uint64_t buffer[3 + PERF_COUNTER_COUNT];
+        ssize_t length = ::read(m_fds[PERF_CYCLES], buffer, sizeof(buffer));
+        if (length < ssize_t((3 + m_open) * sizeof(uint64_t))) return false;
+        if (buffer[2] == 0) return false;
+        for (int n = 0; n < PERF_COUNTER_COUNT; ++n)
+        {
+            values[n] = (m_slots[n] == -1) ? 0 : buffer[3 + m_slots[n]];
+        }
+        return true;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Opens a single counter.
+    int perf_group::m_open_counter(perf_counter counter, int group_fd,
+        bool exclude_kernel)
+    {
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = perf_counter_configs[counter];
+        attr.read_format = PERF_FORMAT_GROUP
+            | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // The leader starts the whole group once it's complete.
+        attr.disabled = (group_fd == -1) ? 1 : 0;
+        attr.exclude_kernel = exclude_kernel ? 1 : 0;
+        attr.exclude_hv = 1;
+        return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+            PERF_FLAG_FD_CLOEXEC);
+    }
+
+}
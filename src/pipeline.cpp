@@ -0,0 +1,417 @@
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <endian.h>
+#include <errno.h>
+#include <string.h>
+#include "tuxnet/log.h"
+#include "tuxnet/pipeline.h"
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    /***** framing_codec *****/
+
+    // Destructor.
+    framing_codec::~framing_codec()
+    {
+    }
+
+    /***** line_codec *****/
+
+    // Finds the first line.
+    int line_codec::decode(const char* data, size_t length,
+        frame_info& frame) const
+    {
+        const char* end = static_cast<const char*>(memchr(data, '\n',
+            length));
+        if (end == nullptr) return 0;
+        frame.length = end - data + 1;
+        frame.payload_offset = 0;
+        frame.payload_length = end - data;
+        if ((frame.payload_length > 0) and (end[-1] == '\r'))
+        {
+            frame.payload_length--;
+        }
+        frame.id = 0;
+        return 1;
+    }
+
+    // Terminates the payload with a newline.
+    void line_codec::encode(uint64_t id, const char* payload, size_t length,
+        std::string& out) const
+    {
+        out.assign(payload, length);
+        out.push_back('\n');
+    }
+
+    // Lines are matched in order.
+    bool line_codec::tagged() const
+    {
+        return false;
+    }
+
+    /***** length_prefixed_codec *****/
+
+    // Constructor.
+    length_prefixed_codec::length_prefixed_codec(bool tagged,
+        uint32_t max_payload) :
+        m_tagged(tagged),
+        m_max_payload(max_payload)
+    {
+    }
+
+    // Finds the first frame.
+    int length_prefixed_codec::decode(const char* data, size_t length,
+        frame_info& frame) const
+    {
+        size_t header = (m_tagged == true) ? 12 : 4;
+        if (length < header) return 0;
+        uint32_t payload = 0;
+        memcpy(&payload, data, sizeof(payload));
+        payload = be32toh(payload);
+        if (payload > m_max_payload) return -1;
+        if (length - header < payload) return 0;
+        frame.length = header + payload;
+        frame.payload_offset = header;
+        frame.payload_length = payload;
+        frame.id = 0;
+        if (m_tagged == true)
+        {
+            memcpy(&frame.id, data + 4, sizeof(frame.id));
+            frame.id = be64toh(frame.id);
+        }
+        return 1;
+    }
+
+    // Prepends the length, and the id if tagged.
+    void length_prefixed_codec::encode(uint64_t id, const char* payload,
+        size_t length, std::string& out) const
+    {
+        size_t header = (m_tagged == true) ? 12 : 4;
+        out.resize(header + length);
+        uint32_t size = htobe32(uint32_t(length));
+        memcpy(&out[0], &size, sizeof(size));
+        if (m_tagged == true)
+        {
+            uint64_t tag = htobe64(id);
+            memcpy(&out[4], &tag, sizeof(tag));
+        }
+        if (length > 0) memcpy(&out[header], payload, length);
+    }
+
+    // Whether frames carry a request id.
+    bool length_prefixed_codec::tagged() const
+    {
+        return m_tagged;
+    }
+
+    /***** pipelined_client *****/
+
+    /// Requests in flight on a connection.
+    struct pipelined_client::pipeline
+    {
+        /// Serializes writes, so requests go out in the order they queued.
+        std::mutex write_lock;
+        /// Guards everything up to received.
+        std::mutex lock;
+        /// Signalled when a request completes or the connection closes.
+        std::condition_variable room;
+        /// Requests in flight, oldest first (untagged codecs).
+        std::deque<pipeline_completion> ordered;
+        /// Requests in flight by id (tagged codecs).
+        std::unordered_map<uint64_t, pipeline_completion> by_id;
+        /// Requests reserved or in flight.
+        int in_flight = 0;
+        /// Id of the next request.
+        uint64_t next_id = 0;
+        /// Set once the connection closed.
+        bool closed = false;
+        /// References : the connection's until it closes, and send()'s.
+        std::atomic<int> references{1};
+        /// Received data not decoded yet, connection's thread only.
+        std::string received;
+    };
+
+    namespace
+    {
+
+        /// Bytes read from a connection at once.
+        const int receive_chunk = 65536;
+
+        /// Frame buffer of the calling thread, reused by send().
+        thread_local std::string t_frame;
+
+        /// Pipeline the calling thread writes to, in send().
+        thread_local const void* t_writing = nullptr;
+
+    }
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    pipelined_client::pipelined_client(const framing_codec* codec,
+        int window) :
+        m_codec(codec),
+        m_window((window > 0) ? window : 1)
+    {
+    }
+
+    // Destructor.
+    pipelined_client::~pipelined_client()
+    {
+        // Fail the requests in flight while on_closed() still reaches us.
+        close_all();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Gets the number of requests in flight.
+    int pipelined_client::in_flight(peer* remote_peer)
+    {
+        pipeline* state = m_pin(remote_peer);
+        if (state == nullptr) return 0;
+        int result = 0;
+        {
+            std::lock_guard<std::mutex> lock(state->lock);
+            result = state->in_flight;
+        }
+        m_unref(state);
+        return result;
+    }
+
+    // Sends a request.
+    bool pipelined_client::send(peer* remote_peer, const char* payload,
+        size_t length, pipeline_completion done, int timeout_ms)
+    {
+        pipeline* state = m_pin(remote_peer);
+        if (state == nullptr)
+        {
+            errno = ENOTCONN;
+            return false;
+        }
+        {
+            // Reserve room first, so waiting doesn't block other writers.
+            std::unique_lock<std::mutex> lock(state->lock);
+            auto has_room = [this, state](){
+                return (state->closed == true)
+                    or (state->in_flight < m_window);
+            };
+            if (timeout_ms < 0) state->room.wait(lock, has_room);
+            else if (timeout_ms > 0)
+            {
+                state->room.wait_for(lock,
+                    std::chrono::milliseconds(timeout_ms), has_room);
+            }
+            if ((state->closed == true) or (state->in_flight >= m_window))
+            {
+                if (state->closed == true) errno = ENOTCONN;
+                else errno = (timeout_ms == 0) ? EAGAIN : ETIMEDOUT;
+                lock.unlock();
+                m_unref(state);
+                return false;
+            }
+            state->in_flight++;
+        }
+        bool queued = false;
+        {
+            std::lock_guard<std::mutex> write_lock(state->write_lock);
+            uint64_t id = 0;
+            {
+                std::lock_guard<std::mutex> lock(state->lock);
+                // Closing reset in_flight, the reservation is gone.
+                if (state->closed != true)
+                {
+                    id = state->next_id++;
+                    if (m_codec->tagged() == true)
+                    {
+                        state->by_id.emplace(id, std::move(done));
+                    }
+                    else state->ordered.push_back(std::move(done));
+                    queued = true;
+                }
+            }
+            if (queued == true)
+            {
+                std::string& frame = t_frame;
+                m_codec->encode(id, payload, length, frame);
+                /* If this fails, closing the connection fails the request.
+                 * The peer is still there : on_disconnect() waits for
+                 * write_lock before it returns and the peer is deleted. */
+                t_writing = state;
+                remote_peer->write_bytes(frame.data(), frame.size());
+                t_writing = nullptr;
+            }
+        }
+        m_unref(state);
+        if (queued != true) errno = ENOTCONN;
+        return queued;
+    }
+
+    // Gets the number of requests in flight per connection.
+    int pipelined_client::get_window() const
+    {
+        return m_window;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Completes a request with a response.
+    bool pipelined_client::m_complete(pipeline* state, const char* data,
+        const frame_info& frame)
+    {
+        pipeline_completion done;
+        {
+            std::lock_guard<std::mutex> lock(state->lock);
+            if (m_codec->tagged() == true)
+            {
+                auto found = state->by_id.find(frame.id);
+                if (found == state->by_id.end()) return false;
+                done = std::move(found->second);
+                state->by_id.erase(found);
+            }
+            else
+            {
+                if (state->ordered.empty() == true) return false;
+                done = std::move(state->ordered.front());
+                state->ordered.pop_front();
+            }
+            state->in_flight--;
+        }
+        // Only one sender at a time waits for room.
+        state->room.notify_one();
+        if (done) done(data + frame.payload_offset, frame.payload_length, 0);
+        return true;
+    }
+
+    // Gets the pipeline of a connection, referenced.
+    pipelined_client::pipeline* pipelined_client::m_pin(peer* remote_peer)
+    {
+        std::lock_guard<std::mutex> lock(m_pin_lock);
+        pipeline* state = static_cast<pipeline*>(remote_peer->get_context());
+        if (state != nullptr)
+        {
+            state->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        return state;
+    }
+
+    // Drops a reference to a pipeline, deleting it with the last.
+    void pipelined_client::m_unref(pipeline* state)
+    {
+        if (state->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete state;
+        }
+    }
+
+    // Events. ----------------------------------------------------------------
+
+    // Connection established.
+    void pipelined_client::on_ready(peer* remote_peer)
+    {
+    }
+
+    // Connection closed.
+    void pipelined_client::on_closed(peer* remote_peer)
+    {
+    }
+
+    // Sets up the pipeline of a new connection.
+    void pipelined_client::on_connect(peer* remote_peer)
+    {
+        remote_peer->set_context(new pipeline);
+        on_ready(remote_peer);
+    }
+
+    // Decodes responses and completes their requests.
+    void pipelined_client::on_receive(peer* remote_peer)
+    {
+        // Completions can close the connection, the pipeline outlives it.
+        pipeline* state = m_pin(remote_peer);
+        if (state == nullptr) return;
+        char chunk[receive_chunk];
+        int count = receive_chunk;
+        while (count == receive_chunk)
+        {
+            count = remote_peer->read_bytes(chunk, receive_chunk);
+            // Nothing left, or closed and the peer went with it.
+            if (count <= 0) break;
+            std::string& received = state->received;
+            received.append(chunk, count);
+            size_t offset = 0;
+            while (offset < received.size())
+            {
+                frame_info frame;
+                int found = m_codec->decode(received.data() + offset,
+                    received.size() - offset, frame);
+                if (found == 0) break;
+                if (
+                    (found < 0)
+                    or (m_complete(state, received.data() + offset, frame)
+                        != true)
+                )
+                {
+                    log::get().info("Closing a pipelined connection after "
+                        "an unexpected response.");
+                    remote_peer->disconnect(DISCONNECT_REASON_ERROR);
+                    count = -1;
+                    break;
+                }
+                offset += frame.length;
+                // Closed by the completion, and the peer went with it.
+                std::lock_guard<std::mutex> lock(state->lock);
+                if (state->closed == true)
+                {
+                    count = -1;
+                    break;
+                }
+            }
+            if (count < 0) break;
+            received.erase(0, offset);
+        }
+        m_unref(state);
+    }
+
+    // Fails the requests in flight.
+    void pipelined_client::on_disconnect(peer* remote_peer)
+    {
+        pipeline* state = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_pin_lock);
+            state = static_cast<pipeline*>(remote_peer->get_context());
+            if (state == nullptr) return;
+            remote_peer->set_context(nullptr);
+        }
+        std::deque<pipeline_completion> ordered;
+        std::unordered_map<uint64_t, pipeline_completion> by_id;
+        {
+            std::lock_guard<std::mutex> lock(state->lock);
+            state->closed = true;
+            state->in_flight = 0;
+            ordered.swap(state->ordered);
+            by_id.swap(state->by_id);
+        }
+        state->room.notify_all();
+        // Writes in progress finish before the peer is deleted, unless
+        // it's this thread's write which failed.
+        if (t_writing != state)
+        {
+            std::lock_guard<std::mutex> write_lock(state->write_lock);
+        }
+        for (auto it = ordered.begin(); it != ordered.end(); ++it)
+        {
+            if (*it) (*it)(nullptr, 0, ECONNRESET);
+        }
+        for (auto it = by_id.begin(); it != by_id.end(); ++it)
+        {
+            if (it->second) it->second(nullptr, 0, ECONNRESET);
+        }
+        on_closed(remote_peer);
+        m_unref(state);
+    }
+
+}
@@ -0,0 +1,305 @@
+#include <mutex>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "tuxnet/client.h"
+#include "tuxnet/log.h"
+#include "tuxnet/proxy.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// Side of a pair accepted by the proxy.
+        const int side_client = 0;
+        /// Side of a pair connected to the backend.
+        const int side_backend = 1;
+
+        /// Bytes spliced at once, the default capacity of a pipe.
+        const size_t splice_chunk = 65536;
+
+    }
+
+    /// Accepted connection and its backend connection.
+    struct proxy::pair
+    {
+        /// Guards done, fds[side_backend] and resuming the client side.
+        std::mutex lock;
+        /// Peers by side, compared only, never used once done.
+        peer* sides[2] = { nullptr, nullptr };
+        /// Duplicates of the sides' sockets, which stay valid after their
+        /// peer is deleted, -1 until known.
+        int fds[2] = { -1, -1 };
+        /// Pipe per direction, pipes[side] carries what side sends.
+        int pipes[2][2] = { { -1, -1 }, { -1, -1 } };
+        /// Set once a side's peer is gone, or failed to connect.
+        bool done[2] = { false, false };
+    };
+
+    /// Backend connections of a proxy.
+    class proxy::upstream : public client
+    {
+
+        /// Proxy owning the connections.
+        proxy* const m_owner;
+
+        public:
+
+            /**
+             * Constructor.
+             * @param owner : Proxy owning the connections.
+             */
+            upstream(proxy* owner) : m_owner(owner)
+            {
+            }
+
+            /// Destructor.
+            ~upstream()
+            {
+                // Closed connections have to reach the proxy.
+                close_all();
+            }
+
+        protected:
+
+            void on_connect(peer* remote_peer) override
+            {
+                m_owner->m_backend_connected(remote_peer);
+            }
+
+            void on_connect_error(const socket_address* saddr, int error,
+                void* context) override
+            {
+                log::get().info(std::string("Could not connect to the proxy "
+                    "backend: ") + strerror(error) + ".");
+                m_owner->m_failed++;
+                m_owner->m_side_done(static_cast<pair*>(context),
+                    side_backend);
+            }
+
+            void on_receive(peer* remote_peer) override
+            {
+                pair* conn = static_cast<pair*>(remote_peer->get_context());
+                if (conn != nullptr) m_owner->m_forward(conn, remote_peer);
+            }
+
+            void on_disconnect(peer* remote_peer) override
+            {
+                pair* conn = static_cast<pair*>(remote_peer->get_context());
+                if (conn == nullptr) return;
+                remote_peer->set_context(nullptr);
+                m_owner->m_side_done(conn, side_backend);
+            }
+
+    };
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    proxy::proxy(const ip4_socket_address& backend, int connect_timeout_ms) :
+        m_backend(backend),
+        m_connect_timeout_ms(connect_timeout_ms),
+        m_upstream(new upstream(this)),
+        m_accepted(0),
+        m_failed(0),
+        m_active(0),
+        m_bytes_upstream(0),
+        m_bytes_downstream(0)
+    {
+    }
+
+    // Destructor.
+    proxy::~proxy()
+    {
+        delete m_upstream;
+        m_upstream = nullptr;
+    }
+
+    // Getters. ---------------------------------------------------------------
+
+    // Gets the backend address.
+    const ip4_socket_address& proxy::get_backend() const
+    {
+        return m_backend;
+    }
+
+    // Gets the proxy's counters.
+    proxy_stats proxy::get_proxy_stats() const
+    {
+        proxy_stats result = {};
+        result.accepted = m_accepted.load(std::memory_order_relaxed);
+        result.failed = m_failed.load(std::memory_order_relaxed);
+        result.active = m_active.load(std::memory_order_relaxed);
+        result.bytes_upstream = m_bytes_upstream.load(
+            std::memory_order_relaxed);
+        result.bytes_downstream = m_bytes_downstream.load(
+            std::memory_order_relaxed);
+        return result;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Pairs an established backend connection with its client.
+    void proxy::m_backend_connected(peer* backend_peer)
+    {
+        pair* conn = static_cast<pair*>(backend_peer->get_context());
+        if (conn == nullptr) return;
+        std::lock_guard<std::mutex> lock(conn->lock);
+        conn->sides[side_backend] = backend_peer;
+        conn->fds[side_backend] = fcntl(backend_peer->get_fd(),
+            F_DUPFD_CLOEXEC, 0);
+        if (
+            (conn->done[side_client] == true)
+            or (conn->fds[side_backend] == -1)
+        )
+        {
+            // The backend's thread disconnects it, which ends the pair.
+            ::shutdown(backend_peer->get_fd(), SHUT_RDWR);
+            if (conn->done[side_client] != true)
+            {
+                ::shutdown(conn->fds[side_client], SHUT_RDWR);
+            }
+            return;
+        }
+        // The client can't be gone, its on_disconnect waits for the lock.
+        conn->sides[side_client]->set_receiving(true);
+    }
+
+    // Closes and frees a pair whose sides are both done.
+    void proxy::m_delete(pair* conn)
+    {
+        for (int side = 0; side < 2; ++side)
+        {
+            if (conn->fds[side] != -1) ::close(conn->fds[side]);
+            if (conn->pipes[side][0] != -1) ::close(conn->pipes[side][0]);
+            if (conn->pipes[side][1] != -1) ::close(conn->pipes[side][1]);
+        }
+        delete conn;
+        m_active--;
+    }
+
+    // Moves data received on one side to the other.
+    void proxy::m_forward(pair* conn, peer* source)
+    {
+        int side = (source == conn->sides[side_client]) ? side_client
+            : side_backend;
+        int destination = conn->fds[1 - side];
+        int* pipe = conn->pipes[side];
+        /* A single splice per event : the socket is blocking, so a second
+         * one could wait for data, and epoll reports what's left anyway. */
+        ssize_t count = splice(source->get_fd(), nullptr, pipe[1], nullptr,
+            splice_chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (count == 0)
+        {
+            // Pass the half-close on, the other direction keeps going.
+            ::shutdown(destination, SHUT_WR);
+            source->set_receiving(false);
+            return;
+        }
+        if (count < 0)
+        {
+            if ((errno == EAGAIN) or (errno == EINTR)) return;
+            source->disconnect(DISCONNECT_REASON_ERROR);
+            return;
+        }
+        ssize_t left = count;
+        while (left > 0)
+        {
+            // Blocks while the destination's send buffer is full.
+            ssize_t sent = splice(pipe[0], nullptr, destination, nullptr,
+                left, SPLICE_F_MOVE);
+            if ((sent == -1) and (errno == EINTR)) continue;
+            if (sent <= 0)
+            {
+                source->disconnect(DISCONNECT_REASON_ERROR);
+                return;
+            }
+            left -= sent;
+        }
+        if (side == side_client) m_bytes_upstream += count;
+        else m_bytes_downstream += count;
+    }
+
+    // Marks a side of a pair as done, and closes the other side.
+    void proxy::m_side_done(pair* conn, int side)
+    {
+        bool finished = false;
+        {
+            std::lock_guard<std::mutex> lock(conn->lock);
+            conn->done[side] = true;
+            int other = 1 - side;
+            /* Only the other side's own thread may disconnect it, shutting
+             * the socket down makes it hang up. */
+            if ((conn->done[other] != true) and (conn->fds[other] != -1))
+            {
+                ::shutdown(conn->fds[other], SHUT_RDWR);
+            }
+            // A backend still connecting finishes the pair when it's done.
+            finished = (conn->done[side_client] == true)
+                and (conn->done[side_backend] == true);
+        }
+        if (finished == true) m_delete(conn);
+    }
+
+    // Events. ----------------------------------------------------------------
+
+    // Pairs an accepted connection with a new backend connection.
+    void proxy::on_connect(peer* remote_peer)
+    {
+        pair* conn = new pair;
+        conn->sides[side_client] = remote_peer;
+        conn->fds[side_client] = fcntl(remote_peer->get_fd(),
+            F_DUPFD_CLOEXEC, 0);
+        bool ready = (conn->fds[side_client] != -1)
+            and (pipe2(conn->pipes[side_client], O_CLOEXEC | O_NONBLOCK) == 0)
+            and (pipe2(conn->pipes[side_backend], O_CLOEXEC | O_NONBLOCK)
+                == 0);
+        m_accepted++;
+        m_active++;
+        if (ready == true)
+        {
+            // Keep the client's data in its socket until the backend is up.
+            ready = remote_peer->set_receiving(false);
+        }
+        if (ready != true)
+        {
+            log::get().info(std::string("Could not set up a proxied "
+                "connection: ") + strerror(errno) + ".");
+            m_failed++;
+            // The peer's thread hangs up, it isn't running yet.
+            ::shutdown(remote_peer->get_fd(), SHUT_RDWR);
+            m_delete(conn);
+            return;
+        }
+        remote_peer->set_context(conn);
+        if (m_upstream->connect(&m_backend, m_connect_timeout_ms, conn)
+            != true)
+        {
+            log::get().info(std::string("Could not connect to the proxy "
+                "backend: ") + strerror(errno) + ".");
+            m_failed++;
+            m_side_done(conn, side_backend);
+        }
+    }
+
+    // Forwards data from a client to the backend.
+    void proxy::on_receive(peer* remote_peer)
+    {
+        pair* conn = static_cast<pair*>(remote_peer->get_context());
+        if (conn != nullptr) m_forward(conn, remote_peer);
+    }
+
+    // Closes the backend connection of a client.
+    void proxy::on_disconnect(peer* remote_peer)
+    {
+        pair* conn = static_cast<pair*>(remote_peer->get_context());
+        if (conn == nullptr) return;
+        remote_peer->set_context(nullptr);
+        m_side_done(conn, side_client);
+    }
+
+}
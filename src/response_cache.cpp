@@ -0,0 +1,243 @@
+#include <strings.h>
+#include "tuxnet/http.h"
+#include "tuxnet/response_cache.h"
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        // Parses the status line of a response, returns its length.
+        size_t parse_status(const std::string& data, int& status)
+        {
+            // HTTP/1.x, a three digit code, then a reason or the line's end.
+            if (
+                (data.size() < 14) or (data.compare(0, 7, "HTTP/1.") != 0)
+                or (data[7] < '0') or (data[7] > '9') or (data[8] != ' ')
+                or (data[9] < '1') or (data[9] > '5')
+                or (data[10] < '0') or (data[10] > '9')
+                or (data[11] < '0') or (data[11] > '9')
+                or ((data[12] != ' ') and (data[12] != '\r'))
+            )
+            {
+                return 0;
+            }
+            size_t end = data.find("\r\n", 12);
+            if (end == std::string::npos) return 0;
+            status = (data[9] - '0') * 100 + (data[10] - '0') * 10
+                + (data[11] - '0');
+            return end + 2;
+        }
+
+        // Finds the value of the Date header in a response head.
+        size_t find_date(const std::string& data, size_t head_length)
+        {
+            // Skip the status line.
+            size_t line = data.find("\r\n");
+            while ((line != std::string::npos) and (line + 2 < head_length))
+            {
+                line += 2;
+                size_t end = data.find("\r\n", line);
+                if ((end == std::string::npos) or (end >= head_length)) break;
+                if (
+                    (end - line > 5)
+                    and (strncasecmp(data.data() + line, "Date:", 5) == 0)
+                )
+                {
+                    size_t value = line + 5;
+                    while ((value < end) and (data[value] == ' ')) value++;
+                    // Only a value of the same length can be patched.
+                    if (end - value == http_date_length) return value;
+                    return std::string::npos;
+                }
+                line = end;
+            }
+            return std::string::npos;
+        }
+
+    }
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    response_cache::response_cache(size_t max_bytes, int default_ttl_ms) :
+        m_bytes(0),
+        m_max_bytes(max_bytes),
+        m_default_ttl_ms(default_ttl_ms)
+    {
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Removes all responses.
+    void response_cache::clear()
+    {
+        for (shard& owner : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(owner.lock);
+            while (owner.entries.empty() != true)
+            {
+                m_erase(owner, owner.entries.begin());
+            }
+        }
+    }
+
+    // Gets a cached response.
+    cached_response_ptr response_cache::get(std::string_view key)
+    {
+        shard& owner = m_shard(key);
+        std::lock_guard<std::mutex> lock(owner.lock);
+        auto found = owner.index.find(key);
+        if (found == owner.index.end())
+        {
+            owner.misses++;
+            return nullptr;
+        }
+        std::list<entry>::iterator it = found->second;
+        uint64_t expires = it->response->expires;
+        if ((expires != 0) and (expires <= stats_clock()))
+        {
+            m_erase(owner, it);
+            owner.expirations++;
+            owner.misses++;
+            return nullptr;
+        }
+        if (it != owner.entries.begin())
+        {
+            owner.entries.splice(owner.entries.begin(), owner.entries, it);
+        }
+        owner.hits++;
+        return it->response;
+    }
+
+    // Removes a cached response.
+    bool response_cache::invalidate(std::string_view key)
+    {
+        shard& owner = m_shard(key);
+        std::lock_guard<std::mutex> lock(owner.lock);
+        auto found = owner.index.find(key);
+        if (found == owner.index.end()) return false;
+        m_erase(owner, found->second);
+        return true;
+    }
+
+    // Caches a serialized response.
+    cached_response_ptr response_cache::put(std::string_view key,
+        std::string response, int ttl_ms)
+    {
+        int status = 0;
+        size_t status_length = parse_status(response, status);
+        size_t head_end = response.find("\r\n\r\n");
+        size_t size = key.size() + response.size();
+        if (
+            (status_length == 0) or (head_end == std::string::npos)
+            or (size > m_max_bytes)
+        )
+        {
+            return nullptr;
+        }
+        if (ttl_ms < 0) ttl_ms = m_default_ttl_ms;
+        std::shared_ptr<cached_response> cached =
+            std::make_shared<cached_response>();
+        cached->data = std::move(response);
+        cached->status = status;
+        cached->status_length = status_length;
+        cached->head_length = head_end + 4;
+        cached->date_offset = find_date(cached->data, cached->head_length);
+        cached->expires = 0;
+        if (ttl_ms > 0)
+        {
+            cached->expires = stats_clock() + uint64_t(ttl_ms) * 1000000;
+        }
+        shard& owner = m_shard(key);
+        {
+            std::lock_guard<std::mutex> lock(owner.lock);
+            auto found = owner.index.find(key);
+            if (found != owner.index.end()) m_erase(owner, found->second);
+            owner.entries.push_front(entry{ std::string(key), cached });
+            owner.index.emplace(owner.entries.front().key,
+                owner.entries.begin());
+            m_bytes.fetch_add(size, std::memory_order_relaxed);
+            // The new entry fits on its own, so it's never the one evicted.
+            m_evict(owner, 1);
+        }
+        // Then the other shards, holding a single lock at a time.
+        for (shard& other : m_shards)
+        {
+            if (m_bytes.load(std::memory_order_relaxed) <= m_max_bytes) break;
+            if (&other == &owner) continue;
+            std::lock_guard<std::mutex> lock(other.lock);
+            m_evict(other, 0);
+        }
+        return cached;
+    }
+
+    // Gets the cache's counters.
+    response_cache_stats response_cache::stats()
+    {
+        response_cache_stats result = {};
+        for (shard& owner : m_shards)
+        {
+            std::lock_guard<std::mutex> lock(owner.lock);
+            result.entries += owner.entries.size();
+            result.hits += owner.hits;
+            result.misses += owner.misses;
+            result.evictions += owner.evictions;
+            result.expirations += owner.expirations;
+        }
+        result.bytes = m_bytes.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    // Serializes a response.
+    std::string response_cache::serialize(int status, std::string_view body,
+        std::string_view content_type, std::string_view headers)
+    {
+        std::string result = "HTTP/1.1 " + std::to_string(status) + " "
+            + http_status_text(status) + "\r\nDate: " + http_date() + "\r\n";
+        if (content_type.empty() != true)
+        {
+            result += "Content-Type: ";
+            result += content_type;
+            result += "\r\n";
+        }
+        result += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        result += headers;
+        result += "\r\n";
+        result += body;
+        return result;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Removes an entry.
+    void response_cache::m_erase(shard& owner, std::list<entry>::iterator it)
+    {
+        m_bytes.fetch_sub(it->key.size() + it->response->data.size(),
+            std::memory_order_relaxed);
+        owner.index.erase(it->key);
+        owner.entries.erase(it);
+    }
+
+    // Evicts the least recently used entries of a shard.
+    void response_cache::m_evict(shard& owner, size_t keep)
+    {
+        while (
+            (m_bytes.load(std::memory_order_relaxed) > m_max_bytes)
+            and (owner.entries.size() > keep)
+        )
+        {
+            m_erase(owner, std::prev(owner.entries.end()));
+            owner.evictions++;
+        }
+    }
+
+    // Gets the shard of a key.
+    response_cache::shard& response_cache::m_shard(std::string_view key)
+    {
+        return m_shards[std::hash<std::string_view>()(key) % shard_count];
+    }
+
+}
@@ -23,11 +23,15 @@ namespace tuxnet
 
     // Constructor.
     server::server() : 
+        m_admin(nullptr),
         m_keepalive(true), 
         m_keepalive_interval(5),
         m_keepalive_retries(3), 
         m_keepalive_timeout(10),
-        m_listen_sockets({})
+        m_listen_options(),
+        m_listen_sockets({}),
+        m_tcp_sampler(&m_listen_sockets),
+        m_watchdog(&m_stats)
     {
         
     }
@@ -35,6 +39,10 @@ namespace tuxnet
     // Destructor
     server::~server()
     {
+        // The sampler walks the peers of the sockets deleted below.
+        m_tcp_sampler.stop();
+        delete m_admin;
+        m_admin = nullptr;
         m_listen_sockets.lock();
         for (auto it = m_listen_sockets.get().begin(); 
             it != m_listen_sockets.get().end(); ++it)
@@ -51,6 +59,7 @@ namespace tuxnet
     bool server::m_poll_single(socket* const sock)
     {
         if (sock == nullptr) return false;
+        stats_scope scope(sock->m_stats);
         while(sock->poll() == true){ }
         return true;
     }
@@ -67,8 +76,21 @@ namespace tuxnet
         m_keepalive_retries = retries;
     }
 
+    // Configures the default listen socket tuning options.
+    void server::configure_listen(const listen_options& options)
+    {
+        m_listen_options = options;
+    }
+
     // Start listening for connections.
     bool server::listen(const socket_addresses& saddrs, const layer4_protocol& proto)
+    {
+        return listen(saddrs, proto, m_listen_options);
+    }
+
+    // Start listening for connections with tuning options.
+    bool server::listen(const socket_addresses& saddrs,
+        const layer4_protocol& proto, const listen_options& options)
     {
         int domain = AF_INET; 
         int type = SOCK_STREAM;
@@ -83,6 +105,7 @@ namespace tuxnet
             sock->set_keepalive_interval(m_keepalive_interval);
             sock->set_keepalive_retry(m_keepalive_retries);
             sock->set_keepalive_timeout(m_keepalive_timeout);
+            sock->set_listen_options(options);
             // Listen on socket.
             if (sock->listen(*it, this) == true)
             {
@@ -98,6 +121,13 @@ namespace tuxnet
         return !err;
     }
 
+    // Starts an admin listener serving metrics.
+    bool server::listen_admin(const socket_address* const saddr)
+    {
+        if (m_admin == nullptr) m_admin = new admin_listener(&m_stats);
+        return m_admin->listen(saddr);
+    }
+
     // Return number of connected clients.
     int server::num_clients()
     {
@@ -130,6 +160,8 @@ namespace tuxnet
         if (num_threads < m_listen_sockets.get().size())
             num_threads = m_listen_sockets.get().size();
         log::get().info("Starting "+std::to_string(num_threads)+" server threads.");
+        m_watchdog.start();
+        m_tcp_sampler.start();
         std::vector<std::thread*> threads;
         sockets::iterator sock_it = m_listen_sockets.get().begin();
         for (int thread_id = 0; thread_id < num_threads; ++thread_id)
@@ -153,6 +185,55 @@ namespace tuxnet
         return result;
     }
 
+    // Gets the server's counters.
+    stats_snapshot server::stats()
+    {
+        return m_stats.snapshot();
+    }
+
+    // Gets event callback latency percentiles.
+    latency_summary server::latency(latency_metric metric, int window)
+    {
+        return m_stats.latency(metric, window);
+    }
+
+    // Gets recent event loop stalls.
+    stall_reports server::stalls()
+    {
+        return m_watchdog.reports();
+    }
+
+    // Gets the distribution of TCP state over all peers.
+    tcp_info_summary server::tcp_summary()
+    {
+        return m_tcp_sampler.summary();
+    }
+
+    // Gets the remote addresses with the most traffic.
+    heavy_hitter_list server::top_clients(heavy_hitter_metric metric,
+        int count)
+    {
+        return m_heavy_hitters.top(metric, count);
+    }
+
+    // Resets the counts behind top_clients().
+    void server::clear_top_clients()
+    {
+        m_heavy_hitters.clear();
+    }
+
+    // Gets peers recently flagged as retransmitting.
+    retransmit_reports server::retransmitting_peers()
+    {
+        return m_tcp_sampler.reports();
+    }
+
+    // Gets busy and idle time per event loop thread.
+    thread_utilizations server::utilization()
+    {
+        return m_stats.utilization();
+    }
+
     // Events. ----------------------------------------------------------------
 
     void server::on_connect(peer* remote_peer)
@@ -4,9 +4,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <iostream>
+#include <fstream>
 #include <sys/epoll.h>
 #include <netinet/tcp.h>
+#include "tuxnet/client.h"
 #include "tuxnet/log.h"
 #include "tuxnet/socket.h"
 #include "tuxnet/peer.h"
@@ -14,6 +15,10 @@
 #include "tuxnet/event.h"
 #include "tuxnet/config.h"
 
+#ifndef IP_LOCAL_PORT_RANGE
+#define IP_LOCAL_PORT_RANGE 51
+#endif
+
 namespace tuxnet
 {
 
@@ -21,33 +26,34 @@ namespace tuxnet
 
     // Constructor with local/remote saddrs.
     socket::socket(const layer4_protocol& proto) :
-        m_epoll_listener_events(nullptr), 
         m_epoll_listener_fd(0), 
         m_listen_socket_fd(0),
         m_keepalive(true),
         m_keepalive_interval(5),
         m_keepalive_retry(3),
         m_keepalive_timeout(10),
+        m_connect_options(),
+        m_connect_context(nullptr),
+        m_listen_options(),
         m_local_saddr(nullptr),
         m_peers({}),
         m_proto(proto),
         m_remote_saddr(nullptr), 
+        m_client(nullptr),
         m_server(nullptr),
-        m_state(SOCKET_STATE_UNINITIALIZED)
+        m_state(SOCKET_STATE_UNINITIALIZED),
+        m_stats(nullptr),
+        m_heavy_hitters(nullptr)
     {
         m_listen_socket_fd = ::socket(AF_INET, SOCK_STREAM, layer4_to_proto(proto));
-        m_epoll_listener_events = new epoll_event[
-            config::get().get_listen_socket_epoll_max_events()]();
     }
 
     // Destructor.
     socket::~socket()
     {
         close();
-        if (m_epoll_listener_events != nullptr)
-        {
-            delete[] m_epoll_listener_events;
-        }
+        delete m_remote_saddr;
+        m_remote_saddr = nullptr;
     }
 
     // Getters / setters. -----------------------------------------------------
@@ -76,6 +82,18 @@ namespace tuxnet
         return m_keepalive_timeout;
     }
 
+    // Gets the source address options used when connecting.
+    const connect_options& socket::get_connect_options() const
+    {
+        return m_connect_options;
+    }
+
+    // Gets the tuning options used when listening.
+    const listen_options& socket::get_listen_options() const
+    {
+        return m_listen_options;
+    }
+
     // Gets ip/port information for local side of the connection.
     const socket_address* const socket::get_local() const
     {
@@ -94,6 +112,12 @@ namespace tuxnet
         return m_remote_saddr;
     }
 
+    // Sets the source address options used when connecting.
+    void socket::set_connect_options(const connect_options& options)
+    {
+        m_connect_options = options;
+    }
+
     // Sets whether or not keepalive should be enabled for this socket.
     void socket::set_keepalive(bool keepalive_enabled)
     {
@@ -118,6 +142,12 @@ namespace tuxnet
         m_keepalive_timeout = timeout;
     }
 
+    // Sets the tuning options used when listening.
+    void socket::set_listen_options(const listen_options& options)
+    {
+        m_listen_options = options;
+    }
+
     // Public methods. --------------------------------------------------------
 
     // Binds the socket to an address/port pair.
@@ -142,11 +172,12 @@ namespace tuxnet
     {
         // Bind the socket.
         if (socket::bind(saddr) != true) return false;
+        // Apply tuning options which have to be set before listening.
+        if (m_apply_listen_options() != true) return false;
         // Listen on the socket.
-        /**
-         * @todo : configurable backlog with net.core.somaxconn as default.
-         */
-        if (::listen(m_listen_socket_fd,5) == -1)
+        int backlog = m_listen_options.backlog;
+        if (backlog < 1) backlog = m_somaxconn();
+        if (::listen(m_listen_socket_fd, backlog) == -1)
         {
             std::string errstr = "Could not listen on socket (error ";
             errstr += std::to_string(errno) + " : ";
@@ -167,6 +198,11 @@ namespace tuxnet
         {
             m_state = SOCKET_STATE_LISTENING;
             m_server = server_object;
+            if (m_server != nullptr)
+            {
+                m_stats = &m_server->m_stats;
+                m_heavy_hitters = &m_server->m_heavy_hitters;
+            }
             return true;
         }
         return false;
@@ -183,13 +219,16 @@ namespace tuxnet
         if (m_listen_socket_fd != 0) 
         {
             shutdown(m_listen_socket_fd, SHUT_RDWR);
+            ::close(m_listen_socket_fd);
             m_listen_socket_fd = 0;
         }
+        thread_stats& stats = stats_registry::local();
         for (auto it = m_peers.get().begin(); it != m_peers.get().end(); ++it)
         {
             if ((*it) != nullptr)
             {
                 shutdown((*it)->get_fd(), SHUT_RDWR);
+                stat_add(stats.disconnects[DISCONNECT_REASON_SHUTDOWN]);
             }
             delete (*it);
             (*it) = nullptr;
@@ -198,6 +237,58 @@ namespace tuxnet
         m_state = SOCKET_STATE_CLOSED;
     }
 
+    // Starts connecting to an address/port pair.
+    bool socket::connect(const socket_address* const saddr,
+        client* client_object)
+    {
+        if ((saddr == nullptr) or (saddr->get_protocol() != L3_PROTO_IP4))
+        {
+            /// @todo handle ipv6
+            log::get().info("Could not connect (only IPv4 is supported).");
+            errno = EAFNOSUPPORT;
+            return false;
+        }
+        const ip4_socket_address* p4saddr = static_cast<
+            const ip4_socket_address*>(saddr);
+        delete m_remote_saddr;
+        m_remote_saddr = new ip4_socket_address(*p4saddr);
+        m_client = client_object;
+        if (m_client != nullptr) m_stats = &m_client->m_stats;
+        if (
+            (m_enable_keepalive(m_listen_socket_fd) != true)
+            or (m_make_fd_nonblocking(m_listen_socket_fd) != true)
+        )
+        {
+            errno = EINVAL;
+            return false;
+        }
+        if (m_bind_source() != true)
+        {
+            m_state = SOCKET_STATE_CLOSED;
+            return false;
+        }
+        const sockaddr_in remote = p4saddr->get_sockaddr_in();
+        int result = ::connect(m_listen_socket_fd,
+            reinterpret_cast<const sockaddr*>(&remote), sizeof(remote));
+        if ((result == -1) and (errno != EINPROGRESS))
+        {
+            int error = errno;
+            std::string errstr = "Could not connect to ";
+            errstr += p4saddr->get_ip().as_string() + ":";
+            errstr += std::to_string(ntohs(p4saddr->get_port()));
+            errstr += " : ";
+            errstr += strerror(error);
+            errstr += " (errno=" + std::to_string(error) + ")";
+            log::get().info(errstr);
+            m_state = SOCKET_STATE_CLOSED;
+            errno = error;
+            return false;
+        }
+        // Even an immediate success completes through the connector.
+        m_state = SOCKET_STATE_CONNECTING;
+        return true;
+    }
+
     // Disconnects a remote peer.
     void socket::disconnect(peer* client)
     {
@@ -217,21 +308,33 @@ namespace tuxnet
                 " which it can be polled.");
             return false;
         }
-        /* Call epoll_wait to fetch a bunch of events and
-         * loop through them to handle them. */
-        /// @todo make last argument to epoll_wait configurable (timeout).
-        int event_count = epoll_wait(
+        /* Several server threads may poll the same socket, so each of them
+         * gets its own event buffer. Batch size bounds, timeout and
+         * busy-polling are re-read from the config on every call so they can
+         * be tuned on a running server. */
+        static thread_local event_batch events(
+            config::get().get_listen_socket_epoll_min_events());
+        thread_stats& stats = stats_registry::local();
+        stats.wait_begin();
+        int event_count = events.wait(
             m_epoll_listener_fd, 
-            m_epoll_listener_events, 
+            config::get().get_listen_socket_epoll_min_events(),
             config::get().get_listen_socket_epoll_max_events(), 
-            -1);
+            config::get().get_listen_socket_epoll_timeout(),
+            config::get().get_busy_poll_usec());
+        uint64_t ready = stats.wait_end();
+        if (event_count > 0)
+        {
+            stat_add(stats.epoll_wakeups);
+            stat_add(stats.epoll_events, event_count);
+        }
         for (int n_event = 0 ; n_event < event_count ; ++n_event)
         {
-            int event_fd = m_epoll_listener_events[n_event].data.fd;
+            int event_fd = events[n_event].data.fd;
             if (
-                (m_epoll_listener_events[n_event].events & EPOLLERR)
-                or (m_epoll_listener_events[n_event].events & EPOLLHUP)
-                or (not (m_epoll_listener_events[n_event].events & EPOLLIN))
+                (events[n_event].events & EPOLLERR)
+                or (events[n_event].events & EPOLLHUP)
+                or (not (events[n_event].events & EPOLLIN))
             ) 
             {
                 close();
@@ -252,8 +355,19 @@ namespace tuxnet
                         m_peers.unlock();
                         if (m_server != nullptr)
                         {
+                            uint64_t start = stats_clock();
+                            stats.record(LATENCY_DISPATCH_DELAY,
+                                start - ready);
+                            bool tracked = stats.begin_callback(
+                                LATENCY_CONNECT, my_peer->get_fd(),
+                                my_peer->get_saddr());
                             on_connect(my_peer);
+                            if (tracked == true) stats.end_callback();
+                            stats.record(LATENCY_CONNECT,
+                                stats_clock() - start);
                         }
+                        // Only now the peer's own thread may delete it.
+                        my_peer->start();
                     }
                 }
             }
@@ -268,6 +382,76 @@ namespace tuxnet
 
     // Private methods. -------------------------------------------------------
 
+    // Applies listen options to the listening socket.
+    bool socket::m_apply_listen_options()
+    {
+        const listen_options& opt = m_listen_options;
+        int fd = m_listen_socket_fd;
+        if ((opt.receive_buffer > 0) and (m_setsockopt(fd, SOL_SOCKET,
+            SO_RCVBUF, opt.receive_buffer, "SOL_SOCKET, SO_RCVBUF") != true))
+        {
+            return false;
+        }
+        if ((opt.send_buffer > 0) and (m_setsockopt(fd, SOL_SOCKET,
+            SO_SNDBUF, opt.send_buffer, "SOL_SOCKET, SO_SNDBUF") != true))
+        {
+            return false;
+        }
+        if (m_proto != L4_PROTO_TCP) return true;
+        if ((opt.defer_accept > 0) and (m_setsockopt(fd, IPPROTO_TCP,
+            TCP_DEFER_ACCEPT, opt.defer_accept,
+            "IPPROTO_TCP, TCP_DEFER_ACCEPT") != true))
+        {
+            return false;
+        }
+        if ((opt.fastopen_queue > 0) and (m_setsockopt(fd, IPPROTO_TCP,
+            TCP_FASTOPEN, opt.fastopen_queue,
+            "IPPROTO_TCP, TCP_FASTOPEN") != true))
+        {
+            return false;
+        }
+        if ((opt.nodelay == true) and (m_setsockopt(fd, IPPROTO_TCP,
+            TCP_NODELAY, 1, "IPPROTO_TCP, TCP_NODELAY") != true))
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // Applies listen options to an accepted connection.
+    bool socket::m_apply_peer_options(int fd)
+    {
+        int busy_poll = config::get().get_busy_poll_usec();
+        if (busy_poll > 0)
+        {
+            /* Raising SO_BUSY_POLL above net.core.busy_read needs
+             * CAP_NET_ADMIN, without it we only spin in epoll_wait. */
+            static std::atomic<bool> warned(false);
+            if ((setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll,
+                sizeof(busy_poll)) == -1) and (warned.exchange(true) != true))
+            {
+                std::string errstr = "setsockopt(...SOL_SOCKET, SO_BUSY_POLL";
+                errstr += "...) failed: ";
+                errstr += strerror(errno);
+                errstr += ", falling back to busy-polling epoll_wait only.";
+                log::get().info(errstr);
+            }
+        }
+        if (m_proto != L4_PROTO_TCP) return true;
+        if ((m_listen_options.nodelay == true) and (m_setsockopt(fd,
+            IPPROTO_TCP, TCP_NODELAY, 1, "IPPROTO_TCP, TCP_NODELAY") != true))
+        {
+            return false;
+        }
+        if ((m_listen_options.quickack == true) and (m_setsockopt(fd,
+            IPPROTO_TCP, TCP_QUICKACK, 1, "IPPROTO_TCP, TCP_QUICKACK")
+            != true))
+        {
+            return false;
+        }
+        return true;
+    }
+
     // Enables keepalive on the socket.
     bool socket::m_enable_keepalive(int fd)
     {
@@ -320,6 +504,73 @@ namespace tuxnet
         return true;
     }
 
+    // Binds a connecting socket to the source address options.
+    bool socket::m_bind_source()
+    {
+        const connect_options& opt = m_connect_options;
+        bool ranged = (opt.source_port_min > 0)
+            and (opt.source_port_max >= opt.source_port_min)
+            and (opt.source_port_max <= 65535);
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr = opt.source.as_in_addr();
+        if ((ranged != true) and (local.sin_addr.s_addr == INADDR_ANY))
+        {
+            return true;
+        }
+        int fd = m_listen_socket_fd;
+        int one = 1;
+        // Leave picking the port to connect(), which knows the destination.
+        if (setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one,
+            sizeof(one)) == -1)
+        {
+            log::get().info(std::string("Could not set "
+                "IP_BIND_ADDRESS_NO_PORT: ") + strerror(errno) + ".");
+        }
+        bool manual = false;
+        if (ranged == true)
+        {
+            uint32_t range = (uint32_t(opt.source_port_max) << 16)
+                | uint32_t(opt.source_port_min);
+            manual = setsockopt(fd, IPPROTO_IP, IP_LOCAL_PORT_RANGE, &range,
+                sizeof(range)) == -1;
+        }
+        if (manual != true)
+        {
+            if (::bind(fd, reinterpret_cast<const sockaddr*>(&local),
+                sizeof(local)) == 0)
+            {
+                return true;
+            }
+        }
+        else
+        {
+            // No IP_LOCAL_PORT_RANGE, take turns over the range instead.
+            static std::atomic<uint32_t> next_port(0);
+            uint32_t count = opt.source_port_max - opt.source_port_min + 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            errno = EADDRINUSE;
+            for (uint32_t attempt = 0; attempt < count; ++attempt)
+            {
+                uint32_t port = opt.source_port_min
+                    + next_port.fetch_add(1, std::memory_order_relaxed)
+                    % count;
+                local.sin_port = htons(port);
+                if (::bind(fd, reinterpret_cast<const sockaddr*>(&local),
+                    sizeof(local)) == 0)
+                {
+                    return true;
+                }
+                if (errno != EADDRINUSE) break;
+            }
+        }
+        int error = errno;
+        log::get().info(std::string("Could not bind the source address ")
+            + opt.source.as_string() + ": " + strerror(error) + ".");
+        errno = error;
+        return false;
+    }
+
     // Bind socket to an IPv4 address.
     bool socket::m_ip4_bind()
     {
@@ -332,6 +583,13 @@ namespace tuxnet
             const ip4_socket_address*>(m_local_saddr);
         assert(p4saddr);
         const sockaddr_in saddr = p4saddr->get_sockaddr_in();
+        /* Connections we closed linger in TIME_WAIT, don't let them keep a
+         * restarted server from binding. */
+        if (m_setsockopt(m_listen_socket_fd, SOL_SOCKET, SO_REUSEADDR, 1,
+            "SOL_SOCKET, SO_REUSEADDR") != true)
+        {
+            return false;
+        }
         int result = ::bind(m_listen_socket_fd, 
             reinterpret_cast<const sockaddr*>(&saddr), 
             sizeof(saddr));
@@ -388,12 +646,102 @@ namespace tuxnet
         return true;
     }
 
+    // Reads net.core.somaxconn.
+    int socket::m_somaxconn()
+    {
+        int result = 0;
+        std::ifstream in("/proc/sys/net/core/somaxconn");
+        if ((in >> result) and (result > 0)) return result;
+        return SOMAXCONN;
+    }
+
+    // Sets an integer socket option.
+    bool socket::m_setsockopt(int fd, int level, int option, int value,
+        const char* name)
+    {
+        if (setsockopt(fd, level, option, &value, sizeof(value)) == -1)
+        {
+            std::string errstr = "setsockopt(...";
+            errstr += name;
+            errstr += "...) failed: ";
+            errstr += strerror(errno);
+            errstr += " (errno=" + std::to_string(errno) + ", ";
+            errstr += "fd=" + std::to_string(fd) + ")";
+            log::get().info(errstr);
+            return false;
+        }
+        return true;
+    }
+
+    // Completes a connection attempt started by connect().
+    int socket::m_finish_connect()
+    {
+        if (m_state != SOCKET_STATE_CONNECTING) return EINVAL;
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(m_listen_socket_fd, SOL_SOCKET, SO_ERROR, &error,
+            &length) == -1)
+        {
+            error = errno;
+        }
+        if (error != 0)
+        {
+            m_state = SOCKET_STATE_CLOSED;
+            return error;
+        }
+        // Peers write blocking, like accepted sockets do.
+        int flags = fcntl(m_listen_socket_fd, F_GETFL, 0);
+        if (
+            (flags == -1)
+            or (fcntl(m_listen_socket_fd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+        )
+        {
+            error = errno;
+            m_state = SOCKET_STATE_CLOSED;
+            return error;
+        }
+        const sockaddr_in remote = static_cast<const ip4_socket_address*>(
+            m_remote_saddr)->get_sockaddr_in();
+        peer* my_peer = new peer(m_listen_socket_fd, remote, this);
+        // The peer owns the file descriptor from now on.
+        m_listen_socket_fd = 0;
+        if (my_peer->initialize() != true)
+        {
+            delete my_peer;
+            m_state = SOCKET_STATE_CLOSED;
+            return EIO;
+        }
+        m_state = SOCKET_STATE_CONNECTED;
+        my_peer->set_context(m_connect_context);
+        my_peer->m_record(FLIGHT_CONNECT);
+        m_peers.lock();
+        m_peers.get().push_back(my_peer);
+        m_peers.unlock();
+        thread_stats& stats = stats_registry::local();
+        uint64_t start = stats_clock();
+        bool tracked = stats.begin_callback(LATENCY_CONNECT,
+            my_peer->get_fd(), my_peer->get_saddr());
+        on_connect(my_peer);
+        if (tracked == true) stats.end_callback();
+        stats.record(LATENCY_CONNECT, stats_clock() - start);
+        // Only now the peer's own thread may delete it.
+        my_peer->start();
+        return 0;
+    }
+
     // Remove a peer, cleanup after a client disconnects.
     void socket::remove_peer(peer* client)
     {
         if (client == nullptr) return;
         // Fire event.
+        thread_stats& stats = stats_registry::local();
+        uint64_t start = stats_clock();
+        bool tracked = stats.begin_callback(LATENCY_DISCONNECT,
+            client->get_fd(), client->get_saddr());
         on_disconnect(client);
+        if (tracked == true) stats.end_callback();
+        stats.record(LATENCY_DISCONNECT, stats_clock() - start);
+        client->m_record(FLIGHT_REMOVE);
         // Find peer.
         m_peers.lock();
         auto it = m_peers.get().begin();
@@ -410,6 +758,8 @@ namespace tuxnet
         // Free peer.
         delete client;
         client = nullptr;
+        // A client connection owns its socket, which is done now.
+        if (m_client != nullptr) m_client->m_release(this);
     }
 
     // Try to accept an incomming connection.
@@ -432,17 +782,29 @@ namespace tuxnet
                 }
                 else
                 {
+                    /* Running out of file descriptors or memory is
+                     * recoverable, so keep serving the connections we
+                     * already have. */
+                    stat_add(stats_registry::local().accept_errors);
                     std::string errmsg = "Could not accept a connection: ";
                     errmsg += strerror(errno);
                     errmsg += " (";
                     errmsg += std::to_string(errno);
                     errmsg += ")";
-                    log::get().error(errmsg);
+                    log::get().info(errmsg);
                     return nullptr;
                 }
             }
             else
             {
+                stat_add(stats_registry::local().accepts);
+                flight_recorder::record(FLIGHT_ACCEPT, in_fd,
+                    in_addr.sin_addr.s_addr, ntohs(in_addr.sin_port));
+                if (m_heavy_hitters != nullptr)
+                {
+                    m_heavy_hitters->add(HEAVY_HITTER_CONNECTIONS,
+                        in_addr.sin_addr.s_addr);
+                }
                 if (m_enable_keepalive(in_fd) != true)
                 {
                     log::get().error("Could not enable keepalive on peer"
@@ -453,6 +815,12 @@ namespace tuxnet
                     }
                     return nullptr;
                 }           
+                if (m_apply_peer_options(in_fd) != true)
+                {
+                    shutdown(in_fd, SHUT_RDWR);
+                    ::close(in_fd);
+                    return nullptr;
+                }
                 peer* my_peer = new peer(in_fd, in_addr, this);
                 if (my_peer->initialize() != true)
                 {
@@ -473,17 +841,20 @@ namespace tuxnet
 
     void socket::on_receive(peer* client)
     {
-        m_server->on_receive(client);
+        if (m_server != nullptr) m_server->on_receive(client);
+        else if (m_client != nullptr) m_client->on_receive(client);
     }
     
     void socket::on_connect(peer* client)
     {
-        m_server->on_connect(client);
+        if (m_server != nullptr) m_server->on_connect(client);
+        else if (m_client != nullptr) m_client->on_connect(client);
     }
 
     void socket::on_disconnect(peer* client)
     {
-        m_server->on_disconnect(client);
+        if (m_server != nullptr) m_server->on_disconnect(client);
+        else if (m_client != nullptr) m_client->on_disconnect(client);
     }
 
 }
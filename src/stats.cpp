@@ -0,0 +1,466 @@
+#include <netinet/in.h>
+#include "tuxnet/config.h"
+#include "tuxnet/stats.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// Block of the calling thread, nullptr if not attached.
+        thread_local thread_stats* t_block = nullptr;
+
+        /// Block used by threads which aren't attached to a registry.
+        thread_stats unattached_block;
+
+        /// Names of disconnect_reason values.
+        const char* const disconnect_reason_names[DISCONNECT_REASON_COUNT] =
+        {
+            "local", "remote", "error", "hangup", "shutdown"
+        };
+
+        /// Names of latency_metric values.
+        const char* const latency_metric_names[LATENCY_METRIC_COUNT] =
+        {
+            "connect", "receive", "disconnect", "dispatch_delay",
+            "receive_queue"
+        };
+
+        /// Reads a counter.
+        inline uint64_t load(const std::atomic<uint64_t>& counter)
+        {
+            return counter.load(std::memory_order_relaxed);
+        }
+
+        /// Reads an int field.
+        inline int load_int(const std::atomic<int>& value)
+        {
+            return value.load(std::memory_order_relaxed);
+        }
+
+    }
+
+    // Gets the name of a disconnect reason.
+    const char* disconnect_reason_name(disconnect_reason reason)
+    {
+        if ((reason < 0) or (reason >= DISCONNECT_REASON_COUNT)) return "";
+        return disconnect_reason_names[reason];
+    }
+
+    // Gets the name of a latency metric.
+    const char* latency_metric_name(latency_metric metric)
+    {
+        if ((metric < 0) or (metric >= LATENCY_METRIC_COUNT)) return "";
+        return latency_metric_names[metric];
+    }
+
+    /*************************************************************************
+     * thread_stats                                                          *
+     *************************************************************************/
+
+    // Constructor.
+    thread_stats::thread_stats() : accepts(0), accept_errors(0), bytes_in(0),
+        bytes_out(0), eagain_spins(0), epoll_events(0), epoll_wakeups(0),
+        recv_calls(0), send_calls(0), latency(nullptr), busy_ns(0),
+        idle_ns(0), attach_busy_ns(0), attach_idle_ns(0), busy_since(0),
+        idle_since(0), callback(-1), callback_fd(-1), callback_ip(0),
+        callback_port(0), stalls(0), stall_reported(0), perf_events(0),
+        perf(nullptr), perf_start_events(0), perf_started(false)
+    {
+        for (int n = 0; n < DISCONNECT_REASON_COUNT; ++n) disconnects[n] = 0;
+        for (int n = 0; n < PERF_COUNTER_COUNT; ++n)
+        {
+            perf_counts[n] = 0;
+            perf_start[n] = 0;
+        }
+    }
+
+    // Marks the block as used by the calling thread.
+    void thread_stats::attach()
+    {
+        attach_busy_ns.store(load(busy_ns), std::memory_order_relaxed);
+        attach_idle_ns.store(load(idle_ns), std::memory_order_relaxed);
+        idle_since.store(0, std::memory_order_relaxed);
+        busy_since.store(stats_clock(), std::memory_order_relaxed);
+        if ((this == &unattached_block) or (config::get().get_perf_counters()
+            != 1))
+        {
+            return;
+        }
+        perf_group* group = new perf_group();
+        if (group->open() != true)
+        {
+            delete group;
+            return;
+        }
+        perf_started = false;
+        perf.store(group, std::memory_order_relaxed);
+    }
+
+    // Marks the start of a callback.
+    bool thread_stats::begin_callback(latency_metric metric, int fd,
+        const socket_address* saddr)
+    {
+        if ((this == &unattached_block) or (load_int(callback) != -1))
+        {
+            return false;
+        }
+        uint32_t ip = 0;
+        uint16_t port = 0;
+        if ((saddr != nullptr) and (saddr->get_protocol() == L3_PROTO_IP4))
+        {
+            const sockaddr_in in_addr = static_cast<const ip4_socket_address*>(
+                saddr)->get_sockaddr_in();
+            ip = in_addr.sin_addr.s_addr;
+            port = ntohs(in_addr.sin_port);
+        }
+        callback_fd.store(fd, std::memory_order_relaxed);
+        callback_ip.store(ip, std::memory_order_relaxed);
+        callback_port.store(port, std::memory_order_relaxed);
+        // Published last, the watchdog reads it first.
+        callback.store(metric, std::memory_order_release);
+        return true;
+    }
+
+    // Marks the end of the running callback.
+    void thread_stats::end_callback()
+    {
+        callback.store(-1, std::memory_order_release);
+    }
+
+    // Marks the block as no longer used by a thread.
+    void thread_stats::detach()
+    {
+        wait_begin();
+        idle_since.store(0, std::memory_order_relaxed);
+        perf_group* group = perf.exchange(nullptr, std::memory_order_relaxed);
+        if (group != nullptr) delete group;
+    }
+
+    // Accounts busy time right before epoll_wait().
+    void thread_stats::wait_begin()
+    {
+        uint64_t now = stats_clock();
+        uint64_t since = busy_since.load(std::memory_order_relaxed);
+        if (since != 0) stat_add(busy_ns, now - since);
+        busy_since.store(0, std::memory_order_relaxed);
+        idle_since.store(now, std::memory_order_relaxed);
+        perf_group* group = perf.load(std::memory_order_relaxed);
+        if ((group == nullptr) or (perf_started != true)) return;
+        perf_started = false;
+        uint64_t values[PERF_COUNTER_COUNT];
+        if (group->read(values) != true) return;
+        for (int n = 0; n < PERF_COUNTER_COUNT; ++n)
+        {
+            stat_add(perf_counts[n], values[n] - perf_start[n]);
+        }
+        stat_add(perf_events, load(epoll_events) - perf_start_events);
+    }
+
+    // Accounts idle time right after epoll_wait().
+    uint64_t thread_stats::wait_end()
+    {
+        uint64_t now = stats_clock();
+        uint64_t since = idle_since.load(std::memory_order_relaxed);
+        if (since != 0) stat_add(idle_ns, now - since);
+        idle_since.store(0, std::memory_order_relaxed);
+        busy_since.store(now, std::memory_order_relaxed);
+        perf_group* group = perf.load(std::memory_order_relaxed);
+        if (group != nullptr)
+        {
+            perf_started = group->read(perf_start);
+            perf_start_events = load(epoll_events);
+        }
+        return now;
+    }
+
+    // Records a latency.
+    void thread_stats::record(latency_metric metric, uint64_t nanoseconds)
+    {
+        // Unattached threads share a block, nobody reads their latencies.
+        if (this == &unattached_block) return;
+        latency_histograms* histograms = latency.load(
+            std::memory_order_relaxed);
+        if (histograms == nullptr)
+        {
+            histograms = new latency_histograms();
+            latency.store(histograms, std::memory_order_release);
+        }
+        histograms->metrics[metric].record(nanoseconds);
+    }
+
+    /*************************************************************************
+     * stats_snapshot                                                        *
+     *************************************************************************/
+
+    // Average number of events handled per epoll wakeup.
+    double stats_snapshot::events_per_wakeup() const
+    {
+        if (epoll_wakeups == 0) return 0;
+        return static_cast<double>(epoll_events) / epoll_wakeups;
+    }
+
+    // Average hardware events per handled epoll event.
+    double stats_snapshot::perf_per_event(perf_counter counter) const
+    {
+        if ((counter < 0) or (counter >= PERF_COUNTER_COUNT)) return 0;
+        if (perf_events == 0) return 0;
+        return static_cast<double>(perf[counter]) / perf_events;
+    }
+
+    // Busy time as a percentage of busy and idle time.
+    double stats_snapshot::utilization() const
+    {
+        if (busy_ns + idle_ns == 0) return 0;
+        return 100.0 * busy_ns / (busy_ns + idle_ns);
+    }
+
+    // Total number of disconnects.
+    uint64_t stats_snapshot::total_disconnects() const
+    {
+        uint64_t result = 0;
+        for (int n = 0; n < DISCONNECT_REASON_COUNT; ++n)
+        {
+            result += disconnects[n];
+        }
+        return result;
+    }
+
+    /*************************************************************************
+     * stats_registry                                                        *
+     *************************************************************************/
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    stats_registry::stats_registry() : m_start(stats_clock())
+    {
+    }
+
+    // Destructor.
+    stats_registry::~stats_registry()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto it = m_active.begin(); it != m_active.end(); ++it)
+        {
+            delete (*it)->latency.load();
+            delete (*it);
+        }
+        for (auto it = m_free.begin(); it != m_free.end(); ++it)
+        {
+            delete (*it)->latency.load();
+            delete (*it);
+        }
+        std::lock_guard<std::mutex> history_lock(m_history_lock);
+        for (auto it = m_history.begin(); it != m_history.end(); ++it)
+        {
+            delete (*it);
+        }
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Gets a counter block for a new thread.
+    thread_stats* stats_registry::acquire()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        thread_stats* block = nullptr;
+        if (m_free.empty() != true)
+        {
+            block = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            block = new thread_stats();
+        }
+        m_active.push_back(block);
+        return block;
+    }
+
+    // Gets the counter block of the calling thread.
+    thread_stats& stats_registry::local()
+    {
+        if (t_block == nullptr) return unattached_block;
+        return *t_block;
+    }
+
+    // Gets latency percentiles over a rolling window.
+    latency_summary stats_registry::latency(latency_metric metric, int window)
+    {
+        uint64_t now = stats_clock();
+        latency_sample* current = new latency_sample();
+        current->time = now;
+        merge_latency(current->metrics);
+        histogram_snapshot result = current->metrics[metric];
+        uint64_t since = m_start;
+        {
+            std::lock_guard<std::mutex> lock(m_history_lock);
+            if (window > max_latency_window) window = max_latency_window;
+            uint64_t length = uint64_t(window) * 1000000000;
+            if ((window > 0) and (now - m_start > length))
+            {
+                uint64_t start = now - length;
+                // Newest sample at least window old.
+                for (auto it = m_history.rbegin(); it != m_history.rend(); ++it)
+                {
+                    if ((*it)->time <= start)
+                    {
+                        result.subtract((*it)->metrics[metric]);
+                        since = (*it)->time;
+                        break;
+                    }
+                }
+            }
+            // Keep at most one sample per second.
+            if ((m_history.empty() == true)
+                or (now - m_history.back()->time >= 1000000000))
+            {
+                m_history.push_back(current);
+                current = nullptr;
+            }
+            // Drop samples no window can start at anymore, keeping the
+            // newest one old enough for the longest window.
+            uint64_t horizon = uint64_t(max_latency_window) * 1000000000;
+            while ((m_history.size() > 1)
+                and (m_history.back()->time - m_history[1]->time >= horizon))
+            {
+                delete m_history.front();
+                m_history.pop_front();
+            }
+        }
+        delete current;
+        latency_summary summary = {};
+        summary.count = result.count();
+        summary.p50 = result.percentile(50);
+        summary.p99 = result.percentile(99);
+        summary.p999 = result.percentile(99.9);
+        summary.max = result.max();
+        summary.seconds = static_cast<double>(now - since) / 1e9;
+        return summary;
+    }
+
+    // Merges the latency histograms of all threads.
+    void stats_registry::merge_latency(
+        histogram_snapshot (&metrics)[LATENCY_METRIC_COUNT])
+    {
+        for_each([&metrics](thread_stats& block, bool){
+            latency_histograms* histograms = block.latency.load(
+                std::memory_order_acquire);
+            if (histograms == nullptr) return;
+            for (int n = 0; n < LATENCY_METRIC_COUNT; ++n)
+            {
+                metrics[n].add(histograms->metrics[n]);
+            }
+        });
+    }
+
+    // Gets busy and idle time of every running event loop thread.
+    thread_utilizations stats_registry::utilization()
+    {
+        thread_utilizations result;
+        uint64_t now = stats_clock();
+        for_each([&result, now](thread_stats& block, bool active){
+            if (active != true) return;
+            thread_utilization entry = {};
+            entry.busy_ns = load(block.busy_ns) - load(block.attach_busy_ns);
+            entry.idle_ns = load(block.idle_ns) - load(block.attach_idle_ns);
+            // Include the period in progress.
+            uint64_t busy_since = load(block.busy_since);
+            uint64_t idle_since = load(block.idle_since);
+            if ((busy_since != 0) and (now > busy_since))
+            {
+                entry.busy_for_ns = now - busy_since;
+                entry.busy_ns += entry.busy_for_ns;
+            }
+            else if ((idle_since != 0) and (now > idle_since))
+            {
+                entry.idle_ns += now - idle_since;
+            }
+            if (entry.busy_ns + entry.idle_ns != 0)
+            {
+                entry.utilization = 100.0 * entry.busy_ns
+                    / (entry.busy_ns + entry.idle_ns);
+            }
+            result.push_back(entry);
+        });
+        return result;
+    }
+
+    // Returns a block when its thread stops.
+    void stats_registry::release(thread_stats* block)
+    {
+        if (block == nullptr) return;
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto it = m_active.begin(); it != m_active.end(); ++it)
+        {
+            if ((*it) == block)
+            {
+                m_active.erase(it);
+                break;
+            }
+        }
+        m_free.push_back(block);
+    }
+
+    // Sums the counters of all threads.
+    stats_snapshot stats_registry::snapshot()
+    {
+        stats_snapshot result = {};
+        for_each([&result](thread_stats& block, bool active){
+            result.accepts += load(block.accepts);
+            result.accept_errors += load(block.accept_errors);
+            result.bytes_in += load(block.bytes_in);
+            result.bytes_out += load(block.bytes_out);
+            for (int n = 0; n < DISCONNECT_REASON_COUNT; ++n)
+            {
+                result.disconnects[n] += load(block.disconnects[n]);
+            }
+            result.eagain_spins += load(block.eagain_spins);
+            result.epoll_events += load(block.epoll_events);
+            result.epoll_wakeups += load(block.epoll_wakeups);
+            result.recv_calls += load(block.recv_calls);
+            result.send_calls += load(block.send_calls);
+            result.busy_ns += load(block.busy_ns);
+            result.idle_ns += load(block.idle_ns);
+            result.stalls += load(block.stalls);
+            if (active == true) result.threads++;
+            for (int n = 0; n < PERF_COUNTER_COUNT; ++n)
+            {
+                result.perf[n] += load(block.perf_counts[n]);
+            }
+            result.perf_events += load(block.perf_events);
+            if ((active == true) and (block.perf.load(
+                std::memory_order_relaxed) != nullptr))
+            {
+                result.perf_threads++;
+            }
+        });
+        return result;
+    }
+
+    /*************************************************************************
+     * stats_scope                                                           *
+     *************************************************************************/
+
+    // Constructor, attaches the calling thread.
+    stats_scope::stats_scope(stats_registry* registry) :
+        m_block(nullptr), m_previous(t_block), m_registry(registry)
+    {
+        if (m_registry == nullptr) return;
+        m_block = m_registry->acquire();
+        t_block = m_block;
+        m_block->attach();
+    }
+
+    // Destructor, detaches the calling thread.
+    stats_scope::~stats_scope()
+    {
+        if (m_registry == nullptr) return;
+        m_block->detach();
+        t_block = m_previous;
+        m_registry->release(m_block);
+    }
+
+}
@@ -0,0 +1,201 @@
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include "tuxnet/config.h"
+#include "tuxnet/log.h"
+#include "tuxnet/tcp_sampler.h"
+
+namespace tuxnet
+{
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    tcp_sampler::tcp_sampler(lockable<sockets>* sockets) :
+        m_building(),
+        m_flagged_format(log::get().register_format("Peer {} (fd={}) is "
+            "retransmitting: {} segments ({}%) since the previous sample, "
+            "backoff {}, rtt {} us.")),
+        m_sockets(sockets),
+        m_stopping(false),
+        m_summary()
+    {
+    }
+
+    // Destructor.
+    tcp_sampler::~tcp_sampler()
+    {
+        stop();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Gets recently flagged peers.
+    retransmit_reports tcp_sampler::reports()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return retransmit_reports(m_reports.begin(), m_reports.end());
+    }
+
+    // Starts the sampler thread.
+    void tcp_sampler::start()
+    {
+        if (m_thread.joinable() == true) return;
+        m_stopping = false;
+        m_thread = std::thread([this](){ m_run(); });
+    }
+
+    // Stops the sampler thread.
+    void tcp_sampler::stop()
+    {
+        if (m_thread.joinable() != true) return;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    // Gets the distribution of TCP state over all peers.
+    tcp_info_summary tcp_sampler::summary()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_summary;
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Samples all peers once.
+    void tcp_sampler::m_pass()
+    {
+        m_building.peers = 0;
+        m_building.retransmitting = 0;
+        m_building.rtt_us.clear();
+        m_building.snd_cwnd.clear();
+        m_building.unacked.clear();
+        // Copying into the member keeps its capacity, so passes don't
+        // allocate once the socket list stopped growing.
+        m_sockets->lock();
+        m_listeners = m_sockets->get();
+        m_sockets->unlock();
+        m_flagged.clear();
+        for (auto it = m_listeners.begin(); it != m_listeners.end(); ++it)
+        {
+            if ((*it) == nullptr) continue;
+            lockable<peers>& socket_peers = (*it)->m_peers;
+            // Peers coming and going between batches may be skipped or
+            // sampled twice, which is fine for a statistical view.
+            for (size_t first = 0; ; first += m_batch_size)
+            {
+                socket_peers.lock();
+                peers& list = socket_peers.get();
+                size_t last = first + m_batch_size;
+                if (last > list.size()) last = list.size();
+                for (size_t n = first; n < last; ++n)
+                {
+                    if (list[n] != nullptr) m_sample(list[n], m_flagged);
+                }
+                bool done = (last >= list.size());
+                socket_peers.unlock();
+                if (done == true) break;
+                std::this_thread::yield();
+            }
+        }
+        m_building.time = stats_clock();
+        for (auto it = m_flagged.begin(); it != m_flagged.end(); ++it)
+        {
+            log::get().info(m_flagged_format, it->peer, it->fd,
+                it->retransmits, it->ratio * 100, it->info.backoff,
+                it->info.rtt_us);
+        }
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_summary = m_building;
+        for (auto it = m_flagged.begin(); it != m_flagged.end(); ++it)
+        {
+            m_reports.push_back(*it);
+            if (m_reports.size() > m_max_reports) m_reports.pop_front();
+        }
+    }
+
+    // Samples TCP_INFO until stopped.
+    void tcp_sampler::m_run()
+    {
+        // Sampling is never urgent, stay out of the event loops' way.
+        sched_param param = {};
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0)
+        {
+            setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+        }
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (m_stopping != true)
+        {
+            // Re-read every time as it's live, 0 pauses sampling.
+            int interval = config::get().get_tcp_info_interval_ms();
+            bool paused = (interval <= 0);
+            if (paused == true) interval = 1000;
+            m_wake.wait_for(lock, std::chrono::milliseconds(interval));
+            if (m_stopping == true) break;
+            if (paused == true) continue;
+            lock.unlock();
+            m_pass();
+            lock.lock();
+        }
+    }
+
+    // Samples a single peer.
+    void tcp_sampler::m_sample(peer* client, retransmit_reports& flagged)
+    {
+        if (client->get_state() != PEER_STATE_CONNECTED) return;
+        peer_tcp_info info = client->tcp_info();
+        if (info.valid != true) return;
+        m_building.peers++;
+        m_building.rtt_us.record(info.rtt_us);
+        m_building.snd_cwnd.record(info.snd_cwnd);
+        m_building.unacked.record(info.unacked);
+        // The first sample only sets the baseline.
+        if (client->m_sampled != true)
+        {
+            client->m_sampled = true;
+            client->m_sampled_bytes = info.bytes_sent;
+            client->m_sampled_retrans = info.total_retrans;
+            return;
+        }
+        uint32_t retransmits = info.total_retrans - client->m_sampled_retrans;
+        uint64_t bytes = info.bytes_sent - client->m_sampled_bytes;
+        client->m_sampled_bytes = info.bytes_sent;
+        client->m_sampled_retrans = info.total_retrans;
+        // TCP_INFO in glibc has no segments out count, estimate it from the
+        // bytes written; retransmissions are counted as segments too.
+        uint32_t mss = (info.snd_mss == 0) ? 1460 : info.snd_mss;
+        uint64_t segments = (bytes + mss - 1) / mss + retransmits;
+        double ratio = (segments == 0) ? 0 : double(retransmits) / segments;
+        bool retransmitting = (info.backoff >= m_max_backoff) or (
+            (retransmits >= m_min_retransmits)
+            and (ratio > m_max_retransmit_ratio)
+        );
+        bool was = client->m_retransmitting.exchange(retransmitting,
+            std::memory_order_relaxed);
+        if (retransmitting == true) m_building.retransmitting++;
+        if ((retransmitting != true) or (was == true)) return;
+        retransmit_report report = {};
+        report.time = stats_clock();
+        report.fd = client->m_fd;
+        ip4_socket_address* saddr =
+            dynamic_cast<ip4_socket_address*>(client->get_saddr());
+        if (saddr != nullptr)
+        {
+            report.peer = saddr->get_ip().as_string() + ":"
+                + std::to_string(ntohs(saddr->get_port()));
+        }
+        report.retransmits = retransmits;
+        report.ratio = ratio;
+        report.info = info;
+        flagged.push_back(report);
+    }
+
+}
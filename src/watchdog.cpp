@@ -0,0 +1,140 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <chrono>
+#include "tuxnet/config.h"
+#include "tuxnet/log.h"
+#include "tuxnet/watchdog.h"
+
+namespace tuxnet
+{
+
+    // Ctor(s) / dtor. --------------------------------------------------------
+
+    // Constructor.
+    watchdog::watchdog(stats_registry* stats) :
+        m_stats(stats),
+        m_stopping(false)
+    {
+    }
+
+    // Destructor.
+    watchdog::~watchdog()
+    {
+        stop();
+    }
+
+    // Methods. ---------------------------------------------------------------
+
+    // Gets recent stall reports.
+    stall_reports watchdog::reports()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return stall_reports(m_reports.begin(), m_reports.end());
+    }
+
+    // Starts the watchdog thread.
+    void watchdog::start()
+    {
+        if (m_thread.joinable() == true) return;
+        m_stopping = false;
+        m_thread = std::thread([this](){ m_run(); });
+    }
+
+    // Stops the watchdog thread.
+    void watchdog::stop()
+    {
+        if (m_thread.joinable() != true) return;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    // Private methods. -------------------------------------------------------
+
+    // Checks all event loops once.
+    void watchdog::m_check()
+    {
+        uint64_t threshold =
+            uint64_t(config::get().get_watchdog_threshold_ms()) * 1000000;
+        if (threshold == 0) return;
+        uint64_t now = stats_clock();
+        stall_reports found;
+        m_stats->for_each([&found, now, threshold](thread_stats& block,
+            bool active){
+            if (active != true) return;
+            int callback = block.callback.load(std::memory_order_acquire);
+            uint64_t since = block.busy_since.load(std::memory_order_relaxed);
+            if ((since == 0) or (now < since) or (now - since < threshold))
+            {
+                return;
+            }
+            // Report every busy period once.
+            if (block.stall_reported.load(std::memory_order_relaxed) == since)
+            {
+                return;
+            }
+            block.stall_reported.store(since, std::memory_order_relaxed);
+            stat_add(block.stalls);
+            stall_report report = {};
+            report.time = now;
+            report.busy_ns = now - since;
+            report.callback = callback;
+            report.fd = -1;
+            if (callback != -1)
+            {
+                report.fd = block.callback_fd.load(std::memory_order_relaxed);
+                in_addr ip = {};
+                ip.s_addr = block.callback_ip.load(std::memory_order_relaxed);
+                char buffer[INET_ADDRSTRLEN] = {};
+                inet_ntop(AF_INET, &ip, buffer, sizeof(buffer));
+                report.peer = std::string(buffer) + ":" + std::to_string(
+                    block.callback_port.load(std::memory_order_relaxed));
+            }
+            found.push_back(report);
+        });
+        for (auto it = found.begin(); it != found.end(); ++it)
+        {
+            std::string message = "Event loop stalled for ";
+            message += std::to_string(it->busy_ns / 1000000) + " ms";
+            if (it->callback != -1)
+            {
+                message += " in ";
+                message += latency_metric_name(
+                    static_cast<latency_metric>(it->callback));
+                message += " for peer " + it->peer;
+                message += " (fd=" + std::to_string(it->fd) + ")";
+            }
+            message += ".";
+            log::get().info(message);
+        }
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto it = found.begin(); it != found.end(); ++it)
+        {
+            m_reports.push_back(*it);
+            if (m_reports.size() > m_max_reports) m_reports.pop_front();
+        }
+    }
+
+    // Checks event loops until stopped.
+    void watchdog::m_run()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (m_stopping != true)
+        {
+            // Check a few times per threshold, re-read as it's live.
+            int interval = config::get().get_watchdog_threshold_ms() / 4;
+            if (interval <= 0) interval = 1000;
+            if (interval < 10) interval = 10;
+            if (interval > 1000) interval = 1000;
+            m_wake.wait_for(lock, std::chrono::milliseconds(interval));
+            if (m_stopping == true) break;
+            lock.unlock();
+            m_check();
+            lock.lock();
+        }
+    }
+
+}
@@ -0,0 +1,399 @@
+#include <string.h>
+#include <strings.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "tuxnet/websocket.h"
+
+namespace tuxnet
+{
+
+    namespace
+    {
+
+        /// GUID the handshake appends to the client's key.
+        const char handshake_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+        /// Characters of base64.
+        const char base64_chars[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        // Rotates a 32 bit number left.
+        uint32_t rotate_left(uint32_t value, int bits)
+        {
+            return (value << bits) | (value >> (32 - bits));
+        }
+
+        // Runs SHA-1 over a 64 byte block.
+        void sha1_block(uint32_t state[5], const uint8_t* block)
+        {
+            uint32_t w[80];
+            for (int n = 0; n < 16; ++n)
+            {
+                w[n] = (uint32_t(block[n * 4]) << 24)
+                    | (uint32_t(block[n * 4 + 1]) << 16)
+                    | (uint32_t(block[n * 4 + 2]) << 8)
+                    | uint32_t(block[n * 4 + 3]);
+            }
+            for (int n = 16; n < 80; ++n)
+            {
+                w[n] = rotate_left(w[n - 3] ^ w[n - 8] ^ w[n - 14] ^ w[n - 16],
+                    1);
+            }
+            uint32_t a = state[0];
+            uint32_t b = state[1];
+            uint32_t c = state[2];
+            uint32_t d = state[3];
+            uint32_t e = state[4];
+            for (int n = 0; n < 80; ++n)
+            {
+                uint32_t f;
+                uint32_t k;
+                if (n < 20)
+                {
+                    f = (b & c) | (~b & d);
+                    k = 0x5a827999;
+                }
+                else if (n < 40)
+                {
+                    f = b ^ c ^ d;
+                    k = 0x6ed9eba1;
+                }
+                else if (n < 60)
+                {
+                    f = (b & c) | (b & d) | (c & d);
+                    k = 0x8f1bbcdc;
+                }
+                else
+                {
+                    f = b ^ c ^ d;
+                    k = 0xca62c1d6;
+                }
+                uint32_t next = rotate_left(a, 5) + f + e + k + w[n];
+                e = d;
+                d = c;
+                c = rotate_left(b, 30);
+                b = a;
+                a = next;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+        }
+
+        // Computes the SHA-1 digest of a message.
+        void sha1(std::string_view message, uint8_t digest[20])
+        {
+            uint32_t state[5] = {
+                0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+            };
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(
+                message.data());
+            size_t left = message.size();
+            for (; left >= 64; left -= 64, data += 64)
+            {
+                sha1_block(state, data);
+            }
+            // The rest, a 1 bit, zeros and the length in bits.
+            uint8_t last[128] = {};
+            memcpy(last, data, left);
+            last[left] = 0x80;
+            size_t blocks = (left < 56) ? 1 : 2;
+            uint64_t bits = uint64_t(message.size()) * 8;
+            for (int n = 0; n < 8; ++n)
+            {
+                last[blocks * 64 - 1 - n] = uint8_t(bits >> (n * 8));
+            }
+            for (size_t n = 0; n < blocks; ++n)
+            {
+                sha1_block(state, last + n * 64);
+            }
+            for (int n = 0; n < 20; ++n)
+            {
+                digest[n] = uint8_t(state[n / 4] >> (24 - (n % 4) * 8));
+            }
+        }
+
+        // Appends data encoded as base64.
+        void base64_encode(std::string& out, const uint8_t* data,
+            size_t length)
+        {
+            for (size_t n = 0; n < length; n += 3)
+            {
+                uint32_t bits = uint32_t(data[n]) << 16;
+                if (n + 1 < length) bits |= uint32_t(data[n + 1]) << 8;
+                if (n + 2 < length) bits |= data[n + 2];
+                out.push_back(base64_chars[bits >> 18]);
+                out.push_back(base64_chars[(bits >> 12) & 0x3f]);
+                out.push_back((n + 1 < length)
+                    ? base64_chars[(bits >> 6) & 0x3f] : '=');
+                out.push_back((n + 2 < length)
+                    ? base64_chars[bits & 0x3f] : '=');
+            }
+        }
+
+        // Compares a header name, ignoring ASCII case.
+        bool name_is(const http_header& header, std::string_view name)
+        {
+            return (header.name.size() == name.size())
+                and (strncasecmp(header.name.data(), name.data(), name.size())
+                    == 0);
+        }
+
+        // Whether a comma separated list holds a token, ignoring case.
+        bool has_token(std::string_view list, std::string_view token)
+        {
+            while (list.empty() != true)
+            {
+                size_t comma = list.find(',');
+                std::string_view item = list.substr(0, comma);
+                while ((item.empty() != true) and (item.front() == ' '))
+                {
+                    item.remove_prefix(1);
+                }
+                while ((item.empty() != true) and (item.back() == ' '))
+                {
+                    item.remove_suffix(1);
+                }
+                if (
+                    (item.size() == token.size())
+                    and (strncasecmp(item.data(), token.data(), token.size())
+                        == 0)
+                )
+                {
+                    return true;
+                }
+                if (comma == std::string_view::npos) break;
+                list.remove_prefix(comma + 1);
+            }
+            return false;
+        }
+
+    }
+
+    // Decodes a frame header.
+    int websocket_read_frame_header(const char* data, size_t length,
+        websocket_frame_header& header)
+    {
+        if (length < 2) return 0;
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+        // No extensions are negotiated, so reserved bits stay clear.
+        if ((in[0] & 0x70) != 0) return -1;
+        header.fin = ((in[0] & 0x80) != 0);
+        header.opcode = in[0] & 0x0f;
+        switch (header.opcode)
+        {
+            case WEBSOCKET_CONTINUATION:
+            case WEBSOCKET_TEXT:
+            case WEBSOCKET_BINARY:
+            case WEBSOCKET_CLOSE:
+            case WEBSOCKET_PING:
+            case WEBSOCKET_PONG:
+                break;
+            default:
+                return -1;
+        }
+        header.masked = ((in[1] & 0x80) != 0);
+        uint64_t payload = in[1] & 0x7f;
+        size_t used = 2;
+        if (payload == 126)
+        {
+            if (length < 4) return 0;
+            payload = (uint64_t(in[2]) << 8) | in[3];
+            used = 4;
+        }
+        else if (payload == 127)
+        {
+            if (length < 10) return 0;
+            payload = 0;
+            for (int n = 2; n < 10; ++n) payload = (payload << 8) | in[n];
+            if ((payload >> 63) != 0) return -1;
+            used = 10;
+        }
+        // Control frames fit in a single small frame.
+        if (
+            ((header.opcode & 0x08) != 0)
+            and ((header.fin != true) or (payload > 125))
+        )
+        {
+            return -1;
+        }
+        header.length = payload;
+        if (header.masked == true)
+        {
+            if (length < used + 4) return 0;
+            memcpy(header.mask, in + used, 4);
+            used += 4;
+        }
+        else memset(header.mask, 0, 4);
+        return int(used);
+    }
+
+    // Encodes an unmasked frame header.
+    size_t websocket_write_frame_header(char* out, uint8_t opcode,
+        uint64_t length, bool fin)
+    {
+        uint8_t* pos = reinterpret_cast<uint8_t*>(out);
+        pos[0] = ((fin == true) ? 0x80 : 0x00) | (opcode & 0x0f);
+        if (length < 126)
+        {
+            pos[1] = uint8_t(length);
+            return 2;
+        }
+        if (length <= 0xffff)
+        {
+            pos[1] = 126;
+            pos[2] = uint8_t(length >> 8);
+            pos[3] = uint8_t(length);
+            return 4;
+        }
+        pos[1] = 127;
+        for (int n = 0; n < 8; ++n)
+        {
+            pos[2 + n] = uint8_t(length >> (56 - n * 8));
+        }
+        return 10;
+    }
+
+    // Unmasks a payload in place.
+    void websocket_unmask(char* data, size_t length, const uint8_t mask[4])
+    {
+        // Blocks are multiples of 4 bytes, so the key stays in step.
+        uint32_t key;
+        memcpy(&key, mask, 4);
+        size_t n = 0;
+#if defined(__SSE2__)
+        const __m128i keys = _mm_set1_epi32(int(key));
+        for (; n + 16 <= length; n += 16)
+        {
+            __m128i* block = reinterpret_cast<__m128i*>(data + n);
+            _mm_storeu_si128(block,
+                _mm_xor_si128(_mm_loadu_si128(block), keys));
+        }
+#endif
+        const uint64_t keys64 = (uint64_t(key) << 32) | key;
+        for (; n + 8 <= length; n += 8)
+        {
+            uint64_t block;
+            memcpy(&block, data + n, 8);
+            block ^= keys64;
+            memcpy(data + n, &block, 8);
+        }
+        for (; n < length; ++n) data[n] ^= mask[n & 3];
+    }
+
+    // Checks that text is valid UTF-8.
+    bool websocket_valid_utf8(const char* data, size_t length)
+    {
+        const uint8_t* pos = reinterpret_cast<const uint8_t*>(data);
+        const uint8_t* end = pos + length;
+        while (pos < end)
+        {
+#if defined(__SSE2__)
+            // Skip to the next byte with its high bit set.
+            while (end - pos >= 16)
+            {
+                int high = _mm_movemask_epi8(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(pos)));
+                if (high != 0)
+                {
+                    pos += __builtin_ctz(high);
+                    break;
+                }
+                pos += 16;
+            }
+            if (pos == end) break;
+#endif
+            uint8_t c = *pos;
+            if (c < 0x80)
+            {
+                pos++;
+                continue;
+            }
+            // Continuation bytes, with tighter bounds on the first one.
+            size_t follow;
+            uint8_t low = 0x80;
+            uint8_t high = 0xbf;
+            if ((c >= 0xc2) and (c <= 0xdf)) follow = 1;
+            else if ((c >= 0xe0) and (c <= 0xef))
+            {
+                follow = 2;
+                // Overlong, or a surrogate.
+                if (c == 0xe0) low = 0xa0;
+                else if (c == 0xed) high = 0x9f;
+            }
+            else if ((c >= 0xf0) and (c <= 0xf4))
+            {
+                follow = 3;
+                // Overlong, or past U+10FFFF.
+                if (c == 0xf0) low = 0x90;
+                else if (c == 0xf4) high = 0x8f;
+            }
+            else return false;
+            if (size_t(end - pos) <= follow) return false;
+            if ((pos[1] < low) or (pos[1] > high)) return false;
+            for (size_t n = 2; n <= follow; ++n)
+            {
+                if ((pos[n] & 0xc0) != 0x80) return false;
+            }
+            pos += follow + 1;
+        }
+        return true;
+    }
+
+    // Checks whether a request asks for a WebSocket handshake.
+    bool websocket_is_upgrade(const http_request& request)
+    {
+        if (
+            (request.version_major != 1) or (request.version_minor != 1)
+            or (request.method != "GET")
+        )
+        {
+            return false;
+        }
+        bool upgrade = false;
+        bool connection = false;
+        bool version = false;
+        bool key = false;
+        for (const http_header& header : request.headers)
+        {
+            if (name_is(header, "upgrade") == true)
+            {
+                upgrade = upgrade or has_token(header.value, "websocket");
+            }
+            else if (name_is(header, "connection") == true)
+            {
+                connection = connection or has_token(header.value, "upgrade");
+            }
+            else if (name_is(header, "sec-websocket-version") == true)
+            {
+                version = (header.value == "13");
+            }
+            else if (name_is(header, "sec-websocket-key") == true)
+            {
+                // 16 random bytes, base64 encoded.
+                key = (header.value.size() == 24);
+            }
+        }
+        return (upgrade == true) and (connection == true)
+            and (version == true) and (key == true);
+    }
+
+    // Computes the Sec-WebSocket-Accept value answering a handshake.
+    std::string websocket_accept_key(std::string_view key)
+    {
+        std::string message;
+        message.reserve(key.size() + sizeof(handshake_guid) - 1);
+        message.append(key.data(), key.size());
+        message.append(handshake_guid, sizeof(handshake_guid) - 1);
+        uint8_t digest[20];
+        sha1(message, digest);
+        std::string accept;
+        accept.reserve(28);
+        base64_encode(accept, digest, sizeof(digest));
+        return accept;
+    }
+
+}
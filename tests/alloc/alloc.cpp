@@ -0,0 +1,414 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/config.h>
+#include <tuxnet/tuxnet.h>
+#include <tuxnet/peer.h>
+
+// Counts heap allocations per request on a keep-alive connection.
+//
+// Usage: alloc [options]
+//
+//   --mode MODE       Request handler to test (raw) :
+//                       raw    : read_bytes() and write_bytes() with
+//                                preallocated buffers.
+//                       string : read_all() and write_string() with the
+//                                response built as a std::string.
+//                       http   : tuxnet::http_server parsing the request
+//                                and answering with respond().
+//   --requests N      Requests to count allocations over (10000).
+//   --warmup N        Requests to send before counting (1000).
+//   --budget N        Allowed allocations per request (0).
+//   --slack N         Allocations allowed on top of the budget over the
+//                     whole run, for one-off work such as a buffer growing
+//                     once more (16).
+//   --port PORT       Loopback port the server listens on (18083).
+//
+// The global operator new is replaced to count allocations made on threads
+// which handled a request, so background threads (TCP_INFO sampler,
+// watchdog, ...) don't skew the count; those are turned off as well. The
+// client side only uses plain system calls on fixed buffers. Exits with
+// status 2 when the budget is exceeded.
+
+namespace
+{
+
+    /// Number of counted allocations since the program started.
+    std::atomic<uint64_t> g_allocations(0);
+
+    /// Set on threads which handled a request, only those are counted.
+    thread_local bool t_counted = false;
+
+    /// Body of every response.
+    const char body[] = "<h1>Hello world!</h1>";
+
+    /// Request sent by the client.
+    const char request[] =
+        "GET / HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+
+    /// Command line options.
+    struct options
+    {
+        std::string mode = "raw";
+        long requests = 10000;
+        long warmup = 1000;
+        double budget = 0;
+        long slack = 16;
+        int port = 18083;
+    };
+
+    // Counts and performs an allocation.
+    void* allocate(size_t size)
+    {
+        if (t_counted == true)
+        {
+            g_allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        void* p = malloc((size == 0) ? 1 : size);
+        return p;
+    }
+
+    // Counts and performs an aligned allocation.
+    void* allocate(size_t size, std::align_val_t alignment)
+    {
+        if (t_counted == true)
+        {
+            g_allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        void* p = nullptr;
+        size_t align = static_cast<size_t>(alignment);
+        if (align < sizeof(void*)) align = sizeof(void*);
+        if (posix_memalign(&p, align, (size == 0) ? 1 : size) != 0)
+        {
+            return nullptr;
+        }
+        return p;
+    }
+
+    /// Server answering every request with the same response.
+    class test_server : public tuxnet::server
+    {
+        bool m_raw;
+        std::string m_response;
+
+        public:
+
+            /**
+             * Constructor.
+             * @param raw : Use the raw bytes API instead of strings.
+             * @param response : Response to send in raw mode.
+             */
+            test_server(bool raw, const std::string& response) :
+                tuxnet::server(), m_raw(raw), m_response(response)
+            {
+            }
+
+        protected:
+
+            virtual void on_receive(tuxnet::peer* remote_peer)
+            {
+                t_counted = true;
+                if (m_raw == true)
+                {
+                    static thread_local char buffer[4096];
+                    while (remote_peer->read_bytes(buffer, sizeof(buffer))
+                        > 0)
+                    {
+                    }
+                    remote_peer->write_bytes(m_response.data(),
+                        m_response.length());
+                    return;
+                }
+                // The way most handlers are written.
+                std::string client_request = remote_peer->read_all();
+                std::string response = body;
+                remote_peer->write_string("HTTP/1.1 200 OK\r\n"
+                    "Content-Length: " + std::to_string(response.length())
+                    + "\r\n\r\n" + response);
+            }
+
+    };
+
+    /// HTTP server answering every request with the same body.
+    class http_test_server : public tuxnet::http_server
+    {
+
+        protected:
+
+            virtual void on_request(tuxnet::peer* remote_peer,
+                const tuxnet::http_request& request)
+            {
+                t_counted = true;
+                respond(remote_peer, 200, body, "");
+            }
+
+    };
+
+    // Sends a request and waits for the whole response.
+    bool round_trip(int fd, char* buffer, size_t response_length)
+    {
+        size_t length = sizeof(request) - 1;
+        const char* pos = request;
+        while (length > 0)
+        {
+            ssize_t count = send(fd, pos, length, MSG_NOSIGNAL);
+            if (count == -1)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            pos += count;
+            length -= count;
+        }
+        size_t received = 0;
+        while (received < response_length)
+        {
+            ssize_t count = recv(fd, buffer + received,
+                response_length - received, 0);
+            if (count == -1)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (count == 0) return false;
+            received += count;
+        }
+        return true;
+    }
+
+    // Connects to the server, retrying until it listens.
+    int connect_to(int port)
+    {
+        sockaddr_in remote = {};
+        remote.sin_family = AF_INET;
+        remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        remote.sin_port = htons(port);
+        for (int tries = 0; tries < 100; ++tries)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd == -1) return -1;
+            if (connect(fd, reinterpret_cast<sockaddr*>(&remote),
+                sizeof(remote)) == 0)
+            {
+                int enable = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable,
+                    sizeof(enable));
+                return fd;
+            }
+            ::close(fd);
+            usleep(50000);
+        }
+        return -1;
+    }
+
+    // Prints usage.
+    void usage(const char* name)
+    {
+        std::cerr << "Usage: " << name << " [--mode raw|string|http]"
+            " [--requests N] [--warmup N] [--budget N] [--slack N]"
+            " [--port PORT]"
+            << std::endl;
+    }
+
+}
+
+// Replacements for the global allocation functions. --------------------------
+
+void* operator new(size_t size)
+{
+    void* p = allocate(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    void* p = allocate(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* p = allocate(size, alignment);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    void* p = allocate(size, alignment);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    free(p);
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        bool has_value = (n + 1 < argc);
+        if ((arg == "--mode") and has_value) opt.mode = argv[++n];
+        else if ((arg == "--requests") and has_value)
+        {
+            opt.requests = atol(argv[++n]);
+        }
+        else if ((arg == "--warmup") and has_value)
+        {
+            opt.warmup = atol(argv[++n]);
+        }
+        else if ((arg == "--budget") and has_value)
+        {
+            opt.budget = atof(argv[++n]);
+        }
+        else if ((arg == "--slack") and has_value)
+        {
+            opt.slack = atol(argv[++n]);
+        }
+        else if ((arg == "--port") and has_value) opt.port = atoi(argv[++n]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (
+        ((opt.mode != "raw") and (opt.mode != "string")
+            and (opt.mode != "http"))
+        or (opt.requests < 1) or (opt.warmup < 0) or (opt.slack < 0)
+    )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Length: "
+        + std::to_string(sizeof(body) - 1) + "\r\n\r\n" + body;
+    tuxnet::config::get().set_tcp_info_interval_ms(0);
+    tuxnet::config::get().set_watchdog_threshold_ms(0);
+    // The server runs for as long as the process does.
+    tuxnet::server* server = nullptr;
+    if (opt.mode == "http") server = new http_test_server();
+    else server = new test_server(opt.mode == "raw", response);
+    tuxnet::ip4_socket_address saddr(tuxnet::ip4_address("127.0.0.1"),
+        opt.port);
+    tuxnet::socket_addresses saddrs = { &saddr };
+    if (server->listen(saddrs, tuxnet::L4_PROTO_TCP) != true) return 1;
+    std::thread([server](){
+        while (server->poll() == true)
+        {
+        }
+    }).detach();
+    size_t response_length = response.length();
+    // http_server adds a Date header.
+    if (opt.mode == "http")
+    {
+        response_length += strlen("Date: \r\n") + tuxnet::http_date_length;
+    }
+    int fd = connect_to(opt.port);
+    if (fd == -1)
+    {
+        std::cerr << "Could not connect to the server." << std::endl;
+        return 1;
+    }
+    char buffer[4096];
+    for (long n = 0; n < opt.warmup; ++n)
+    {
+        if (round_trip(fd, buffer, response_length) != true)
+        {
+            std::cerr << "Request failed during warmup." << std::endl;
+            return 1;
+        }
+    }
+    uint64_t before = g_allocations.load();
+    for (long n = 0; n < opt.requests; ++n)
+    {
+        if (round_trip(fd, buffer, response_length) != true)
+        {
+            std::cerr << "Request failed." << std::endl;
+            return 1;
+        }
+    }
+    uint64_t allocations = g_allocations.load() - before;
+    double per_request = double(allocations) / opt.requests;
+    printf("mode %s: %llu allocations over %ld requests, %.3f per request "
+        "(budget %g)\n", opt.mode.c_str(),
+        static_cast<unsigned long long>(allocations), opt.requests,
+        per_request, opt.budget);
+    uint64_t allowed = uint64_t(opt.budget * opt.requests) + opt.slack;
+    int status = 0;
+    if (allocations > allowed)
+    {
+        printf("Allocation budget exceeded: %llu allocations, at most %llu "
+            "allowed.\n", static_cast<unsigned long long>(allocations),
+            static_cast<unsigned long long>(allowed));
+        status = 2;
+    }
+    fflush(stdout);
+    // Server threads are still running, skip static destructors.
+    _exit(status);
+}
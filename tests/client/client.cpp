@@ -0,0 +1,281 @@
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/client.h>
+
+// Checks outbound connections on loopback : established, refused, timed out
+// and cancelled by close_all() attempts.
+//
+// Usage: client
+//
+// Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Checks that failed.
+    int g_failed = 0;
+
+    /// Port of the listener which never accepts.
+    const int full_port = 18090;
+    /// Port of the listener which accepts.
+    const int open_port = 18091;
+    /// Port nothing listens on.
+    const int closed_port = 18092;
+
+    // Records a failed check.
+    void fail(const std::string& what)
+    {
+        std::cerr << what << std::endl;
+        g_failed++;
+    }
+
+    // Listens on a loopback port with a plain socket.
+    int listen_on(int port, int backlog)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        local.sin_port = htons(port);
+        if (
+            (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local))
+                == -1)
+            or (::listen(fd, backlog) == -1)
+        )
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    /// Client recording the outcome of every attempt.
+    class test_client : public tuxnet::client
+    {
+        std::condition_variable m_changed;
+        int m_connected = 0;
+        std::vector<int> m_errors;
+        std::mutex m_lock;
+
+        public:
+
+            virtual ~test_client()
+            {
+                close_all();
+            }
+
+            /**
+             * Waits for a number of attempts to end.
+             * @param count : Attempts which have to end.
+             * @param timeout_ms : Milliseconds to wait at most.
+             * @return Returns false on timeout.
+             */
+            bool wait(size_t count, int timeout_ms)
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                return m_changed.wait_for(lock,
+                    std::chrono::milliseconds(timeout_ms), [&](){
+                        return m_connected + m_errors.size() >= count;
+                    });
+            }
+
+            /// Gets the number of established connections.
+            int connected()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                return m_connected;
+            }
+
+            /// Gets the errors of failed attempts, in order.
+            std::vector<int> errors()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                return m_errors;
+            }
+
+            /// Stops connecting, see tuxnet::client::close_all().
+            void stop()
+            {
+                close_all();
+            }
+
+        protected:
+
+            virtual void on_connect(tuxnet::peer* remote_peer)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_connected++;
+                m_changed.notify_all();
+            }
+
+            virtual void on_connect_error(
+                const tuxnet::socket_address* saddr, int error,
+                void* context)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_errors.push_back(error);
+                m_changed.notify_all();
+            }
+
+    };
+
+    // Gets a loopback address.
+    tuxnet::ip4_socket_address loopback(int port)
+    {
+        return tuxnet::ip4_socket_address(tuxnet::ip4_address("127.0.0.1"),
+            port);
+    }
+
+    // Checks an accepted and a refused connection.
+    void check_connect()
+    {
+        int fd = listen_on(open_port, 16);
+        if (fd == -1)
+        {
+            fail("Could not listen on port " + std::to_string(open_port));
+            return;
+        }
+        test_client client;
+        tuxnet::ip4_socket_address open_addr = loopback(open_port);
+        tuxnet::ip4_socket_address closed_addr = loopback(closed_port);
+        if (client.connect(&open_addr, 2000) != true)
+        {
+            fail("connect() to an open port failed to start");
+        }
+        else if (
+            (client.wait(1, 3000) != true) or (client.connected() != 1)
+        )
+        {
+            fail("Connecting to an open port did not fire on_connect()");
+        }
+        if (client.connect(&closed_addr, 2000) != true)
+        {
+            fail("connect() to a closed port failed to start");
+        }
+        else if (client.wait(2, 3000) != true)
+        {
+            fail("Connecting to a closed port did not end");
+        }
+        else if (
+            (client.errors().size() != 1)
+            or (client.errors()[0] != ECONNREFUSED)
+        )
+        {
+            fail("Connecting to a closed port did not fail with "
+                "ECONNREFUSED");
+        }
+        client.stop();
+        ::close(fd);
+    }
+
+    // Checks timeouts and close_all() cancelling attempts.
+    void check_timeout()
+    {
+        // Once the accept queue is full, further SYNs are dropped.
+        int fd = listen_on(full_port, 0);
+        if (fd == -1)
+        {
+            fail("Could not listen on port " + std::to_string(full_port));
+            return;
+        }
+        std::vector<int> fillers;
+        for (int n = 0; n < 4; ++n)
+        {
+            int filler = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK
+                | SOCK_CLOEXEC, 0);
+            sockaddr_in remote = {};
+            remote.sin_family = AF_INET;
+            remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            remote.sin_port = htons(full_port);
+            connect(filler, reinterpret_cast<sockaddr*>(&remote),
+                sizeof(remote));
+            fillers.push_back(filler);
+        }
+        usleep(100000);
+        test_client client;
+        tuxnet::ip4_socket_address full_addr = loopback(full_port);
+        auto start = std::chrono::steady_clock::now();
+        if (client.connect(&full_addr, 200) != true)
+        {
+            fail("connect() with a timeout failed to start");
+        }
+        else if (client.wait(1, 3000) != true)
+        {
+            fail("Connect timeout did not fire");
+        }
+        else
+        {
+            auto elapsed = std::chrono::duration_cast<
+                std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            if (
+                (client.errors().size() != 1)
+                or (client.errors()[0] != ETIMEDOUT)
+            )
+            {
+                fail("Connect timeout did not fail with ETIMEDOUT");
+            }
+            if ((elapsed < 150) or (elapsed > 2000))
+            {
+                fail("Connect timeout fired after "
+                    + std::to_string(elapsed) + " ms instead of 200");
+            }
+        }
+        if (client.connect(&full_addr, 0) != true)
+        {
+            fail("connect() without a timeout failed to start");
+        }
+        client.stop();
+        if (
+            (client.errors().size() != 2)
+            or (client.errors()[1] != ECANCELED)
+        )
+        {
+            fail("close_all() did not cancel a pending attempt");
+        }
+        if (client.num_pending() != 0)
+        {
+            fail("Attempts still pending after close_all()");
+        }
+        // The client connects again after close_all().
+        if (client.connect(&full_addr, 100) != true)
+        {
+            fail("connect() after close_all() failed to start");
+        }
+        else if (client.wait(3, 3000) != true)
+        {
+            fail("Connecting after close_all() did not end");
+        }
+        for (auto it = fillers.begin(); it != fillers.end(); ++it)
+        {
+            ::close(*it);
+        }
+        ::close(fd);
+    }
+
+}
+
+int main()
+{
+    check_connect();
+    check_timeout();
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,261 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/connection_pool.h>
+
+// Checks connection reuse within a thread and across threads at max_total,
+// and health checks closing idle connections, against a loopback backend.
+//
+// Usage: connection_pool
+//
+// Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Checks that failed.
+    int g_failed = 0;
+
+    /// Port of the backend.
+    const int backend_port = 18093;
+
+    // Records a failed check.
+    void fail(const std::string& what)
+    {
+        std::cerr << what << std::endl;
+        g_failed++;
+    }
+
+    /// Backend accepting connections and keeping them open until stopped.
+    class backend
+    {
+        std::vector<int> m_accepted;
+        int m_fd;
+        std::mutex m_lock;
+        std::thread m_thread;
+
+        public:
+
+            backend() : m_fd(-1)
+            {
+            }
+
+            ~backend()
+            {
+                if (m_fd == -1) return;
+                shutdown(m_fd, SHUT_RDWR);
+                m_thread.join();
+                ::close(m_fd);
+                for (auto it = m_accepted.begin(); it != m_accepted.end();
+                    ++it)
+                {
+                    ::close(*it);
+                }
+            }
+
+            /**
+             * Starts listening on loopback.
+             * @param port : Port to listen on.
+             * @return Returns false if it can't listen.
+             */
+            bool start(int port)
+            {
+                m_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (m_fd == -1) return false;
+                int enable = 1;
+                setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &enable,
+                    sizeof(enable));
+                sockaddr_in local = {};
+                local.sin_family = AF_INET;
+                local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                local.sin_port = htons(port);
+                if (
+                    (bind(m_fd, reinterpret_cast<sockaddr*>(&local),
+                        sizeof(local)) == -1)
+                    or (::listen(m_fd, 16) == -1)
+                )
+                {
+                    ::close(m_fd);
+                    m_fd = -1;
+                    return false;
+                }
+                m_thread = std::thread([this](){
+                    while (true)
+                    {
+                        int fd = accept4(m_fd, nullptr, nullptr,
+                            SOCK_CLOEXEC);
+                        if (fd == -1) break;
+                        std::lock_guard<std::mutex> lock(m_lock);
+                        m_accepted.push_back(fd);
+                    }
+                });
+                return true;
+            }
+
+    };
+
+    // Gets the loopback address of the backend.
+    tuxnet::ip4_socket_address backend_address()
+    {
+        return tuxnet::ip4_socket_address(tuxnet::ip4_address("127.0.0.1"),
+            backend_port);
+    }
+
+    // Checks a thread getting its own connection back.
+    void check_same_thread()
+    {
+        tuxnet::pool_options options;
+        options.health_check_ms = 0;
+        tuxnet::connection_pool pool(options);
+        tuxnet::ip4_socket_address saddr = backend_address();
+        tuxnet::peer* first = pool.acquire(&saddr, 2000);
+        if (first == nullptr)
+        {
+            fail("Could not connect to the backend");
+            return;
+        }
+        pool.release(first);
+        tuxnet::peer* second = pool.acquire(&saddr);
+        if (second != first)
+        {
+            fail("Same thread did not get its connection back");
+        }
+        tuxnet::pool_backend_stats stats = pool.backend_stats(&saddr);
+        if ((stats.created != 1) or (stats.reused != 1))
+        {
+            fail("Same thread reuse: created " + std::to_string(
+                stats.created) + ", reused " + std::to_string(stats.reused)
+                + " instead of 1 and 1");
+        }
+        if (second != nullptr) pool.release(second);
+    }
+
+    // Checks a connection cached by a thread going to another one at
+    // max_total.
+    void check_other_thread()
+    {
+        tuxnet::pool_options options;
+        options.max_total = 1;
+        options.health_check_ms = 0;
+        tuxnet::connection_pool pool(options);
+        tuxnet::ip4_socket_address saddr = backend_address();
+        tuxnet::peer* mine = pool.acquire(&saddr, 2000);
+        if (mine == nullptr)
+        {
+            fail("Could not connect to the backend");
+            return;
+        }
+        pool.release(mine);
+        // Cached by this thread, taken back by another.
+        tuxnet::peer* theirs = nullptr;
+        std::thread([&](){
+            theirs = pool.acquire(&saddr, 1000);
+            if (theirs != nullptr) pool.release(theirs);
+        }).join();
+        if (theirs != mine)
+        {
+            fail("Other thread did not get the cached connection");
+        }
+        // Released while another thread waits for it.
+        mine = pool.acquire(&saddr, 1000);
+        if (mine == nullptr)
+        {
+            fail("Could not get the connection back");
+            return;
+        }
+        std::atomic<int64_t> waited(-1);
+        std::thread waiter([&](){
+            auto start = std::chrono::steady_clock::now();
+            tuxnet::peer* got = pool.acquire(&saddr, 3000);
+            waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            if (got != nullptr) pool.release(got);
+            else waited = -1;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        pool.release(mine);
+        waiter.join();
+        if ((waited < 0) or (waited > 1000))
+        {
+            fail("Waiting thread got the released connection after "
+                + std::to_string(waited) + " ms");
+        }
+        tuxnet::pool_backend_stats stats = pool.backend_stats(&saddr);
+        if (stats.created != 1)
+        {
+            fail("Cross thread reuse created " + std::to_string(
+                stats.created) + " connections instead of 1");
+        }
+    }
+
+    // Checks idle connections expiring.
+    void check_expiry()
+    {
+        tuxnet::pool_options options;
+        options.health_check_ms = 50;
+        options.idle_timeout_ms = 100;
+        tuxnet::connection_pool pool(options);
+        tuxnet::ip4_socket_address saddr = backend_address();
+        tuxnet::peer* conn = pool.acquire(&saddr, 2000);
+        if (conn == nullptr)
+        {
+            fail("Could not connect to the backend");
+            return;
+        }
+        pool.release(conn);
+        tuxnet::pool_backend_stats stats = {};
+        for (int n = 0; n < 40; ++n)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            stats = pool.backend_stats(&saddr);
+            if ((stats.expired > 0) and (stats.idle == 0)
+                and (stats.busy == 0))
+            {
+                break;
+            }
+        }
+        if ((stats.expired != 1) or (stats.idle != 0) or (stats.busy != 0))
+        {
+            fail("Idle connection did not expire: expired "
+                + std::to_string(stats.expired) + ", idle "
+                + std::to_string(stats.idle) + ", busy "
+                + std::to_string(stats.busy));
+        }
+        conn = pool.acquire(&saddr, 2000);
+        stats = pool.backend_stats(&saddr);
+        if ((conn == nullptr) or (stats.created != 2))
+        {
+            fail("No new connection after the idle one expired");
+        }
+        if (conn != nullptr) pool.release(conn);
+    }
+
+}
+
+int main()
+{
+    backend server;
+    if (server.start(backend_port) != true)
+    {
+        std::cerr << "Could not listen on port " << backend_port << "."
+            << std::endl;
+        return 1;
+    }
+    check_same_thread();
+    check_other_thread();
+    check_expiry();
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
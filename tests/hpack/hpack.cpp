@@ -0,0 +1,371 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <tuxnet/hpack.h>
+
+// Checks HPACK (RFC 7541) : integers, Huffman coding, the examples of
+// appendix C.3 and C.4, and the dynamic table.
+//
+// Usage: hpack
+//
+// Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Checks that failed.
+    int g_failed = 0;
+
+    /// A header list.
+    typedef std::vector<std::pair<std::string, std::string>> header_list;
+
+    // Records a failed check.
+    void fail(const std::string& what)
+    {
+        std::cerr << what << std::endl;
+        g_failed++;
+    }
+
+    // Turns hex digits (spaces ignored) into bytes.
+    std::string from_hex(const char* hex)
+    {
+        std::string out;
+        int high = -1;
+        for (const char* c = hex; *c != 0; ++c)
+        {
+            if (*c == ' ') continue;
+            int value = (*c <= '9') ? *c - '0' : *c - 'a' + 10;
+            if (high == -1) high = value;
+            else
+            {
+                out.push_back(char(high * 16 + value));
+                high = -1;
+            }
+        }
+        return out;
+    }
+
+    // Decodes a header block, returns false if it's rejected.
+    bool decode(tuxnet::hpack_decoder& decoder, const std::string& block,
+        header_list& fields)
+    {
+        std::vector<tuxnet::http_header> headers;
+        std::string storage;
+        if (
+            decoder.decode(block.data(), block.size(), headers, storage)
+            != true
+        )
+        {
+            return false;
+        }
+        fields.clear();
+        for (const tuxnet::http_header& header : headers)
+        {
+            fields.push_back({ std::string(header.name),
+                std::string(header.value) });
+        }
+        return true;
+    }
+
+    // Checks integers at and around the prefix boundaries (RFC 7541 5.1).
+    void check_integers()
+    {
+        // C.1.1 and C.1.2 as dynamic table size updates (5 bit prefix),
+        // then up to the decoder's limit and just past it.
+        const struct {
+            const char* hex;
+            bool valid;
+        } updates[] = {
+            { "2a 82", true },
+            { "3f 9a 0a 82", true },
+            { "3f e1 1f 82", true },
+            { "3f e2 1f 82", false },
+            { "3f ff ff ff ff ff ff ff ff ff ff 01", false },
+            { "3f ff", false },
+            { "82 2a", false }
+        };
+        for (auto& update : updates)
+        {
+            tuxnet::hpack_decoder decoder(4096, 0);
+            header_list fields;
+            if (decode(decoder, from_hex(update.hex), fields) != update.valid)
+            {
+                fail(std::string("integer: wrong answer for ") + update.hex);
+            }
+        }
+        // String lengths (7 bit prefix) and table indexes (6 bit prefix).
+        tuxnet::hpack_encoder encoder(65536);
+        encoder.set_limit(65536);
+        tuxnet::hpack_decoder decoder(65536, 0);
+        const size_t lengths[] = {
+            0, 1, 126, 127, 128, 254, 255, 16382, 16383, 16384, 16511,
+            16512, 40000
+        };
+        for (size_t length : lengths)
+        {
+            std::string name = "x-" + std::to_string(length);
+            // Not Huffman-coded : bytes with long codes.
+            std::string value(length, '\x7f');
+            std::string block;
+            encoder.begin(block);
+            encoder.encode(block, name, value);
+            encoder.encode(block, name, value);
+            header_list fields;
+            if (
+                (decode(decoder, block, fields) != true)
+                or (fields.size() != 2)
+                or (fields[0] != header_list::value_type(name, value))
+                or (fields[1] != fields[0])
+            )
+            {
+                fail("integer: string of " + std::to_string(length)
+                    + " bytes didn't round trip");
+            }
+        }
+        // Indexes well past 62, sent again from the dynamic table.
+        header_list sent;
+        for (int n = 0; n < 200; ++n)
+        {
+            sent.push_back({ "x-" + std::to_string(n), std::to_string(n) });
+        }
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            std::string block;
+            encoder.begin(block);
+            for (auto& field : sent)
+            {
+                encoder.encode(block, field.first, field.second);
+            }
+            header_list fields;
+            if ((decode(decoder, block, fields) != true) or (fields != sent))
+            {
+                fail("integer: indexed fields didn't round trip");
+            }
+            // Indexes take at most two bytes each.
+            if ((pass == 1) and (block.size() > sent.size() * 2))
+            {
+                fail("integer: fields weren't sent as indexes");
+            }
+        }
+    }
+
+    // Checks Huffman coding (RFC 7541 5.2 and appendix B).
+    void check_huffman()
+    {
+        std::vector<std::string> texts = { "", "a", "www.example.com",
+            "no-cache", "custom-key", "Mon, 21 Oct 2013 20:13:21 GMT" };
+        std::string all;
+        for (int c = 0; c < 256; ++c) all.push_back(char(c));
+        texts.push_back(all);
+        std::string mixed;
+        uint32_t seed = 1;
+        for (int n = 0; n < 5000; ++n)
+        {
+            seed = seed * 1103515245 + 12345;
+            mixed.push_back(char(seed >> 16));
+        }
+        texts.push_back(mixed);
+        for (const std::string& text : texts)
+        {
+            std::string coded;
+            tuxnet::hpack_huffman_encode(coded, text);
+            std::string decoded;
+            if (
+                (coded.size() != tuxnet::hpack_huffman_length(text))
+                or (tuxnet::hpack_huffman_decode(decoded, coded.data(),
+                    coded.size()) != true)
+                or (decoded != text)
+            )
+            {
+                fail("huffman: " + std::to_string(text.size())
+                    + " bytes didn't round trip");
+            }
+        }
+        // EOS, padding over 7 bits, padding of zeros.
+        const char* invalid[] = { "ff ff ff ff", "1f ff", "18" };
+        for (const char* hex : invalid)
+        {
+            std::string coded = from_hex(hex);
+            std::string decoded;
+            if (
+                tuxnet::hpack_huffman_decode(decoded, coded.data(),
+                    coded.size()) == true
+            )
+            {
+                fail(std::string("huffman: accepted ") + hex);
+            }
+        }
+    }
+
+    // Checks the request examples of RFC 7541 C.3 and C.4.
+    void check_examples()
+    {
+        const header_list requests[] = {
+            {
+                { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+                { ":authority", "www.example.com" }
+            },
+            {
+                { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+                { ":authority", "www.example.com" },
+                { "cache-control", "no-cache" }
+            },
+            {
+                { ":method", "GET" }, { ":scheme", "https" },
+                { ":path", "/index.html" },
+                { ":authority", "www.example.com" },
+                { "custom-key", "custom-value" }
+            }
+        };
+        const char* plain[] = {
+            "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+            "8286 84be 5808 6e6f 2d63 6163 6865",
+            "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d"
+                "7661 6c75 65"
+        };
+        const char* huffman[] = {
+            "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+            "8286 84be 5886 a8eb 1064 9cbf",
+            "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"
+        };
+        tuxnet::hpack_decoder plain_decoder;
+        tuxnet::hpack_decoder huffman_decoder;
+        tuxnet::hpack_encoder encoder;
+        for (int n = 0; n < 3; ++n)
+        {
+            header_list fields;
+            if (
+                (decode(plain_decoder, from_hex(plain[n]), fields) != true)
+                or (fields != requests[n])
+            )
+            {
+                fail("C.3." + std::to_string(n + 1) + ": wrong headers");
+            }
+            if (
+                (decode(huffman_decoder, from_hex(huffman[n]), fields)
+                    != true)
+                or (fields != requests[n])
+            )
+            {
+                fail("C.4." + std::to_string(n + 1) + ": wrong headers");
+            }
+            // Huffman-coding wherever it's shorter gives C.4 exactly.
+            std::string block;
+            encoder.begin(block);
+            for (auto& field : requests[n])
+            {
+                encoder.encode(block, field.first, field.second);
+            }
+            if (block != from_hex(huffman[n]))
+            {
+                fail("C.4." + std::to_string(n + 1) + ": encoded "
+                    "differently");
+            }
+        }
+    }
+
+    // Checks the dynamic table (RFC 7541 4).
+    void check_table()
+    {
+        // Sizes of C.3, each entry costing 32 bytes on top of its strings.
+        tuxnet::hpack_table table(4096);
+        table.add(":authority", "www.example.com");
+        table.add("cache-control", "no-cache");
+        table.add("custom-key", "custom-value");
+        tuxnet::http_header field;
+        if (
+            (table.get_count() != 3) or (table.get_size() != 164)
+            or (table.get(0, field) != true) or (field.name != "custom-key")
+            or (table.get(2, field) != true)
+            or (field.value != "www.example.com")
+            or (table.get(3, field) == true)
+        )
+        {
+            fail("table: wrong entries after C.3");
+        }
+        bool exact = false;
+        if (
+            (table.find("cache-control", "no-cache", exact) != 2)
+            or (exact != true)
+            or (table.find("custom-key", "other", exact) != 1)
+            or (exact == true)
+            or (table.find("missing", "", exact) != 0)
+        )
+        {
+            fail("table: find() gave the wrong entry");
+        }
+        // Eviction with C.5's 256 bytes.
+        tuxnet::hpack_table small(256);
+        small.add(":status", "302");
+        small.add("cache-control", "private");
+        small.add("date", "Mon, 21 Oct 2013 20:13:21 GMT");
+        small.add("location", "https://www.example.com");
+        if ((small.get_count() != 4) or (small.get_size() != 222))
+        {
+            fail("table: wrong size before eviction");
+        }
+        small.add(":status", "307");
+        if (
+            (small.get_count() != 4) or (small.get_size() != 222)
+            or (small.get(3, field) != true)
+            or (field.name != "cache-control")
+            or (small.find(":status", "302", exact) != 1) or (exact == true)
+        )
+        {
+            fail("table: oldest entry wasn't evicted");
+        }
+        small.set_max_size(110);
+        if (
+            (small.get_count() != 2) or (small.get_size() != 105)
+            or (small.get_max_size() != 110)
+            or (small.get(1, field) != true) or (field.name != "location")
+        )
+        {
+            fail("table: set_max_size() didn't evict the oldest");
+        }
+        small.set_max_size(0);
+        if ((small.get_count() != 0) or (small.get_size() != 0))
+        {
+            fail("table: set_max_size(0) didn't empty it");
+        }
+        small.set_max_size(256);
+        small.add("x", "y");
+        small.add("too-big", std::string(256, 'z'));
+        if (small.get_count() != 0)
+        {
+            fail("table: an entry larger than the table didn't empty it");
+        }
+        // Many more entries than fit, so the buffer is compacted.
+        for (int n = 0; n < 2000; ++n)
+        {
+            std::string value(n % 50, char('a' + n % 26));
+            small.add("n" + std::to_string(n), value);
+            if (
+                (small.get_size() > 256) or (small.get(0, field) != true)
+                or (field.name != "n" + std::to_string(n))
+                or (field.value != value)
+            )
+            {
+                fail("table: wrong newest entry after " + std::to_string(n)
+                    + " additions");
+                break;
+            }
+        }
+    }
+
+}
+
+int main()
+{
+    check_integers();
+    check_huffman();
+    check_examples();
+    check_table();
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
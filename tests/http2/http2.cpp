@@ -0,0 +1,566 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <tuxnet/http2.h>
+
+// Checks tuxnet::http2_session (RFC 7540) : SETTINGS, PING, GOAWAY,
+// CONTINUATION and flow control, feeding it frames the way a client would
+// send them and reading back the frames it queues.
+//
+// Usage: http2
+//
+// Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Checks that failed.
+    int g_failed = 0;
+
+    /// Frame queued by the session.
+    struct frame
+    {
+        tuxnet::http2_frame_header header;
+        std::string payload;
+    };
+
+    /// Session answering every request with a body of a set size.
+    class test_session : public tuxnet::http2_session
+    {
+
+        public:
+
+            /// Targets of the requests received.
+            std::vector<std::string> targets;
+            /// Bodies of the requests received.
+            std::vector<std::string> bodies;
+            /// Bytes of every response body.
+            size_t response_size;
+
+            /**
+             * Constructor.
+             * @param settings : Our settings.
+             */
+            test_session(const tuxnet::http2_settings& settings) :
+                tuxnet::http2_session(settings, 1048576), response_size(0)
+            {
+            }
+
+        protected:
+
+            virtual void on_request(uint32_t id,
+                const tuxnet::http_request& request)
+            {
+                targets.push_back(std::string(request.target));
+                bodies.push_back(std::string(request.body));
+                send_headers(id, 200, "text/plain", response_size,
+                    std::string_view(), false);
+                send_data(id, std::string(response_size, 'x'), true);
+            }
+
+    };
+
+    // Records a failed check.
+    void fail(const std::string& what)
+    {
+        std::cerr << what << std::endl;
+        g_failed++;
+    }
+
+    // Appends a 32 bit number.
+    void put_u32(std::string& out, uint32_t value)
+    {
+        out.push_back(char(value >> 24));
+        out.push_back(char(value >> 16));
+        out.push_back(char(value >> 8));
+        out.push_back(char(value));
+    }
+
+    // Builds a frame.
+    std::string make_frame(uint8_t type, uint8_t flags, uint32_t stream,
+        const std::string& payload)
+    {
+        std::string out;
+        tuxnet::http2_write_frame_header(out, payload.size(), type, flags,
+            stream);
+        return out + payload;
+    }
+
+    // Builds a SETTINGS payload with a single setting.
+    std::string setting(uint16_t id, uint32_t value)
+    {
+        std::string out;
+        out.push_back(char(id >> 8));
+        out.push_back(char(id));
+        put_u32(out, value);
+        return out;
+    }
+
+    // Builds a WINDOW_UPDATE frame.
+    std::string window_update(uint32_t stream, uint32_t increment)
+    {
+        std::string payload;
+        put_u32(payload, increment);
+        return make_frame(tuxnet::HTTP2_WINDOW_UPDATE, 0, stream, payload);
+    }
+
+    // Builds the header block of a GET request.
+    std::string request_block(tuxnet::hpack_encoder& encoder,
+        const std::string& path, const std::string& method="GET")
+    {
+        std::string block;
+        encoder.begin(block);
+        encoder.encode(block, ":method", method);
+        encoder.encode(block, ":scheme", "http");
+        encoder.encode(block, ":path", path);
+        encoder.encode(block, ":authority", "localhost");
+        encoder.encode(block, "user-agent", "tuxnet-test");
+        return block;
+    }
+
+    // Hands input to the session, returns what receive() did.
+    int feed(test_session& session, const std::string& input)
+    {
+        std::vector<char> buffer(input.begin(), input.end());
+        return session.receive(buffer.data(), buffer.size());
+    }
+
+    // Takes the frames the session queued.
+    std::vector<frame> take_output(test_session& session)
+    {
+        std::string& output = session.get_output();
+        std::vector<frame> frames;
+        size_t offset = 0;
+        while (output.size() - offset >= tuxnet::http2_frame_header_length)
+        {
+            frame f;
+            tuxnet::http2_read_frame_header(output.data() + offset, f.header);
+            offset += tuxnet::http2_frame_header_length;
+            f.payload = output.substr(offset, f.header.length);
+            offset += f.header.length;
+            frames.push_back(f);
+        }
+        output.clear();
+        return frames;
+    }
+
+    // Reads the 32 bit number at the start of a payload.
+    uint32_t read_u32(const std::string& payload, size_t offset=0)
+    {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(
+            payload.data() + offset);
+        return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16)
+            | (uint32_t(in[2]) << 8) | uint32_t(in[3]);
+    }
+
+    // Counts the DATA bytes sent on a stream, and whether it was ended.
+    size_t data_sent(const std::vector<frame>& frames, uint32_t stream,
+        bool& ended)
+    {
+        size_t total = 0;
+        ended = false;
+        for (const frame& f : frames)
+        {
+            if (
+                (f.header.type != tuxnet::HTTP2_DATA)
+                or (f.header.stream != stream)
+            )
+            {
+                continue;
+            }
+            total += f.payload.size();
+            if ((f.header.flags & tuxnet::HTTP2_FLAG_END_STREAM) != 0)
+            {
+                ended = true;
+            }
+        }
+        return total;
+    }
+
+    // Gets the error code of the GOAWAY queued, -1 if there's none.
+    long goaway_error(const std::vector<frame>& frames)
+    {
+        for (const frame& f : frames)
+        {
+            if (f.header.type == tuxnet::HTTP2_GOAWAY)
+            {
+                return read_u32(f.payload, 4);
+            }
+        }
+        return -1;
+    }
+
+    // Starts a session, through the preface and SETTINGS of both ends.
+    void start(test_session& session, const std::string& settings="")
+    {
+        std::string input(tuxnet::http2_preface);
+        input += make_frame(tuxnet::HTTP2_SETTINGS, 0, 0, settings);
+        feed(session, input);
+        take_output(session);
+    }
+
+    // Checks the SETTINGS exchange, PING and GOAWAY.
+    void check_control()
+    {
+        test_session session{ tuxnet::http2_settings() };
+        std::vector<frame> frames = take_output(session);
+        if (
+            (frames.empty() == true)
+            or (frames[0].header.type != tuxnet::HTTP2_SETTINGS)
+            or (frames[0].header.flags != 0)
+        )
+        {
+            fail("control: the server preface isn't SETTINGS");
+        }
+        std::string input(tuxnet::http2_preface);
+        input += make_frame(tuxnet::HTTP2_SETTINGS, 0, 0,
+            setting(tuxnet::HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 10));
+        input += make_frame(tuxnet::HTTP2_SETTINGS, tuxnet::HTTP2_FLAG_ACK, 0,
+            "");
+        input += make_frame(tuxnet::HTTP2_PING, 0, 0, "12345678");
+        if (feed(session, input) != int(input.size()))
+        {
+            fail("control: SETTINGS and PING weren't consumed");
+        }
+        frames = take_output(session);
+        if (
+            (frames.size() != 2)
+            or (frames[0].header.type != tuxnet::HTTP2_SETTINGS)
+            or (frames[0].header.flags != tuxnet::HTTP2_FLAG_ACK)
+            or (frames[0].header.length != 0)
+            or (frames[1].header.type != tuxnet::HTTP2_PING)
+            or (frames[1].header.flags != tuxnet::HTTP2_FLAG_ACK)
+            or (frames[1].payload != "12345678")
+        )
+        {
+            fail("control: SETTINGS or PING wasn't acknowledged");
+        }
+        // The client going away.
+        std::string goaway;
+        put_u32(goaway, 0);
+        put_u32(goaway, tuxnet::HTTP2_NO_ERROR);
+        if (
+            (feed(session, make_frame(tuxnet::HTTP2_GOAWAY, 0, 0, goaway))
+                != -1)
+            or (session.is_closing() != true)
+            or (take_output(session).empty() != true)
+        )
+        {
+            fail("control: GOAWAY from the client wasn't taken");
+        }
+        // Connection errors, each answered with GOAWAY.
+        const struct {
+            const char* name;
+            std::string frame;
+            long error;
+        } errors[] = {
+            { "SETTINGS of 5 bytes",
+                make_frame(tuxnet::HTTP2_SETTINGS, 0, 0, "12345"),
+                tuxnet::HTTP2_FRAME_SIZE_ERROR },
+            { "SETTINGS on a stream",
+                make_frame(tuxnet::HTTP2_SETTINGS, 0, 1, ""),
+                tuxnet::HTTP2_PROTOCOL_ERROR },
+            { "SETTINGS ACK with a payload",
+                make_frame(tuxnet::HTTP2_SETTINGS, tuxnet::HTTP2_FLAG_ACK, 0,
+                    setting(tuxnet::HTTP2_SETTINGS_ENABLE_PUSH, 0)),
+                tuxnet::HTTP2_FRAME_SIZE_ERROR },
+            { "ENABLE_PUSH of 2",
+                make_frame(tuxnet::HTTP2_SETTINGS, 0, 0,
+                    setting(tuxnet::HTTP2_SETTINGS_ENABLE_PUSH, 2)),
+                tuxnet::HTTP2_PROTOCOL_ERROR },
+            { "INITIAL_WINDOW_SIZE over 2^31-1",
+                make_frame(tuxnet::HTTP2_SETTINGS, 0, 0,
+                    setting(tuxnet::HTTP2_SETTINGS_INITIAL_WINDOW_SIZE,
+                        0x80000000)),
+                tuxnet::HTTP2_FLOW_CONTROL_ERROR },
+            { "MAX_FRAME_SIZE under 16384",
+                make_frame(tuxnet::HTTP2_SETTINGS, 0, 0,
+                    setting(tuxnet::HTTP2_SETTINGS_MAX_FRAME_SIZE, 100)),
+                tuxnet::HTTP2_PROTOCOL_ERROR },
+            { "PING of 4 bytes",
+                make_frame(tuxnet::HTTP2_PING, 0, 0, "1234"),
+                tuxnet::HTTP2_FRAME_SIZE_ERROR },
+            { "GOAWAY on a stream",
+                make_frame(tuxnet::HTTP2_GOAWAY, 0, 1, goaway),
+                tuxnet::HTTP2_PROTOCOL_ERROR },
+            { "connection WINDOW_UPDATE of 0",
+                window_update(0, 0), tuxnet::HTTP2_PROTOCOL_ERROR },
+            { "connection window over 2^31-1",
+                window_update(0, 0x7fffffff),
+                tuxnet::HTTP2_FLOW_CONTROL_ERROR },
+            { "frame over MAX_FRAME_SIZE",
+                make_frame(tuxnet::HTTP2_DATA, 0, 1, std::string(16385, 0)),
+                tuxnet::HTTP2_FRAME_SIZE_ERROR }
+        };
+        for (auto& error : errors)
+        {
+            test_session failing{ tuxnet::http2_settings() };
+            start(failing);
+            if (
+                (feed(failing, error.frame) != -1)
+                or (goaway_error(take_output(failing)) != error.error)
+                or (failing.is_closing() != true)
+            )
+            {
+                fail(std::string("control: wrong answer to ") + error.name);
+            }
+        }
+        // Not starting with the preface.
+        test_session rude{ tuxnet::http2_settings() };
+        take_output(rude);
+        if (
+            (feed(rude, "GET / HTTP/1.1\r\n\r\n") != -1)
+            or (goaway_error(take_output(rude))
+                != tuxnet::HTTP2_PROTOCOL_ERROR)
+        )
+        {
+            fail("control: a missing preface wasn't a PROTOCOL_ERROR");
+        }
+    }
+
+    // Checks header blocks continued in CONTINUATION frames.
+    void check_continuation()
+    {
+        tuxnet::hpack_encoder encoder;
+        test_session session{ tuxnet::http2_settings() };
+        start(session);
+        std::string block = request_block(encoder, "/continued");
+        std::string input = make_frame(tuxnet::HTTP2_HEADERS,
+            tuxnet::HTTP2_FLAG_END_STREAM, 1, block.substr(0, 3));
+        input += make_frame(tuxnet::HTTP2_CONTINUATION, 0, 1,
+            block.substr(3, 5));
+        input += make_frame(tuxnet::HTTP2_CONTINUATION,
+            tuxnet::HTTP2_FLAG_END_HEADERS, 1, block.substr(8));
+        // A frame at a time.
+        size_t offset = 0;
+        while (offset < input.size())
+        {
+            size_t size = tuxnet::http2_frame_header_length
+                + ((uint8_t(input[offset + 1]) << 8)
+                    | uint8_t(input[offset + 2]));
+            if (
+                (session.targets.empty() != true)
+                or (feed(session, input.substr(offset, size)) != int(size))
+            )
+            {
+                fail("continuation: request dispatched early, or a frame "
+                    "wasn't consumed");
+                return;
+            }
+            offset += size;
+        }
+        bool ended = false;
+        if (
+            (session.targets.size() != 1)
+            or (session.targets[0] != "/continued")
+            or (data_sent(take_output(session), 1, ended) != 0)
+            or (ended != true)
+        )
+        {
+            fail("continuation: the request wasn't dispatched once "
+                "complete");
+        }
+        // Anything but CONTINUATION of the same stream, in between.
+        block = request_block(encoder, "/interrupted");
+        const struct {
+            const char* name;
+            std::string frame;
+        } interruptions[] = {
+            { "PING", make_frame(tuxnet::HTTP2_PING, 0, 0, "12345678") },
+            { "CONTINUATION of another stream",
+                make_frame(tuxnet::HTTP2_CONTINUATION,
+                    tuxnet::HTTP2_FLAG_END_HEADERS, 5, block.substr(4)) },
+            { "HEADERS", make_frame(tuxnet::HTTP2_HEADERS,
+                tuxnet::HTTP2_FLAG_END_HEADERS, 5, block) }
+        };
+        for (auto& interruption : interruptions)
+        {
+            test_session failing{ tuxnet::http2_settings() };
+            start(failing);
+            tuxnet::hpack_encoder fresh;
+            std::string started = request_block(fresh, "/interrupted");
+            feed(failing, make_frame(tuxnet::HTTP2_HEADERS,
+                tuxnet::HTTP2_FLAG_END_STREAM, 3, started.substr(0, 4)));
+            if (
+                (feed(failing, interruption.frame) != -1)
+                or (goaway_error(take_output(failing))
+                    != tuxnet::HTTP2_PROTOCOL_ERROR)
+            )
+            {
+                fail(std::string("continuation: ") + interruption.name
+                    + " in a header block wasn't a PROTOCOL_ERROR");
+            }
+        }
+        // CONTINUATION without HEADERS.
+        test_session orphan{ tuxnet::http2_settings() };
+        start(orphan);
+        if (
+            (feed(orphan, make_frame(tuxnet::HTTP2_CONTINUATION,
+                tuxnet::HTTP2_FLAG_END_HEADERS, 1, block)) != -1)
+            or (goaway_error(take_output(orphan))
+                != tuxnet::HTTP2_PROTOCOL_ERROR)
+        )
+        {
+            fail("continuation: CONTINUATION alone wasn't a "
+                "PROTOCOL_ERROR");
+        }
+    }
+
+    // Checks the send and receive windows.
+    void check_flow_control()
+    {
+        // A stream window of 10 bytes, raised by WINDOW_UPDATE, then by
+        // SETTINGS for the streams already open.
+        tuxnet::hpack_encoder encoder;
+        test_session session{ tuxnet::http2_settings() };
+        session.response_size = 100;
+        start(session,
+            setting(tuxnet::HTTP2_SETTINGS_INITIAL_WINDOW_SIZE, 10));
+        feed(session, make_frame(tuxnet::HTTP2_HEADERS,
+            tuxnet::HTTP2_FLAG_END_STREAM | tuxnet::HTTP2_FLAG_END_HEADERS, 1,
+            request_block(encoder, "/")));
+        bool ended = false;
+        if (
+            (data_sent(take_output(session), 1, ended) != 10)
+            or (ended == true)
+        )
+        {
+            fail("flow control: the stream window wasn't respected");
+        }
+        feed(session, window_update(1, 50));
+        if (
+            (data_sent(take_output(session), 1, ended) != 50)
+            or (ended == true)
+        )
+        {
+            fail("flow control: WINDOW_UPDATE didn't let 50 bytes through");
+        }
+        feed(session, make_frame(tuxnet::HTTP2_SETTINGS, 0, 0,
+            setting(tuxnet::HTTP2_SETTINGS_INITIAL_WINDOW_SIZE, 100)));
+        if (
+            (data_sent(take_output(session), 1, ended) != 40)
+            or (ended != true) or (session.get_stream_count() != 0)
+        )
+        {
+            fail("flow control: a larger INITIAL_WINDOW_SIZE didn't apply "
+                "to the open stream");
+        }
+        // The connection window of 65535 bytes.
+        test_session big{ tuxnet::http2_settings() };
+        big.response_size = 70000;
+        start(big, setting(tuxnet::HTTP2_SETTINGS_INITIAL_WINDOW_SIZE,
+            0x7fffffff));
+        tuxnet::hpack_encoder big_encoder;
+        feed(big, make_frame(tuxnet::HTTP2_HEADERS,
+            tuxnet::HTTP2_FLAG_END_STREAM | tuxnet::HTTP2_FLAG_END_HEADERS, 1,
+            request_block(big_encoder, "/big")));
+        std::vector<frame> frames = take_output(big);
+        bool oversized = false;
+        for (const frame& f : frames)
+        {
+            if (f.header.length > 16384) oversized = true;
+        }
+        if (
+            (data_sent(frames, 1, ended) != 65535) or (ended == true)
+            or (oversized == true)
+        )
+        {
+            fail("flow control: the connection window wasn't respected");
+        }
+        feed(big, window_update(0, 10000));
+        if (
+            (data_sent(take_output(big), 1, ended) != 70000 - 65535)
+            or (ended != true)
+        )
+        {
+            fail("flow control: connection WINDOW_UPDATE didn't finish the "
+                "response");
+        }
+        // A stream window pushed past 2^31-1 resets the stream, which is
+        // still open since the connection window stalled it.
+        feed(big, make_frame(tuxnet::HTTP2_HEADERS,
+            tuxnet::HTTP2_FLAG_END_STREAM | tuxnet::HTTP2_FLAG_END_HEADERS, 3,
+            request_block(big_encoder, "/big")));
+        take_output(big);
+        feed(big, window_update(3, 65536));
+        frames = take_output(big);
+        if (
+            (frames.size() != 1)
+            or (frames[0].header.type != tuxnet::HTTP2_RST_STREAM)
+            or (read_u32(frames[0].payload)
+                != tuxnet::HTTP2_FLOW_CONTROL_ERROR)
+        )
+        {
+            fail("flow control: an overflowing stream window wasn't reset");
+        }
+        // Received data is acknowledged once half the window is used.
+        test_session upload{ tuxnet::http2_settings() };
+        start(upload);
+        tuxnet::hpack_encoder upload_encoder;
+        std::string input = make_frame(tuxnet::HTTP2_HEADERS,
+            tuxnet::HTTP2_FLAG_END_HEADERS, 1,
+            request_block(upload_encoder, "/upload", "POST"));
+        for (int n = 0; n < 3; ++n)
+        {
+            input += make_frame(tuxnet::HTTP2_DATA, 0, 1,
+                std::string(16384, 'u'));
+        }
+        input += make_frame(tuxnet::HTTP2_DATA, tuxnet::HTTP2_FLAG_END_STREAM,
+            1, "end");
+        feed(upload, input);
+        uint32_t connection_credit = 0;
+        uint32_t stream_credit = 0;
+        for (const frame& f : take_output(upload))
+        {
+            if (f.header.type != tuxnet::HTTP2_WINDOW_UPDATE) continue;
+            if (f.header.stream == 0)
+            {
+                connection_credit += read_u32(f.payload);
+            }
+            else stream_credit += read_u32(f.payload);
+        }
+        if (
+            (connection_credit != 3 * 16384) or (stream_credit != 3 * 16384)
+            or (upload.bodies.size() != 1)
+            or (upload.bodies[0].size() != 3 * 16384 + 3)
+        )
+        {
+            fail("flow control: received data wasn't acknowledged");
+        }
+        // More than the receive window in a single frame.
+        tuxnet::http2_settings large_frames;
+        large_frames.max_frame_size = 131072;
+        test_session flood{ large_frames };
+        start(flood);
+        tuxnet::hpack_encoder flood_encoder;
+        input = make_frame(tuxnet::HTTP2_HEADERS,
+            tuxnet::HTTP2_FLAG_END_HEADERS, 1,
+            request_block(flood_encoder, "/flood", "POST"));
+        input += make_frame(tuxnet::HTTP2_DATA, 0, 1,
+            std::string(70000, 'f'));
+        if (
+            (feed(flood, input) != -1)
+            or (goaway_error(take_output(flood))
+                != tuxnet::HTTP2_FLOW_CONTROL_ERROR)
+        )
+        {
+            fail("flow control: overflowing the receive window wasn't a "
+                "FLOW_CONTROL_ERROR");
+        }
+    }
+
+}
+
+int main()
+{
+    check_control();
+    check_continuation();
+    check_flow_control();
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <tuxnet/http.h>
+
+// Checks tuxnet::http_parser against a table of requests.
+//
+// Usage: http_parser
+//
+// Every request is parsed twice : received at once, and received a byte at
+// a time, which has to give the same result. Then come pipelined requests
+// and the interim 100 Continue. Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Largest head the parsers accept.
+    const size_t max_head = 256;
+
+    /// Largest body the parsers accept.
+    const size_t max_body = 64;
+
+    /// A request and how it should be parsed.
+    struct parse_case
+    {
+        /// What's tested.
+        const char* name;
+        /// Received data.
+        std::string input;
+        /// Status code it's rejected with, 0 if it's accepted.
+        int error;
+        /// Decoded body, if accepted.
+        std::string body;
+    };
+
+    /// Requests to parse.
+    const std::vector<parse_case> cases = {
+        { "simple GET",
+            "GET /index.html?page=2 HTTP/1.1\r\nHost: a\r\n\r\n", 0, "" },
+        { "line feeds alone",
+            "GET / HTTP/1.1\nHost: a\n\n", 0, "" },
+        { "empty lines before the request",
+            "\r\n\r\nGET / HTTP/1.1\r\nHost: a\r\n\r\n", 0, "" },
+        { "Content-Length body",
+            "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\nhello",
+            0, "hello" },
+        { "repeated equal Content-Length",
+            "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 2\r\n"
+            "Content-Length: 2\r\n\r\nhi", 0, "hi" },
+        { "chunked body",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n", 0, "hello world" },
+        { "chunk extensions and trailers",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: Chunked\r\n\r\n"
+            "a;name=value\r\n0123456789\r\n0\r\nChecksum: 1\r\n\r\n", 0,
+            "0123456789" },
+        { "HTTP/1.0 without Host",
+            "GET / HTTP/1.0\r\n\r\n", 0, "" },
+        { "HTTP/1.9 read as 1.1",
+            "GET / HTTP/1.9\r\nHost: a\r\n\r\n", 0, "" },
+        { "request line without target",
+            "GET HTTP/1.1\r\nHost: a\r\n\r\n", 400, "" },
+        { "malformed version",
+            "GET / HTTP/1\r\nHost: a\r\n\r\n", 400, "" },
+        { "carriage return inside a line",
+            "GET / HTTP/1.1\r\nHost: a\rb\r\n\r\n", 400, "" },
+        { "control character in a header",
+            "GET / HTTP/1.1\r\nHost: a\x01\r\n\r\n", 400, "" },
+        { "obsolete line folding",
+            "GET / HTTP/1.1\r\nHost: a\r\nX-Long: a\r\n b\r\n\r\n", 400,
+            "" },
+        { "whitespace before a colon",
+            "GET / HTTP/1.1\r\nHost : a\r\n\r\n", 400, "" },
+        { "header without colon",
+            "GET / HTTP/1.1\r\nHost: a\r\nnonsense\r\n\r\n", 400, "" },
+        { "HTTP/1.1 without Host",
+            "GET / HTTP/1.1\r\n\r\n", 400, "" },
+        { "two Host fields",
+            "GET / HTTP/1.1\r\nHost: a\r\nHost: b\r\n\r\n", 400, "" },
+        { "two Host fields in HTTP/1.0",
+            "GET / HTTP/1.0\r\nHost: a\r\nHost: b\r\n\r\n", 400, "" },
+        { "Content-Length and Transfer-Encoding",
+            "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n", 400, "" },
+        { "Transfer-Encoding and Content-Length",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n"
+            "Content-Length: 5\r\n\r\n0\r\n\r\n", 400, "" },
+        { "conflicting Content-Length",
+            "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 2\r\n"
+            "Content-Length: 3\r\n\r\nabc", 400, "" },
+        { "Content-Length with a sign",
+            "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: +2\r\n\r\nhi",
+            400, "" },
+        { "chunked not last",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked, gzip"
+            "\r\n\r\n0\r\n\r\n", 400, "" },
+        { "chunked in a later field, not last",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n"
+            "Transfer-Encoding: gzip\r\n\r\n0\r\n\r\n", 400, "" },
+        { "empty Transfer-Encoding",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: \r\n\r\n",
+            400, "" },
+        { "bad chunk size",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "zz\r\nhello\r\n0\r\n\r\n", 400, "" },
+        { "chunk without line end",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5\r\nhelloX\r\n0\r\n\r\n", 400, "" },
+        { "body over max_body",
+            "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 65\r\n\r\n",
+            413, "" },
+        { "chunks over max_body",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "20\r\n" + std::string(32, 'x') + "\r\n21\r\n", 413, "" },
+        { "huge chunk size",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "ffffffffffffffffff\r\n", 413, "" },
+        { "head over max_head",
+            "GET / HTTP/1.1\r\nHost: a\r\nX-Big: " + std::string(300, 'x')
+            + "\r\n\r\n", 431, "" },
+        { "gzip then chunked",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: gzip, chunked"
+            "\r\n\r\n0\r\n\r\n", 501, "" },
+        { "gzip and chunked in separate fields",
+            "POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: gzip\r\n"
+            "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n", 501, "" },
+        { "HTTP/2.0 request line",
+            "GET / HTTP/2.0\r\nHost: a\r\n\r\n", 505, "" },
+        { "HTTP/0.9 request line",
+            "GET / HTTP/0.9\r\n\r\n", 505, "" }
+    };
+
+    // Parses a request received in steps of a given size.
+    int parse_in_steps(const parse_case& test, size_t step,
+        std::vector<char>& buffer, tuxnet::http_request& request,
+        int& error)
+    {
+        tuxnet::http_parser parser(max_head, max_body);
+        buffer.assign(test.input.begin(), test.input.end());
+        int result = 0;
+        for (size_t length = 0; length < buffer.size();)
+        {
+            length = std::min(length + step, buffer.size());
+            result = parser.parse(buffer.data(), length, request);
+            if (result != 0) break;
+        }
+        error = parser.get_error();
+        return result;
+    }
+
+    // Checks one request, returns false if it isn't parsed as expected.
+    bool check(const parse_case& test, size_t step)
+    {
+        std::vector<char> buffer;
+        tuxnet::http_request request;
+        int error = 0;
+        int result = parse_in_steps(test, step, buffer, request, error);
+        std::string how = (step == 1) ? " (a byte at a time)" : "";
+        if (test.error != 0)
+        {
+            if ((result == -1) and (error == test.error)) return true;
+            std::cerr << test.name << how << ": expected " << test.error
+                << ", got " << result << " (" << error << ")" << std::endl;
+            return false;
+        }
+        if (result != 1)
+        {
+            std::cerr << test.name << how << ": expected a request, got "
+                << result << " (" << error << ")" << std::endl;
+            return false;
+        }
+        if (
+            (request.body != test.body)
+            or (request.length != test.input.size())
+        )
+        {
+            std::cerr << test.name << how << ": got body '" << request.body
+                << "' and length " << request.length << std::endl;
+            return false;
+        }
+        // Chunked bodies are decoded in place, right after the head.
+        size_t head = test.input.find("\r\n\r\n");
+        if (
+            (request.body.empty() != true)
+            and (request.body.data() != buffer.data() + head + 4)
+        )
+        {
+            std::cerr << test.name << how << ": body isn't in place"
+                << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Checks requests sent back to back.
+    bool check_pipelined()
+    {
+        std::string input =
+            "GET /first HTTP/1.1\r\nHost: a\r\n\r\n"
+            "POST /second HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked"
+            "\r\n\r\n3\r\nabc\r\n0\r\n\r\n"
+            "GET /third HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+        const char* targets[] = { "/first", "/second", "/third" };
+        const char* bodies[] = { "", "abc", "" };
+        tuxnet::http_parser parser(max_head, max_body);
+        tuxnet::http_request request;
+        size_t offset = 0;
+        for (int n = 0; n < 3; ++n)
+        {
+            int result = parser.parse(&input[offset], input.size() - offset,
+                request);
+            if (
+                (result != 1) or (request.target != targets[n])
+                or (request.body != bodies[n])
+                or (request.keep_alive != true)
+            )
+            {
+                std::cerr << "pipelined request " << n + 1 << ": got "
+                    << result << " (" << parser.get_error() << ")"
+                    << std::endl;
+                return false;
+            }
+            offset += request.length;
+        }
+        if (offset != input.size())
+        {
+            std::cerr << "pipelined requests: " << input.size() - offset
+                << " bytes left over" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Checks when the client waits for 100 Continue.
+    bool check_continue()
+    {
+        const struct {
+            const char* head;
+            bool expected;
+        } tests[] = {
+            { "POST / HTTP/1.1\r\nHost: a\r\nExpect: 100-continue\r\n"
+                "Content-Length: 5\r\n\r\n", true },
+            { "POST / HTTP/1.1\r\nHost: a\r\nExpect: 100-Continue\r\n"
+                "Transfer-Encoding: chunked\r\n\r\n", true },
+            { "POST / HTTP/1.0\r\nExpect: 100-continue\r\n"
+                "Content-Length: 5\r\n\r\n", false },
+            { "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\n",
+                false }
+        };
+        bool passed = true;
+        for (auto& test : tests)
+        {
+            std::string input = std::string(test.head) + "hello";
+            tuxnet::http_parser parser(max_head, max_body);
+            tuxnet::http_request request;
+            size_t head = strlen(test.head);
+            if (
+                (parser.parse(&input[0], head, request) != 0)
+                or (parser.expects_continue() != test.expected)
+            )
+            {
+                std::cerr << "100 Continue: wrong answer for\n" << test.head
+                    << std::endl;
+                passed = false;
+            }
+            // Not once the body is there.
+            if (
+                (input.find("chunked") == std::string::npos)
+                and (
+                    (parser.parse(&input[0], input.size(), request) != 1)
+                    or (parser.expects_continue() == true)
+                )
+            )
+            {
+                std::cerr << "100 Continue: still expected after the body "
+                    "of\n" << test.head << std::endl;
+                passed = false;
+            }
+        }
+        return passed;
+    }
+
+}
+
+int main()
+{
+    int failed = 0;
+    for (const parse_case& test : cases)
+    {
+        if (check(test, test.input.size()) != true) failed++;
+        if (check(test, 1) != true) failed++;
+    }
+    if (check_pipelined() != true) failed++;
+    if (check_continue() != true) failed++;
+    if (failed > 0)
+    {
+        std::cerr << failed << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All " << cases.size() * 2 + 2 << " checks passed."
+        << std::endl;
+    return 0;
+}
@@ -0,0 +1,575 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/histogram.h>
+
+// HTTP load generator for tuxnet servers.
+//
+// Usage: load [options]
+//
+//   --host ADDRESS      IPv4 address to connect to (127.0.0.1).
+//   --port PORT         Port to connect to (8080).
+//   --connections N     Number of concurrent connections (16).
+//   --threads N         Number of client threads (4).
+//   --duration SECONDS  How long to run (10).
+//   --rate N            Requests per second over all connections. 0 runs a
+//                       closed loop where every connection sends its next
+//                       request as soon as it got a response (0).
+//   --close             Open a new connection for every request instead of
+//                       keeping connections alive.
+//   --payload BYTES     Send a POST body of this size instead of a GET (0).
+//   --path PATH         Request path (/).
+//
+// With --rate, requests are sent on a fixed schedule and latency is measured
+// from the time a request was supposed to be sent, so a stalled server gets
+// charged for the requests it held up (no coordinated omission). In a closed
+// loop the schedule is driven by the server itself, so the histogram is
+// corrected afterwards the way HdrHistogram does it, using the median
+// latency as the expected interval between requests.
+
+namespace
+{
+
+    typedef std::chrono::steady_clock load_clock;
+
+    /// Command line options.
+    struct options
+    {
+        std::string host = "127.0.0.1";
+        int port = 8080;
+        int connections = 16;
+        int threads = 4;
+        double duration = 10;
+        double rate = 0;
+        bool keepalive = true;
+        int payload = 0;
+        std::string path = "/";
+    };
+
+    /// Connection states.
+    enum connection_state
+    {
+        /// Waiting for the next request to be due.
+        CONNECTION_IDLE,
+        /// Non-blocking connect() in progress.
+        CONNECTION_CONNECTING,
+        /// Request partially written.
+        CONNECTION_SENDING,
+        /// Waiting for (the rest of) the response.
+        CONNECTION_RECEIVING
+    };
+
+    /// A client connection and its request in flight.
+    struct connection
+    {
+        int fd = -1;
+        connection_state state = CONNECTION_IDLE;
+        /// When the next request is due (ns, see now()).
+        uint64_t intended = 0;
+        /// When the request in flight was actually started.
+        uint64_t started = 0;
+        /// Bytes of the request written so far.
+        size_t sent = 0;
+        /// Response bytes received so far.
+        std::string response;
+    };
+
+    /// Results of a single thread.
+    struct worker_result
+    {
+        /// Latency from the intended send time.
+        tuxnet::histogram_snapshot corrected;
+        /// Latency from the actual send time.
+        tuxnet::histogram_snapshot raw;
+        uint64_t bytes = 0;
+        uint64_t connects = 0;
+        uint64_t errors = 0;
+        uint64_t requests = 0;
+    };
+
+    // Gets a monotonic timestamp in nanoseconds.
+    uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            load_clock::now().time_since_epoch()).count();
+    }
+
+    // Builds the request sent on every connection.
+    std::string make_request(const options& opt)
+    {
+        std::string request;
+        request += (opt.payload > 0) ? "POST " : "GET ";
+        request += opt.path + " HTTP/1.1\r\n";
+        request += "Host: " + opt.host + "\r\n";
+        request += opt.keepalive ? "Connection: keep-alive\r\n"
+            : "Connection: close\r\n";
+        if (opt.payload > 0)
+        {
+            request += "Content-Type: application/octet-stream\r\n";
+            request += "Content-Length: " + std::to_string(opt.payload)
+                + "\r\n\r\n";
+            request.append(opt.payload, 'x');
+        }
+        else
+        {
+            request += "\r\n";
+        }
+        return request;
+    }
+
+    /**
+     * Checks whether a response is complete.
+     *
+     * @param response : Bytes received so far.
+     * @param closed : True if the server closed the connection.
+     * @param keepalive : Set to false if the server asked to close.
+     * @return Returns true if the whole response was received.
+     */
+    bool response_complete(const std::string& response, bool closed,
+        bool& keepalive)
+    {
+        // Tolerate bare \n line endings.
+        size_t head_end = response.find("\n\r\n");
+        size_t body_start = head_end + 3;
+        if (head_end == std::string::npos)
+        {
+            head_end = response.find("\n\n");
+            body_start = head_end + 2;
+        }
+        if (head_end == std::string::npos) return false;
+        long content_length = -1;
+        size_t pos = 0;
+        while (pos < head_end)
+        {
+            size_t eol = response.find('\n', pos);
+            if (eol == std::string::npos) eol = head_end;
+            const char* line = response.c_str() + pos;
+            if (strncasecmp(line, "Content-Length:", 15) == 0)
+            {
+                content_length = atol(line + 15);
+            }
+            else if ((strncasecmp(line, "Connection:", 11) == 0)
+                and (strcasestr(std::string(line, eol - pos).c_str(),
+                "close") != nullptr))
+            {
+                keepalive = false;
+            }
+            pos = eol + 1;
+        }
+        if (content_length < 0)
+        {
+            // Body runs until the server closes.
+            keepalive = false;
+            return closed;
+        }
+        return response.size() >= body_start + content_length;
+    }
+
+    /// Runs a share of the connections.
+    class worker
+    {
+
+        const options& m_options;
+        const std::string& m_request;
+        sockaddr_in m_address;
+        int m_epoll_fd;
+        std::vector<connection> m_connections;
+        /// Time between requests on one connection in ns, 0 when closed loop.
+        uint64_t m_interval;
+        worker_result m_result;
+
+        // Closes a connection.
+        void m_close(connection& conn)
+        {
+            if (conn.fd == -1) return;
+            epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+            ::close(conn.fd);
+            conn.fd = -1;
+        }
+
+        // Fails the request in flight.
+        void m_fail(connection& conn, uint64_t time)
+        {
+            m_result.errors++;
+            m_close(conn);
+            conn.state = CONNECTION_IDLE;
+            // Don't hammer a server that refuses connections.
+            if (m_interval == 0) conn.intended = time + 10000000;
+            else conn.intended += m_interval;
+        }
+
+        // Waits for the given events on a connection.
+        void m_watch(connection& conn, uint32_t events)
+        {
+            epoll_event event = {};
+            event.events = events;
+            event.data.ptr = &conn;
+            if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, conn.fd, &event) == -1)
+            {
+                epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, conn.fd, &event);
+            }
+        }
+
+        // Writes as much of the request as possible.
+        void m_send(connection& conn, uint64_t time)
+        {
+            while (conn.sent < m_request.size())
+            {
+                ssize_t count = ::send(conn.fd, m_request.data() + conn.sent,
+                    m_request.size() - conn.sent, MSG_NOSIGNAL);
+                if (count == -1)
+                {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN)
+                    {
+                        conn.state = CONNECTION_SENDING;
+                        m_watch(conn, EPOLLOUT);
+                        return;
+                    }
+                    m_fail(conn, time);
+                    return;
+                }
+                conn.sent += count;
+            }
+            conn.state = CONNECTION_RECEIVING;
+            m_watch(conn, EPOLLIN);
+        }
+
+        // Starts the next request on a connection.
+        void m_start(connection& conn, uint64_t time)
+        {
+            conn.started = time;
+            conn.sent = 0;
+            conn.response.clear();
+            if (conn.fd != -1)
+            {
+                m_send(conn, time);
+                return;
+            }
+            conn.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (conn.fd == -1)
+            {
+                m_fail(conn, time);
+                return;
+            }
+            int enable = 1;
+            setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &enable,
+                sizeof(enable));
+            m_result.connects++;
+            if (connect(conn.fd, reinterpret_cast<sockaddr*>(&m_address),
+                sizeof(m_address)) == 0)
+            {
+                m_send(conn, time);
+            }
+            else if (errno == EINPROGRESS)
+            {
+                conn.state = CONNECTION_CONNECTING;
+                m_watch(conn, EPOLLOUT);
+            }
+            else
+            {
+                m_fail(conn, time);
+            }
+        }
+
+        // Reads response data.
+        void m_receive(connection& conn, uint64_t time)
+        {
+            char buffer[16384];
+            bool closed = false;
+            while (true)
+            {
+                ssize_t count = recv(conn.fd, buffer, sizeof(buffer), 0);
+                if (count > 0)
+                {
+                    conn.response.append(buffer, count);
+                    m_result.bytes += count;
+                    continue;
+                }
+                if ((count == -1) and (errno == EINTR)) continue;
+                if ((count == -1) and (errno == EAGAIN)) break;
+                closed = true;
+                break;
+            }
+            bool keepalive = m_options.keepalive;
+            if (response_complete(conn.response, closed, keepalive) != true)
+            {
+                if (closed == true) m_fail(conn, time);
+                return;
+            }
+            m_result.requests++;
+            m_result.corrected.record(time - conn.intended);
+            m_result.raw.record(time - conn.started);
+            if ((keepalive != true) or (closed == true)) m_close(conn);
+            else m_watch(conn, 0);
+            conn.state = CONNECTION_IDLE;
+            conn.intended = (m_interval == 0) ? time
+                : conn.intended + m_interval;
+        }
+
+        public:
+
+            worker(const options& opt, const std::string& request,
+                int connections, int first_connection) :
+                m_options(opt), m_request(request),
+                m_epoll_fd(epoll_create1(0)), m_connections(connections),
+                m_interval(0)
+            {
+                m_address = {};
+                m_address.sin_family = AF_INET;
+                m_address.sin_port = htons(opt.port);
+                inet_pton(AF_INET, opt.host.c_str(), &m_address.sin_addr);
+                if (opt.rate > 0)
+                {
+                    m_interval = static_cast<uint64_t>(
+                        1e9 * opt.connections / opt.rate);
+                }
+                // Spread the first requests evenly over one interval.
+                uint64_t start = now();
+                for (int n = 0; n < connections; ++n)
+                {
+                    m_connections[n].intended = start + m_interval
+                        * (first_connection + n) / opt.connections;
+                }
+            }
+
+            ~worker()
+            {
+                for (auto it = m_connections.begin();
+                    it != m_connections.end(); ++it)
+                {
+                    m_close(*it);
+                }
+                ::close(m_epoll_fd);
+            }
+
+            // Gets the results.
+            const worker_result& result() const
+            {
+                return m_result;
+            }
+
+            // Runs until the deadline.
+            void run(uint64_t deadline)
+            {
+                std::vector<epoll_event> events(m_connections.size() + 1);
+                while (true)
+                {
+                    uint64_t time = now();
+                    if (time >= deadline) break;
+                    // Start due requests, find out when the next one is due.
+                    uint64_t next = deadline;
+                    for (auto it = m_connections.begin();
+                        it != m_connections.end(); ++it)
+                    {
+                        if (it->state != CONNECTION_IDLE) continue;
+                        if (it->intended <= time) m_start(*it, time);
+                        if ((it->state == CONNECTION_IDLE)
+                            and (it->intended < next))
+                        {
+                            next = it->intended;
+                        }
+                    }
+                    int timeout = 0;
+                    if (next > time)
+                    {
+                        timeout = static_cast<int>((next - time) / 1000000);
+                    }
+                    int count = epoll_wait(m_epoll_fd, events.data(),
+                        events.size(), timeout);
+                    time = now();
+                    for (int n = 0; n < count; ++n)
+                    {
+                        connection& conn = *static_cast<connection*>(
+                            events[n].data.ptr);
+                        if (conn.state == CONNECTION_CONNECTING)
+                        {
+                            int error = 0;
+                            socklen_t length = sizeof(error);
+                            getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error,
+                                &length);
+                            if (error != 0) m_fail(conn, time);
+                            else m_send(conn, time);
+                        }
+                        else if (conn.state == CONNECTION_SENDING)
+                        {
+                            m_send(conn, time);
+                        }
+                        else if (conn.state == CONNECTION_RECEIVING)
+                        {
+                            m_receive(conn, time);
+                        }
+                        else
+                        {
+                            // Server closed an idle keep-alive connection.
+                            m_close(conn);
+                        }
+                    }
+                }
+            }
+
+    };
+
+    // Corrects a closed-loop histogram for coordinated omission.
+    tuxnet::histogram_snapshot correct(const tuxnet::histogram_snapshot& raw,
+        uint64_t interval)
+    {
+        tuxnet::histogram_snapshot result;
+        result.add(raw);
+        if (interval == 0) return result;
+        // A response that took value ns held up the requests that would
+        // have been sent every interval in the meantime.
+        for (int n = 0; n < tuxnet::histogram_buckets::count; ++n)
+        {
+            uint64_t count = raw.bucket(n);
+            if (count == 0) continue;
+            uint64_t value = tuxnet::histogram_buckets::highest(n);
+            for (uint64_t missing = value - interval;
+                (missing >= interval) and (missing < value);
+                missing -= interval)
+            {
+                result.record(missing, count);
+            }
+        }
+        return result;
+    }
+
+    // Prints percentiles of a histogram.
+    void print_latency(const char* title,
+        const tuxnet::histogram_snapshot& h)
+    {
+        const double percentiles[] = { 50, 90, 99, 99.9, 99.99, 100 };
+        const char* names[] = { "p50", "p90", "p99", "p99.9", "p99.99",
+            "max" };
+        printf("%s\n", title);
+        for (int n = 0; n < 6; ++n)
+        {
+            printf("  %-7s %10.3f ms\n", names[n],
+                h.percentile(percentiles[n]) / 1e6);
+        }
+    }
+
+    // Prints usage.
+    void usage(const char* name)
+    {
+        std::cerr << "Usage: " << name << " [--host ADDRESS] [--port PORT]"
+            " [--connections N] [--threads N] [--duration SECONDS]"
+            " [--rate N] [--close] [--payload BYTES] [--path PATH]"
+            << std::endl;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for (int n = 1; n < argc; ++n)
+    {
+        std::string arg = argv[n];
+        bool has_value = (n + 1 < argc);
+        if (arg == "--close") opt.keepalive = false;
+        else if ((arg == "--host") and has_value) opt.host = argv[++n];
+        else if ((arg == "--port") and has_value) opt.port = atoi(argv[++n]);
+        else if ((arg == "--connections") and has_value)
+        {
+            opt.connections = atoi(argv[++n]);
+        }
+        else if ((arg == "--threads") and has_value)
+        {
+            opt.threads = atoi(argv[++n]);
+        }
+        else if ((arg == "--duration") and has_value)
+        {
+            opt.duration = atof(argv[++n]);
+        }
+        else if ((arg == "--rate") and has_value) opt.rate = atof(argv[++n]);
+        else if ((arg == "--payload") and has_value)
+        {
+            opt.payload = atoi(argv[++n]);
+        }
+        else if ((arg == "--path") and has_value) opt.path = argv[++n];
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    in_addr check = {};
+    if ((opt.connections < 1) or (opt.threads < 1) or (opt.duration <= 0)
+        or (opt.rate < 0) or (opt.payload < 0)
+        or (inet_pton(AF_INET, opt.host.c_str(), &check) != 1))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt.threads > opt.connections) opt.threads = opt.connections;
+    std::string request = make_request(opt);
+    // Split connections over threads.
+    std::vector<worker*> workers;
+    int first = 0;
+    for (int n = 0; n < opt.threads; ++n)
+    {
+        int count = opt.connections / opt.threads
+            + ((n < opt.connections % opt.threads) ? 1 : 0);
+        workers.push_back(new worker(opt, request, count, first));
+        first += count;
+    }
+    uint64_t start = now();
+    uint64_t deadline = start + static_cast<uint64_t>(opt.duration * 1e9);
+    std::vector<std::thread> threads;
+    for (auto it = workers.begin(); it != workers.end(); ++it)
+    {
+        worker* w = *it;
+        threads.emplace_back([w, deadline](){ w->run(deadline); });
+    }
+    worker_result total;
+    for (size_t n = 0; n < threads.size(); ++n)
+    {
+        threads[n].join();
+        const worker_result& result = workers[n]->result();
+        total.corrected.add(result.corrected);
+        total.raw.add(result.raw);
+        total.bytes += result.bytes;
+        total.connects += result.connects;
+        total.errors += result.errors;
+        total.requests += result.requests;
+        delete workers[n];
+    }
+    double elapsed = (now() - start) / 1e9;
+    tuxnet::histogram_snapshot corrected = total.corrected;
+    if (opt.rate == 0)
+    {
+        corrected = correct(total.raw, total.raw.percentile(50));
+    }
+    printf("%s loop, %d connections, %d threads, %s, %d byte payload\n",
+        (opt.rate > 0) ? "open" : "closed", opt.connections, opt.threads,
+        opt.keepalive ? "keep-alive" : "connection per request",
+        opt.payload);
+    if (opt.rate > 0) printf("target rate  %.0f req/s\n", opt.rate);
+    printf("requests     %llu in %.2f s (%.0f req/s)\n",
+        static_cast<unsigned long long>(total.requests), elapsed,
+        total.requests / elapsed);
+    printf("errors       %llu\n",
+        static_cast<unsigned long long>(total.errors));
+    printf("connects     %llu\n",
+        static_cast<unsigned long long>(total.connects));
+    printf("received     %.2f MB/s\n", total.bytes / elapsed / 1e6);
+    print_latency("latency (coordinated omission corrected)", corrected);
+    print_latency("latency (uncorrected)", total.raw);
+    return (total.requests > 0) ? 0 : 1;
+}
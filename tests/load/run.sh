@@ -0,0 +1,34 @@
+#!/bin/bash
+# Benchmarks tests/server on loopback.
+#
+# Usage: run.sh SERVER LOAD [load options...]
+#
+# Starts the server binary, waits for it to accept connections on port 8080,
+# runs the load generator against it and stops the server again. Options are
+# passed on to the load generator (see tests/load/load.cpp), extra options
+# can also be given through the LOAD_ARGS environment variable.
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 SERVER LOAD [load options...]" >&2
+    exit 1
+fi
+server="$1"
+load="$2"
+shift 2
+
+"$server" > /dev/null &
+server_pid=$!
+trap 'kill $server_pid 2> /dev/null' EXIT INT TERM
+
+# Wait up to 5 seconds for the server to listen.
+tries=0
+while ! (echo > /dev/tcp/127.0.0.1/8080) 2> /dev/null; do
+    tries=$((tries + 1))
+    if [ $tries -gt 50 ]; then
+        echo "Server didn't start listening on 127.0.0.1:8080." >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+"$load" --port 8080 $LOAD_ARGS "$@"
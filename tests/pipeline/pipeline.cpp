@@ -0,0 +1,406 @@
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/pipeline.h>
+
+// Checks pipelined requests against a loopback backend : responses matched
+// in order with an untagged codec and by id with a tagged one answering out
+// of order, and the window limiting requests in flight.
+//
+// Usage: pipeline
+//
+// Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Checks that failed.
+    int g_failed = 0;
+
+    /// Port of the backend.
+    const int backend_port = 18094;
+
+    // Records a failed check.
+    void fail(const std::string& what)
+    {
+        std::cerr << what << std::endl;
+        g_failed++;
+    }
+
+    /**
+     * Backend echoing requests in batches.
+     *
+     * Serves a single connection. Requests are held until a batch is
+     * complete and the backend was let go, then echoed in order, or in
+     * reverse order for tagged frames, which responses are matched to by
+     * id.
+     */
+    class backend
+    {
+        size_t m_batch;
+        int m_fd;
+        bool m_held;
+        std::mutex m_lock;
+        std::condition_variable m_released;
+        bool m_tagged;
+        std::thread m_thread;
+
+        // Gets the length of the first frame in data, 0 if incomplete.
+        size_t m_frame_length(const std::string& data)
+        {
+            if (m_tagged != true)
+            {
+                size_t end = data.find('\n');
+                return (end == std::string::npos) ? 0 : end + 1;
+            }
+            if (data.size() < 12) return 0;
+            size_t length = 12;
+            for (int n = 0; n < 4; ++n)
+            {
+                length += size_t(uint8_t(data[n])) << (8 * (3 - n));
+            }
+            return (data.size() < length) ? 0 : length;
+        }
+
+        // Echoes batches of frames until the connection closes.
+        void m_serve(int fd)
+        {
+            std::string received;
+            std::vector<std::string> frames;
+            char buffer[4096];
+            while (true)
+            {
+                ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+                if (count <= 0) break;
+                received.append(buffer, count);
+                size_t length;
+                while ((length = m_frame_length(received)) > 0)
+                {
+                    frames.push_back(received.substr(0, length));
+                    received.erase(0, length);
+                }
+                if (frames.size() < m_batch) continue;
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_released.wait(lock, [this](){ return m_held != true; });
+                }
+                std::string out;
+                for (size_t n = 0; n < frames.size(); ++n)
+                {
+                    out += (m_tagged == true)
+                        ? frames[frames.size() - 1 - n] : frames[n];
+                }
+                frames.clear();
+                if (send(fd, out.data(), out.size(), MSG_NOSIGNAL)
+                    != ssize_t(out.size()))
+                {
+                    break;
+                }
+            }
+            ::close(fd);
+        }
+
+        public:
+
+            /**
+             * Constructor.
+             * @param tagged : Whether frames are length prefixed and tagged,
+             *                 or lines.
+             * @param batch : Requests to hold before answering.
+             * @param held : (optional) Hold answers until release().
+             */
+            backend(bool tagged, size_t batch, bool held=false) :
+                m_batch(batch), m_fd(-1), m_held(held), m_tagged(tagged)
+            {
+            }
+
+            ~backend()
+            {
+                release();
+                if (m_fd == -1) return;
+                shutdown(m_fd, SHUT_RDWR);
+                m_thread.join();
+                ::close(m_fd);
+            }
+
+            /// Lets held answers go.
+            void release()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_held = false;
+                m_released.notify_all();
+            }
+
+            /**
+             * Starts listening on loopback.
+             * @param port : Port to listen on.
+             * @return Returns false if it can't listen.
+             */
+            bool start(int port)
+            {
+                m_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (m_fd == -1) return false;
+                int enable = 1;
+                setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &enable,
+                    sizeof(enable));
+                sockaddr_in local = {};
+                local.sin_family = AF_INET;
+                local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                local.sin_port = htons(port);
+                if (
+                    (bind(m_fd, reinterpret_cast<sockaddr*>(&local),
+                        sizeof(local)) == -1)
+                    or (::listen(m_fd, 16) == -1)
+                )
+                {
+                    ::close(m_fd);
+                    m_fd = -1;
+                    return false;
+                }
+                m_thread = std::thread([this](){
+                    int fd = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (fd != -1) m_serve(fd);
+                });
+                return true;
+            }
+
+    };
+
+    /// Client recording completions.
+    class test_client : public tuxnet::pipelined_client
+    {
+        std::condition_variable m_changed;
+        std::vector<std::string> m_completed;
+        int m_errors = 0;
+        std::mutex m_lock;
+        tuxnet::peer* m_peer = nullptr;
+
+        public:
+
+            test_client(const tuxnet::framing_codec* codec, int window) :
+                tuxnet::pipelined_client(codec, window)
+            {
+            }
+
+            virtual ~test_client()
+            {
+                close_all();
+            }
+
+            /**
+             * Waits for the connection.
+             * @return Returns the connection, or nullptr on timeout.
+             */
+            tuxnet::peer* wait_ready()
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_changed.wait_for(lock, std::chrono::seconds(3),
+                    [this](){ return m_peer != nullptr; });
+                return m_peer;
+            }
+
+            /**
+             * Waits for requests to complete.
+             * @param count : Completions to wait for.
+             * @return Returns the payloads of completed requests, in
+             *         completion order.
+             */
+            std::vector<std::string> wait(size_t count)
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_changed.wait_for(lock, std::chrono::seconds(3),
+                    [&](){ return m_completed.size() >= count; });
+                return m_completed;
+            }
+
+            /// Gets the number of requests which failed.
+            int errors()
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                return m_errors;
+            }
+
+            /**
+             * Sends a request, recording its response.
+             * @param remote_peer : Connection to send on.
+             * @param payload : Request payload.
+             * @param timeout_ms : Milliseconds to wait for room.
+             * @return Returns false if it wasn't sent.
+             */
+            bool request(tuxnet::peer* remote_peer,
+                const std::string& payload, int timeout_ms)
+            {
+                return send(remote_peer, payload.data(), payload.size(),
+                    [this, payload](const char* data, size_t length,
+                        int error){
+                        std::lock_guard<std::mutex> lock(m_lock);
+                        if (error != 0)
+                        {
+                            m_errors++;
+                        }
+                        else if (std::string(data, length) != payload)
+                        {
+                            // Matched to the wrong request.
+                            m_errors++;
+                        }
+                        m_completed.push_back(std::string(data, length));
+                        m_changed.notify_all();
+                    }, timeout_ms);
+            }
+
+        protected:
+
+            virtual void on_ready(tuxnet::peer* remote_peer)
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_peer = remote_peer;
+                m_changed.notify_all();
+            }
+
+    };
+
+    // Connects a client to the backend.
+    tuxnet::peer* connect(test_client& client)
+    {
+        tuxnet::ip4_socket_address saddr(tuxnet::ip4_address("127.0.0.1"),
+            backend_port);
+        if (client.connect(&saddr, 2000) != true) return nullptr;
+        return client.wait_ready();
+    }
+
+    // Checks untagged responses completing their requests in order.
+    void check_ordered()
+    {
+        backend server(false, 10);
+        if (server.start(backend_port) != true)
+        {
+            fail("Could not listen on port " + std::to_string(backend_port));
+            return;
+        }
+        tuxnet::line_codec codec;
+        test_client client(&codec, 16);
+        tuxnet::peer* conn = connect(client);
+        if (conn == nullptr)
+        {
+            fail("Could not connect to the line backend");
+            return;
+        }
+        for (int n = 0; n < 10; ++n)
+        {
+            if (client.request(conn, "request " + std::to_string(n), 0)
+                != true)
+            {
+                fail("Could not send line request " + std::to_string(n));
+            }
+        }
+        std::vector<std::string> completed = client.wait(10);
+        if (completed.size() != 10)
+        {
+            fail("Line requests completed: " + std::to_string(
+                completed.size()) + " instead of 10");
+        }
+        for (size_t n = 0; n < completed.size(); ++n)
+        {
+            if (completed[n] != "request " + std::to_string(n))
+            {
+                fail("Line response " + std::to_string(n)
+                    + " completed out of order");
+            }
+        }
+        if (client.errors() != 0)
+        {
+            fail("Line responses matched to the wrong requests");
+        }
+    }
+
+    // Checks tagged responses completing their requests by id, and the
+    // window.
+    void check_tagged_window()
+    {
+        backend server(true, 4, true);
+        if (server.start(backend_port) != true)
+        {
+            fail("Could not listen on port " + std::to_string(backend_port));
+            return;
+        }
+        tuxnet::length_prefixed_codec codec(true);
+        test_client client(&codec, 4);
+        tuxnet::peer* conn = connect(client);
+        if (conn == nullptr)
+        {
+            fail("Could not connect to the tagged backend");
+            return;
+        }
+        // The backend holds the first 4 requests, which fill the window.
+        for (int n = 0; n < 4; ++n)
+        {
+            if (client.request(conn, "tagged " + std::to_string(n), 0)
+                != true)
+            {
+                fail("Could not send tagged request " + std::to_string(n));
+            }
+        }
+        if (client.in_flight(conn) != 4)
+        {
+            fail("In flight: " + std::to_string(client.in_flight(conn))
+                + " instead of 4");
+        }
+        if (
+            (client.request(conn, "tagged 4", 0) == true)
+            or (errno != EAGAIN)
+        )
+        {
+            fail("Sending with a full window did not fail with EAGAIN");
+        }
+        // Waits until the backend answered the first batch.
+        server.release();
+        for (int n = 4; n < 8; ++n)
+        {
+            if (client.request(conn, "tagged " + std::to_string(n), 2000)
+                != true)
+            {
+                fail("Could not send tagged request " + std::to_string(n));
+            }
+        }
+        std::vector<std::string> completed = client.wait(8);
+        if (completed.size() != 8)
+        {
+            fail("Tagged requests completed: " + std::to_string(
+                completed.size()) + " instead of 8");
+        }
+        else if (completed[0] != "tagged 3")
+        {
+            fail("Tagged responses were not taken out of order");
+        }
+        if (client.errors() != 0)
+        {
+            fail("Tagged responses matched to the wrong requests");
+        }
+        if (client.in_flight(conn) != 0)
+        {
+            fail("Requests still in flight after all completed");
+        }
+    }
+
+}
+
+int main()
+{
+    check_ordered();
+    check_tagged_window();
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
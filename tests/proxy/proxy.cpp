@@ -0,0 +1,237 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tuxnet/proxy.h>
+
+// Checks the proxy on loopback : data echoed by a backend through the proxy
+// both ways, and a client's half-close reaching the backend while the
+// backend's answer still comes back.
+//
+// Usage: proxy
+//
+// Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Checks that failed.
+    int g_failed = 0;
+
+    /// Port of the proxy.
+    const int proxy_port = 18095;
+    /// Port of the backend.
+    const int backend_port = 18096;
+    /// Bytes sent through the proxy.
+    const size_t payload_size = 1 << 20;
+    /// Sent by the backend once the client half-closed.
+    const char trailer[] = "done";
+
+    // Records a failed check.
+    void fail(const std::string& what)
+    {
+        std::cerr << what << std::endl;
+        g_failed++;
+    }
+
+    // Listens on a loopback port.
+    int listen_on(int port)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) return -1;
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        sockaddr_in local = {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        local.sin_port = htons(port);
+        if (
+            (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local))
+                == -1)
+            or (::listen(fd, 16) == -1)
+        )
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Sends all of a buffer.
+    bool send_all(int fd, const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t count = send(fd, data, length, MSG_NOSIGNAL);
+            if (count == -1)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += count;
+            length -= count;
+        }
+        return true;
+    }
+
+    // Echoes a connection until it half-closes, then sends the trailer.
+    void echo(int listen_fd)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) return;
+        char buffer[65536];
+        while (true)
+        {
+            ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+            if (count == -1)
+            {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (count == 0)
+            {
+                send_all(fd, trailer, sizeof(trailer) - 1);
+                break;
+            }
+            if (send_all(fd, buffer, count) != true) break;
+        }
+        ::close(fd);
+    }
+
+    // Connects to the proxy, retrying until it listens.
+    int connect_to(int port)
+    {
+        sockaddr_in remote = {};
+        remote.sin_family = AF_INET;
+        remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        remote.sin_port = htons(port);
+        for (int tries = 0; tries < 100; ++tries)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd == -1) return -1;
+            if (connect(fd, reinterpret_cast<sockaddr*>(&remote),
+                sizeof(remote)) == 0)
+            {
+                return fd;
+            }
+            ::close(fd);
+            usleep(50000);
+        }
+        return -1;
+    }
+
+    // Checks echo through the proxy and half-close.
+    void check_echo(tuxnet::proxy& server)
+    {
+        int fd = connect_to(proxy_port);
+        if (fd == -1)
+        {
+            fail("Could not connect to the proxy");
+            return;
+        }
+        timeval timeout = { 5, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::string payload(payload_size, '\0');
+        for (size_t n = 0; n < payload_size; ++n)
+        {
+            payload[n] = char('a' + n % 26);
+        }
+        // Sends from another thread, the echo comes back meanwhile.
+        std::thread sender([&](){
+            if (send_all(fd, payload.data(), payload.size()) != true)
+            {
+                fail("Could not send through the proxy");
+            }
+            // Half-close : the backend answers with the trailer.
+            shutdown(fd, SHUT_WR);
+        });
+        std::string received;
+        char buffer[65536];
+        while (true)
+        {
+            ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+            if (count == -1)
+            {
+                if (errno == EINTR) continue;
+                fail("Receiving through the proxy failed or timed out");
+                break;
+            }
+            if (count == 0) break;
+            received.append(buffer, count);
+        }
+        sender.join();
+        ::close(fd);
+        if (received != payload + trailer)
+        {
+            fail("Received " + std::to_string(received.size())
+                + " bytes instead of the echo and the trailer");
+        }
+        tuxnet::proxy_stats stats = {};
+        for (int n = 0; n < 100; ++n)
+        {
+            stats = server.get_proxy_stats();
+            if (stats.active == 0) break;
+            usleep(20000);
+        }
+        if (
+            (stats.accepted != 1) or (stats.failed != 0)
+            or (stats.active != 0)
+        )
+        {
+            fail("Proxy counted " + std::to_string(stats.accepted)
+                + " accepted, " + std::to_string(stats.failed) + " failed, "
+                + std::to_string(stats.active) + " active instead of 1, 0, 0");
+        }
+        if (
+            (stats.bytes_upstream != payload_size)
+            or (stats.bytes_downstream != payload_size + sizeof(trailer) - 1)
+        )
+        {
+            fail("Proxy forwarded " + std::to_string(stats.bytes_upstream)
+                + " bytes up and " + std::to_string(stats.bytes_downstream)
+                + " down");
+        }
+    }
+
+}
+
+int main()
+{
+    int backend_fd = listen_on(backend_port);
+    if (backend_fd == -1)
+    {
+        std::cerr << "Could not listen on port " << backend_port << "."
+            << std::endl;
+        return 1;
+    }
+    std::thread backend([backend_fd](){ echo(backend_fd); });
+    // The proxy runs for as long as the process does.
+    tuxnet::proxy* server = new tuxnet::proxy(tuxnet::ip4_socket_address(
+        tuxnet::ip4_address("127.0.0.1"), backend_port), 2000);
+    tuxnet::ip4_socket_address saddr(tuxnet::ip4_address("127.0.0.1"),
+        proxy_port);
+    tuxnet::socket_addresses saddrs = { &saddr };
+    if (server->listen(saddrs, tuxnet::L4_PROTO_TCP) != true) return 1;
+    std::thread([server](){
+        while (server->poll() == true)
+        {
+        }
+    }).detach();
+    check_echo(*server);
+    backend.join();
+    ::close(backend_fd);
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed." << std::endl;
+        fflush(stderr);
+        _exit(1);
+    }
+    std::cout << "All checks passed." << std::endl;
+    // Server threads are still running, skip static destructors.
+    _exit(0);
+}
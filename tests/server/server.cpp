@@ -3,30 +3,22 @@
 #include <tuxnet/tuxnet.h>
 
 // Here's a test implementation of a server.
-class my_server : public tuxnet::server
+class my_server : public tuxnet::http_server
 {
     public:
 
         // Constructor.
-        my_server() : tuxnet::server()
+        my_server() : tuxnet::http_server()
         {
         }
 
     protected:
 
-        // Runs when a client sends data.
-        virtual void on_receive(tuxnet::peer* remote_peer)
+        // Runs for every request a client sends.
+        virtual void on_request(tuxnet::peer* remote_peer,
+            const tuxnet::http_request& request)
         {
-            std::string client_request = remote_peer->read_all();
-            std::string response = "<h1>Hello world!</h1>";
-            remote_peer->write_string("HTTP/1.1 200 OK\n");
-            remote_peer->write_string("Connection: Close\n");
-            remote_peer->write_string("Content-Encoding: text/plain\n");
-            remote_peer->write_string("Content-Length: "
-                + std::to_string(response.length()) + "\n");
-            remote_peer->write_string("\r\n");
-            remote_peer->write_string(response);
-            remote_peer->disconnect();
+            respond(remote_peer, 200, "<h1>Hello world!</h1>", "text/html");
         }
 
 };
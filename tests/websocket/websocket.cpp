@@ -0,0 +1,306 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <tuxnet/websocket.h>
+
+// Checks the WebSocket codec (RFC 6455) : frame headers, unmasking, UTF-8
+// validation and the handshake.
+//
+// Usage: websocket
+//
+// Exits with status 1 if anything fails.
+
+namespace
+{
+
+    /// Checks that failed.
+    int g_failed = 0;
+
+    /// A frame header and how it should decode.
+    struct header_case
+    {
+        /// What's tested.
+        const char* name;
+        /// Header bytes.
+        std::string data;
+        /// Expected return value of websocket_read_frame_header().
+        int result;
+        /// Expected payload length, if it decodes.
+        uint64_t length;
+    };
+
+    // Records a failed check.
+    void fail(const std::string& what)
+    {
+        std::cerr << what << std::endl;
+        g_failed++;
+    }
+
+    // Checks decoding of frame headers.
+    void check_headers()
+    {
+        const std::vector<header_case> cases = {
+            { "short text", std::string("\x81\x05", 2), 2, 5 },
+            { "125 bytes", std::string("\x82\x7d", 2), 2, 125 },
+            { "126 bytes, 16 bit length",
+                std::string("\x82\x7e\x00\x7e", 4), 4, 126 },
+            { "65535 bytes", std::string("\x82\x7e\xff\xff", 4), 4, 65535 },
+            { "65536 bytes, 64 bit length",
+                std::string("\x82\x7f\x00\x00\x00\x00\x00\x01\x00\x00", 10),
+                10, 65536 },
+            { "2^62 bytes",
+                std::string("\x82\x7f\x40\x00\x00\x00\x00\x00\x00\x00", 10),
+                10, uint64_t(1) << 62 },
+            { "masked", std::string("\x81\x85\x37\xfa\x21\x3d", 6), 6, 5 },
+            { "masked, 16 bit length",
+                std::string("\x82\xfe\x01\x00\x01\x02\x03\x04", 8), 8, 256 },
+            { "masked, 64 bit length",
+                std::string("\x82\xff\x00\x00\x00\x00\x00\x01\x00\x00"
+                    "\x01\x02\x03\x04", 14), 14, 65536 },
+            { "fragment", std::string("\x01\x03", 2), 2, 3 },
+            { "continuation", std::string("\x80\x03", 2), 2, 3 },
+            { "close of 125 bytes", std::string("\x88\x7d", 2), 2, 125 },
+            { "empty ping", std::string("\x89\x00", 2), 2, 0 },
+            { "64 bit length with the top bit set",
+                std::string("\x82\x7f\x80\x00\x00\x00\x00\x00\x00\x00", 10),
+                -1, 0 },
+            { "RSV1", std::string("\xc1\x05", 2), -1, 0 },
+            { "RSV2", std::string("\xa1\x05", 2), -1, 0 },
+            { "RSV3", std::string("\x91\x05", 2), -1, 0 },
+            { "reserved data opcode", std::string("\x83\x05", 2), -1, 0 },
+            { "reserved control opcode", std::string("\x8b\x05", 2), -1, 0 },
+            { "ping of 126 bytes", std::string("\x89\x7e\x00\x7e", 4), -1,
+                0 },
+            { "pong of 65536 bytes",
+                std::string("\x8a\x7f\x00\x00\x00\x00\x00\x01\x00\x00", 10),
+                -1, 0 },
+            { "fragmented ping", std::string("\x09\x00", 2), -1, 0 }
+        };
+        for (const header_case& test : cases)
+        {
+            tuxnet::websocket_frame_header header;
+            int result = tuxnet::websocket_read_frame_header(
+                test.data.data(), test.data.size(), header);
+            if (
+                (result != test.result)
+                or ((result > 0) and (header.length != test.length))
+            )
+            {
+                fail(std::string("header: ") + test.name + ": got "
+                    + std::to_string(result));
+                continue;
+            }
+            if (result < 0) continue;
+            // Any less and there's not enough.
+            for (size_t length = 0; length < test.data.size(); ++length)
+            {
+                if (
+                    tuxnet::websocket_read_frame_header(test.data.data(),
+                        length, header) != 0
+                )
+                {
+                    fail(std::string("header: ") + test.name
+                        + ": decoded from " + std::to_string(length)
+                        + " bytes");
+                    break;
+                }
+            }
+        }
+        // The masking key and flags of a masked frame.
+        tuxnet::websocket_frame_header header;
+        tuxnet::websocket_read_frame_header("\x01\x85\x37\xfa\x21\x3d", 6,
+            header);
+        if (
+            (header.fin == true) or (header.opcode != tuxnet::WEBSOCKET_TEXT)
+            or (header.masked != true)
+            or (memcmp(header.mask, "\x37\xfa\x21\x3d", 4) != 0)
+        )
+        {
+            fail("header: wrong flags or masking key");
+        }
+        // Written headers read back, at every length encoding.
+        const uint64_t lengths[] = {
+            0, 1, 125, 126, 127, 65535, 65536, uint64_t(1) << 40
+        };
+        for (uint64_t length : lengths)
+        {
+            char out[tuxnet::websocket_max_header_length];
+            size_t size = tuxnet::websocket_write_frame_header(out,
+                tuxnet::WEBSOCKET_BINARY, length, false);
+            size_t expected = (length < 126) ? 2 : (length < 65536) ? 4 : 10;
+            if (
+                (size != expected)
+                or (tuxnet::websocket_read_frame_header(out, size, header)
+                    != int(size))
+                or (header.length != length) or (header.fin == true)
+                or (header.masked == true)
+                or (header.opcode != tuxnet::WEBSOCKET_BINARY)
+            )
+            {
+                fail("header: a written header of length "
+                    + std::to_string(length) + " didn't read back");
+            }
+        }
+    }
+
+    // Checks unmasking against a byte at a time, at any length and
+    // alignment.
+    void check_unmask()
+    {
+        const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+        std::vector<char> buffer(200);
+        for (size_t offset = 0; offset < 4; ++offset)
+        {
+            for (size_t length = 0; length <= 150; ++length)
+            {
+                char* data = buffer.data() + offset;
+                std::string expected;
+                for (size_t n = 0; n < length; ++n)
+                {
+                    data[n] = char(n * 7 + offset);
+                    expected.push_back(char(data[n] ^ mask[n % 4]));
+                }
+                tuxnet::websocket_unmask(data, length, mask);
+                if (std::string(data, length) != expected)
+                {
+                    fail("unmask: wrong at length " + std::to_string(length)
+                        + ", offset " + std::to_string(offset));
+                }
+            }
+        }
+        // RFC 6455 5.7, a masked "Hello".
+        char hello[] = "\x7f\x9f\x4d\x51\x58";
+        tuxnet::websocket_unmask(hello, 5, mask);
+        if (memcmp(hello, "Hello", 5) != 0)
+        {
+            fail("unmask: the RFC example isn't \"Hello\"");
+        }
+    }
+
+    // Checks UTF-8 validation, with sequences on either side of the
+    // 16 byte blocks skipped as ASCII.
+    void check_utf8()
+    {
+        const struct {
+            const char* name;
+            std::string text;
+            bool valid;
+        } cases[] = {
+            { "ASCII", "Hello", true },
+            { "two bytes", "\xc3\xa9", true },
+            { "three bytes", "\xe2\x82\xac", true },
+            { "four bytes", "\xf0\x9f\x98\x80", true },
+            { "U+D7FF", "\xed\x9f\xbf", true },
+            { "U+E000", "\xee\x80\x80", true },
+            { "U+10FFFF", "\xf4\x8f\xbf\xbf", true },
+            { "U+0800", "\xe0\xa0\x80", true },
+            { "U+10000", "\xf0\x90\x80\x80", true },
+            { "NUL", std::string("\0", 1), true },
+            { "overlong slash, two bytes", "\xc0\xaf", false },
+            { "overlong U+007F", "\xc1\xbf", false },
+            { "overlong, three bytes", "\xe0\x9f\xbf", false },
+            { "overlong, four bytes", "\xf0\x8f\xbf\xbf", false },
+            { "surrogate U+D800", "\xed\xa0\x80", false },
+            { "surrogate U+DFFF", "\xed\xbf\xbf", false },
+            { "past U+10FFFF", "\xf4\x90\x80\x80", false },
+            { "five byte lead", "\xf8\x88\x80\x80\x80", false },
+            { "0xff", "\xff", false },
+            { "lone continuation", "\x80", false },
+            { "truncated two bytes", "\xc3", false },
+            { "truncated three bytes", "\xe2\x82", false },
+            { "truncated four bytes", "\xf0\x9f\x98", false },
+            { "bad second continuation", "\xe2\x82\x41", false },
+            { "bad third continuation", "\xf0\x9f\x98\xc0", false }
+        };
+        for (auto& test : cases)
+        {
+            for (size_t prefix : { 0, 1, 13, 15, 16, 17, 31, 40 })
+            {
+                for (size_t suffix : { 0, 1, 20 })
+                {
+                    std::string text = std::string(prefix, 'a') + test.text
+                        + std::string(suffix, 'z');
+                    if (
+                        tuxnet::websocket_valid_utf8(text.data(), text.size())
+                        != test.valid
+                    )
+                    {
+                        fail(std::string("utf8: ") + test.name + " after "
+                            + std::to_string(prefix) + " and before "
+                            + std::to_string(suffix) + " ASCII bytes");
+                    }
+                }
+            }
+        }
+    }
+
+    // Checks the handshake.
+    void check_handshake()
+    {
+        // RFC 6455 1.3.
+        if (
+            tuxnet::websocket_accept_key("dGhlIHNhbXBsZSBub25jZQ==")
+            != "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+        )
+        {
+            fail("handshake: wrong accept key for the RFC example");
+        }
+        std::vector<tuxnet::http_header> headers = {
+            { "Host", "server.example.com" },
+            { "Upgrade", "websocket" },
+            { "Connection", "keep-alive, Upgrade" },
+            { "Sec-WebSocket-Key", "dGhlIHNhbXBsZSBub25jZQ==" },
+            { "Sec-WebSocket-Version", "13" }
+        };
+        tuxnet::http_request request;
+        request.method = "GET";
+        request.target = "/chat";
+        request.version_major = 1;
+        request.version_minor = 1;
+        request.headers = headers;
+        if (tuxnet::websocket_is_upgrade(request) != true)
+        {
+            fail("handshake: the RFC request isn't an upgrade");
+        }
+        // Each field missing or wrong in turn.
+        for (size_t n = 1; n < headers.size(); ++n)
+        {
+            request.headers = headers;
+            request.headers[n].value = "x";
+            if (tuxnet::websocket_is_upgrade(request) == true)
+            {
+                fail("handshake: upgrade with a bad "
+                    + std::string(headers[n].name));
+            }
+        }
+        request.headers = headers;
+        request.method = "POST";
+        if (tuxnet::websocket_is_upgrade(request) == true)
+        {
+            fail("handshake: upgrade with POST");
+        }
+        request.method = "GET";
+        request.version_minor = 0;
+        if (tuxnet::websocket_is_upgrade(request) == true)
+        {
+            fail("handshake: upgrade over HTTP/1.0");
+        }
+    }
+
+}
+
+int main()
+{
+    check_headers();
+    check_unmask();
+    check_utf8();
+    check_handshake();
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
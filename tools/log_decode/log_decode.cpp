@@ -0,0 +1,110 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+#include <time.h>
+#include <unordered_map>
+#include <tuxnet/log_sink.h>
+
+// Decodes files written by tuxnet::binary_log_sink back into text.
+//
+// Usage: log_decode <file> [file...]
+//
+// Rotated files should be passed oldest first (path.3 path.2 path.1 path).
+
+namespace
+{
+
+    // Level names indexed by tuxnet::log_level.
+    const char* const level_names[] = { "DEBUG", "INFO", "ERROR" };
+
+    // Formats a nanosecond timestamp as UTC date/time.
+    std::string format_timestamp(uint64_t timestamp)
+    {
+        time_t seconds = timestamp / 1000000000ULL;
+        tm t = {};
+        gmtime_r(&seconds, &t);
+        char buffer[64];
+        size_t len = strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &t);
+        snprintf(buffer + len, sizeof(buffer) - len, ".%09llu",
+            static_cast<unsigned long long>(timestamp % 1000000000ULL));
+        return buffer;
+    }
+
+    // Decodes a single file, returns false if it isn't a binary log.
+    bool decode_file(const char* path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            std::cerr << path << ": could not open file." << std::endl;
+            return false;
+        }
+        std::string data((std::istreambuf_iterator<char>(in)),
+            std::istreambuf_iterator<char>());
+        if ((data.size() < 8)
+            or (data.compare(0, 8, TUXNET_BINARY_LOG_MAGIC) != 0))
+        {
+            std::cerr << path << ": not a tuxnet binary log." << std::endl;
+            return false;
+        }
+        std::unordered_map<uint32_t, std::string> formats;
+        size_t pos = 8;
+        while (pos + sizeof(tuxnet::binary_log_record) <= data.size())
+        {
+            tuxnet::binary_log_record header;
+            memcpy(&header, data.data() + pos, sizeof(header));
+            if ((header.type == tuxnet::BINARY_LOG_RECORD_END)
+                or (header.size < sizeof(header))
+                or (pos + header.size > data.size()))
+            {
+                break;
+            }
+            const char* payload = data.data() + pos + sizeof(header);
+            size_t payload_size = header.size - sizeof(header);
+            if (header.type == tuxnet::BINARY_LOG_RECORD_FORMAT)
+            {
+                formats[header.format_id].assign(payload, payload_size);
+            }
+            else if (header.type == tuxnet::BINARY_LOG_RECORD_EVENT)
+            {
+                const char* level = "?";
+                if (header.level <= tuxnet::LOG_LEVEL_ERROR)
+                {
+                    level = level_names[header.level];
+                }
+                auto format = formats.find(header.format_id);
+                std::cout << format_timestamp(header.timestamp) << " "
+                    << level << " ";
+                if (format == formats.end())
+                {
+                    std::cout << "<unknown format " << header.format_id
+                        << ">" << std::endl;
+                }
+                else
+                {
+                    std::cout << tuxnet::format_log_args(format->second,
+                        payload, payload_size) << std::endl;
+                }
+            }
+            pos += header.size;
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <file> [file...]" << std::endl;
+        return 1;
+    }
+    int result = 0;
+    for (int n = 1; n < argc; ++n)
+    {
+        if (decode_file(argv[n]) != true) result = 1;
+    }
+    return result;
+}